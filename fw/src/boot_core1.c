@@ -0,0 +1,80 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#include "pch.h"
+#include "boot_core1.h"
+
+#include "diag/boot_profile.h"
+#include "fatal.h"
+
+// Posted to the intercore FIFO by core1 when the work is done.
+#define DONE_TOKEN 0x444F4E45     // "DONE"
+
+static struct {
+    const char* name;
+    void (*work)(void* context);
+    void* context;
+    bool busy;
+    bool released;                  // Core1 belongs to video
+
+    // Written by core1, read by core0 after the FIFO handshake.
+    volatile uint64_t start_us;
+    volatile uint64_t end_us;
+} core1;
+
+static void core1_main(void) {
+    core1.start_us = time_us_64();
+    core1.work(core1.context);
+    core1.end_us = time_us_64();
+
+    multicore_fifo_push_blocking(DONE_TOKEN);
+
+    while (true) {
+        __wfe();
+    }
+    __builtin_unreachable();
+}
+
+void boot_core1_start(const char* name, void (*work)(void* context), void* context) {
+    vet(!core1.busy && !core1.released, "core1: cannot start '%s'", name);
+
+    core1.name = name;
+    core1.work = work;
+    core1.context = context;
+    core1.busy = true;
+
+    if (BOOT_CORE1) {
+        multicore_launch_core1(core1_main);
+    } else {
+        // Inline: the work finishes here and boot_core1_join() only records it.
+        core1.start_us = time_us_64();
+        work(context);
+        core1.end_us = time_us_64();
+    }
+}
+
+void boot_core1_join(void) {
+    if (!core1.busy) {
+        return;
+    }
+
+    if (BOOT_CORE1) {
+        const uint32_t token = multicore_fifo_pop_blocking();
+        vet(token == DONE_TOKEN, "core1: unexpected FIFO token 0x%08lx", (unsigned long) token);
+
+        // Return core1 to the state multicore_launch_core1() expects.
+        multicore_reset_core1();
+    }
+
+    core1.busy = false;
+    boot_phase_add(core1.name, BOOT_CORE1 ? "core1" : NULL, core1.start_us, core1.end_us);
+}
+
+bool boot_core1_busy(void) {
+    return core1.busy;
+}
+
+void boot_core1_release(void) {
+    vet(!core1.busy, "core1: '%s' must be joined before video starts", core1.name);
+    core1.released = true;
+}
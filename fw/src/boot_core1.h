@@ -0,0 +1,43 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#pragma once
+
+#include <stdbool.h>
+
+// Boot work on core1. Core1 is idle until video_init() hands it to the DVI
+// loop, so one piece of boot work that is independent of core0's (such as
+// bringing up the SD card while core0 sends the FPGA its bitstream) can run
+// there in the meantime.
+//
+// The work must not log, print, or register interrupt handlers (which would
+// stay on core1), and must only touch state that core0 leaves alone until
+// boot_core1_join(). That rules out the heap, errno, stdio, and the VFS, all
+// of which core0 uses while it boots. Core0 joins before anything that
+// depends on the work, and video_init() checks that core1 has been joined
+// before launching the DVI loop on it.
+
+// Configuration: run the work on core1 (1) or inline on core0 (0). Inline by
+// default: the only work is SD card bring-up, and pico-vfs' SD block device
+// init() has not been checked for interrupt handlers or DMA channels that it
+// would bind to core1 (and that would stop being serviced once core1 runs the
+// DVI loop).
+#ifndef BOOT_CORE1
+#define BOOT_CORE1 0
+#endif
+
+// Start 'work' on core1. 'name' (a static string) names it in the boot
+// profile (see boot_profile.h). Fatal if work is already running or core1 has
+// been handed to video.
+void boot_core1_start(const char* name, void (*work)(void* context), void* context);
+
+// Wait for the work started by boot_core1_start() (if any) to finish, then
+// reset core1 so that video_init() can launch it again.
+void boot_core1_join(void);
+
+// True between boot_core1_start() and boot_core1_join().
+bool boot_core1_busy(void);
+
+// Called by video_init() before launching core1. Fatal if core1 has not been
+// joined.
+void boot_core1_release(void);
@@ -73,6 +73,16 @@ bool bp_remove(uint16_t addr) {
     return true;
 }
 
+void bp_rearm() {
+    for (int i = 0; i < bp_entry_count; i++) {
+        bp_entry_t* const entry = &bp_table[i];
+        if (entry->active) {
+            entry->original = spi_read_at(entry->addr);
+            spi_write_at(entry->addr, STP_OPCODE);
+        }
+    }
+}
+
 void bp_task() {
     if (!system_state.bp_halted) {
         return;
@@ -49,6 +49,10 @@ void bp_set(uint16_t addr, bp_callback_t callback, void* context);
 // breakpoint exists at 'addr'.
 bool bp_remove(uint16_t addr);
 
+// Write STP again at each active breakpoint after SRAM was replaced (e.g., by
+// restoring a snapshot), taking the byte now at its address as the original.
+void bp_rearm();
+
 // Check for breakpoint hits and handle them. Call this periodically from the
 // main loop.
 void bp_task();
@@ -9,7 +9,7 @@
 // Fold a PETSCII byte for case-insensitive comparison: shifted letters
 // ($C1-$DA) map onto the unshifted range ($41-$5A) so a name typed in either
 // PET character set compares equal.
-static uint8_t petscii_fold(uint8_t ch) {
+uint8_t cbm_filename_fold(uint8_t ch) {
     if (ch >= 0xC1 && ch <= 0xDA) return (uint8_t)(ch & 0x7F);
     return ch;
 }
@@ -17,10 +17,10 @@ static uint8_t petscii_fold(uint8_t ch) {
 // Encode a host (ASCII) filename character to PETSCII and fold it. This reuses
 // the same mapping the directory listing renders with, so the comparison is an
 // exact inverse of what the user sees (including relocated punctuation). The
-// charset mode is irrelevant here because petscii_fold collapses the letter
+// charset mode is irrelevant here because cbm_filename_fold collapses the letter
 // case afterward, so encode without graphics folding (text mode).
-static uint8_t encode_fold(char c) {
-    return petscii_fold(ascii_to_petscii((uint8_t)c, /* graphics_mode: */ false));
+uint8_t cbm_filename_fold_host(char c) {
+    return cbm_filename_fold(ascii_to_petscii((uint8_t)c, /* graphics_mode: */ false));
 }
 
 bool cbm_filename_match(const uint8_t* pattern, uint8_t pattern_len,
@@ -37,7 +37,7 @@ bool cbm_filename_match(const uint8_t* pattern, uint8_t pattern_len,
 
     // Compare the typed PETSCII against the PETSCII-encoded host filename.
     for (uint8_t i = 0; i < match_len; i++) {
-        if (petscii_fold(pattern[i]) != encode_fold(filename[i])) return false;
+        if (cbm_filename_fold(pattern[i]) != cbm_filename_fold_host(filename[i])) return false;
     }
 
     if (!has_wildcard) {
@@ -46,10 +46,10 @@ bool cbm_filename_match(const uint8_t* pattern, uint8_t pattern_len,
         const char* rest = filename + match_len;
         if (rest[0] == '\0') return true;
         static const char ext[] = ".prg";
-        // sizeof(ext) includes the terminating NUL; encode_fold('\0') == 0, so
+        // sizeof(ext) includes the terminating NUL; cbm_filename_fold_host('\0') == 0, so
         // the comparison also requires the name to end exactly at ".prg".
         for (uint8_t i = 0; i < sizeof(ext); i++) {
-            if (encode_fold(rest[i]) != encode_fold(ext[i])) return false;
+            if (cbm_filename_fold_host(rest[i]) != cbm_filename_fold_host(ext[i])) return false;
         }
         return true;
     }
@@ -19,3 +19,11 @@
 // "fall through to the physical datasette").
 bool cbm_filename_match(const uint8_t* pattern, uint8_t pattern_len,
                         const char* filename);
+
+// Fold a typed PETSCII byte for case-insensitive comparison: shifted letters
+// ($C1-$DA) map onto the unshifted range ($41-$5A).
+uint8_t cbm_filename_fold(uint8_t ch);
+
+// Encode a host (ASCII) filename character to PETSCII and fold it, so that it
+// compares equal to the folded glyph the user would type.
+uint8_t cbm_filename_fold_host(char c);
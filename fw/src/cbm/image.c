@@ -0,0 +1,385 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#include "image.h"
+
+#include <ctype.h>
+#include <string.h>
+
+#include "filename.h"
+
+// Filenames and disk names are padded with shifted spaces.
+#define PAD_SHIFTED_SPACE 0xA0
+
+// 1541 geometry.
+#define D64_DIR_TRACK      18
+#define D64_SECTORS_35     683
+#define D64_SECTORS_40     768
+#define D64_DIR_ENTRY_SIZE 32
+#define D64_DIR_MAX_SECTORS 18      // Sectors 1-18 of the directory track
+
+// Offsets in the BAM sector (18/0).
+#define BAM_DISK_NAME      0x90
+
+// Offsets in a directory entry.
+#define DIR_TYPE           2
+#define DIR_TRACK          3
+#define DIR_SECTOR         4
+#define DIR_NAME           5
+#define DIR_BLOCKS         30
+
+// File type byte: bit 7 is set once the file is closed, the low bits hold
+// the type (2 = PRG).
+#define TYPE_CLOSED        0x80
+#define TYPE_MASK          0x07
+#define TYPE_PRG           2
+
+// T64 layout.
+#define T64_HEADER_SIZE    64
+#define T64_ENTRY_SIZE     32
+#define T64_MAX_ENTRIES    0x22
+#define T64_USED_ENTRIES   0x24
+#define T64_TAPE_NAME      0x28
+#define T64_TAPE_NAME_SIZE 24
+
+#define T64_ENTRY_TYPE     0
+#define T64_START_ADDR     2
+#define T64_END_ADDR       4
+#define T64_OFFSET         8
+#define T64_NAME           16
+
+#define T64_ENTRY_NORMAL   1
+
+// Data bytes per 1541 block, used to convert T64 file sizes to blocks.
+#define BLOCK_DATA_SIZE    254
+
+static uint16_t get_u16(const uint8_t* p) {
+    return (uint16_t) (p[0] | (p[1] << 8));
+}
+
+static uint32_t get_u32(const uint8_t* p) {
+    return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+// Copy a padded name, dropping the trailing padding. T64 tools pad with either
+// spaces or shifted spaces.
+static uint8_t copy_name(uint8_t* dest, const uint8_t* src, size_t size) {
+    size_t len = size < CBM_IMAGE_NAME_SIZE ? size : CBM_IMAGE_NAME_SIZE;
+    while (len > 0 && (src[len - 1] == PAD_SHIFTED_SPACE || src[len - 1] == ' ' || src[len - 1] == 0)) {
+        len--;
+    }
+    memcpy(dest, src, len);
+    return (uint8_t) len;
+}
+
+bool cbm_image_format_from_name(const char* filename, cbm_image_format_t* format) {
+    const size_t len = strlen(filename);
+    if (len <= 4 || filename[len - 4] != '.' || filename[len - 2] != '6' || filename[len - 1] != '4') {
+        return false;
+    }
+
+    switch (tolower((unsigned char) filename[len - 3])) {
+        case 'd': *format = cbm_image_d64; return true;
+        case 't': *format = cbm_image_t64; return true;
+        default:  return false;
+    }
+}
+
+static uint8_t d64_sectors_per_track(uint8_t track) {
+    if (track <= 17) return 21;
+    if (track <= 24) return 19;
+    if (track <= 30) return 18;
+    return 17;
+}
+
+// Byte offset of a sector in the image, or false if it is out of range.
+static bool d64_sector_offset(const cbm_image_t* image, uint8_t track, uint8_t sector, uint32_t* offset) {
+    if (track < 1 || track > image->tracks || sector >= d64_sectors_per_track(track)) {
+        return false;
+    }
+
+    uint32_t index = sector;
+    for (uint8_t t = 1; t < track; t++) {
+        index += d64_sectors_per_track(t);
+    }
+    *offset = index * CBM_IMAGE_SECTOR_SIZE;
+    return true;
+}
+
+static bool d64_read_sector(const cbm_image_t* image, uint8_t track, uint8_t sector, uint8_t* buffer) {
+    uint32_t offset;
+    return d64_sector_offset(image, track, sector, &offset)
+        && image->read(image->context, offset, buffer, CBM_IMAGE_SECTOR_SIZE);
+}
+
+static bool add_file(cbm_image_t* image, const cbm_image_file_t* file) {
+    if (image->count >= CBM_IMAGE_MAX_FILES) {
+        image->complete = false;
+        return false;
+    }
+    image->files[image->count++] = *file;
+    return true;
+}
+
+static bool d64_open(cbm_image_t* image) {
+    // Images may carry a trailing error byte per sector.
+    switch (image->image_size) {
+        case D64_SECTORS_35 * CBM_IMAGE_SECTOR_SIZE:
+        case D64_SECTORS_35 * (CBM_IMAGE_SECTOR_SIZE + 1):
+            image->tracks = 35;
+            break;
+        case D64_SECTORS_40 * CBM_IMAGE_SECTOR_SIZE:
+        case D64_SECTORS_40 * (CBM_IMAGE_SECTOR_SIZE + 1):
+            image->tracks = 40;
+            break;
+        default:
+            return false;
+    }
+
+    uint8_t sector[CBM_IMAGE_SECTOR_SIZE];
+    if (!d64_read_sector(image, D64_DIR_TRACK, 0, sector)) {
+        return false;
+    }
+
+    image->name_len = copy_name(image->name, &sector[BAM_DISK_NAME], CBM_IMAGE_NAME_SIZE);
+
+    // Free sector counts for tracks 1-35 (the directory track is reserved).
+    // 40-track images keep the extra BAM entries in DOS-specific places, so
+    // those tracks are not counted.
+    for (uint8_t track = 1; track <= 35; track++) {
+        if (track != D64_DIR_TRACK) {
+            image->free_blocks += sector[4 * track];
+        }
+    }
+
+    // Follow the directory chain, which starts where the BAM points.
+    uint8_t track = sector[0];
+    uint8_t next = sector[1];
+    for (int n = 0; track != 0; n++) {
+        if (n >= D64_DIR_MAX_SECTORS || !d64_read_sector(image, track, next, sector)) {
+            return false;
+        }
+
+        for (size_t i = 0; i < CBM_IMAGE_SECTOR_SIZE; i += D64_DIR_ENTRY_SIZE) {
+            const uint8_t* const entry = &sector[i];
+            const uint8_t type = entry[DIR_TYPE];
+            if ((type & TYPE_CLOSED) == 0 || (type & TYPE_MASK) != TYPE_PRG) {
+                continue;
+            }
+
+            cbm_image_file_t file = {
+                .blocks = get_u16(&entry[DIR_BLOCKS]),
+                .start = (uint32_t) (entry[DIR_TRACK] << 8) | entry[DIR_SECTOR],
+            };
+            file.name_len = copy_name(file.name, &entry[DIR_NAME], CBM_IMAGE_NAME_SIZE);
+            add_file(image, &file);
+        }
+
+        track = sector[0];
+        next = sector[1];
+    }
+
+    return true;
+}
+
+// Many T64 writers store a bogus end address, so a file's length is also
+// limited by the next file's data (or the end of the image).
+static uint32_t t64_data_limit(const cbm_image_t* image, uint32_t offset) {
+    uint32_t limit = image->image_size;
+    for (size_t i = 0; i < image->count; i++) {
+        const uint32_t other = image->files[i].start;
+        if (other > offset && other < limit) {
+            limit = other;
+        }
+    }
+    return limit;
+}
+
+static bool t64_open(cbm_image_t* image) {
+    uint8_t header[T64_HEADER_SIZE];
+    if (image->image_size < T64_HEADER_SIZE
+        || !image->read(image->context, 0, header, sizeof(header))
+        || memcmp(header, "C64", 3) != 0) {
+        return false;
+    }
+
+    image->name_len = copy_name(image->name, &header[T64_TAPE_NAME], T64_TAPE_NAME_SIZE);
+
+    // Some writers leave the used count at zero, so scan every slot.
+    uint16_t slots = get_u16(&header[T64_MAX_ENTRIES]);
+    if (slots == 0) {
+        slots = get_u16(&header[T64_USED_ENTRIES]);
+    }
+
+    const uint32_t max_slots = (image->image_size - T64_HEADER_SIZE) / T64_ENTRY_SIZE;
+    if (slots > max_slots) {
+        slots = (uint16_t) max_slots;
+    }
+
+    uint16_t end_addrs[CBM_IMAGE_MAX_FILES];
+    for (uint16_t slot = 0; slot < slots; slot++) {
+        uint8_t entry[T64_ENTRY_SIZE];
+        if (!image->read(image->context, T64_HEADER_SIZE + (uint32_t) slot * T64_ENTRY_SIZE, entry, sizeof(entry))) {
+            return false;
+        }
+
+        const uint32_t offset = get_u32(&entry[T64_OFFSET]);
+        if (entry[T64_ENTRY_TYPE] != T64_ENTRY_NORMAL || offset >= image->image_size) {
+            continue;
+        }
+
+        cbm_image_file_t file = {
+            .start = offset,
+            .load_addr = get_u16(&entry[T64_START_ADDR]),
+        };
+        file.name_len = copy_name(file.name, &entry[T64_NAME], CBM_IMAGE_NAME_SIZE);
+        if (add_file(image, &file)) {
+            end_addrs[image->count - 1] = get_u16(&entry[T64_END_ADDR]);
+        }
+    }
+
+    // Sizes can only be checked once every file's offset is known.
+    for (size_t i = 0; i < image->count; i++) {
+        cbm_image_file_t* const file = &image->files[i];
+        const uint32_t available = t64_data_limit(image, file->start) - file->start;
+        const uint32_t declared = end_addrs[i] > file->load_addr ? (uint32_t) (end_addrs[i] - file->load_addr) : 0;
+
+        file->size = declared != 0 && declared < available ? declared : available;
+        file->blocks = (uint16_t) ((file->size + 2 + BLOCK_DATA_SIZE - 1) / BLOCK_DATA_SIZE);
+    }
+
+    return true;
+}
+
+bool cbm_image_open(cbm_image_t* image, cbm_image_format_t format, uint32_t image_size,
+                    cbm_image_read_t read, void* context) {
+    memset(image, 0, sizeof(*image));
+    image->format = format;
+    image->read = read;
+    image->context = context;
+    image->image_size = image_size;
+    image->complete = true;
+
+    return format == cbm_image_d64
+        ? d64_open(image)
+        : t64_open(image);
+}
+
+static bool name_matches(const cbm_image_file_t* file, const uint8_t* pattern, uint8_t pattern_len) {
+    const bool prefix = pattern[pattern_len - 1] == '*';
+    const uint8_t match_len = prefix ? pattern_len - 1 : pattern_len;
+
+    if (prefix ? file->name_len < match_len : file->name_len != match_len) {
+        return false;
+    }
+
+    for (uint8_t i = 0; i < match_len; i++) {
+        if (cbm_filename_fold(file->name[i]) != cbm_filename_fold(pattern[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+const cbm_image_file_t* cbm_image_find(const cbm_image_t* image,
+                                       const uint8_t* pattern, uint8_t pattern_len) {
+    if (pattern_len == 0 || (pattern_len == 1 && pattern[0] == '*')) {
+        return NULL;
+    }
+
+    for (size_t i = 0; i < image->count; i++) {
+        if (name_matches(&image->files[i], pattern, pattern_len)) {
+            return &image->files[i];
+        }
+    }
+    return NULL;
+}
+
+static bool d64_read_file(const cbm_image_t* image, const cbm_image_file_t* file,
+                          cbm_image_sink_t sink, void* sink_context,
+                          size_t max_bytes, size_t* bytes) {
+    uint8_t track = (uint8_t) (file->start >> 8);
+    uint8_t sector = (uint8_t) file->start;
+
+    // A chain that revisits a sector loops forever.
+    uint8_t visited[(D64_SECTORS_40 + 7) / 8] = { 0 };
+
+    uint8_t buffer[CBM_IMAGE_SECTOR_SIZE];
+    while (*bytes < max_bytes) {
+        uint32_t offset;
+        if (!d64_sector_offset(image, track, sector, &offset)) {
+            return false;
+        }
+
+        const uint32_t index = offset / CBM_IMAGE_SECTOR_SIZE;
+        if (visited[index / 8] & (1u << (index % 8))) {
+            return false;
+        }
+        visited[index / 8] |= (uint8_t) (1u << (index % 8));
+
+        if (!image->read(image->context, offset, buffer, CBM_IMAGE_SECTOR_SIZE)) {
+            return false;
+        }
+
+        // The last sector has no successor. Its link holds the index of the
+        // last byte in use instead.
+        const bool last = buffer[0] == 0;
+        size_t length = last
+            ? (buffer[1] >= 2 ? buffer[1] - 1u : 0)
+            : CBM_IMAGE_SECTOR_SIZE - 2;
+        if (length > max_bytes - *bytes) {
+            length = max_bytes - *bytes;
+        }
+
+        sink(sink_context, *bytes, &buffer[2], length);
+        *bytes += length;
+
+        if (last) {
+            break;
+        }
+        track = buffer[0];
+        sector = buffer[1];
+    }
+
+    return true;
+}
+
+static bool t64_read_file(const cbm_image_t* image, const cbm_image_file_t* file,
+                          cbm_image_sink_t sink, void* sink_context,
+                          size_t max_bytes, size_t* bytes) {
+    // T64 stores the load address in the directory, not with the data.
+    const uint8_t header[2] = { (uint8_t) file->load_addr, (uint8_t) (file->load_addr >> 8) };
+    const size_t header_len = max_bytes < sizeof(header) ? max_bytes : sizeof(header);
+    sink(sink_context, 0, header, header_len);
+    *bytes = header_len;
+
+    uint8_t buffer[CBM_IMAGE_SECTOR_SIZE];
+    uint32_t offset = file->start;
+    uint32_t remaining = file->size;
+
+    while (remaining > 0 && *bytes < max_bytes) {
+        size_t length = remaining < sizeof(buffer) ? remaining : sizeof(buffer);
+        if (length > max_bytes - *bytes) {
+            length = max_bytes - *bytes;
+        }
+        if (!image->read(image->context, offset, buffer, length)) {
+            return false;
+        }
+
+        sink(sink_context, *bytes, buffer, length);
+        *bytes += length;
+        offset += (uint32_t) length;
+        remaining -= (uint32_t) length;
+    }
+
+    return true;
+}
+
+bool cbm_image_read_file(const cbm_image_t* image, const cbm_image_file_t* file,
+                         cbm_image_sink_t sink, void* sink_context,
+                         size_t max_bytes, size_t* bytes) {
+    *bytes = 0;
+    return image->format == cbm_image_d64
+        ? d64_read_file(image, file, sink, sink_context, max_bytes, bytes)
+        : t64_read_file(image, file, sink, sink_context, max_bytes, bytes);
+}
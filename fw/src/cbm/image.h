@@ -0,0 +1,86 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Read-only access to the PRG files in a 1541 disk image (.d64) or a tape
+// archive (.t64). The directory is parsed once by cbm_image_open and kept in
+// the cbm_image_t. File contents are only read when a file is streamed, one
+// sector (or chunk) at a time through the 'read' callback, so nothing is
+// extracted and the image is never read as a whole.
+
+// Configuration: maximum number of files kept from the directory (a 1541
+// directory track holds 144). Further files are left out and the directory
+// is marked incomplete.
+#ifndef CBM_IMAGE_MAX_FILES
+#define CBM_IMAGE_MAX_FILES 144
+#endif
+
+// Length of a CBM filename or disk name.
+#define CBM_IMAGE_NAME_SIZE 16
+
+// Size of a 1541 sector, and the unit in which file data is streamed.
+#define CBM_IMAGE_SECTOR_SIZE 256
+
+typedef enum {
+    cbm_image_d64,
+    cbm_image_t64,
+} cbm_image_format_t;
+
+// Read 'length' bytes at 'offset' in the image file. Returns false on error
+// (including a read past the end).
+typedef bool (*cbm_image_read_t)(void* context, uint32_t offset, uint8_t* buffer, size_t length);
+
+// Receives a file as it is streamed: 'offset' counts from the start of the
+// PRG image, so the 2-byte load address arrives first.
+typedef void (*cbm_image_sink_t)(void* context, size_t offset, const uint8_t* data, size_t length);
+
+typedef struct {
+    uint8_t name[CBM_IMAGE_NAME_SIZE];  // Raw PETSCII, padding removed
+    uint8_t name_len;
+    uint16_t blocks;                    // Size in 254-byte blocks
+    uint32_t start;                     // D64: (track << 8) | sector. T64: data offset
+    uint32_t size;                      // T64: data bytes (without load address)
+    uint16_t load_addr;                 // T64: load address
+} cbm_image_file_t;
+
+typedef struct {
+    cbm_image_format_t format;
+    cbm_image_read_t read;
+    void* context;
+    uint32_t image_size;
+    uint8_t tracks;                     // D64: 35 or 40
+
+    uint8_t name[CBM_IMAGE_NAME_SIZE];  // Disk or tape name, raw PETSCII
+    uint8_t name_len;
+    uint16_t free_blocks;               // D64: from the BAM. T64: 0
+    bool complete;                      // False if files were left out
+    uint16_t count;
+    cbm_image_file_t files[CBM_IMAGE_MAX_FILES];
+} cbm_image_t;
+
+// Select the image format from the extension of 'filename' (".d64" or
+// ".t64", case-insensitive). Returns false for anything else.
+bool cbm_image_format_from_name(const char* filename, cbm_image_format_t* format);
+
+// Validate the image and read its directory. Only PRG files are kept, as no
+// other file type can be LOADed. Returns false if the image is malformed.
+bool cbm_image_open(cbm_image_t* image, cbm_image_format_t format, uint32_t image_size,
+                    cbm_image_read_t read, void* context);
+
+// Find the first file (in directory order, as a 1541 does) that a LOAD of
+// 'pattern' selects. Follows the rules of cbm_filename_match: letters fold
+// case and a trailing '*' matches a prefix. Returns NULL if nothing matches.
+const cbm_image_file_t* cbm_image_find(const cbm_image_t* image,
+                                       const uint8_t* pattern, uint8_t pattern_len);
+
+// Stream 'file' to 'sink' as a PRG image, stopping after 'max_bytes'. D64
+// files follow their sector chain one sector at a time. Sets 'bytes' to the
+// number of bytes delivered. Returns false on a read error or a broken chain.
+bool cbm_image_read_file(const cbm_image_t* image, const cbm_image_file_t* file,
+                         cbm_image_sink_t sink, void* sink_context,
+                         size_t max_bytes, size_t* bytes);
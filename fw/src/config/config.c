@@ -4,20 +4,50 @@
 #include "pch.h"
 #include "config.h"
 
+#include "config_cache.h"
+
 #include "display/display.h"
 #include "fatal.h"
-#include "global.h"
+#include "pool.h"
 #include "sd/sd.h"
 #include "system_state.h"
 
+// Configuration: deepest nesting of aliases (an alias within an anchored node
+// that is itself replayed through an alias, and so on).
+#ifndef CONFIG_MAX_ALIAS_DEPTH
+#define CONFIG_MAX_ALIAS_DEPTH 8
+#endif
+
+// The events of an anchored node, recorded as they are parsed so that aliases
+// can replay them without re-reading the file.
+typedef struct anchor_s {
+    struct anchor_s* next;
+    char* name;
+    yaml_event_t* events;
+    size_t count;
+    size_t capacity;
+    int depth;                      // Nesting within the node while recording
+    bool recording;
+} anchor_t;
+
+// Position within an anchor being replayed for an alias.
+typedef struct replay_s {
+    const anchor_t* anchor;
+    size_t index;
+} replay_t;
+
 typedef struct parser_s {
     yaml_parser_t parser;
     yaml_event_t event;
     const char* filename;
     FILE* file;
     const config_sink_t* sink;
-    struct parser_s* previous;
+    config_cache_writer_t* writer;  // Non-NULL when compiling (see config_cache.h)
     int depth;
+
+    anchor_t* anchors;              // Most recently defined first
+    replay_t replay[CONFIG_MAX_ALIAS_DEPTH];
+    int replay_depth;
     
     // Config selection state: -1 for enumerate all, >= 0 to execute specific config
     int target_index;
@@ -72,25 +102,37 @@ void vet_parser(parser_t* parser, bool condition, const char* const format, ...)
     }
 }
 
-static void on_action_load(const parser_t* const parser, const char* file, uint32_t address) {
+static void on_action_load(const parser_t* const parser, const char* file, uint32_t address, const uint32_t* crc) {
+    if (parser->writer) {
+        config_cache_write_load(parser->writer, file, address, crc);
+    }
     if (parser->executing && parser->sink->setup && parser->sink->setup->on_load) {
-        parser->sink->setup->on_load(parser->sink->setup->context, file, address);
+        parser->sink->setup->on_load(parser->sink->setup->context, file, address, crc);
     }
 }
 
 static void on_action_patch(const parser_t* const parser, uint32_t address, const binary_t* binary) {
+    if (parser->writer) {
+        config_cache_write_patch(parser->writer, address, binary);
+    }
     if (parser->executing && parser->sink->setup && parser->sink->setup->on_patch) {
         parser->sink->setup->on_patch(parser->sink->setup->context, address, binary);
     }
 }
 
 static void on_action_copy(const parser_t* const parser, uint32_t source, uint32_t destination, uint32_t length) {
+    if (parser->writer) {
+        config_cache_write_copy(parser->writer, source, destination, length);
+    }
     if (parser->executing && parser->sink->setup && parser->sink->setup->on_copy) {
         parser->sink->setup->on_copy(parser->sink->setup->context, source, destination, length);
     }
 }
 
 static void on_action_fix_checksum(const parser_t* const parser, uint32_t start_addr, uint32_t end_addr, uint32_t fix_addr, uint32_t checksum) {
+    if (parser->writer) {
+        config_cache_write_fix_checksum(parser->writer, start_addr, end_addr, fix_addr, checksum);
+    }
     if (parser->executing && parser->sink->setup && parser->sink->setup->on_fix_checksum) {
         parser->sink->setup->on_fix_checksum(parser->sink->setup->context, start_addr, end_addr, fix_addr, checksum);
     }
@@ -131,40 +173,153 @@ static void assert_yaml_type(parser_t* parser, yaml_event_type_t expected_type)
     }
 }
 
-static void push_parser(parser_t* parser);
-static void pop_parser(parser_t* parser);
+static void vetted_yaml_parse_next(parser_t* parser) {
+    if (!yaml_parser_parse(&parser->parser, &parser->event)) {
+        fatal_parse_error(parser, "(YAML is malformed)");
+    }
+}
+
+// Initialize 'dest' as a copy of 'src' (libyaml has no event copy).
+static void copy_event(parser_t* parser, yaml_event_t* dest, const yaml_event_t* src) {
+    int ok = 0;
 
-static void mark_parser_depth(parser_t* parser) {
-    switch (parser->event.type) {
-        case YAML_STREAM_START_EVENT:
-        case YAML_DOCUMENT_START_EVENT:
+    switch (src->type) {
+        case YAML_SCALAR_EVENT:
+            ok = yaml_scalar_event_initialize(dest,
+                src->data.scalar.anchor, src->data.scalar.tag,
+                src->data.scalar.value, (int) src->data.scalar.length,
+                src->data.scalar.plain_implicit, src->data.scalar.quoted_implicit,
+                src->data.scalar.style);
+            break;
+        case YAML_ALIAS_EVENT:
+            ok = yaml_alias_event_initialize(dest, src->data.alias.anchor);
+            break;
         case YAML_MAPPING_START_EVENT:
-        case YAML_SEQUENCE_START_EVENT: {
-            parser->depth = 0;
+            ok = yaml_mapping_start_event_initialize(dest,
+                src->data.mapping_start.anchor, src->data.mapping_start.tag,
+                src->data.mapping_start.implicit, src->data.mapping_start.style);
+            break;
+        case YAML_MAPPING_END_EVENT:
+            ok = yaml_mapping_end_event_initialize(dest);
+            break;
+        case YAML_SEQUENCE_START_EVENT:
+            ok = yaml_sequence_start_event_initialize(dest,
+                src->data.sequence_start.anchor, src->data.sequence_start.tag,
+                src->data.sequence_start.implicit, src->data.sequence_start.style);
+            break;
+        case YAML_SEQUENCE_END_EVENT:
+            ok = yaml_sequence_end_event_initialize(dest);
+            break;
+        default:
             break;
+    }
+
+    vet_parser(parser, ok, "cannot copy %s", type_to_string(src->type));
+
+    // Keep the position for error messages.
+    dest->start_mark = src->start_mark;
+    dest->end_mark = src->end_mark;
+}
+
+// Add the current event (read from the file) to each anchored node being
+// recorded, and start recording if the event begins one.
+static void record_event(parser_t* parser) {
+    const yaml_char_t* name = get_current_anchor(parser);
+    if (name != NULL) {
+        anchor_t* anchor = vetted_malloc(sizeof(anchor_t));
+        memset(anchor, 0, sizeof(anchor_t));
+        anchor->name = vetted_malloc(strlen((const char*) name) + 1);
+        strcpy(anchor->name, (const char*) name);
+        anchor->recording = true;
+
+        anchor->next = parser->anchors;
+        parser->anchors = anchor;
+    }
+
+    for (anchor_t* anchor = parser->anchors; anchor != NULL; anchor = anchor->next) {
+        if (!anchor->recording) {
+            continue;
         }
 
-        default: {
-            parser->depth = -1;
-            break;
+        if (anchor->count == anchor->capacity) {
+            anchor->capacity = anchor->capacity == 0 ? 8 : anchor->capacity * 2;
+            anchor->events = realloc(anchor->events, anchor->capacity * sizeof(yaml_event_t));
+            vet_parser(parser, anchor->events != NULL, "out of memory for anchor '%s'", anchor->name);
         }
+        copy_event(parser, &anchor->events[anchor->count++], &parser->event);
+
+        switch (parser->event.type) {
+            case YAML_MAPPING_START_EVENT:
+            case YAML_SEQUENCE_START_EVENT: anchor->depth++; break;
+            case YAML_MAPPING_END_EVENT:
+            case YAML_SEQUENCE_END_EVENT: anchor->depth--; break;
+            default: break;
+        }
+
+        anchor->recording = anchor->depth > 0;
     }
 }
 
-static void vetted_yaml_parse_next(parser_t* parser) {
-    if (!yaml_parser_parse(&parser->parser, &parser->event)) {
-        fatal_parse_error(parser, "(YAML is malformed)");
+static void free_anchors(parser_t* parser) {
+    while (parser->anchors != NULL) {
+        anchor_t* anchor = parser->anchors;
+        parser->anchors = anchor->next;
+
+        for (size_t i = 0; i < anchor->count; i++) {
+            yaml_event_delete(&anchor->events[i]);
+        }
+        free(anchor->events);
+        free(anchor->name);
+        free(anchor);
     }
 }
 
-static void parse_next(parser_t* parser) {
-    if (parser->depth < 0) {
-        pop_parser(parser);
-        assert_yaml_type(parser, YAML_ALIAS_EVENT);
+// Replay the node anchored as 'name' before continuing after the alias.
+static void begin_replay(parser_t* parser, const char* name) {
+    const anchor_t* anchor = parser->anchors;
+    while (anchor != NULL && strcmp(anchor->name, name) != 0) {
+        anchor = anchor->next;
+    }
+
+    if (anchor == NULL) {
+        fatal_parse_error(parser, "Unknown alias '%s'", name);
     }
+    if (anchor->recording) {
+        fatal_parse_error(parser, "Alias '%s' refers to an enclosing node", name);
+    }
+    if (parser->replay_depth == CONFIG_MAX_ALIAS_DEPTH) {
+        fatal_parse_error(parser, "Aliases nested too deeply");
+    }
+
+    parser->replay[parser->replay_depth++] = (replay_t) { .anchor = anchor, .index = 0 };
+}
 
+// Read the next event, from an alias being replayed if any, or else from the file.
+static void next_event(parser_t* parser) {
     yaml_event_delete(&parser->event);
+
+    while (parser->replay_depth > 0) {
+        replay_t* const replay = &parser->replay[parser->replay_depth - 1];
+        if (replay->index < replay->anchor->count) {
+            copy_event(parser, &parser->event, &replay->anchor->events[replay->index++]);
+            return;
+        }
+        parser->replay_depth--;
+    }
+
     vetted_yaml_parse_next(parser);
+    record_event(parser);
+}
+
+// Advance to the next event. Aliases are resolved in place, so callers see
+// the events of the anchored node instead of a YAML_ALIAS_EVENT.
+static void parse_next(parser_t* parser) {
+    next_event(parser);
+
+    while (parser->event.type == YAML_ALIAS_EVENT) {
+        begin_replay(parser, (const char*) parser->event.data.alias.anchor);
+        next_event(parser);
+    }
 
     switch (parser->event.type) {
         case YAML_STREAM_START_EVENT: { parser->depth++; break; }
@@ -179,25 +334,6 @@ static void parse_next(parser_t* parser) {
         case YAML_SEQUENCE_START_EVENT: { parser->depth++; break; }
         case YAML_SEQUENCE_END_EVENT: { parser->depth--; break; }
 
-        case YAML_ALIAS_EVENT: {
-            const yaml_char_t* target_anchor = parser->event.data.alias.anchor;
-            
-            push_parser(parser);
-            
-            while (true) {
-                const yaml_char_t* current_anchor = get_current_anchor(parser);
-                
-                if (current_anchor != NULL &&
-                    strcmp((const char*) target_anchor, (const char*) current_anchor) == 0) {
-                    mark_parser_depth(parser);
-                    break;
-                }
-                
-                parse_next(parser);
-            }
-            break;
-        }
-
         default: break;
     }
 }
@@ -229,33 +365,13 @@ static void init_parser(parser_t* parser, const char* filename, const config_sin
 }
 
 static void deinit_parser(parser_t* parser) {
-    vet_parser(parser, parser->previous == NULL, "deinit_parser with non-empty stack");
     vet_parser(parser, parser->depth == 0, "deinit_parser depth=%d", parser->depth);
     yaml_event_delete(&parser->event);
+    free_anchors(parser);
     yaml_parser_delete(&parser->parser);
     fclose((FILE*) parser->file);
 }
 
-static void push_parser(parser_t* parser) {
-    parser_t* saved_parser = vetted_malloc(sizeof(parser_t));
-    memcpy(/* dest: */ saved_parser, /* src: */ parser, sizeof(parser_t));
-    init_parser(parser, saved_parser->filename, saved_parser->sink, saved_parser->target_index);
-    parser->previous = saved_parser;
-}
-
-static void pop_parser(parser_t* parser) {
-    vet_parser(parser->previous, parser->depth == -1, "unbalanced yaml (depth=%d)", parser->depth);
-
-    parser_t* previous_parser = parser->previous;
-    vet_parser(parser, previous_parser != NULL, "pop_parser with empty stack");
-    parser->previous = NULL;
-    
-    parser->depth = 0;
-    deinit_parser(parser);
-    memcpy(/* dest: */ parser, /* src: */ previous_parser, sizeof(parser_t));
-    free(previous_parser);
-}
-
 static void parse_skip(parser_t* parser, void* context, size_t context_size) {
     (void) context;
     (void) context_size;
@@ -274,7 +390,6 @@ static void parse_skip(parser_t* parser, void* context, size_t context_size) {
             break;
         }
 
-        case YAML_ALIAS_EVENT:
         case YAML_SCALAR_EVENT:
             break;
 
@@ -317,6 +432,19 @@ static void parse_as_uint32(parser_t* parser, void* context, size_t context_size
     return parse_uint32(parser, (uint32_t*) context);
 }
 
+typedef struct {
+    uint32_t value;
+    bool present;               // False if the key was absent
+} optional_uint32_t;
+
+static void parse_as_optional_uint32(parser_t* parser, void* context, size_t context_size) {
+    (void)context_size;
+    assert(context_size == sizeof(optional_uint32_t));
+    optional_uint32_t* const optional = (optional_uint32_t*) context;
+    parse_uint32(parser, &optional->value);
+    optional->present = true;
+}
+
 static void parse_as_hex(parser_t* parser, void* context, size_t context_size) {
     (void)context_size;
     parse_expect_type(parser, YAML_SCALAR_EVENT);
@@ -408,14 +536,16 @@ static void parse_sequence(parser_t* parser, parse_callback_t on_item_fn) {
 static void parse_action_load_file_entry(parser_t* parser) {
     char file[261] = { 0 };     // Windows OS max path length is 260 characters
     uint32_t address = 0;
+    optional_uint32_t crc = { 0 };
     
     parse_mapping(parser, (const map_dispatch_entry_t[]) {
         { "file", parse_as_string, &file, sizeof(file) },
         { "address", parse_as_uint32, &address, sizeof(address) },
+        { "crc", parse_as_optional_uint32, &crc, sizeof(crc) },
         { NULL, NULL, NULL, 0 }
     });
 
-    on_action_load(parser, file, address);
+    on_action_load(parser, file, address, crc.present ? &crc.value : NULL);
 }
 
 static void parse_action_load_files(parser_t* parser, void* context, size_t context_size) {
@@ -442,12 +572,12 @@ static void parse_action_patch(parser_t* parser, void* context, size_t context_s
 
     uint32_t address = 0;
 
-    uint8_t* binary_data = acquire_temp_buffer();
+    uint8_t* binary_data = pool_alloc(POOL_MEDIUM_SIZE, "patch");
     binary_t binary = {
         .data = binary_data,
         .size = 0,
         .expected = 0,
-        .capacity = TEMP_BUFFER_SIZE
+        .capacity = POOL_MEDIUM_SIZE
     };
 
     parse_mapping_continued(parser, (const map_dispatch_entry_t[]) {
@@ -457,7 +587,7 @@ static void parse_action_patch(parser_t* parser, void* context, size_t context_s
     });
 
     on_action_patch(parser, address, &binary);
-    release_temp_buffer(&binary_data);
+    pool_free(binary_data);
 }
 
 static void parse_action_copy(parser_t* parser, void* context, size_t context_size) {
@@ -494,12 +624,45 @@ static void parse_action_set(parser_t* parser, void* context, size_t context_siz
         .capacity = TAPE_CONFIG_SIZE,
     };
 
+    // Temporary buffer for the tape-save hex blob.
+    uint8_t tape_save_blob_data[TAPE_SAVE_CONFIG_SIZE];
+    binary_t tape_save_blob = {
+        .data = tape_save_blob_data,
+        .size = 0,
+        .expected = TAPE_SAVE_CONFIG_SIZE,
+        .capacity = TAPE_SAVE_CONFIG_SIZE,
+    };
+
+    // Temporary buffer for the key-buffer hex blob.
+    uint8_t key_buffer_blob_data[KEY_BUFFER_CONFIG_SIZE];
+    binary_t key_buffer_blob = {
+        .data = key_buffer_blob_data,
+        .size = 0,
+        .expected = KEY_BUFFER_CONFIG_SIZE,
+        .capacity = KEY_BUFFER_CONFIG_SIZE,
+    };
+
+    // Temporary buffer for the ieee hex blob.
+    uint8_t ieee_blob_data[IEEE_CONFIG_SIZE];
+    binary_t ieee_blob = {
+        .data = ieee_blob_data,
+        .size = 0,
+        .expected = IEEE_CONFIG_SIZE,
+        .capacity = IEEE_CONFIG_SIZE,
+    };
+
     options_t options = {
         .columns = 40,          // Default value
         .video_ram_mask = 0,    // Default value (will be derived from video_ram_kb)
         .usb_keymap = { 0 },    // Default: empty (use default keymap)
         .tape = { 0 },          // Default: disabled
         .tape_enabled = false,
+        .tape_save = { 0 },     // Default: SAVE goes to the datasette
+        .tape_save_enabled = false,
+        .key_buffer = { 0 },    // Default: type through the keyboard matrix
+        .key_buffer_enabled = false,
+        .ieee = { 0 },          // Default: the bus is left to real drives
+        .ieee_enabled = false,
     };
 
     parse_mapping_continued(parser, (const map_dispatch_entry_t[]) {
@@ -507,6 +670,9 @@ static void parse_action_set(parser_t* parser, void* context, size_t context_siz
         { "video-ram-kb", parse_as_uint32, &video_ram_kb, sizeof(video_ram_kb) },
         { "usb-keymap", parse_as_string, &options.usb_keymap, sizeof(options.usb_keymap) },
         { "tape", parse_as_hex, &tape_blob, sizeof(tape_blob) },
+        { "tape-save", parse_as_hex, &tape_save_blob, sizeof(tape_save_blob) },
+        { "key-buffer", parse_as_hex, &key_buffer_blob, sizeof(key_buffer_blob) },
+        { "ieee", parse_as_hex, &ieee_blob, sizeof(ieee_blob) },
         { NULL, NULL, NULL, 0 }
     });
 
@@ -528,6 +694,28 @@ static void parse_action_set(parser_t* parser, void* context, size_t context_siz
         options.tape_enabled = true;
     }
 
+    if (tape_save_blob.size != 0) {
+        assert(tape_save_blob.size == TAPE_SAVE_CONFIG_SIZE);
+        memcpy(&options.tape_save, tape_save_blob.data, TAPE_SAVE_CONFIG_SIZE);
+        options.tape_save_enabled = true;
+    }
+
+    if (key_buffer_blob.size != 0) {
+        assert(key_buffer_blob.size == KEY_BUFFER_CONFIG_SIZE);
+        memcpy(&options.key_buffer, key_buffer_blob.data, KEY_BUFFER_CONFIG_SIZE);
+        options.key_buffer_enabled = true;
+    }
+
+    if (ieee_blob.size != 0) {
+        assert(ieee_blob.size == IEEE_CONFIG_SIZE);
+        memcpy(&options.ieee, ieee_blob.data, IEEE_CONFIG_SIZE);
+        options.ieee_enabled = true;
+    }
+
+    if (parser->writer) {
+        config_cache_write_set_options(parser->writer, &options);
+    }
+
     if (parser->executing && parser->sink->setup && parser->sink->setup->on_set_options) {
         parser->sink->setup->on_set_options(parser->sink->setup->context, &options);
     }
@@ -577,12 +765,28 @@ static void parse_action(parser_t* parser, void* context, size_t context_size) {
 
 static void parse_action_list(parser_t* parser, void* context, size_t context_size);
 
+typedef struct then_else_context_s {
+    bool condition;
+    bool graphics;      // Keyboard model for which the branch applies (for compiling)
+} then_else_context_t;
+
 static void parse_then_else(parser_t* parser, void* context, size_t context_size) {
     (void)context_size;
-    assert(context_size == sizeof(bool));
-    bool condition = *((bool*)context);
+    assert(context_size == sizeof(then_else_context_t));
+    const then_else_context_t* const branch = (const then_else_context_t*) context;
+    bool condition = branch->condition;
+
+    if (parser->writer) {
+        // Compile both branches, but only execute the one that applies.
+        const bool executing = parser->executing;
+        parser->executing = executing && condition;
+
+        config_cache_write_branch_begin(parser->writer, branch->graphics);
+        parse_action_list(parser, NULL, 0);
+        config_cache_write_branch_end(parser->writer);
 
-    if (condition) {
+        parser->executing = executing;
+    } else if (condition) {
         parse_action_list(parser, NULL, 0);
     } else {
         //assert_yaml_type(parser, YAML_SEQUENCE_START_EVENT);
@@ -614,11 +818,12 @@ static void parse_if(parser_t* parser, void* context, size_t context_size) {
         fatal_parse_error(parser, "Unknown if-cond '%s'", condition);
     }
 
-    bool else_value = !then_value;
+    then_else_context_t then_branch = { .condition = then_value, .graphics = true };
+    then_else_context_t else_branch = { .condition = !then_value, .graphics = false };
 
     parse_mapping_continued(parser, (const map_dispatch_entry_t[]) {
-        { "then", parse_then_else, &then_value, sizeof(then_value) },
-        { "else", parse_then_else, &else_value, sizeof(else_value) },
+        { "then", parse_then_else, &then_branch, sizeof(then_branch) },
+        { "else", parse_then_else, &else_branch, sizeof(else_branch) },
         { NULL, NULL, NULL, 0 }
     });
 }
@@ -662,6 +867,10 @@ static void parse_config(parser_t* parser) {
         parser->sink->on_enter_config(parser->sink->context);
     }
 
+    if (parser->writer) {
+        config_cache_write_enter_config(parser->writer);
+    }
+
     char id[41] = { 0 };
     char name[41] = { 0 };
 
@@ -672,6 +881,10 @@ static void parse_config(parser_t* parser) {
         { NULL, NULL, NULL, 0 }
     });
 
+    if (parser->writer) {
+        config_cache_write_exit_config(parser->writer, id, name);
+    }
+
     if (parser->sink->on_exit_config) {
         parser->sink->on_exit_config(parser->sink->context, id, name);
     }
@@ -698,21 +911,45 @@ static void parse_default(parser_t* parser, void* context, size_t context_size)
     parse_expect_type(parser, YAML_SCALAR_EVENT);
     const char* name = get_current_string(parser);
 
+    if (parser->writer) {
+        config_cache_write_default(parser->writer, name);
+    }
+
     if (parser->sink->on_default) {
         parser->sink->on_default(parser->sink->context, name);
     }
 }
 
-void parse_config_file(const char* filename, const config_sink_t* const sink, int target_index) {
+// Helper function to parse the top-level 'search-order' key (e.g., "usb, sd")
+static void parse_search_order(parser_t* parser, void* context, size_t context_size) {
+    (void)context;
+    (void)context_size;
+
+    parse_expect_type(parser, YAML_SCALAR_EVENT);
+    const char* order = get_current_string(parser);
+
+    if (parser->writer) {
+        config_cache_write_search_order(parser->writer, order);
+    }
+
+    if (parser->sink->on_search_order) {
+        parser->sink->on_search_order(parser->sink->context, order);
+    }
+}
+
+static void parse_file(const char* filename, const config_sink_t* const sink, int target_index,
+                       config_cache_writer_t* writer) {
     parser_t parser;
 
     init_parser(&parser, filename, sink, target_index);
+    parser.writer = writer;
 
     parse_expect_type(&parser, YAML_MAPPING_START_EVENT);
     
     parse_mapping(&parser, (const map_dispatch_entry_t[]) {
         { "configs", parse_config_list, NULL, 0 },
         { "default", parse_default, NULL, 0 },
+        { "search-order", parse_search_order, NULL, 0 },
         { "data", parse_skip, NULL, 0 },
         { NULL, NULL, NULL, 0 }
     });
@@ -722,3 +959,12 @@ void parse_config_file(const char* filename, const config_sink_t* const sink, in
 
     deinit_parser(&parser);
 }
+
+void parse_config_file(const char* filename, const config_sink_t* const sink, int target_index) {
+    parse_file(filename, sink, target_index, NULL);
+}
+
+void parse_config_file_compiled(const char* filename, const config_sink_t* const sink, int target_index,
+                                config_cache_writer_t* writer) {
+    parse_file(filename, sink, target_index, writer);
+}
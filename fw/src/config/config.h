@@ -9,6 +9,7 @@
 typedef void (*on_enter_config_fn_t)(void* context);
 typedef void (*on_exit_config_fn_t)(void* context, const char* id, const char* name);
 typedef void (*on_default_fn_t)(void* context, const char* id);
+typedef void (*on_search_order_fn_t)(void* context, const char* order);
 
 // Struct for sinking parsed data
 typedef struct config_sink_s {
@@ -16,6 +17,7 @@ typedef struct config_sink_s {
     const on_enter_config_fn_t on_enter_config;
     const on_exit_config_fn_t on_exit_config;
     const on_default_fn_t on_default;
+    const on_search_order_fn_t on_search_order;
     const setup_sink_t* const setup;
 } config_sink_t;
 
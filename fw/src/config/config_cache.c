@@ -0,0 +1,481 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#include "config_cache.h"
+
+#include <string.h>
+
+#include "fatal.h"
+#include "pool.h"
+
+// "EPY" + format version. Bump the version when the records change.
+#define CACHE_MAGIC   0x00595045
+#define CACHE_VERSION 3
+
+// File layout:
+//
+//   file_header_t
+//   For each config:
+//     uint32_t length          Bytes of actions that follow
+//     actions                  Records below, each starting with an opcode byte
+//     char id[41]
+//     char name[41]
+//
+// The header is written last, so an interrupted compile never has a valid
+// magic number.
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t options_size;          // sizeof(options_t), which is stored raw
+    config_cache_key_t key;
+    uint32_t total_size;            // Size of the whole file
+    uint32_t config_count;
+    uint8_t has_default;
+    uint8_t has_search_order;
+    char default_id[41];
+    char search_order[41];
+} file_header_t;
+
+typedef enum {
+    op_load,                        // uint32_t address, uint8_t has_crc, uint32_t crc, uint16_t length, char file[length]
+    op_patch,                       // uint32_t address, uint16_t size, uint8_t data[size]
+    op_copy,                        // uint32_t source, destination, length
+    op_set_options,                 // options_t
+    op_fix_checksum,                // uint32_t start_addr, end_addr, fix_addr, checksum
+    op_branch,                      // uint8_t graphics, uint32_t length, actions[length]
+} opcode_t;
+
+#define ID_SIZE   41
+#define NAME_SIZE 41
+
+static void put(config_cache_writer_t* writer, const void* data, size_t size) {
+    if (writer->ok && fwrite(data, size, 1, writer->file) != 1) {
+        writer->ok = false;
+    }
+}
+
+static void put_u8(config_cache_writer_t* writer, uint8_t value) {
+    put(writer, &value, sizeof(value));
+}
+
+static void put_u16(config_cache_writer_t* writer, uint16_t value) {
+    put(writer, &value, sizeof(value));
+}
+
+static void put_u32(config_cache_writer_t* writer, uint32_t value) {
+    put(writer, &value, sizeof(value));
+}
+
+// Write a placeholder length and return its offset (see patch_length()).
+static long begin_length(config_cache_writer_t* writer) {
+    const long start = ftell(writer->file);
+    put_u32(writer, 0);
+    return start;
+}
+
+// Fill in the length field at 'start' with the number of bytes written since.
+static void patch_length(config_cache_writer_t* writer, long start) {
+    const long end = ftell(writer->file);
+    if (!writer->ok || start < 0 || end < 0) {
+        writer->ok = false;
+        return;
+    }
+
+    const uint32_t length = (uint32_t) (end - start - (long) sizeof(uint32_t));
+    if (fseek(writer->file, start, SEEK_SET) != 0) {
+        writer->ok = false;
+        return;
+    }
+    put_u32(writer, length);
+    if (fseek(writer->file, end, SEEK_SET) != 0) {
+        writer->ok = false;
+    }
+}
+
+void config_cache_write_begin(config_cache_writer_t* writer, FILE* file) {
+    memset(writer, 0, sizeof(*writer));
+    writer->file = file;
+    writer->ok = true;
+    writer->config_start = -1;
+
+    // Reserve space for the header.
+    const file_header_t header = { 0 };
+    put(writer, &header, sizeof(header));
+}
+
+bool config_cache_write_end(config_cache_writer_t* writer, const config_cache_key_t* key) {
+    const long total_size = ftell(writer->file);
+    if (!writer->ok || writer->depth != 0 || writer->config_start >= 0 || total_size < 0) {
+        return false;
+    }
+
+    file_header_t header = {
+        .magic = CACHE_MAGIC,
+        .version = CACHE_VERSION,
+        .options_size = sizeof(options_t),
+        .key = *key,
+        .total_size = (uint32_t) total_size,
+        .config_count = writer->config_count,
+        .has_default = writer->has_default,
+        .has_search_order = writer->has_search_order,
+    };
+    memcpy(header.default_id, writer->default_id, sizeof(header.default_id));
+    memcpy(header.search_order, writer->search_order, sizeof(header.search_order));
+
+    if (fseek(writer->file, 0, SEEK_SET) != 0) {
+        return false;
+    }
+    put(writer, &header, sizeof(header));
+    return writer->ok && fflush(writer->file) == 0;
+}
+
+// Copy 'value' into a fixed-size field. Strings that do not fit cannot be
+// replayed faithfully, so they fail the compile.
+static void copy_field(config_cache_writer_t* writer, char* field, size_t field_size, const char* value) {
+    if (strlen(value) >= field_size) {
+        writer->ok = false;
+        return;
+    }
+    strcpy(field, value);
+}
+
+void config_cache_write_default(config_cache_writer_t* writer, const char* id) {
+    copy_field(writer, writer->default_id, sizeof(writer->default_id), id);
+    writer->has_default = true;
+}
+
+void config_cache_write_search_order(config_cache_writer_t* writer, const char* order) {
+    copy_field(writer, writer->search_order, sizeof(writer->search_order), order);
+    writer->has_search_order = true;
+}
+
+void config_cache_write_enter_config(config_cache_writer_t* writer) {
+    writer->config_start = begin_length(writer);
+}
+
+void config_cache_write_exit_config(config_cache_writer_t* writer, const char* id, const char* name) {
+    patch_length(writer, writer->config_start);
+    writer->config_start = -1;
+
+    char field[ID_SIZE > NAME_SIZE ? ID_SIZE : NAME_SIZE] = { 0 };
+    copy_field(writer, field, ID_SIZE, id);
+    put(writer, field, ID_SIZE);
+
+    memset(field, 0, sizeof(field));
+    copy_field(writer, field, NAME_SIZE, name);
+    put(writer, field, NAME_SIZE);
+
+    writer->config_count++;
+}
+
+void config_cache_write_load(config_cache_writer_t* writer, const char* filename, uint32_t address, const uint32_t* crc) {
+    const size_t length = strlen(filename);
+
+    put_u8(writer, op_load);
+    put_u32(writer, address);
+    put_u8(writer, crc != NULL);
+    put_u32(writer, crc != NULL ? *crc : 0);
+    put_u16(writer, (uint16_t) length);
+    put(writer, filename, length);
+}
+
+void config_cache_write_patch(config_cache_writer_t* writer, uint32_t address, const binary_t* binary) {
+    if (binary->size > POOL_MEDIUM_SIZE) {
+        writer->ok = false;
+        return;
+    }
+
+    put_u8(writer, op_patch);
+    put_u32(writer, address);
+    put_u16(writer, (uint16_t) binary->size);
+    put(writer, binary->data, binary->size);
+}
+
+void config_cache_write_copy(config_cache_writer_t* writer, uint32_t source, uint32_t destination, uint32_t length) {
+    put_u8(writer, op_copy);
+    put_u32(writer, source);
+    put_u32(writer, destination);
+    put_u32(writer, length);
+}
+
+void config_cache_write_set_options(config_cache_writer_t* writer, const options_t* options) {
+    put_u8(writer, op_set_options);
+    put(writer, options, sizeof(*options));
+}
+
+void config_cache_write_fix_checksum(config_cache_writer_t* writer, uint32_t start_addr, uint32_t end_addr,
+                                     uint32_t fix_addr, uint32_t checksum) {
+    put_u8(writer, op_fix_checksum);
+    put_u32(writer, start_addr);
+    put_u32(writer, end_addr);
+    put_u32(writer, fix_addr);
+    put_u32(writer, checksum);
+}
+
+void config_cache_write_branch_begin(config_cache_writer_t* writer, bool graphics) {
+    if (writer->depth >= CONFIG_CACHE_MAX_DEPTH) {
+        writer->ok = false;
+        writer->depth++;
+        return;
+    }
+
+    put_u8(writer, op_branch);
+    put_u8(writer, graphics);
+    writer->branch_start[writer->depth++] = begin_length(writer);
+}
+
+void config_cache_write_branch_end(config_cache_writer_t* writer) {
+    writer->depth--;
+    if (writer->depth < CONFIG_CACHE_MAX_DEPTH) {
+        patch_length(writer, writer->branch_start[writer->depth]);
+    }
+}
+
+//
+// Replay
+//
+
+static bool get(FILE* file, void* data, size_t size, uint32_t* remaining) {
+    if (size > *remaining || fread(data, size, 1, file) != 1) {
+        return false;
+    }
+    *remaining -= (uint32_t) size;
+    return true;
+}
+
+static bool skip(FILE* file, uint32_t length) {
+    return fseek(file, (long) length, SEEK_CUR) == 0;
+}
+
+// Run the 'length' bytes of actions at the current position. If 'setup' is
+// NULL, only check that the records are well formed (including both sides of
+// each branch).
+static bool run_actions(FILE* file, uint32_t length, const setup_sink_t* const setup, int depth) {
+    void* const context = setup != NULL ? setup->context : NULL;
+
+    while (length > 0) {
+        uint8_t opcode;
+        if (!get(file, &opcode, sizeof(opcode), &length)) {
+            return false;
+        }
+
+        switch (opcode) {
+            case op_load: {
+                uint32_t address;
+                uint8_t has_crc;
+                uint32_t crc;
+                uint16_t file_length;
+                char filename[261];
+                if (!get(file, &address, sizeof(address), &length)
+                    || !get(file, &has_crc, sizeof(has_crc), &length)
+                    || !get(file, &crc, sizeof(crc), &length)
+                    || !get(file, &file_length, sizeof(file_length), &length)
+                    || file_length >= sizeof(filename)
+                    || !get(file, filename, file_length, &length)) {
+                    return false;
+                }
+                filename[file_length] = '\0';
+
+                if (setup != NULL && setup->on_load) {
+                    setup->on_load(context, filename, address, has_crc ? &crc : NULL);
+                }
+                break;
+            }
+
+            case op_patch: {
+                uint32_t address;
+                uint16_t size;
+                if (!get(file, &address, sizeof(address), &length)
+                    || !get(file, &size, sizeof(size), &length)
+                    || size > POOL_MEDIUM_SIZE
+                    || size > length) {
+                    return false;
+                }
+
+                if (setup == NULL) {
+                    length -= size;
+                    if (!skip(file, size)) {
+                        return false;
+                    }
+                    break;
+                }
+
+                uint8_t* const data = pool_alloc(POOL_MEDIUM_SIZE, "patch");
+                const bool ok = get(file, data, size, &length);
+                if (ok && setup->on_patch) {
+                    const binary_t binary = { .data = data, .size = size, .capacity = POOL_MEDIUM_SIZE };
+                    setup->on_patch(context, address, &binary);
+                }
+                pool_free(data);
+                if (!ok) {
+                    return false;
+                }
+                break;
+            }
+
+            case op_copy: {
+                uint32_t args[3];
+                if (!get(file, args, sizeof(args), &length)) {
+                    return false;
+                }
+                if (setup != NULL && setup->on_copy) {
+                    setup->on_copy(context, args[0], args[1], args[2]);
+                }
+                break;
+            }
+
+            case op_set_options: {
+                options_t options;
+                if (!get(file, &options, sizeof(options), &length)) {
+                    return false;
+                }
+                if (setup != NULL && setup->on_set_options) {
+                    setup->on_set_options(context, &options);
+                }
+                break;
+            }
+
+            case op_fix_checksum: {
+                uint32_t args[4];
+                if (!get(file, args, sizeof(args), &length)) {
+                    return false;
+                }
+                if (setup != NULL && setup->on_fix_checksum) {
+                    setup->on_fix_checksum(context, args[0], args[1], args[2], args[3]);
+                }
+                break;
+            }
+
+            case op_branch: {
+                uint8_t graphics;
+                uint32_t branch_length;
+                if (depth >= CONFIG_CACHE_MAX_DEPTH
+                    || !get(file, &graphics, sizeof(graphics), &length)
+                    || !get(file, &branch_length, sizeof(branch_length), &length)
+                    || branch_length > length) {
+                    return false;
+                }
+                length -= branch_length;
+
+                const bool taken = setup == NULL
+                    || (setup->system_state->pet_keyboard_model == pet_keyboard_model_graphics) == (graphics != 0);
+                const bool ok = taken
+                    ? run_actions(file, branch_length, setup, depth + 1)
+                    : skip(file, branch_length);
+                if (!ok) {
+                    return false;
+                }
+                break;
+            }
+
+            default:
+                return false;
+        }
+    }
+
+    return true;
+}
+
+// Check that every record is well formed and that the configs exactly fill
+// the file, so a damaged file is rejected before any callbacks run. Records
+// where each config's actions are in 'index' (if not NULL).
+static bool check_records(FILE* file, const file_header_t* header, config_cache_index_t* index) {
+    if (index != NULL) {
+        // A file with more configs than fit is not indexed.
+        index->count = header->config_count <= CONFIG_CACHE_MAX_CONFIGS ? header->config_count : 0;
+    }
+
+    for (uint32_t i = 0; i < header->config_count; i++) {
+        uint32_t length;
+        if (fread(&length, sizeof(length), 1, file) != 1 || length > header->total_size) {
+            return false;
+        }
+
+        if (index != NULL && i < index->count) {
+            index->configs[i] = (config_cache_range_t) { .offset = (uint32_t) ftell(file), .length = length };
+        }
+
+        if (!run_actions(file, length, NULL, 0) || !skip(file, ID_SIZE + NAME_SIZE)) {
+            return false;
+        }
+    }
+
+    return ftell(file) == (long) header->total_size
+        && fseek(file, 0, SEEK_END) == 0
+        && ftell(file) == (long) header->total_size
+        && fseek(file, sizeof(file_header_t), SEEK_SET) == 0;
+}
+
+bool config_cache_replay(FILE* file, const config_cache_key_t* key, const config_sink_t* const sink,
+                         int target_index, config_cache_index_t* index) {
+    file_header_t header;
+    if (fseek(file, 0, SEEK_SET) != 0
+        || fread(&header, sizeof(header), 1, file) != 1
+        || header.magic != CACHE_MAGIC
+        || header.version != CACHE_VERSION
+        || header.options_size != sizeof(options_t)
+        || header.key.size != key->size
+        || header.key.mtime != key->mtime
+        || !check_records(file, &header, index)) {
+        return false;
+    }
+
+    if (sink == NULL) {
+        return true;
+    }
+
+    header.default_id[sizeof(header.default_id) - 1] = '\0';
+    header.search_order[sizeof(header.search_order) - 1] = '\0';
+
+    if (header.has_default && sink->on_default) {
+        sink->on_default(sink->context, header.default_id);
+    }
+    if (header.has_search_order && sink->on_search_order) {
+        sink->on_search_order(sink->context, header.search_order);
+    }
+
+    for (uint32_t i = 0; i < header.config_count; i++) {
+        if (sink->on_enter_config) {
+            sink->on_enter_config(sink->context);
+        }
+
+        // The records were checked above, so only a read error can fail here.
+        uint32_t length;
+        vet(fread(&length, sizeof(length), 1, file) == 1, "config: cannot read compiled config");
+
+        const bool ok = (sink->setup != NULL && (int) i == target_index)
+            ? run_actions(file, length, sink->setup, 0)
+            : skip(file, length);
+
+        char id[ID_SIZE];
+        char name[NAME_SIZE];
+        vet(ok && fread(id, sizeof(id), 1, file) == 1 && fread(name, sizeof(name), 1, file) == 1,
+            "config: cannot read compiled config");
+        id[sizeof(id) - 1] = '\0';
+        name[sizeof(name) - 1] = '\0';
+
+        if (sink->on_exit_config) {
+            sink->on_exit_config(sink->context, id, name);
+        }
+    }
+
+    return true;
+}
+
+bool config_cache_run(FILE* file, const config_cache_index_t* index, int target_index,
+                      const setup_sink_t* const setup) {
+    if (target_index < 0 || (uint32_t) target_index >= index->count) {
+        return false;
+    }
+
+    const config_cache_range_t* const range = &index->configs[target_index];
+    if (fseek(file, (long) range->offset, SEEK_SET) != 0) {
+        return false;
+    }
+
+    // The records were checked when the file was indexed, so only a read error
+    // can fail here, after some actions may have run. Falling back to the YAML
+    // would run those actions twice.
+    vet(run_actions(file, range->length, setup, 0), "config: cannot read compiled config");
+    return true;
+}
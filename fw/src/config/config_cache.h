@@ -0,0 +1,119 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "config/config.h"
+
+// Compiled form of config.yaml. Parsing the YAML with libyaml is the slowest
+// part of showing the boot menu and applying a config, and it happens twice
+// per boot (once to list the configs, once to run the selected one).
+//
+// While parse_config_file_compiled() parses the YAML, it also writes each
+// config's setup actions as a flat list of binary records (file paths and
+// patch bytes inline, both branches of each 'if'). config_cache_replay()
+// later invokes the same sink callbacks from the compiled file without
+// touching the YAML. The cache is keyed by the YAML file's size and
+// modification time; if it does not match, the caller parses the YAML again
+// (with the parser's usual error reporting) and recompiles.
+//
+// The boot menu lists the configs with config_cache_replay(), which also
+// records where each config's actions start. The selected config is then
+// applied with config_cache_run() from the same open file, so config.yaml is
+// read only once per boot.
+
+// Configuration: most configs whose position is indexed for
+// config_cache_run().
+#ifndef CONFIG_CACHE_MAX_CONFIGS
+#define CONFIG_CACHE_MAX_CONFIGS 32
+#endif
+
+// Configuration: deepest nesting of 'if' branches that can be compiled.
+#ifndef CONFIG_CACHE_MAX_DEPTH
+#define CONFIG_CACHE_MAX_DEPTH 8
+#endif
+
+typedef struct {
+    uint32_t size;
+    uint32_t mtime;                 // FAT date << 16 | FAT time
+} config_cache_key_t;
+
+// Where a config's setup actions are in the compiled file.
+typedef struct {
+    uint32_t offset;
+    uint32_t length;
+} config_cache_range_t;
+
+typedef struct {
+    uint32_t count;                 // 0 if the file has more than CONFIG_CACHE_MAX_CONFIGS
+    config_cache_range_t configs[CONFIG_CACHE_MAX_CONFIGS];
+} config_cache_index_t;
+
+// Compiler state, owned by the caller of parse_config_file_compiled().
+typedef struct {
+    FILE* file;
+    bool ok;                        // False once anything could not be compiled
+    uint32_t config_count;
+    long config_start;              // Offset of the current config's length field
+    long branch_start[CONFIG_CACHE_MAX_DEPTH];
+    int depth;
+    bool has_default;
+    char default_id[41];
+    bool has_search_order;
+    char search_order[41];
+} config_cache_writer_t;
+
+// Like parse_config_file(), but also compile every config (not only
+// 'target_index') into 'writer', which must have been started with
+// config_cache_write_begin(). Both branches of each 'if' are compiled, while
+// only the branch that applies invokes 'sink'.
+void parse_config_file_compiled(const char* filename, const config_sink_t* const sink, int target_index,
+                                config_cache_writer_t* writer);
+
+// Start compiling to 'file' (opened "w+b"), which must be positioned at 0.
+void config_cache_write_begin(config_cache_writer_t* writer, FILE* file);
+
+// Finish the file. Returns false if the config could not be compiled or a
+// write failed, in which case the file must be discarded.
+bool config_cache_write_end(config_cache_writer_t* writer, const config_cache_key_t* key);
+
+// Called by the parser as it encounters each element.
+void config_cache_write_default(config_cache_writer_t* writer, const char* id);
+void config_cache_write_search_order(config_cache_writer_t* writer, const char* order);
+void config_cache_write_enter_config(config_cache_writer_t* writer);
+void config_cache_write_exit_config(config_cache_writer_t* writer, const char* id, const char* name);
+void config_cache_write_load(config_cache_writer_t* writer, const char* filename, uint32_t address, const uint32_t* crc);
+void config_cache_write_patch(config_cache_writer_t* writer, uint32_t address, const binary_t* binary);
+void config_cache_write_copy(config_cache_writer_t* writer, uint32_t source, uint32_t destination, uint32_t length);
+void config_cache_write_set_options(config_cache_writer_t* writer, const options_t* options);
+void config_cache_write_fix_checksum(config_cache_writer_t* writer, uint32_t start_addr, uint32_t end_addr,
+                                     uint32_t fix_addr, uint32_t checksum);
+
+// Actions between begin and end run only if the keyboard model being
+// graphics equals 'graphics' (i.e., 'then' of 'if: graphics' passes true,
+// 'else' passes false).
+void config_cache_write_branch_begin(config_cache_writer_t* writer, bool graphics);
+void config_cache_write_branch_end(config_cache_writer_t* writer);
+
+// Invoke 'sink' from the compiled config in 'file' exactly as
+// parse_config_file() would for the YAML it was compiled from. Returns false
+// without invoking any callbacks if 'file' is not a complete compiled config
+// for 'key' (from this firmware version), or if any record in it is damaged.
+//
+// If 'index' is not NULL, it receives the position of each config's actions
+// for config_cache_run(). 'sink' may be NULL to only check and index the file.
+bool config_cache_replay(FILE* file, const config_cache_key_t* key, const config_sink_t* const sink,
+                         int target_index, config_cache_index_t* index);
+
+// Run just the setup actions of config 'target_index', using the 'index'
+// filled in by config_cache_replay() for the same open file. This lets the
+// boot menu apply the selected config without walking the rest of the file.
+// Returns false, before invoking any callbacks, if the config is not in the
+// index or its actions cannot be found. Fatal if the file cannot be read once
+// actions have started to run.
+bool config_cache_run(FILE* file, const config_cache_index_t* index, int target_index,
+                      const setup_sink_t* const setup);
@@ -6,8 +6,10 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include "ieee/ieee.h"
 #include "system_state.h"
 #include "tape.h"
+#include "term_inject.h"
 
 typedef struct binary_s {
     uint8_t* data;
@@ -22,9 +24,17 @@ typedef struct options_s {
     char usb_keymap[261];    // USB keymap file path (empty = use default)
     tape_config_t tape;      // Virtual tape config blob (all zeros = disabled)
     bool tape_enabled;       // True if 'tape' key was present in config.yaml
+    tape_save_config_t tape_save; // Virtual tape SAVE hook (requires 'tape')
+    bool tape_save_enabled;  // True if 'tape-save' key was present in config.yaml
+    key_buffer_config_t key_buffer; // KERNAL keyboard queue location (for bulk paste)
+    bool key_buffer_enabled; // True if 'key-buffer' key was present in config.yaml
+    ieee_config_t ieee;      // KERNAL IEEE-488 hooks for the emulated disk drive
+    bool ieee_enabled;       // True if 'ieee' key was present in config.yaml
 } options_t;
 
-typedef void (*on_load_fn_t)(void* user_data, const char* filename, uint32_t address);
+// 'crc' is the expected CRC-32 of the file (after decompression), or NULL if
+// the 'load' entry has none.
+typedef void (*on_load_fn_t)(void* user_data, const char* filename, uint32_t address, const uint32_t* crc);
 typedef void (*on_patch_fn_t)(void* user_data, uint32_t address, const binary_t* binary);
 typedef void (*on_copy_fn_t)(void* user_data, uint32_t source, uint32_t destination, uint32_t length);
 typedef void (*on_set_options_fn_t)(void* user_data, options_t* options);
@@ -0,0 +1,35 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#include "crc.h"
+
+uint16_t crc16_update(uint16_t crc, const uint8_t* data, size_t length) {
+    while (length--) {
+        crc ^= (uint16_t) (*data++ << 8);
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000)
+                ? (uint16_t) ((crc << 1) ^ 0x1021)
+                : (uint16_t) (crc << 1);
+        }
+    }
+    return crc;
+}
+
+uint32_t crc32_update(uint32_t crc, const uint8_t* data, size_t length) {
+    // Reflected polynomial 0x04C11DB7, processed a nibble at a time to keep
+    // the table small.
+    static const uint32_t table[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC,
+        0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+        0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+    };
+
+    crc = ~crc;
+    while (length--) {
+        crc ^= *data++;
+        crc = (crc >> 4) ^ table[crc & 0x0F];
+        crc = (crc >> 4) ^ table[crc & 0x0F];
+    }
+    return ~crc;
+}
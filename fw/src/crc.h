@@ -0,0 +1,23 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Initial value for a CRC-16/CCITT-FALSE computation.
+#define CRC16_INIT 0xFFFF
+
+// Update a CRC-16/CCITT-FALSE (poly 0x1021, no reflection, no final XOR) with
+// 'length' bytes of 'data'. Pass CRC16_INIT for the first block and the
+// previous result for subsequent blocks.
+uint16_t crc16_update(uint16_t crc, const uint8_t* data, size_t length);
+
+// Initial value for a CRC-32 computation.
+#define CRC32_INIT 0
+
+// Update a CRC-32 (IEEE 802.3, as used by zlib and PNG) with 'length' bytes of
+// 'data'. Pass CRC32_INIT for the first block and the previous result for
+// subsequent blocks. Each result is the finished CRC of the data so far.
+uint32_t crc32_update(uint32_t crc, const uint8_t* data, size_t length);
@@ -0,0 +1,53 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#include "pch.h"
+#include "crc_sniff.h"
+
+// The sniffer watches a DMA channel that reads the data and writes every
+// byte to the same dummy word. In CRC32R mode it reflects each byte as it
+// arrives; reversing and inverting the result when read then gives the
+// reflected CRC-32 (seeded with all ones) that crc32_update() computes.
+
+static int channel = -1;
+static uint8_t sink;
+
+void crc_sniff_begin(void) {
+    if (channel < 0) {
+        channel = dma_claim_unused_channel(/* required: */ true);
+    }
+
+    dma_sniffer_enable((uint) channel, DMA_SNIFF_CTRL_CALC_VALUE_CRC32R, /* force_channel_enable: */ false);
+    dma_sniffer_set_output_reverse_enabled(true);
+    dma_sniffer_set_output_invert_enabled(true);
+    dma_sniffer_set_data_accumulator(0xFFFFFFFF);
+}
+
+void crc_sniff_start(const uint8_t* data, size_t length) {
+    if (length == 0) {
+        return;
+    }
+
+    dma_channel_config config = dma_channel_get_default_config((uint) channel);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_8);
+    channel_config_set_read_increment(&config, true);
+    channel_config_set_write_increment(&config, false);
+    channel_config_set_sniff_enable(&config, true);
+    dma_channel_configure(
+        (uint) channel, &config,
+        &sink,                              // Write address (discarded)
+        data,                               // Read address
+        length,                             // Transfer count
+        /* trigger: */ true);
+}
+
+void crc_sniff_wait(void) {
+    dma_channel_wait_for_finish_blocking((uint) channel);
+}
+
+uint32_t crc_sniff_end(void) {
+    crc_sniff_wait();
+    const uint32_t crc = dma_sniffer_get_data_accumulator();
+    dma_sniffer_disable();
+    return crc;
+}
@@ -0,0 +1,25 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// CRC-32 (the same as crc32_update()) computed by the RP2040's DMA sniffer,
+// so that the CPU can do something else with the data in the meantime (e.g.,
+// write it to the FPGA). There is one sniffer, so only one CRC can be in
+// progress at a time.
+
+void crc_sniff_begin(void);
+
+// Start adding 'length' bytes at 'data' to the CRC. 'data' must not change
+// until crc_sniff_wait() returns.
+void crc_sniff_start(const uint8_t* data, size_t length);
+
+// Wait for the bytes passed to crc_sniff_start() to be added.
+void crc_sniff_wait(void);
+
+// Return the CRC-32 of all the bytes passed to crc_sniff_start() since
+// crc_sniff_begin().
+uint32_t crc_sniff_end(void);
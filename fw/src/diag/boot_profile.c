@@ -0,0 +1,161 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#include "pch.h"
+#include "boot_profile.h"
+
+#include <inttypes.h>
+
+_Static_assert(BOOT_PROFILE_PHASES <= INT8_MAX, "phase indices must fit in 'parent'");
+
+static struct {
+    bool finished;
+    uint64_t ready_us;
+    unsigned int count;
+    uint32_t dropped;
+    boot_phase_t phases[BOOT_PROFILE_PHASES];
+
+    // Open phases, innermost last. -1 for a phase that was dropped, so that
+    // its boot_phase_end() still pairs with it.
+    int8_t open[BOOT_PROFILE_MAX_DEPTH];
+    unsigned int depth;
+    unsigned int open_dropped;          // Dropped phases nested deeper than 'open' holds
+} profile;
+
+// Add a phase nested within the innermost open phase, or return NULL (counting
+// it as dropped) if there is no room.
+static boot_phase_t* add_phase(const char* name, const char* detail) {
+    if (profile.depth == BOOT_PROFILE_MAX_DEPTH || profile.count == BOOT_PROFILE_PHASES) {
+        profile.dropped++;
+        return NULL;
+    }
+
+    boot_phase_t* const phase = &profile.phases[profile.count++];
+    phase->name = name;
+    snprintf(phase->detail, sizeof(phase->detail), "%s", detail != NULL ? detail : "");
+    phase->parent = profile.depth > 0 ? profile.open[profile.depth - 1] : -1;
+    phase->depth = (uint8_t) profile.depth;
+    phase->start_us = 0;
+    phase->end_us = 0;
+    return phase;
+}
+
+void boot_phase_begin(const char* name, const char* detail) {
+    if (profile.finished) {
+        return;
+    }
+
+    if (profile.depth == BOOT_PROFILE_MAX_DEPTH) {
+        profile.open_dropped++;
+        profile.dropped++;
+        return;
+    }
+
+    boot_phase_t* const phase = add_phase(name, detail);
+    profile.open[profile.depth++] = phase != NULL ? (int8_t) (phase - profile.phases) : -1;
+    if (phase != NULL) {
+        phase->start_us = time_us_64();
+    }
+}
+
+void boot_phase_end(void) {
+    const uint64_t now = time_us_64();
+
+    if (profile.finished) {
+        return;
+    }
+
+    if (profile.open_dropped > 0) {
+        profile.open_dropped--;
+        return;
+    }
+
+    if (profile.depth == 0) {
+        return;         // Unbalanced
+    }
+
+    const int8_t index = profile.open[--profile.depth];
+    if (index >= 0) {
+        profile.phases[index].end_us = now;
+    }
+}
+
+void boot_phase_add(const char* name, const char* detail, uint64_t start_us, uint64_t end_us) {
+    if (profile.finished) {
+        return;
+    }
+
+    boot_phase_t* const phase = add_phase(name, detail);
+    if (phase != NULL) {
+        phase->start_us = start_us;
+        phase->end_us = end_us;
+    }
+}
+
+void boot_profile_finish(void) {
+    if (!profile.finished) {
+        profile.ready_us = time_us_64();
+        profile.finished = true;
+    }
+}
+
+void boot_profile_reset(void) {
+    memset(&profile, 0, sizeof(profile));
+}
+
+uint64_t boot_profile_ready_us(void) {
+    return profile.ready_us;
+}
+
+unsigned int boot_profile_count(void) {
+    return profile.count;
+}
+
+const boot_phase_t* boot_profile_get(unsigned int index) {
+    return index < profile.count ? &profile.phases[index] : NULL;
+}
+
+uint32_t boot_profile_dropped(void) {
+    return profile.dropped;
+}
+
+// As snprintf() at 'length' in 'out', adding the length of the output (even
+// if truncated) to 'length'.
+static void append(char* out, size_t size, int* length, const char* format, ...) {
+    const size_t offset = (size_t) *length < size ? (size_t) *length : size;
+
+    va_list args;
+    va_start(args, format);
+    *length += vsnprintf(&out[offset], size - offset, format, args);
+    va_end(args);
+}
+
+static void append_path(int index, char* out, size_t size, int* length) {
+    const boot_phase_t* const phase = &profile.phases[index];
+    if (phase->parent >= 0) {
+        append_path(phase->parent, out, size, length);
+        append(out, size, length, "/");
+    }
+
+    append(out, size, length, "%s", phase->name);
+    if (phase->detail[0] != '\0') {
+        append(out, size, length, "[%s]", phase->detail);
+    }
+}
+
+int boot_profile_format(unsigned int index, char* out, size_t size) {
+    int length = 0;
+    const boot_phase_t* const phase = boot_profile_get(index);
+    if (phase == NULL) {
+        append(out, size, &length, "%s", "");
+        return length;
+    }
+
+    if (phase->end_us != 0) {
+        append(out, size, &length, "%" PRIu64 "\t%" PRIu64 "\t", phase->start_us, phase->end_us - phase->start_us);
+    } else {
+        append(out, size, &length, "%" PRIu64 "\t-1\t", phase->start_us);
+    }
+    append_path((int) index, out, size, &length);
+    return length;
+}
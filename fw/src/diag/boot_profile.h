@@ -0,0 +1,87 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Boot phase profiler. The phases of booting (initializing each subsystem,
+// configuring the FPGA, reading config.yaml, loading each ROM, resetting the
+// PET) are stamped with time_us_64() into a table of their own, apart from
+// the log rings (which wrap), so the 'boot' serial console command can show
+// where the time between power-on and the PET running went.
+//
+// Phases nest: a phase begun while another is open is its child. Recording
+// needs no initialization (so it covers the time before log_init()) and stops
+// at boot_profile_finish(), after which begin/end cost only a branch.
+//
+// boot_profile_format() writes each phase as one line of text keyed by its
+// path rather than its position, so 'tools/host' 'bootdiff' can compare the
+// exports of two firmware versions.
+
+// Configuration: most phases recorded. Later phases are counted as dropped.
+#ifndef BOOT_PROFILE_PHASES
+#define BOOT_PROFILE_PHASES 48
+#endif
+
+// Configuration: longest detail (e.g., a file name) kept with a phase,
+// including the NUL.
+#ifndef BOOT_PROFILE_DETAIL_LENGTH
+#define BOOT_PROFILE_DETAIL_LENGTH 32
+#endif
+
+// Configuration: deepest nesting of phases.
+#ifndef BOOT_PROFILE_MAX_DEPTH
+#define BOOT_PROFILE_MAX_DEPTH 6
+#endif
+
+// First line of an export. The number is the format version.
+#define BOOT_PROFILE_EXPORT_HEADER "# econopet boot profile 1"
+
+typedef struct {
+    const char* name;                           // Static string
+    char detail[BOOT_PROFILE_DETAIL_LENGTH];    // "" if none
+    int8_t parent;                              // Index of the enclosing phase, or -1
+    uint8_t depth;                              // 0 for a top-level phase
+    uint64_t start_us;                          // time_us_64() (i.e., since reset)
+    uint64_t end_us;                            // 0 while the phase is open
+} boot_phase_t;
+
+// Begin a phase named 'name' (which must be a static string), nested within
+// the innermost open phase. 'detail' may be NULL.
+void boot_phase_begin(const char* name, const char* detail);
+
+// End the innermost open phase.
+void boot_phase_end(void);
+
+// Record a phase that has already run from 'start_us' to 'end_us' (e.g., on
+// core1, which must not call boot_phase_begin()), nested within the innermost
+// open phase.
+void boot_phase_add(const char* name, const char* detail, uint64_t start_us, uint64_t end_us);
+
+// Stop recording, noting the time the PET started running.
+void boot_profile_finish(void);
+
+// Discard all phases and start recording again (for tests).
+void boot_profile_reset(void);
+
+// Time passed to boot_profile_finish(), or 0 while still booting.
+uint64_t boot_profile_ready_us(void);
+
+unsigned int boot_profile_count(void);
+const boot_phase_t* boot_profile_get(unsigned int index);
+
+// Phases not recorded because the table was full or nesting too deep.
+uint32_t boot_profile_dropped(void);
+
+// Write phase 'index' to 'out' as one export line (without a line ending):
+//
+//   <start us> TAB <duration us> TAB <path>
+//
+// where <path> is the names of the phase's ancestors and itself separated by
+// '/', each followed by its detail in brackets if it has one (e.g.,
+// "menu/config:apply/load[/roms/basic-4.bin]"). An open phase has a duration
+// of -1. Returns the length of the line as snprintf() does.
+int boot_profile_format(unsigned int index, char* out, size_t size);
@@ -7,7 +7,10 @@
 #include "char_encoding.h"
 #include "driver.h"
 #include "dvi/dvi.h"
+#include "fatal.h"
+#include "screen_stream.h"
 #include "system_state.h"
+#include "uart/uart_tx.h"
 
 // Terminal escape sequences
 static const char* const term_home = "\e[H";
@@ -76,6 +79,48 @@ void display_term_refresh(void) {
     display_term_render();
 }
 
+// Encoder state for term_mode_stream (allocated only while streaming).
+static screen_stream_encoder_t* stream_encoder = NULL;
+
+void display_stream_begin(void) {
+    if (stream_encoder == NULL) {
+        stream_encoder = vetted_malloc(sizeof(screen_stream_encoder_t));
+    }
+    screen_stream_encoder_init(stream_encoder);
+}
+
+void display_stream_end(void) {
+    free(stream_encoder);
+    stream_encoder = NULL;
+}
+
+static void display_stream_write(void* context, const uint8_t* data, size_t length) {
+    (void)context;
+    uart_tx_write_all(data, length);
+}
+
+static void display_stream_frame(void) {
+    uint8_t flags = 0;
+    if (system_state.video_graphics) {
+        flags |= SCREEN_STREAM_FLAG_GRAPHICS;
+    }
+    if (system_state.pet_display_columns == pet_display_columns_80) {
+        flags |= SCREEN_STREAM_FLAG_80_COLUMNS;
+    }
+    if (system_state.video_ram_mask & 0b10) {
+        flags |= SCREEN_STREAM_FLAG_COLOUR;
+    }
+
+    const screen_stream_frame_t frame = {
+        .screen = system_state.video_char_buffer,
+        .length = (uint16_t) system_state.video_ram_bytes,
+        .crtc = system_state.pet_crtc_registers,
+        .flags = flags,
+    };
+
+    screen_stream_encode(stream_encoder, &frame, display_stream_write, NULL);
+}
+
 void display_task(void) {
     // Local pointer to avoid repeated struct member access
     uint8_t* const video_char_buffer = system_state.video_char_buffer;
@@ -91,9 +136,13 @@ void display_task(void) {
     
     // HDMI DVI core continuously reads video_char_buffer - no action needed
     
-    // Render to terminal if in video mode (not in CLI or log mode)
-    if (system_state.term_mode == term_mode_video) {
+    // Render to terminal if in video mode (not in CLI or log mode). Skip the
+    // frame while the previous one is still draining so a slow serial link
+    // drops frames instead of stalling the main loop.
+    if (system_state.term_mode == term_mode_video && uart_tx_pending() == 0) {
         display_term_render();
+    } else if (system_state.term_mode == term_mode_stream && uart_tx_pending() == 0) {
+        display_stream_frame();
     }
 }
 
@@ -20,6 +20,10 @@ void display_term_begin(void);   // Enter alternate screen, hide cursor
 void display_term_end(void);     // Exit alternate screen, show cursor
 void display_term_refresh(void); // Immediately render video buffer to terminal
 
+// Binary screen stream for the host viewer (see screen_stream.h)
+void display_stream_begin(void); // Allocate encoder, next frame is a keyframe
+void display_stream_end(void);   // Release encoder
+
 // Window-based terminal display (for fatal/config error display)
 void display_window_begin(const window_t* window);   // Enter alternate screen, fill window
 void display_window_show(const window_t* window);    // Render window to terminal
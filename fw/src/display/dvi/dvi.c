@@ -4,6 +4,7 @@
 #include "pch.h"
 #include "dvi.h"
 
+#include "boot_core1.h"
 #include "crtc.h"
 #include "pet.h"
 #include "roms/roms.h"
@@ -287,6 +288,10 @@ static inline void __not_in_flash_func(prepare_scanline)(uint16_t y) {
 // Tight loop mode: core1 iterates through all scanlines per frame in a loop,
 // similar to the PicoDVI colour_terminal demo. No interrupt-driven callbacks.
 static void __not_in_flash_func(core1_main)() {
+    // Let core 0 pause this core while it writes the SD file cache to flash
+    // (see sd_cache.h). The display glitches briefly on a cache miss.
+    flash_safe_execute_core_init();
+
     dvi_register_irqs_this_core(&dvi0, DMA_IRQ_0);
     sem_acquire_blocking(&dvi_start_sem);
     dvi_start(&dvi0);
@@ -309,6 +314,10 @@ static void __not_in_flash_func(core1_scanline_callback)() {
 }
 
 static void __not_in_flash_func(core1_main)() {
+    // Let core 0 pause this core while it writes the SD file cache to flash
+    // (see sd_cache.h).
+    flash_safe_execute_core_init();
+
     dvi_register_irqs_this_core(&dvi0, DMA_IRQ_0);
     sem_acquire_blocking(&dvi_start_sem);
     dvi_start(&dvi0);
@@ -364,6 +373,7 @@ void video_init() {
 
     sem_init(&dvi_start_sem, /* initial_permits: */ 0, /* max_permits: */ 1);
     hw_set_bits(&bus_ctrl_hw->priority, BUSCTRL_BUS_PRIORITY_PROC1_BITS);
+    boot_core1_release();   // Core1 must have finished any boot work (see boot_core1.h)
     multicore_launch_core1(core1_main);
     sem_release(&dvi_start_sem);
 }
@@ -0,0 +1,294 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#include "screen_stream.h"
+
+#include <assert.h>
+#include <string.h>
+
+#include "crc.h"
+
+// Longest literal or repeat run a single RLE control byte can describe.
+#define RLE_MAX_RUN 128
+
+// Output sink that tracks the frame CRC and byte count. 'write' is NULL when
+// only measuring the payload size.
+typedef struct {
+    screen_stream_write_fn_t write;
+    void* context;
+    uint16_t crc;
+    size_t count;
+} emitter_t;
+
+static void emit(emitter_t* out, const uint8_t* data, size_t length) {
+    if (out->write != NULL) {
+        out->crc = crc16_update(out->crc, data, length);
+        out->write(out->context, data, length);
+    }
+    out->count += length;
+}
+
+// Source byte 'i' of the frame being encoded: the screen itself for a
+// keyframe, or the XOR with the previous screen for a delta.
+static inline uint8_t source_byte(const uint8_t* screen, const uint8_t* reference, size_t i) {
+    return reference != NULL
+        ? (uint8_t) (screen[i] ^ reference[i])
+        : screen[i];
+}
+
+// PackBits-style RLE. Runs of 3 or more identical bytes become a repeat
+// record. Everything else is gathered into literal records.
+static void rle_encode(const uint8_t* screen, const uint8_t* reference, size_t length, emitter_t* out) {
+    size_t i = 0;
+
+    while (i < length) {
+        const uint8_t value = source_byte(screen, reference, i);
+        size_t run = 1;
+        while (i + run < length && run < RLE_MAX_RUN && source_byte(screen, reference, i + run) == value) {
+            run++;
+        }
+
+        if (run >= 3) {
+            const uint8_t record[2] = { (uint8_t) (257 - run), value };
+            emit(out, record, sizeof(record));
+            i += run;
+            continue;
+        }
+
+        // Gather literals until the next run of 3 (or the record is full).
+        uint8_t literal[1 + RLE_MAX_RUN];
+        size_t count = 0;
+        while (i < length && count < RLE_MAX_RUN) {
+            const uint8_t b = source_byte(screen, reference, i);
+            if (i + 2 < length
+                && source_byte(screen, reference, i + 1) == b
+                && source_byte(screen, reference, i + 2) == b) {
+                break;
+            }
+            literal[1 + count++] = b;
+            i++;
+        }
+
+        literal[0] = (uint8_t) (count - 1);
+        emit(out, literal, 1 + count);
+    }
+}
+
+void screen_stream_encoder_init(screen_stream_encoder_t* encoder) {
+    memset(encoder, 0, sizeof(*encoder));
+    encoder->need_keyframe = true;
+}
+
+void screen_stream_request_keyframe(screen_stream_encoder_t* encoder) {
+    encoder->need_keyframe = true;
+}
+
+size_t screen_stream_encode(screen_stream_encoder_t* encoder, const screen_stream_frame_t* frame,
+                            screen_stream_write_fn_t write, void* context) {
+    assert(frame->length <= SCREEN_STREAM_MAX_SCREEN);
+
+    const bool geometry_changed = frame->length != encoder->previous_length
+        || frame->flags != encoder->previous_flags
+        || memcmp(frame->crtc, encoder->previous_crtc, SCREEN_STREAM_CRTC_REGS) != 0;
+
+    const bool keyframe = encoder->need_keyframe
+        || geometry_changed
+        || ++encoder->calls_since_keyframe >= SCREEN_STREAM_KEYFRAME_INTERVAL;
+
+    if (!keyframe && memcmp(frame->screen, encoder->previous, frame->length) == 0) {
+        return 0;   // Nothing changed since the last frame
+    }
+
+    const uint8_t* const reference = keyframe ? NULL : encoder->previous;
+
+    // Measure the payload first so the header can carry its length without
+    // buffering the whole frame.
+    emitter_t measure = { 0 };
+    rle_encode(frame->screen, reference, frame->length, &measure);
+    const size_t payload_length = measure.count;
+
+    uint8_t header[SCREEN_STREAM_HEADER_SIZE] = {
+        SCREEN_STREAM_MAGIC_0,
+        SCREEN_STREAM_MAGIC_1,
+        keyframe ? SCREEN_STREAM_KEYFRAME : SCREEN_STREAM_DELTA,
+        encoder->sequence,
+        frame->flags,
+        0,
+        (uint8_t) frame->length, (uint8_t) (frame->length >> 8),
+        (uint8_t) payload_length, (uint8_t) (payload_length >> 8),
+    };
+    memcpy(&header[10], frame->crtc, SCREEN_STREAM_CRTC_REGS);
+
+    // The magic is excluded from the CRC.
+    write(context, header, 2);
+    emitter_t out = { .write = write, .context = context, .crc = CRC16_INIT, .count = 2 };
+    emit(&out, &header[2], sizeof(header) - 2);
+    rle_encode(frame->screen, reference, frame->length, &out);
+
+    const uint8_t trailer[SCREEN_STREAM_CRC_SIZE] = { (uint8_t) out.crc, (uint8_t) (out.crc >> 8) };
+    write(context, trailer, sizeof(trailer));
+    out.count += sizeof(trailer);
+
+    memcpy(encoder->previous, frame->screen, frame->length);
+    memcpy(encoder->previous_crtc, frame->crtc, SCREEN_STREAM_CRTC_REGS);
+    encoder->previous_length = frame->length;
+    encoder->previous_flags = frame->flags;
+    encoder->sequence++;
+
+    if (keyframe) {
+        encoder->need_keyframe = false;
+        encoder->calls_since_keyframe = 0;
+    }
+
+    return out.count;
+}
+
+void screen_stream_decoder_init(screen_stream_decoder_t* decoder) {
+    memset(decoder, 0, sizeof(*decoder));
+}
+
+// Discard the first 'count' buffered bytes, then skip ahead to the next
+// candidate magic so a frame that starts inside rejected data is not lost.
+static void decoder_discard(screen_stream_decoder_t* decoder, size_t count) {
+    while (count < decoder->received && decoder->frame[count] != SCREEN_STREAM_MAGIC_0) {
+        count++;
+    }
+
+    decoder->received -= count;
+    memmove(decoder->frame, &decoder->frame[count], decoder->received);
+    decoder->expected = 0;
+}
+
+static uint16_t read_u16(const uint8_t* p) {
+    return (uint16_t) (p[0] | (p[1] << 8));
+}
+
+// Expand the RLE payload into 'decoder->screen' (XOR-ing for deltas).
+// Returns false if the payload is malformed.
+static bool rle_decode(screen_stream_decoder_t* decoder, const uint8_t* payload, size_t payload_length,
+                       size_t screen_length, bool delta) {
+    size_t in = 0;
+    size_t out = 0;
+
+    while (in < payload_length) {
+        const uint8_t control = payload[in++];
+
+        if (control < 128) {
+            const size_t count = (size_t) control + 1;
+            if (in + count > payload_length || out + count > screen_length) {
+                return false;
+            }
+            for (size_t i = 0; i < count; i++) {
+                decoder->screen[out] = delta ? (uint8_t) (decoder->screen[out] ^ payload[in]) : payload[in];
+                out++;
+                in++;
+            }
+        } else if (control > 128) {
+            const size_t count = 257 - (size_t) control;
+            if (in >= payload_length || out + count > screen_length) {
+                return false;
+            }
+            const uint8_t value = payload[in++];
+            for (size_t i = 0; i < count; i++) {
+                decoder->screen[out] = delta ? (uint8_t) (decoder->screen[out] ^ value) : value;
+                out++;
+            }
+        }
+    }
+
+    return out == screen_length;
+}
+
+// Validate and apply the complete frame in 'decoder->frame'.
+static bool decoder_apply(screen_stream_decoder_t* decoder) {
+    const uint8_t* const frame = decoder->frame;
+    const uint8_t type = frame[2];
+    const uint8_t sequence = frame[3];
+    const uint16_t screen_length = read_u16(&frame[6]);
+    const uint16_t payload_length = read_u16(&frame[8]);
+    const size_t crc_offset = SCREEN_STREAM_HEADER_SIZE + payload_length;
+
+    const uint16_t crc = crc16_update(CRC16_INIT, &frame[2], crc_offset - 2);
+    if (crc != read_u16(&frame[crc_offset])) {
+        decoder->crc_errors++;
+        decoder->synced = false;
+        return false;
+    }
+
+    const bool delta = type == SCREEN_STREAM_DELTA;
+    if (delta && (!decoder->synced
+                  || sequence != (uint8_t) (decoder->sequence + 1)
+                  || screen_length != decoder->length)) {
+        // A frame was lost. Deltas are meaningless until the next keyframe.
+        decoder->skipped++;
+        decoder->synced = false;
+        return false;
+    }
+
+    if (!rle_decode(decoder, &frame[SCREEN_STREAM_HEADER_SIZE], payload_length, screen_length, delta)) {
+        decoder->crc_errors++;
+        decoder->synced = false;
+        return false;
+    }
+
+    decoder->length = screen_length;
+    decoder->flags = frame[4];
+    memcpy(decoder->crtc, &frame[10], SCREEN_STREAM_CRTC_REGS);
+    decoder->sequence = sequence;
+    decoder->synced = true;
+    decoder->frames++;
+    return true;
+}
+
+static bool header_is_valid(const uint8_t* frame) {
+    const uint8_t type = frame[2];
+    const uint16_t screen_length = read_u16(&frame[6]);
+    const uint16_t payload_length = read_u16(&frame[8]);
+
+    return (type == SCREEN_STREAM_KEYFRAME || type == SCREEN_STREAM_DELTA)
+        && screen_length <= SCREEN_STREAM_MAX_SCREEN
+        && payload_length <= SCREEN_STREAM_MAX_PAYLOAD(screen_length);
+}
+
+// Advance the parser over the buffered bytes. Returns true if a frame was
+// applied.
+static bool decoder_process(screen_stream_decoder_t* decoder) {
+    for (;;) {
+        if (decoder->received >= 2 && decoder->frame[1] != SCREEN_STREAM_MAGIC_1) {
+            decoder_discard(decoder, 1);
+            continue;
+        }
+
+        if (decoder->expected == 0) {
+            if (decoder->received < SCREEN_STREAM_HEADER_SIZE) {
+                return false;
+            }
+            if (!header_is_valid(decoder->frame)) {
+                decoder_discard(decoder, 1);
+                continue;
+            }
+            decoder->expected = SCREEN_STREAM_HEADER_SIZE + read_u16(&decoder->frame[8]) + SCREEN_STREAM_CRC_SIZE;
+        }
+
+        if (decoder->received < decoder->expected) {
+            return false;
+        }
+
+        if (decoder_apply(decoder)) {
+            decoder_discard(decoder, decoder->expected);
+            return true;
+        }
+
+        decoder_discard(decoder, 1);
+    }
+}
+
+bool screen_stream_decode_byte(screen_stream_decoder_t* decoder, uint8_t byte) {
+    // Skip bytes between frames without buffering them.
+    if (decoder->received == 0 && byte != SCREEN_STREAM_MAGIC_0) {
+        return false;
+    }
+
+    decoder->frame[decoder->received++] = byte;
+    return decoder_process(decoder);
+}
@@ -0,0 +1,129 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Binary screen stream
+ *
+ * Encodes the PET video RAM (characters plus colour RAM, when present) as a
+ * sequence of self-delimiting frames for a host-side viewer. Unlike the ANSI
+ * remote mode, the stream preserves the raw screen codes, so the viewer can
+ * render PET graphics glyphs, reverse video and colour with the real
+ * character ROM.
+ *
+ * Frame layout (multi-byte fields are little-endian):
+ *
+ *   Offset  Size  Field
+ *   0       2     Magic ($EC $50)
+ *   2       1     Type (SCREEN_STREAM_KEYFRAME or SCREEN_STREAM_DELTA)
+ *   3       1     Sequence number (increments per frame, wraps at 256)
+ *   4       1     Flags (SCREEN_STREAM_FLAG_*)
+ *   5       1     Reserved (0)
+ *   6       2     Screen length in bytes (decoded size)
+ *   8       2     Payload length in bytes
+ *   10      14    CRTC registers R0-R13
+ *   24      n     Payload
+ *   24+n    2     CRC-16/CCITT of bytes [2, 24+n)
+ *
+ * The payload is PackBits-style RLE. A control byte 'c' in 0..127 is followed
+ * by c+1 literal bytes, and 'c' in 129..255 repeats the following byte 257-c
+ * times. Keyframes encode the screen bytes directly. Delta frames encode the
+ * XOR of the screen with the previous frame, so unchanged regions collapse
+ * into long runs of zero.
+ *
+ * A decoder that misses a frame (or sees a CRC error) discards deltas until
+ * the next keyframe. The encoder emits a keyframe periodically and whenever
+ * the geometry changes, so a viewer can join an existing stream.
+ */
+
+#define SCREEN_STREAM_MAGIC_0 0xEC
+#define SCREEN_STREAM_MAGIC_1 0x50
+
+#define SCREEN_STREAM_KEYFRAME 'K'
+#define SCREEN_STREAM_DELTA    'D'
+
+#define SCREEN_STREAM_FLAG_GRAPHICS   0x01  // Mirrors system_state.video_graphics (selects the charset)
+#define SCREEN_STREAM_FLAG_80_COLUMNS 0x02  // 80 column display
+#define SCREEN_STREAM_FLAG_COLOUR     0x04  // Colour RAM follows the characters at offset $800
+
+#define SCREEN_STREAM_CRTC_REGS   14
+#define SCREEN_STREAM_HEADER_SIZE 24
+#define SCREEN_STREAM_CRC_SIZE    2
+
+// Largest screen the stream can carry (8KB, the 8296 CRTC window).
+#define SCREEN_STREAM_MAX_SCREEN 0x2000
+
+// Worst case RLE expansion is one control byte per 128 literals.
+#define SCREEN_STREAM_MAX_PAYLOAD(n) ((n) + ((n) + 127) / 128)
+
+#define SCREEN_STREAM_MAX_FRAME \
+    (SCREEN_STREAM_HEADER_SIZE + SCREEN_STREAM_MAX_PAYLOAD(SCREEN_STREAM_MAX_SCREEN) + SCREEN_STREAM_CRC_SIZE)
+
+// Configuration: number of encode calls between forced keyframes
+#ifndef SCREEN_STREAM_KEYFRAME_INTERVAL
+#define SCREEN_STREAM_KEYFRAME_INTERVAL 64
+#endif
+
+// One snapshot of the display state to encode.
+typedef struct {
+    const uint8_t* screen;      // Video RAM contents
+    uint16_t length;            // Bytes of 'screen' to send (<= SCREEN_STREAM_MAX_SCREEN)
+    const uint8_t* crtc;        // SCREEN_STREAM_CRTC_REGS registers
+    uint8_t flags;              // SCREEN_STREAM_FLAG_*
+} screen_stream_frame_t;
+
+// Sink for encoded bytes. Called several times per frame.
+typedef void (*screen_stream_write_fn_t)(void* context, const uint8_t* data, size_t length);
+
+typedef struct {
+    uint8_t previous[SCREEN_STREAM_MAX_SCREEN];     // Screen as last sent
+    uint8_t previous_crtc[SCREEN_STREAM_CRTC_REGS];
+    uint16_t previous_length;
+    uint8_t previous_flags;
+    uint8_t sequence;                               // Sequence number of the next frame
+    uint16_t calls_since_keyframe;
+    bool need_keyframe;
+} screen_stream_encoder_t;
+
+void screen_stream_encoder_init(screen_stream_encoder_t* encoder);
+
+// Force the next call to screen_stream_encode() to emit a keyframe.
+void screen_stream_request_keyframe(screen_stream_encoder_t* encoder);
+
+// Encode 'frame' and pass the bytes to 'write'. Emits a keyframe when one is
+// due, a delta frame when the screen changed, and nothing when it did not.
+// Returns the number of bytes written (0 if no frame was sent).
+size_t screen_stream_encode(screen_stream_encoder_t* encoder, const screen_stream_frame_t* frame,
+                            screen_stream_write_fn_t write, void* context);
+
+typedef struct {
+    // Most recently decoded display state.
+    uint8_t screen[SCREEN_STREAM_MAX_SCREEN];
+    uint8_t crtc[SCREEN_STREAM_CRTC_REGS];
+    uint16_t length;
+    uint8_t flags;
+
+    // Statistics
+    uint32_t frames;            // Frames applied
+    uint32_t crc_errors;        // Frames rejected by CRC
+    uint32_t skipped;           // Deltas dropped while waiting for a keyframe
+
+    // Parser state
+    uint8_t frame[SCREEN_STREAM_MAX_FRAME];
+    size_t received;            // Bytes of 'frame' received so far
+    size_t expected;            // Total frame size once the header is known
+    uint8_t sequence;           // Sequence number of the last applied frame
+    bool synced;                // True once a keyframe has been applied
+} screen_stream_decoder_t;
+
+void screen_stream_decoder_init(screen_stream_decoder_t* decoder);
+
+// Feed one byte from the stream. Returns true when the byte completes a frame
+// that was applied to 'decoder->screen'. Bytes outside a valid frame (e.g.,
+// stray console text) are skipped until the next magic.
+bool screen_stream_decode_byte(screen_stream_decoder_t* decoder, uint8_t byte);
@@ -6,8 +6,9 @@
 
 #include "display/dvi/dvi.h"
 #include "fatal.h"
-#include "global.h"
 #include "hw.h"
+#include "pool.h"
+#include "roms/rom_pages.h"
 #include "usb/keyboard.h"
 
 //                           WMd_AAAA
@@ -293,11 +294,18 @@ void spi_read(uint32_t addr, size_t byteLength, uint8_t* pDest) {
  * For sequential writes, use spi_write_at() once followed by spi_write_next()
  * to achieve 2:1 efficiency.
  * 
+ * Writes to soft-ROM ($9000-$FFFF) are reported to rom_pages_forget(). Only
+ * this byte is reported, so writes of a range should use spi_write(), which
+ * reports all of it. (The RAM test, which continues with spi_write_same(),
+ * fills the whole range with spi_fill() first.)
+ *
  * @param addr 20-bit address to write to
  * @param data Byte value to write
  * @return The byte value from the previously queued read operation (or garbage if no read was queued)
  */
 uint8_t spi_write_at(uint32_t addr, uint8_t data) {
+    rom_pages_forget(addr, 1);
+
     const uint8_t cmd = SPI_CMD_WRITE_AT | addr >> 16;
     const uint8_t addr_hi = addr >> 8;
     const uint8_t addr_lo = addr;
@@ -432,6 +440,8 @@ uint8_t spi_write_same(uint8_t data) {
  */
 void spi_write(uint32_t addr, const uint8_t* const pSrc, size_t byteLength) {
     const uint8_t* p = pSrc;
+
+    rom_pages_forget(addr, byteLength);
     
     if (byteLength--) {
         spi_write_at(addr, *p++);
@@ -506,7 +516,7 @@ void spi_write_read(uint32_t addr, const uint8_t* const pWriteSrc, uint8_t* pRea
  * value and writes entire chunks using spi_write().
  * 
  * STRATEGY:
- * 1. Acquire temporary buffer (size TEMP_BUFFER_SIZE)
+ * 1. Allocate a pool buffer (size POOL_MEDIUM_SIZE)
  * 2. Fill buffer with the repeated byte value
  * 3. Write buffer in chunks using sequential write commands
  * 4. Repeat until all bytes are written
@@ -524,9 +534,9 @@ void spi_write_read(uint32_t addr, const uint8_t* const pWriteSrc, uint8_t* pRea
  * @param byteLength Number of bytes to fill
  */
 void spi_fill(uint32_t addr, uint8_t byte, size_t byteLength) {
-    uint8_t* temp_buffer = acquire_temp_buffer();
+    uint8_t* temp_buffer = pool_alloc(POOL_MEDIUM_SIZE, "spi_fill");
     
-    size_t chunk_len = MIN(TEMP_BUFFER_SIZE, byteLength);
+    size_t chunk_len = MIN(POOL_MEDIUM_SIZE, byteLength);
     memset(temp_buffer, byte, chunk_len);
 
     int32_t remaining = byteLength;
@@ -537,7 +547,7 @@ void spi_fill(uint32_t addr, uint8_t byte, size_t byteLength) {
         chunk_len = MIN(chunk_len, remaining);
     }
 
-    release_temp_buffer(&temp_buffer);
+    pool_free(temp_buffer);
 }
 
 /**
@@ -636,6 +646,18 @@ void write_pet_model(const system_state_t* const system_state) {
     spi_write_at(REG_VIDEO, state);
 }
 
+/**
+ * Writes all CRTC registers (e.g., when restoring a snapshot).
+ * 
+ * The 6502 normally programs the CRTC itself. sync_state() reads the registers
+ * back into system_state.pet_crtc_registers.
+ * 
+ * @param registers Values for R0 through R13
+ */
+void write_crtc_registers(const uint8_t registers[CRTC_REG_COUNT]) {
+    spi_write(ADDR_CRTC, registers, CRTC_REG_COUNT);
+}
+
 /**
  * Synchronizes keyboard and video state between the RP2040 and FPGA.
  * 
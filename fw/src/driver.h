@@ -33,3 +33,4 @@ void bp_clear_halt();
 
 void read_pet_model(system_state_t* const system_state);
 void write_pet_model(const system_state_t* const system_state);
+void write_crtc_registers(const uint8_t registers[CRTC_REG_COUNT]);
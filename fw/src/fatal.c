@@ -7,7 +7,6 @@
 #include "display/display.h"
 #include "display/dvi/dvi.h"
 #include "display/window.h"
-#include "global.h"
 #include "input.h"
 #include "reset.h"
 #include "roms/roms.h"
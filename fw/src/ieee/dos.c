@@ -0,0 +1,574 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#include "dos.h"
+
+#include <limits.h>
+#include <string.h>
+
+#include "cbm/filename.h"
+#include "cbm/petscii.h"
+#include "pool.h"
+#include "tape_dir.h"
+
+// Maximum number of files in a directory listing (as for the virtual tape).
+#define DOS_DIR_MAX_ENTRIES 144
+
+// Each rendered line is at most ~32 bytes, plus the 2-byte load address.
+#define DOS_DIR_CAPACITY (DOS_DIR_MAX_ENTRIES * 32 + 64 + 2)
+
+#define DOS_DIR_LOAD_ADDR 0x0401
+
+#define DOS_DISK_NAME "ECONOPET"
+
+// Characters a written file name may not contain: wildcards and the CBM
+// drive/type separators, plus those FAT rejects.
+static const char reserved_chars[] = "*?$:\"/\\<>|,=";
+
+static void set_status_ts(dos_t* dos, unsigned int code, const char* message, unsigned int track, unsigned int sector) {
+    snprintf(dos->status, sizeof(dos->status), "%02u,%s,%02u,%02u", code, message, track, sector);
+    dos->status_length = (uint8_t) strlen(dos->status);
+    dos->status_pos = 0;
+}
+
+static void set_status(dos_t* dos, unsigned int code, const char* message) {
+    set_status_ts(dos, code, message, 0, 0);
+}
+
+static void close_channel(dos_channel_t* channel) {
+    if (channel->file != NULL) {
+        fclose(channel->file);
+    }
+    pool_free(channel->listing);
+    *channel = (dos_channel_t) { 0 };
+}
+
+void dos_init(dos_t* dos, const char* root, const dos_fs_t* fs) {
+    *dos = (dos_t) { .root = root, .fs = fs, .graphics_charset = true };
+    set_status(dos, 73, "ECONOPET DOS");
+}
+
+void dos_close_all(dos_t* dos) {
+    for (size_t i = 0; i < DOS_CHANNELS; i++) {
+        close_channel(&dos->channels[i]);
+    }
+    dos->listening = false;
+    dos->talking = false;
+    dos->opening = false;
+}
+
+// File name (or command argument) split into its parts.
+typedef struct {
+    const uint8_t* pattern;     // Raw PETSCII, without drive or options
+    uint8_t length;
+    bool overwrite;             // "@0:name"
+    char type;                  // 'P', 'S', 'U', or 0 if not given
+    char mode;                  // 'R', 'W', 'A', or 0 if not given
+} dos_name_t;
+
+// Parse "[@][[drive]:]name[,type][,mode]".
+static bool parse_name(const uint8_t* text, uint8_t length, dos_name_t* name) {
+    *name = (dos_name_t) { 0 };
+
+    uint8_t start = 0;
+    if (length > 0 && text[0] == '@') {
+        name->overwrite = true;
+        start = 1;
+    }
+
+    // Skip a drive specification ("0:" or ":").
+    for (uint8_t i = start; i < length && text[i] != ','; i++) {
+        if (text[i] == ':') {
+            start = i + 1;
+            break;
+        }
+    }
+
+    uint8_t end = start;
+    while (end < length && text[end] != ',') {
+        end++;
+    }
+    name->pattern = &text[start];
+    name->length = end - start;
+
+    // Options: ",type" and ",mode". Only the first letter counts, so ",SEQ"
+    // and ",WRITE" work too.
+    while (end < length) {
+        if (++end >= length) {
+            return false;
+        }
+
+        const char option = (char) cbm_filename_fold(text[end]);
+        switch (option) {
+            case 'P': case 'S': case 'U':
+                name->type = option;
+                break;
+            case 'R': case 'W': case 'A':
+                name->mode = option;
+                break;
+            default:
+                return false;
+        }
+
+        while (end < length && text[end] != ',') {
+            end++;
+        }
+    }
+
+    return name->length > 0 && name->length <= TAPE_DIR_MAX_NAME;
+}
+
+static char type_of_extension(const char* ext) {
+    if (ext == NULL || strlen(ext) != 4) {
+        return 0;
+    }
+
+    char lower[5];
+    for (size_t i = 0; i < 5; i++) {
+        lower[i] = (char) ((ext[i] >= 'A' && ext[i] <= 'Z') ? ext[i] + ('a' - 'A') : ext[i]);
+    }
+
+    if (strcmp(lower, ".prg") == 0) return 'P';
+    if (strcmp(lower, ".seq") == 0) return 'S';
+    if (strcmp(lower, ".usr") == 0) return 'U';
+    return 0;
+}
+
+static const char* extension_of_type(char type) {
+    switch (type) {
+        case 'S': return ".seq";
+        case 'U': return ".usr";
+        default: return ".prg";
+    }
+}
+
+// Host file name 'name' split into its CBM type and base name (in 'base').
+static char split_host_name(const char* name, char* base, size_t base_size) {
+    const char* const dot = strrchr(name, '.');
+    const char type = type_of_extension(dot);
+    if (type == 0 || dot == name) {
+        return 0;
+    }
+
+    const size_t length = (size_t) (dot - name);
+    if (length >= base_size) {
+        return 0;
+    }
+    memcpy(base, name, length);
+    base[length] = '\0';
+    return type;
+}
+
+typedef struct {
+    const dos_name_t* name;
+    void (*action)(void* context, const char* host_name);
+    void* context;
+    bool first_only;
+    unsigned int matches;
+} match_context_t;
+
+static void match_callback(const char* host_name, uint32_t size, void* context) {
+    (void) size;
+    match_context_t* const match = context;
+    if (match->first_only && match->matches > 0) {
+        return;
+    }
+
+    char base[NAME_MAX + 1];
+    const char type = split_host_name(host_name, base, sizeof(base));
+    if (type == 0 || (match->name->type != 0 && type != match->name->type)) {
+        return;
+    }
+
+    if (cbm_filename_match(match->name->pattern, match->name->length, base)) {
+        match->matches++;
+        match->action(match->context, host_name);
+    }
+}
+
+// Call 'action' for each host file matching 'name' (or only the first).
+static unsigned int for_each_match(dos_t* dos, const dos_name_t* name, bool first_only,
+                                   void (*action)(void* context, const char* host_name), void* context) {
+    match_context_t match = { name, action, context, first_only, 0 };
+    if (!dos->fs->scan_dir(dos->root, match_callback, &match)) {
+        return 0;
+    }
+    return match.matches;
+}
+
+static void copy_name(void* context, const char* host_name) {
+    snprintf(context, NAME_MAX + 1, "%s", host_name);
+}
+
+// Convert a PETSCII name for writing to ASCII. Returns false if it contains
+// characters that cannot be used on the card.
+static bool host_base_name(const dos_name_t* name, char* out) {
+    for (uint8_t i = 0; i < name->length; i++) {
+        const char ch = petscii_to_ascii(name->pattern[i]);
+        if ((uint8_t) ch < 0x20 || (uint8_t) ch >= 0x7F || strchr(reserved_chars, ch) != NULL) {
+            return false;
+        }
+        out[i] = ch;
+    }
+    out[name->length] = '\0';
+
+    // FAT silently drops trailing dots and spaces.
+    return out[name->length - 1] != '.' && out[name->length - 1] != ' ';
+}
+
+typedef struct {
+    tape_dir_entry_t* entries;
+    size_t count;
+} listing_context_t;
+
+static void add_listing_entry(const char* host_name, uint32_t size, void* context) {
+    listing_context_t* const listing = context;
+    if (listing->count >= DOS_DIR_MAX_ENTRIES) {
+        return;
+    }
+
+    char base[NAME_MAX + 1];
+    if (split_host_name(host_name, base, sizeof(base)) != 'P') {
+        return;
+    }
+
+    tape_dir_entry_t* const entry = &listing->entries[listing->count++];
+    // Long host names are truncated to fit the listing.
+    snprintf(entry->name, sizeof(entry->name), "%.*s", (int)(sizeof(entry->name) - 1), base);
+    entry->blocks = tape_dir_blocks_from_bytes(size, /* round_up: */ true);
+}
+
+static void open_listing(dos_t* dos, dos_channel_t* channel) {
+    // The listing holds a large block until the channel is closed, so running
+    // out (e.g., a second listing) is an error for the program, not fatal().
+    listing_context_t listing = {
+        .entries = pool_try_alloc(DOS_DIR_MAX_ENTRIES * sizeof(tape_dir_entry_t), "dos dir"),
+    };
+    uint8_t* const image = pool_try_alloc(DOS_DIR_CAPACITY, "dos dir");
+    if (listing.entries == NULL || image == NULL) {
+        pool_free(image);
+        pool_free(listing.entries);
+        set_status(dos, 70, "NO CHANNEL");
+        return;
+    }
+
+    dos->fs->scan_dir(dos->root, add_listing_entry, &listing);
+
+    image[0] = (uint8_t) DOS_DIR_LOAD_ADDR;
+    image[1] = (uint8_t) (DOS_DIR_LOAD_ADDR >> 8);
+    const size_t length = tape_dir_render(&image[2], DOS_DIR_CAPACITY - 2, DOS_DIR_LOAD_ADDR,
+                                          DOS_DISK_NAME, listing.entries, listing.count,
+                                          dos->fs->free_bytes(), dos->graphics_charset);
+    pool_free(listing.entries);
+
+    channel->listing = image;
+    channel->listing_length = length + 2;
+    set_status(dos, 0, " OK");
+}
+
+static void open_file(dos_t* dos, uint8_t sa, const uint8_t* text, uint8_t length) {
+    dos_channel_t* const channel = &dos->channels[sa];
+    close_channel(channel);
+
+    if (length >= 1 && text[0] == '$' && (length == 1 || (length == 2 && text[1] == '0'))) {
+        open_listing(dos, channel);
+        return;
+    }
+
+    dos_name_t name;
+    if (!parse_name(text, length, &name)) {
+        set_status(dos, length == 0 ? 34 : 33, "SYNTAX ERROR");
+        return;
+    }
+
+    const bool writing = sa == 1 || name.mode == 'W' || name.mode == 'A';
+    if (sa == 0 || sa == 1) {
+        name.type = name.type != 0 ? name.type : 'P';
+    }
+
+    char path[PATH_MAX];
+    if (writing) {
+        char base[TAPE_DIR_MAX_NAME + 1];
+        if (!host_base_name(&name, base)) {
+            set_status(dos, 33, "SYNTAX ERROR");
+            return;
+        }
+        if (name.type == 0) {
+            name.type = 'S';
+        }
+        snprintf(path, sizeof(path), "%s/%s%s", dos->root, base, extension_of_type(name.type));
+
+        FILE* existing = fopen(path, "rb");
+        if (existing != NULL) {
+            fclose(existing);
+        }
+        if (name.mode == 'A' && existing == NULL) {
+            set_status(dos, 62, "FILE NOT FOUND");
+            return;
+        }
+        if (name.mode != 'A' && existing != NULL && !name.overwrite) {
+            set_status(dos, 63, "FILE EXISTS");
+            return;
+        }
+
+        channel->file = fopen(path, name.mode == 'A' ? "ab" : "wb");
+        if (channel->file == NULL) {
+            set_status(dos, 25, "WRITE ERROR");
+            return;
+        }
+        channel->writing = true;
+    } else {
+        char host_name[NAME_MAX + 1];
+        if (for_each_match(dos, &name, /* first_only: */ true, copy_name, host_name) == 0) {
+            set_status(dos, 62, "FILE NOT FOUND");
+            return;
+        }
+        snprintf(path, sizeof(path), "%s/%s", dos->root, host_name);
+
+        channel->file = fopen(path, "rb");
+        if (channel->file == NULL) {
+            set_status(dos, 62, "FILE NOT FOUND");
+            return;
+        }
+    }
+
+    set_status(dos, 0, " OK");
+}
+
+// "S:name[,name...]". Each name may use wildcards.
+static void command_scratch(dos_t* dos, const uint8_t* text, uint8_t length) {
+    const uint8_t* const colon = memchr(text, ':', length);
+    if (colon == NULL) {
+        set_status(dos, 34, "SYNTAX ERROR");
+        return;
+    }
+
+    // FAT directories are not safe to modify while being scanned, so find
+    // and remove one file at a time until none are left.
+    bool failed = false;
+    unsigned int count = 0;
+    const uint8_t* p = colon + 1;
+    const uint8_t* const end = text + length;
+    while (p < end) {
+        const uint8_t* comma = memchr(p, ',', (size_t) (end - p));
+        if (comma == NULL) {
+            comma = end;
+        }
+
+        const dos_name_t name = { .pattern = p, .length = (uint8_t) (comma - p) };
+        char host_name[NAME_MAX + 1];
+        while (!failed && name.length > 0 && for_each_match(dos, &name, true, copy_name, host_name) > 0) {
+            char path[PATH_MAX];
+            snprintf(path, sizeof(path), "%s/%s", dos->root, host_name);
+            failed = remove(path) != 0;
+            count += failed ? 0 : 1;
+        }
+        p = comma + 1;
+    }
+
+    if (failed) {
+        set_status(dos, 25, "WRITE ERROR");
+    } else {
+        set_status_ts(dos, 1, "FILES SCRATCHED", count, 0);
+    }
+}
+
+// "R:new=old".
+static void command_rename(dos_t* dos, const uint8_t* text, uint8_t length) {
+    const uint8_t* const colon = memchr(text, ':', length);
+    const uint8_t* const equals = memchr(text, '=', length);
+    if (colon == NULL || equals == NULL || equals < colon) {
+        set_status(dos, 34, "SYNTAX ERROR");
+        return;
+    }
+
+    dos_name_t new_name = { .pattern = colon + 1, .length = (uint8_t) (equals - colon - 1) };
+    dos_name_t old_name;
+    if (!parse_name(equals + 1, (uint8_t) (text + length - equals - 1), &old_name)) {
+        set_status(dos, 34, "SYNTAX ERROR");
+        return;
+    }
+
+    char new_base[TAPE_DIR_MAX_NAME + 1];
+    if (new_name.length == 0 || new_name.length > TAPE_DIR_MAX_NAME || !host_base_name(&new_name, new_base)) {
+        set_status(dos, 33, "SYNTAX ERROR");
+        return;
+    }
+
+    char old_host[NAME_MAX + 1];
+    if (for_each_match(dos, &old_name, true, copy_name, old_host) == 0) {
+        set_status(dos, 62, "FILE NOT FOUND");
+        return;
+    }
+
+    // The renamed file keeps its type.
+    char old_path[PATH_MAX];
+    char new_path[PATH_MAX];
+    snprintf(old_path, sizeof(old_path), "%s/%s", dos->root, old_host);
+    snprintf(new_path, sizeof(new_path), "%s/%s%s", dos->root, new_base, strrchr(old_host, '.'));
+
+    FILE* existing = fopen(new_path, "rb");
+    if (existing != NULL) {
+        fclose(existing);
+        set_status(dos, 63, "FILE EXISTS");
+        return;
+    }
+
+    if (rename(old_path, new_path) != 0) {
+        set_status(dos, 25, "WRITE ERROR");
+        return;
+    }
+    set_status(dos, 0, " OK");
+}
+
+static void execute_command(dos_t* dos, const uint8_t* text, uint8_t length) {
+    // Commands sent with PRINT# end in CR.
+    while (length > 0 && text[length - 1] == '\r') {
+        length--;
+    }
+    if (length == 0) {
+        return;
+    }
+
+    switch (cbm_filename_fold(text[0])) {
+        case 'I':   // Initialize
+        case 'V':   // Validate
+            set_status(dos, 0, " OK");
+            break;
+        case 'S':
+            command_scratch(dos, text, length);
+            break;
+        case 'R':
+            command_rename(dos, text, length);
+            break;
+        case 'U':   // "UI", "UJ", or "U:": reset
+            dos_close_all(dos);
+            set_status(dos, 73, "ECONOPET DOS");
+            break;
+        default:
+            set_status(dos, 31, "SYNTAX ERROR");
+            break;
+    }
+}
+
+void dos_listen(dos_t* dos, uint8_t secondary) {
+    dos->listening = true;
+    dos->talking = false;
+    dos->opening = false;
+    dos->sa = secondary & 0x0F;
+    dos->buffer_length = 0;
+
+    switch (secondary & 0xF0) {
+        case 0xF0:
+            dos->opening = true;
+            break;
+        case 0xE0:
+            if (dos->sa != DOS_COMMAND_CHANNEL) {
+                close_channel(&dos->channels[dos->sa]);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+void dos_unlisten(dos_t* dos) {
+    if (!dos->listening) {
+        return;
+    }
+    dos->listening = false;
+
+    if (dos->sa == DOS_COMMAND_CHANNEL) {
+        execute_command(dos, dos->buffer, dos->buffer_length);
+    } else if (dos->opening) {
+        open_file(dos, dos->sa, dos->buffer, dos->buffer_length);
+    } else {
+        dos_channel_t* const channel = &dos->channels[dos->sa];
+        if (channel->file != NULL && channel->writing && fflush(channel->file) != 0) {
+            set_status(dos, 25, "WRITE ERROR");
+        }
+    }
+    dos->opening = false;
+}
+
+void dos_write(dos_t* dos, uint8_t byte) {
+    if (!dos->listening) {
+        return;
+    }
+
+    if (dos->opening || dos->sa == DOS_COMMAND_CHANNEL) {
+        if (dos->buffer_length < DOS_BUFFER_SIZE) {
+            dos->buffer[dos->buffer_length++] = byte;
+        }
+        return;
+    }
+
+    dos_channel_t* const channel = &dos->channels[dos->sa];
+    if (channel->file == NULL || !channel->writing) {
+        set_status(dos, 61, "FILE NOT OPEN");
+    } else if (fputc(byte, channel->file) == EOF) {
+        set_status(dos, 25, "WRITE ERROR");
+    }
+}
+
+void dos_talk(dos_t* dos, uint8_t secondary) {
+    dos->talking = true;
+    dos->listening = false;
+    dos->opening = false;
+    dos->sa = secondary & 0x0F;
+}
+
+void dos_untalk(dos_t* dos) {
+    dos->talking = false;
+}
+
+bool dos_read(dos_t* dos, uint8_t* byte, bool* eoi) {
+    if (!dos->talking) {
+        return false;
+    }
+
+    if (dos->sa == DOS_COMMAND_CHANNEL) {
+        // The status ends with CR. Once it has been read, it reverts to OK.
+        if (dos->status_pos < dos->status_length) {
+            *byte = (uint8_t) dos->status[dos->status_pos++];
+            *eoi = false;
+        } else {
+            *byte = '\r';
+            *eoi = true;
+            set_status(dos, 0, " OK");
+        }
+        return true;
+    }
+
+    dos_channel_t* const channel = &dos->channels[dos->sa];
+    if (channel->listing != NULL) {
+        if (channel->listing_pos >= channel->listing_length) {
+            return false;
+        }
+        *byte = channel->listing[channel->listing_pos++];
+        *eoi = channel->listing_pos == channel->listing_length;
+        return true;
+    }
+
+    if (channel->file == NULL || channel->writing) {
+        return false;
+    }
+
+    // Read one byte ahead so the last byte can be flagged with EOI.
+    if (!channel->primed) {
+        channel->next = fgetc(channel->file);
+        channel->primed = true;
+    }
+    if (channel->next == EOF) {
+        return false;
+    }
+
+    *byte = (uint8_t) channel->next;
+    channel->next = fgetc(channel->file);
+    *eoi = channel->next == EOF;
+    return true;
+}
+
+const char* dos_status(const dos_t* dos) {
+    return dos->status;
+}
@@ -0,0 +1,102 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Emulated Commodore disk drive (the DOS side of an IEEE-488 device), backed by
+// a directory on the SD card. The bus hooks in ieee.c translate the KERNAL's
+// IEEE primitives into the calls below, so the emulation sees exactly what a
+// drive would: LISTEN/TALK with a secondary address, then data bytes.
+//
+// Secondary addresses (the byte sent after LISTEN or TALK):
+//   $F0 | sa   OPEN channel 'sa'; the bytes that follow are the file name
+//   $E0 | sa   CLOSE channel 'sa'
+//   $60 | sa   Data to or from channel 'sa'
+//
+// Channel 0 is LOAD and channel 1 is SAVE (both PRG files). Channels 2-14 are
+// opened for reading unless the name ends in ",W" or ",A", and default to SEQ
+// files. Channel 15 is the command/error channel: bytes written to it are
+// executed as DOS commands when the sender unlistens, and reading it returns
+// the status ("00, OK,00,00").
+//
+// Host files carry the CBM type as their extension (.prg, .seq, .usr). LOAD
+// "$" returns a directory listing of the .prg files, as for the virtual tape.
+
+#define DOS_CHANNELS 16
+#define DOS_COMMAND_CHANNEL 15
+
+// Size of the buffer for a file name or command (as on the 1541).
+#define DOS_BUFFER_SIZE 41
+
+// Room for "NN,MESSAGE,TT,SS\r".
+#define DOS_STATUS_SIZE 40
+
+// Host file system services. 'scan_dir' has the contract of sd_scan_dir().
+typedef struct {
+    bool (*scan_dir)(const char* path, void (*callback)(const char* name, uint32_t size, void* context),
+                     void* context);
+    uint64_t (*free_bytes)(void);
+} dos_fs_t;
+
+typedef struct {
+    FILE* file;             // Open file, or NULL
+    uint8_t* listing;       // Rendered directory listing (pool block), or NULL
+    size_t listing_length;
+    size_t listing_pos;
+    bool writing;
+    int next;               // Lookahead byte for EOI detection (EOF once drained)
+    bool primed;            // 'next' holds the first byte
+} dos_channel_t;
+
+typedef struct {
+    const char* root;
+    const dos_fs_t* fs;
+    bool graphics_charset;  // Encoding for directory listings (see tape_dir_render)
+
+    dos_channel_t channels[DOS_CHANNELS];
+
+    // Bus state
+    bool listening;
+    bool talking;
+    bool opening;           // Receiving a file name (after $F0 | sa)
+    uint8_t sa;             // Current channel
+    uint8_t buffer[DOS_BUFFER_SIZE];
+    uint8_t buffer_length;
+
+    // Error channel
+    char status[DOS_STATUS_SIZE];
+    uint8_t status_length;
+    uint8_t status_pos;
+} dos_t;
+
+// Initialize the drive with files in the directory 'root'. The status starts
+// as the power-on message (73).
+void dos_init(dos_t* dos, const char* root, const dos_fs_t* fs);
+
+// Close all channels (e.g., on reset or reconfiguration).
+void dos_close_all(dos_t* dos);
+
+// LISTEN or TALK addressed to this drive, followed by 'secondary'.
+void dos_listen(dos_t* dos, uint8_t secondary);
+void dos_talk(dos_t* dos, uint8_t secondary);
+
+// End of the LISTEN (completes an OPEN or command) or TALK.
+void dos_unlisten(dos_t* dos);
+void dos_untalk(dos_t* dos);
+
+// A byte sent to the drive while it is listening.
+void dos_write(dos_t* dos, uint8_t byte);
+
+// The next byte from the drive while it is talking. Sets 'eoi' on the last
+// byte. Returns false if the channel has nothing to send (not open or already
+// drained), which the computer sees as a timeout.
+bool dos_read(dos_t* dos, uint8_t* byte, bool* eoi);
+
+// The status as the error channel would report it, without the trailing CR
+// (e.g., "62,FILE NOT FOUND,00,00").
+const char* dos_status(const dos_t* dos);
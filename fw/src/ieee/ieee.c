@@ -0,0 +1,245 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#include "pch.h"
+#include "ieee.h"
+
+#include "breakpoint.h"
+#include "diag/log/log.h"
+#include "dos.h"
+#include "driver.h"
+#include "sd/sd.h"
+#include "system_state.h"
+
+// Files for the drive live with the virtual tape's programs.
+#define IEEE_ROOT "/prgs"
+
+// ST bits set by the emulated primitives.
+#define ST_TIMEOUT_READ 0x02
+#define ST_EOI          0x40
+
+// The stub at 'trap' (9 bytes):
+//
+//   +0  STA +8        Capture A for the MCU
+//   +3  (breakpoint)  MCU handles the primitive
+//   +4  LDA #value    Return to the primitive's caller with A = value
+//   +6  CLC
+//   +7  RTS
+//   +8  (captured A)
+#define TRAP_BP      3
+#define TRAP_RETURN  4
+#define TRAP_VALUE   8
+#define TRAP_SIZE    9
+
+typedef enum {
+    ieee_talk,
+    ieee_listen,
+    ieee_second,
+    ieee_tksa,
+    ieee_ciout,
+    ieee_acptr,
+    ieee_untlk,
+    ieee_unlsn,
+    ieee_primitive_count,
+} ieee_primitive_t;
+
+static const char* const primitive_names[ieee_primitive_count] = {
+    "TALK", "LISTN", "SECND", "TKSA", "CIOUT", "ACPTR", "UNTLK", "UNLSN",
+};
+
+static struct {
+    bool enabled;
+    ieee_config_t cfg;
+    uint16_t entries[ieee_primitive_count];
+    bool addressed;                 // The emulated drive is the current talker/listener
+    ieee_primitive_t pending;       // Primitive whose A is being captured
+    uint8_t saved[TRAP_SIZE];       // RAM at 'trap' before the stub was written
+} state;
+
+// The drive opens files by their VFS path under IEEE_ROOT, so it only lists
+// the SD card (a USB stick's files live under SD_USB_MOUNT_POINT).
+static bool scan_sd_dir(const char* path, sd_dir_callback_t callback, void* context) {
+    return sd_scan_volume(sd_volume_sd, path, callback, context);
+}
+
+static const dos_fs_t dos_fs = {
+    .scan_dir = scan_sd_dir,
+    .free_bytes = sd_free_bytes,
+};
+
+static dos_t dos;
+
+static void set_status_bits(uint8_t bits) {
+    spi_write_at(state.cfg.status, spi_read_at(state.cfg.status) | bits);
+}
+
+// Resume at the primitive's caller with A = 'value' and carry clear.
+static bp_result_t return_from_primitive(uint8_t value) {
+    const uint16_t stub = state.cfg.trap + TRAP_RETURN;
+    const uint8_t code[] = { 0xA9, value, 0x18, 0x60 };     // LDA #value / CLC / RTS
+    spi_write(stub, code, sizeof(code));
+    return (bp_result_t){ .pc = stub, .rearm = true };
+}
+
+// Breakpoint at a primitive's entry.
+static bp_result_t ieee_entry_callback(uint16_t pc, void* context) {
+    const ieee_primitive_t primitive = (ieee_primitive_t)(uintptr_t)context;
+
+    switch (primitive) {
+        case ieee_talk:
+        case ieee_listen: {
+            // The PET KERNAL ORs the device number in FA into the command, so
+            // A holds nothing of interest here. Addressing another device
+            // unaddresses the emulated drive.
+            const uint8_t device = spi_read_at(state.cfg.fa);
+            state.addressed = (device & 0x1F) == state.cfg.device;
+            if (!state.addressed) {
+                return (bp_result_t){ .pc = pc, .rearm = true };
+            }
+
+            // Channel 0 unless a secondary address follows.
+            dos.graphics_charset = !system_state.video_graphics;
+            if (primitive == ieee_talk) {
+                dos_talk(&dos, 0x60);
+            } else {
+                dos_listen(&dos, 0x60);
+            }
+            log_debug("ieee: %s %u", primitive_names[primitive], device);
+            return return_from_primitive(0);
+        }
+
+        case ieee_second:
+        case ieee_tksa:
+        case ieee_ciout:
+            if (!state.addressed) {
+                return (bp_result_t){ .pc = pc, .rearm = true };
+            }
+            break;
+
+        case ieee_acptr: {
+            if (!state.addressed) {
+                return (bp_result_t){ .pc = pc, .rearm = true };
+            }
+
+            uint8_t byte;
+            bool eoi;
+            if (!dos_read(&dos, &byte, &eoi)) {
+                set_status_bits(ST_TIMEOUT_READ);
+                return return_from_primitive('\r');
+            }
+            if (eoi) {
+                set_status_bits(ST_EOI);
+            }
+            return return_from_primitive(byte);
+        }
+
+        case ieee_untlk:
+        case ieee_unlsn:
+            if (!state.addressed) {
+                return (bp_result_t){ .pc = pc, .rearm = true };
+            }
+            if (primitive == ieee_untlk) {
+                dos_untalk(&dos);
+            } else {
+                dos_unlisten(&dos);
+            }
+            state.addressed = false;
+            return return_from_primitive(0);
+
+        default:
+            break;
+    }
+
+    // Capture A through the trap stub (A is preserved on the way).
+    state.pending = primitive;
+    return (bp_result_t){ .pc = state.cfg.trap, .rearm = true };
+}
+
+// Breakpoint in the trap stub, after A has been stored.
+static bp_result_t ieee_trap_callback(uint16_t pc, void* context) {
+    (void)pc;
+    (void)context;
+
+    const uint8_t a = spi_read_at(state.cfg.trap + TRAP_VALUE);
+
+    switch (state.pending) {
+        case ieee_second:
+            dos_listen(&dos, a);
+            break;
+
+        case ieee_tksa:
+            dos_talk(&dos, a);
+            break;
+
+        case ieee_ciout:
+            dos_write(&dos, a);
+            break;
+
+        default:
+            break;
+    }
+
+    log_debug("ieee: %s $%02X", primitive_names[state.pending], a);
+    return return_from_primitive(a);
+}
+
+void ieee_init(const ieee_config_t* cfg) {
+    memset(&state, 0, sizeof(state));
+
+    if (cfg == NULL) {
+        log_info("ieee: disabled (no config blob)");
+        return;
+    }
+
+    state.cfg = *cfg;
+    state.entries[ieee_talk] = cfg->talk;
+    state.entries[ieee_listen] = cfg->listen;
+    state.entries[ieee_second] = cfg->second;
+    state.entries[ieee_tksa] = cfg->tksa;
+    state.entries[ieee_ciout] = cfg->ciout;
+    state.entries[ieee_acptr] = cfg->acptr;
+    state.entries[ieee_untlk] = cfg->untlk;
+    state.entries[ieee_unlsn] = cfg->unlsn;
+
+    dos_init(&dos, IEEE_ROOT, &dos_fs);
+
+    // The stub borrows RAM that ieee_deinit() gives back.
+    spi_read(cfg->trap, sizeof(state.saved), state.saved);
+
+    // STA trap+8 / NOP (replaced by the breakpoint)
+    const uint16_t value_addr = cfg->trap + TRAP_VALUE;
+    const uint8_t stub[] = { 0x8D, (uint8_t)value_addr, (uint8_t)(value_addr >> 8), 0xEA };
+    spi_write(cfg->trap, stub, sizeof(stub));
+    bp_set(cfg->trap + TRAP_BP, ieee_trap_callback, NULL);
+
+    for (ieee_primitive_t i = 0; i < ieee_primitive_count; i++) {
+        bp_set(state.entries[i], ieee_entry_callback, (void*)(uintptr_t)i);
+    }
+
+    state.enabled = true;
+    log_info("ieee: emulating device %u", cfg->device);
+}
+
+void ieee_deinit(void) {
+    if (!state.enabled) {
+        return;
+    }
+
+    for (ieee_primitive_t i = 0; i < ieee_primitive_count; i++) {
+        bp_remove(state.entries[i]);
+    }
+    bp_remove(state.cfg.trap + TRAP_BP);
+    spi_write(state.cfg.trap, state.saved, sizeof(state.saved));
+
+    dos_close_all(&dos);
+    state.enabled = false;
+    log_info("ieee: disabled");
+}
+
+bool ieee_uses_ram(uint32_t address, size_t length) {
+    return state.enabled && address < (uint32_t) state.cfg.trap + TRAP_SIZE && state.cfg.trap < address + length;
+}
+
+bool ieee_is_device(uint8_t device) {
+    return state.enabled && device == state.cfg.device;
+}
@@ -0,0 +1,55 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Configuration blob for the emulated IEEE-488 disk drive. Like tape_config_t,
+// the packed struct maps directly to a hex string in config.yaml ('ieee').
+// See docs/dev/ieee-drive.md.
+//
+// Each hook is the entry point of a KERNAL IEEE-488 bus primitive. The MCU
+// sets a breakpoint on each one and, while the emulated device is addressed,
+// performs the bus transaction itself instead of letting the KERNAL drive the
+// handshake lines. Transactions with other devices run the original routines.
+typedef struct __attribute__((packed)) {
+    uint16_t talk;      // TALK:   device number in FA
+    uint16_t listen;    // LISTN:  device number in FA
+    uint16_t second;    // SECND:  A = secondary address after LISTEN
+    uint16_t tksa;      // TKSA:   A = secondary address after TALK
+    uint16_t ciout;     // CIOUT:  A = byte to send
+    uint16_t acptr;     // ACPTR:  returns the received byte in A
+    uint16_t untlk;     // UNTLK
+    uint16_t unlsn;     // UNLSN
+
+    // Address of 9 bytes of RAM for the stub that captures the A register.
+    // Nothing else may use them while the drive is enabled (the stock configs
+    // use the end of the second cassette buffer at $03F0).
+    uint16_t trap;
+
+    uint16_t status;    // Addr of ST (I/O status; $020C on BASIC 1)
+    uint8_t fa;         // ZP addr of FA (device number for TALK and LISTN)
+    uint8_t device;     // Emulated device number (normally 8)
+} ieee_config_t;        // 22 bytes total
+
+#define IEEE_CONFIG_SIZE sizeof(ieee_config_t)
+
+// Emulate a disk drive on the IEEE-488 bus, backed by /prgs on the SD card.
+// If 'cfg' is NULL the emulation is disabled and the bus is left to real
+// devices.
+void ieee_init(const ieee_config_t* cfg);
+
+// Remove the breakpoints and close any open files.
+void ieee_deinit(void);
+
+// True if the drive is enabled and its trap stub overlaps the 'length' bytes
+// of RAM at 'address'.
+bool ieee_uses_ram(uint32_t address, size_t length);
+
+// True if 'device' is the emulated drive. The virtual tape uses this to serve
+// LOAD and SAVE for the drive directly from the SD card, bypassing the
+// byte-by-byte bus transfer.
+bool ieee_is_device(uint8_t device);
@@ -9,9 +9,12 @@
 #include "hw.h"
 #include "system_state.h"
 #include "term_inject.h"
+#include "uart/uart_rx.h"
 #include "ui/cli.h"
+#include "ui/esc_parser.h"
 #include "usb/keyboard.h"
 #include "usb/usb.h"
+#include "xfer/xfer.h"
 
 // Ring buffer for firmware input queue
 #define INPUT_BUFFER_LOG2_CAPACITY 4
@@ -110,104 +113,37 @@ static int get_button_action(void) {
     return action;
 }
 
-// Map escape sequences to key constants. (ESC [ has already been matched.)
-typedef struct {
-    const char* sequence;
-    int key;
-} escape_sequence_t;
+// Escape sequence state, held across input_task() iterations.
+static esc_parser_t esc_parser;
 
-static const escape_sequence_t escape_sequences[] = {
-    { "A",  KEY_UP },
-    { "B",  KEY_DOWN },
-    { "C",  KEY_RIGHT },
-    { "D",  KEY_LEFT },
-    { "F",  KEY_END },
-    { "H",  KEY_HOME },
-    { "5~", KEY_PGUP },
-    { "6~", KEY_PGDN },
-    { NULL, EOF }
-};
-
-static bool is_sequence_terminator(int ch) {
-    return (64 <= ch && ch <= 126)
-        || (0 <= ch && ch <= 31);
-}
-
-// Timeout for escape sequence completion (microseconds)
-// VT100 escape sequences should complete within a few milliseconds at any baud rate
-#define ESCAPE_SEQUENCE_TIMEOUT_US 10000
-
-// Wait for UART to have data available, with timeout
-static bool uart_wait_readable(uint64_t timeout_us) {
-    uint64_t start = time_us_64();
-    while (!uart_is_readable(uart_default)) {
-        if (time_us_64() - start > timeout_us) {
-            return false;
-        }
-        tight_loop_contents();
-    }
-    return true;
-}
-
-// Parse escape sequences from UART input
-// Returns the keycode, or EOF if incomplete/no match
-static int parse_uart_escape_sequence(void) {
-    char buffer[10];
-    size_t bytes_read = 0;
+// Read a single keycode from the UART RX ring, handling escape sequences.
+// Never waits for the rest of a partial sequence.
+static int uart_getch(void) {
     int ch;
-
-    do {
-        if (!uart_wait_readable(ESCAPE_SEQUENCE_TIMEOUT_US)) {
-            return EOF;  // Incomplete sequence (timeout)
-        }
-        ch = uart_getc(uart_default);
-        buffer[bytes_read++] = ch;
-    } while (bytes_read < sizeof(buffer) && !is_sequence_terminator(ch));
-
-    for (const escape_sequence_t* entry = &escape_sequences[0]; entry->sequence != NULL; entry++) {
-        if (strncmp(buffer, entry->sequence, bytes_read) == 0) {
-            return entry->key;
+    while ((ch = uart_rx_getc()) != EOF) {
+        const int key = esc_parser_feed(&esc_parser, (uint8_t) ch, time_us_64());
+        if (key != EOF) {
+            return key;
         }
     }
 
-    return EOF;  // Unknown sequence
-}
-
-// Read a single keycode from UART, handling escape sequences
-static int uart_getch(void) {
-    if (!uart_is_readable(uart_default)) {
-        return EOF;
-    }
-
-    int ch = uart_getc(uart_default);
-    if (ch != '\e') {
-        return ch;
-    }
-
-    // Check for CSI (ESC [)
-    // Wait briefly for follow-up characters since escape sequences may span
-    // multiple UART frames
-    if (!uart_wait_readable(ESCAPE_SEQUENCE_TIMEOUT_US)) {
-        return ch;  // Just ESC (timeout)
-    }
-
-    int next = uart_getc(uart_default);
-    if (next != '[') {
-        return next;  // Not a CSI sequence, return second char
-    }
-
-    return parse_uart_escape_sequence();
+    return esc_parser_poll(&esc_parser, time_us_64());
 }
 
 void input_init(void) {
     gpio_init(MENU_BTN_GP);
     gpio_pull_up(MENU_BTN_GP);
     gpio_set_dir(MENU_BTN_GP, GPIO_IN);
+
+    esc_parser_init(&esc_parser);
 }
 
 void input_task(void) {
     // 1. Handle UART input based on term_input_dest
-    if (system_state.term_input_dest != term_input_ignore) {
+    if (system_state.term_input_dest == term_input_to_xfer) {
+        // Binary transfer: bytes bypass escape sequence parsing
+        xfer_task();
+    } else if (system_state.term_input_dest != term_input_ignore) {
         int ch = uart_getch();
         while (ch != EOF) {
             if (system_state.term_input_dest == term_input_to_pet) {
@@ -228,6 +164,11 @@ void input_task(void) {
                     enqueue_key(ch);
                 }
             }
+
+            // The 'xfer' command switches to binary input. Leave the rest for xfer_task().
+            if (system_state.term_input_dest == term_input_to_xfer) {
+                break;
+            }
             ch = uart_getch();
         }
     }
@@ -238,6 +179,7 @@ void input_task(void) {
     // 3. Handle USB keyboard events
     tuh_task();
     hid_app_task();
+    msc_app_task();
     dispatch_key_events();
     
     // 4. Sync USB keyboard state to FPGA
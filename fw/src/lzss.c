@@ -0,0 +1,103 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#include "lzss.h"
+
+#include <string.h>
+
+#include "crc.h"
+
+static const uint8_t magic[4] = { 'E', 'L', 'Z', 0x1A };
+
+static uint32_t get_u32(const uint8_t* p) {
+    return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+bool lzss_read_header(const uint8_t* data, size_t length, lzss_header_t* header) {
+    if (length < LZSS_HEADER_SIZE || memcmp(data, magic, sizeof(magic)) != 0) {
+        return false;
+    }
+
+    header->size = get_u32(&data[4]);
+    header->crc = get_u32(&data[8]);
+    return true;
+}
+
+void lzss_decoder_init(lzss_decoder_t* decoder, const lzss_header_t* header) {
+    decoder->header = *header;
+    decoder->produced = 0;
+    decoder->crc = CRC32_INIT;
+    decoder->pos = 0;
+    decoder->emitted = 0;
+    decoder->flags = 0;
+    decoder->flag_count = 0;
+    decoder->token_length = 0;
+}
+
+// Deliver the bytes decoded since the last call, then rewind the window if it
+// is full.
+static void emit(lzss_decoder_t* decoder, lzss_sink_t sink, void* context) {
+    const size_t length = decoder->pos - decoder->emitted;
+    if (length > 0) {
+        const uint8_t* const data = &decoder->window[decoder->emitted];
+        decoder->crc = crc32_update(decoder->crc, data, length);
+        sink(context, decoder->produced - length, data, length);
+        decoder->emitted = decoder->pos;
+    }
+
+    if (decoder->pos == LZSS_WINDOW_SIZE) {
+        decoder->pos = 0;
+        decoder->emitted = 0;
+    }
+}
+
+static void put(lzss_decoder_t* decoder, uint8_t byte, lzss_sink_t sink, void* context) {
+    decoder->window[decoder->pos++] = byte;
+    decoder->produced++;
+    if (decoder->pos == LZSS_WINDOW_SIZE) {
+        emit(decoder, sink, context);
+    }
+}
+
+lzss_status_t lzss_decode(lzss_decoder_t* decoder, const uint8_t* data, size_t length,
+                          lzss_sink_t sink, void* context) {
+    const uint32_t size = decoder->header.size;
+
+    for (size_t i = 0; i < length && decoder->produced < size; ) {
+        if (decoder->flag_count == 0) {
+            decoder->flags = data[i++];
+            decoder->flag_count = 8;
+            continue;
+        }
+
+        if (decoder->flags & 1) {
+            put(decoder, data[i++], sink, context);
+        } else {
+            decoder->token[decoder->token_length++] = data[i++];
+            if (decoder->token_length < 2) {
+                continue;
+            }
+            decoder->token_length = 0;
+
+            const uint32_t distance = (decoder->token[0] | ((uint32_t) (decoder->token[1] >> 4) << 8)) + 1;
+            const unsigned int count = (decoder->token[1] & 0x0F) + LZSS_MIN_MATCH;
+            if (distance > decoder->produced) {
+                return lzss_error;
+            }
+
+            for (unsigned int n = 0; n < count && decoder->produced < size; n++) {
+                put(decoder, decoder->window[(decoder->pos - distance) & (LZSS_WINDOW_SIZE - 1)], sink, context);
+            }
+        }
+
+        decoder->flags >>= 1;
+        decoder->flag_count--;
+    }
+
+    emit(decoder, sink, context);
+
+    if (decoder->produced < size) {
+        return lzss_more;
+    }
+    return decoder->crc == decoder->header.crc ? lzss_done : lzss_error;
+}
@@ -0,0 +1,88 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// LZSS compression for ROM, PRG, and keymap files on the SD card. A compressed
+// file is a 12-byte header followed by the LZSS stream:
+//
+//   Offset  Size  Field
+//   0       4     Magic "ELZ\x1A"
+//   4       4     Uncompressed size (little-endian)
+//   8       4     CRC-32 of the uncompressed data (little-endian)
+//
+// The stream is a sequence of groups: a flag byte, then 8 items (fewer at the
+// end), least significant flag bit first. A set bit is a literal byte. A clear
+// bit is a 2-byte match: 'oooooooo' 'oooollll', copying length + 3 (3-18)
+// bytes from distance offset + 1 (1-4096) back in the output.
+//
+// Decoding needs only the 4 KB window, and output is delivered in spans taken
+// straight from the window, so a decompressed file can be written to SRAM or
+// the FPGA without ever being held in RAM as a whole.
+
+#define LZSS_WINDOW_SIZE 4096
+#define LZSS_MIN_MATCH   3
+#define LZSS_MAX_MATCH   18
+#define LZSS_HEADER_SIZE 12
+
+typedef struct {
+    uint32_t size;          // Uncompressed size
+    uint32_t crc;           // CRC-32 of the uncompressed data
+} lzss_header_t;
+
+// Parse the header at the start of 'data'. Returns false if 'data' is too
+// short or does not start with the magic (i.e., the file is not compressed).
+bool lzss_read_header(const uint8_t* data, size_t length, lzss_header_t* header);
+
+// Receives decompressed output. 'offset' is the position of 'data' in the
+// uncompressed file. 'data' is only valid until the callback returns.
+typedef void (*lzss_sink_t)(void* context, size_t offset, const uint8_t* data, size_t length);
+
+typedef enum {
+    lzss_more,              // Needs more input
+    lzss_done,              // All output delivered and the CRC matches
+    lzss_error,             // Corrupt stream or CRC mismatch
+} lzss_status_t;
+
+typedef struct {
+    lzss_header_t header;
+    uint32_t produced;      // Bytes decoded so far
+    uint32_t crc;           // CRC-32 of the bytes delivered so far
+    uint16_t pos;           // Next write position in 'window'
+    uint16_t emitted;       // Start of the bytes not yet delivered
+    uint8_t flags;          // Remaining flag bits of the current group
+    uint8_t flag_count;     // Number of items left in the current group
+    uint8_t token[2];       // Partially received match
+    uint8_t token_length;
+    uint8_t window[LZSS_WINDOW_SIZE];
+} lzss_decoder_t;
+
+void lzss_decoder_init(lzss_decoder_t* decoder, const lzss_header_t* header);
+
+// Decode the next 'length' bytes of the stream (following the header), in
+// chunks of any size. Output is passed to 'sink' before the window wraps and
+// before returning. Input after the end of the stream is ignored.
+lzss_status_t lzss_decode(lzss_decoder_t* decoder, const uint8_t* data, size_t length,
+                          lzss_sink_t sink, void* context);
+
+// Compression (lzss_pack.c). lzss_pack() finds the best matches but needs
+// memory proportional to 'length', so it is only used on the host.
+
+// Worst-case compressed size, including the header, of 'length' bytes.
+#define LZSS_PACK_BOUND(length) (LZSS_HEADER_SIZE + (length) + ((length) + 7) / 8)
+
+// Compress 'length' bytes into 'out', which must hold LZSS_PACK_BOUND(length)
+// bytes. Returns the compressed size including the header.
+size_t lzss_pack(const uint8_t* data, size_t length, uint8_t* out);
+
+#define LZSS_PACK_FAST_HASH_SIZE 1024
+
+// Like lzss_pack(), but trying only the most recent earlier position with the
+// same hash for each match, so the only scratch space is 'head' (2 KB). For
+// the firmware. 'length' must be less than UINT16_MAX.
+size_t lzss_pack_fast(const uint8_t* data, size_t length, uint8_t* out,
+                      uint16_t head[LZSS_PACK_FAST_HASH_SIZE]);
@@ -0,0 +1,175 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+// LZSS compressor. lzss_pack() is for the host-side packer and tests; the
+// firmware only uses lzss_pack_fast() (for snapshots).
+
+#include "lzss.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "crc.h"
+
+#define HASH_BITS  12
+#define HASH_SIZE  (1 << HASH_BITS)
+#define MAX_CHAIN  512
+#define NO_POS     (-1)
+
+static void put_u32(uint8_t* p, uint32_t value) {
+    p[0] = (uint8_t) value;
+    p[1] = (uint8_t) (value >> 8);
+    p[2] = (uint8_t) (value >> 16);
+    p[3] = (uint8_t) (value >> 24);
+}
+
+static unsigned int hash3(const uint8_t* p) {
+    return ((p[0] << 8) ^ (p[1] << 4) ^ p[2]) & (HASH_SIZE - 1);
+}
+
+static unsigned int hash3_fast(const uint8_t* p) {
+    return ((p[0] << 6) ^ (p[1] << 3) ^ p[2]) & (LZSS_PACK_FAST_HASH_SIZE - 1);
+}
+
+// Position in 'out' of the current flag byte, and the number of items it
+// already describes.
+typedef struct {
+    uint8_t* out;
+    size_t length;
+    size_t flag_pos;
+    unsigned int item;
+} writer_t;
+
+static void begin(writer_t* writer, const uint8_t* data, size_t length, uint8_t* out) {
+    memcpy(out, "ELZ\x1A", 4);
+    put_u32(&out[4], (uint32_t) length);
+    put_u32(&out[8], crc32_update(CRC32_INIT, data, length));
+    *writer = (writer_t) { .out = out, .length = LZSS_HEADER_SIZE, .item = 8 };
+}
+
+static void begin_item(writer_t* writer) {
+    if (writer->item == 8) {
+        writer->flag_pos = writer->length++;
+        writer->out[writer->flag_pos] = 0;
+        writer->item = 0;
+    }
+}
+
+static void put_literal(writer_t* writer, uint8_t byte) {
+    begin_item(writer);
+    writer->out[writer->flag_pos] |= (uint8_t) (1 << writer->item++);
+    writer->out[writer->length++] = byte;
+}
+
+static void put_match(writer_t* writer, size_t distance, size_t length) {
+    begin_item(writer);
+    writer->item++;
+    const size_t d = distance - 1;
+    writer->out[writer->length++] = (uint8_t) d;
+    writer->out[writer->length++] = (uint8_t) (((d >> 8) << 4) | (length - LZSS_MIN_MATCH));
+}
+
+size_t lzss_pack(const uint8_t* data, size_t length, uint8_t* out) {
+    writer_t writer;
+    begin(&writer, data, length, out);
+
+    // Chains of earlier positions with the same 3-byte hash, newest first.
+    int32_t head[HASH_SIZE];
+    for (size_t i = 0; i < HASH_SIZE; i++) {
+        head[i] = NO_POS;
+    }
+    int32_t* const prev = malloc((length > 0 ? length : 1) * sizeof(int32_t));
+
+    size_t i = 0;
+    while (i < length) {
+        // Find the longest match within the window (greedy).
+        size_t best_length = 0;
+        size_t best_distance = 0;
+        if (i + LZSS_MIN_MATCH <= length) {
+            const size_t limit = length - i < LZSS_MAX_MATCH ? length - i : LZSS_MAX_MATCH;
+            int chain = MAX_CHAIN;
+            for (int32_t p = head[hash3(&data[i])]; p != NO_POS && chain-- > 0; p = prev[p]) {
+                const size_t distance = i - (size_t) p;
+                if (distance > LZSS_WINDOW_SIZE) {
+                    break;
+                }
+
+                size_t n = 0;
+                while (n < limit && data[p + n] == data[i + n]) {
+                    n++;
+                }
+                if (n > best_length) {
+                    best_length = n;
+                    best_distance = distance;
+                    if (n == limit) {
+                        break;
+                    }
+                }
+            }
+        }
+
+        size_t advance;
+        if (best_length >= LZSS_MIN_MATCH) {
+            put_match(&writer, best_distance, best_length);
+            advance = best_length;
+        } else {
+            put_literal(&writer, data[i]);
+            advance = 1;
+        }
+
+        // Index every position consumed so later matches can start there.
+        for (size_t end = i + advance; i < end; i++) {
+            if (i + LZSS_MIN_MATCH <= length) {
+                const unsigned int h = hash3(&data[i]);
+                prev[i] = head[h];
+                head[h] = (int32_t) i;
+            }
+        }
+    }
+
+    free(prev);
+    return writer.length;
+}
+
+size_t lzss_pack_fast(const uint8_t* data, size_t length, uint8_t* out,
+                      uint16_t head[LZSS_PACK_FAST_HASH_SIZE]) {
+    writer_t writer;
+    begin(&writer, data, length, out);
+
+    // Most recent position + 1 with each hash, or 0.
+    memset(head, 0, LZSS_PACK_FAST_HASH_SIZE * sizeof(head[0]));
+
+    size_t i = 0;
+    while (i < length) {
+        size_t match_length = 0;
+        size_t distance = 0;
+        if (i + LZSS_MIN_MATCH <= length) {
+            const unsigned int h = hash3_fast(&data[i]);
+            const size_t candidate = head[h];
+            head[h] = (uint16_t) (i + 1);
+
+            if (candidate != 0 && i - (candidate - 1) <= LZSS_WINDOW_SIZE) {
+                const size_t p = candidate - 1;
+                const size_t limit = length - i < LZSS_MAX_MATCH ? length - i : LZSS_MAX_MATCH;
+                while (match_length < limit && data[p + match_length] == data[i + match_length]) {
+                    match_length++;
+                }
+                distance = i - p;
+            }
+        }
+
+        if (match_length < LZSS_MIN_MATCH) {
+            put_literal(&writer, data[i++]);
+            continue;
+        }
+
+        put_match(&writer, distance, match_length);
+        for (const size_t end = i + match_length; ++i < end; ) {
+            if (i + LZSS_MIN_MATCH <= length) {
+                head[hash3_fast(&data[i])] = (uint16_t) (i + 1);
+            }
+        }
+    }
+
+    return writer.length;
+}
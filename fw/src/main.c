@@ -3,19 +3,27 @@
 
 #include "pch.h"
 
+#include <inttypes.h>
+
+#include "boot_core1.h"
 #include "breakpoint.h"
+#include "diag/boot_profile.h"
 #include "diag/log/log.h"
 #include "diag/mem.h"
 #include "display/display.h"
 #include "display/dvi/dvi.h"
 #include "driver.h"
-#include "global.h"
+#include "fatal.h"
 #include "hw.h"
 #include "input.h"
 #include "menu/menu.h"
 #include "pet.h"
+#include "pool.h"
 #include "sd/sd.h"
+#include "sd/sd_stream.h"
 #include "system_state.h"
+#include "uart/uart_rx.h"
+#include "uart/uart_tx.h"
 #include "ui/cli.h"
 #include "usb/usb.h"
 
@@ -35,19 +43,145 @@ void measure_freqs(uint fpga_div) {
 }
 
 void fpga_write_zeros(size_t count) {
-    assert(count <= TEMP_BUFFER_SIZE);
-    
-    uint8_t* temp_buffer = acquire_temp_buffer();
+    uint8_t* temp_buffer = pool_alloc(count, "fpga");
     memset(temp_buffer, 0, count);
     spi_write_blocking(FPGA_SPI_INSTANCE, temp_buffer, count);
-    release_temp_buffer(&temp_buffer);
+    pool_free(temp_buffer);
 }
 
-void fpga_read_bitstream_callback(size_t offset, uint8_t* buffer, size_t bytes_read, void* context) {
+// During configuration the bitstream is a raw byte stream with no STALL
+// handshake, so each chunk is sent by DMA while the next is read from the SD
+// card (on the other SPI instance).
+static void bitstream_begin(void* context, size_t offset, const uint8_t* buffer, size_t length) {
     (void)offset;
-    (void)context;
+    const uint channel = *(const uint*)context;
+
+    dma_channel_config config = dma_channel_get_default_config(channel);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_8);
+    channel_config_set_read_increment(&config, true);
+    channel_config_set_write_increment(&config, false);
+    channel_config_set_dreq(&config, spi_get_dreq(FPGA_SPI_INSTANCE, /* is_tx: */ true));
+    dma_channel_configure(
+        channel, &config,
+        &spi_get_hw(FPGA_SPI_INSTANCE)->dr,     // Write address (SPI data register)
+        buffer,                                 // Read address
+        length,                                 // Transfer count
+        /* trigger: */ true);
+}
+
+static void bitstream_wait(void* context) {
+    const uint channel = *(const uint*)context;
+    dma_channel_wait_for_finish_blocking(channel);
 
-    spi_write_blocking(FPGA_SPI_INSTANCE, buffer, bytes_read);
+    // Wait for the last byte to shift out, then discard what was clocked in
+    // (as spi_write_blocking() does) and clear the RX overrun it caused.
+    while (spi_is_busy(FPGA_SPI_INSTANCE)) {
+        tight_loop_contents();
+    }
+    while (spi_is_readable(FPGA_SPI_INSTANCE)) {
+        (void)spi_get_hw(FPGA_SPI_INSTANCE)->dr;
+    }
+    spi_get_hw(FPGA_SPI_INSTANCE)->icr = SPI_SSPICR_RORIC_BITS;
+}
+
+// Configuration: configure the FPGA from the flash copy of the bitstream (see
+// sd_cache.h) before the SD card is mounted, if a compressed copy is cached.
+#ifndef FPGA_BITSTREAM_FROM_FLASH
+#define FPGA_BITSTREAM_FROM_FLASH 1
+#endif
+
+// To generate a '*.hex.bin' file, you must enable 'Generate SPI Raw Binary Configuration File'
+// under ~File ~Edit Project ~Bitstream Generation. It may be LZSS compressed with 'lzpack'.
+static const char bitstream_path[] = "/fpga/EconoPET.hex.bin";
+
+// True if a JTAG programmer is attached, in which case the FPGA is left alone.
+static bool fpga_programmer_attached;
+
+// Size and mtime of the SD card file that the flash copy used by fpga_init() was made from,
+// to be checked by fpga_check() once the SD card is mounted.
+static bool fpga_from_flash;
+static uint32_t fpga_flash_size;
+static uint32_t fpga_flash_mtime;
+
+// Send the bitstream, from the flash copy if 'from_flash' is true (returning false if there is
+// none or it is corrupt) and otherwise from the SD card.
+static bool fpga_send_bitstream(bool from_flash) {
+    uint channel = (uint)dma_claim_unused_channel(/* required: */ true);
+    const sd_stream_sink_t sink = {
+        .begin = bitstream_begin,
+        .wait = bitstream_wait,
+        .context = &channel,
+    };
+
+    sd_stream_stats_t stats;
+    bool ok;
+    if (from_flash) {
+        ok = sd_stream_flash(bitstream_path, &sink, &stats, &fpga_flash_size, &fpga_flash_mtime);
+    } else if (!(ok = sd_stream_path(bitstream_path, /* cache: */ true, &sink, SIZE_MAX, &stats))) {
+        fatal("error reading '%s'", bitstream_path);
+    }
+    dma_channel_unclaim(channel);
+
+    if (ok) {
+        sd_stream_log(from_flash ? "FPGA bitstream (flash)" : "FPGA bitstream", &stats);
+    }
+    return ok;
+}
+
+// Reset the FPGA and send it the bitstream (see fpga_send_bitstream()). Returns false if the
+// FPGA was not configured.
+static bool fpga_configure(bool from_flash) {
+    // Create a clean CRESET_N pulse to initiate FPGA configuration.
+    gpio_set_dir(FPGA_CRESET_GP, GPIO_OUT);
+    gpio_put(FPGA_CRESET_GP, 1);
+    sleep_ms(1);  // t_CRESET_N = 320 ns
+    gpio_put(FPGA_CRESET_GP, 0);
+    sleep_ms(1);  // t_CRESET_N = 320 ns
+
+    // Efinix requires SPI mode 3 for configuration.
+    spi_set_format(FPGA_SPI_INSTANCE, 8, SPI_CPOL_1, SPI_CPHA_1, SPI_MSB_FIRST);
+
+    // Changes in clock polarity do not seem to take effect until the next write.  Send
+    // a single byte while CS_N is deasserted to transition SCK to high.
+    fpga_write_zeros(/* count: */ 1);
+    sleep_ms(1);  // t_CRESET_N = 320 ns
+
+    // The Efinix FPGA samples CS_N on the positive edge of CRESET_N to select passive
+    // vs. active SPI configuration.  (0 = Passive, 1 = Active)
+    gpio_put(FPGA_SPI_CSN_GP, 0);
+
+    sleep_ms(1);  // t_CRESET_N = 320 ns
+    gpio_put(FPGA_CRESET_GP, 1);
+    sleep_ms(1);  // t_CRESET_N = 320 ns
+
+    boot_phase_begin("bitstream", from_flash ? "flash" : "sd");
+    const bool ok = fpga_send_bitstream(from_flash);
+    boot_phase_end();
+
+    // To ensure successful configuration, the microprocessor must continue to supply the
+    // configuration clock to the Trion FPGA for at least 100 cycles after sending the last
+    // configuration data.
+    //
+    // Efinix example clocks out 1000 zero bits to generate extra clock cycles.
+    fpga_write_zeros(/* count: */ 125);
+
+    // Deassert CS_N to signal end of configuration.
+    sleep_ms(1);  // t_CRESET_N = 320 ns
+    gpio_put(FPGA_SPI_CSN_GP, 1);
+
+    // Restore SPI mode 0
+    spi_set_format(FPGA_SPI_INSTANCE, 8, SPI_CPOL_0, SPI_CPHA_0, SPI_MSB_FIRST);
+
+    // Changes in clock polarity do not seem to take effect until the next write.  Send
+    // a single byte while CS_N is deasserted to transition SCK to low.
+    fpga_write_zeros(/* count: */ 1);
+
+    if (ok) {
+        // Time from reset until the FPGA generates video (i.e., the PET monitor has sync).
+        log_info("FPGA configured from %s (%" PRIu32 " ms after reset)", from_flash ? "flash" : "SD card",
+            to_ms_since_boot(get_absolute_time()));
+    }
+    return ok;
 }
 
 void fpga_init() {
@@ -76,6 +210,12 @@ void fpga_init() {
     // See: https://github.com/Bodmer/TFT_eSPI/discussions/2432
     // See: https://github.com/raspberrypi/pico-examples/blob/master/clocks/hello_48MHz/hello_48MHz.c
     stdio_init_all();
+
+    // Route stdout through the DMA-driven TX ring so console output does not
+    // stall the main loop, and buffer input from the RX interrupt so none is
+    // lost while it is busy.
+    uart_tx_init();
+    uart_rx_init();
     printf("\e[2J");
 
     log_debug("FLASH_SIZE=0x%08x XOSC_DELAY=%d", PICO_FLASH_SIZE_BYTES, PICO_XOSC_STARTUP_DELAY_MULTIPLIER);
@@ -102,57 +242,57 @@ void fpga_init() {
     // If CRESET_N is is high, we know a JTAG programmer is attached and skip FPGA configuration.
     if (gpio_get(FPGA_CRESET_GP)) {
         log_warn("FPGA config skipped: Programmer attached");
+        fpga_programmer_attached = true;
         return;
     }
 
-    // Create a clean CRESET_N pulse to initiate FPGA configuration.
-    gpio_set_dir(FPGA_CRESET_GP, GPIO_OUT);
-    gpio_put(FPGA_CRESET_GP, 1);
-    sleep_ms(1);  // t_CRESET_N = 320 ns
-    gpio_put(FPGA_CRESET_GP, 0);
-    sleep_ms(1);  // t_CRESET_N = 320 ns
-
-    // Efinix requires SPI mode 3 for configuration.
-    spi_set_format(FPGA_SPI_INSTANCE, 8, SPI_CPOL_1, SPI_CPHA_1, SPI_MSB_FIRST);
-
-    // Changes in clock polarity do not seem to take effect until the next write.  Send
-    // a single byte while CS_N is deasserted to transition SCK to high.
-    fpga_write_zeros(/* count: */ 1);
-    sleep_ms(1);  // t_CRESET_N = 320 ns
-
-    // The Efinix FPGA samples CS_N on the positive edge of CRESET_N to select passive
-    // vs. active SPI configuration.  (0 = Passive, 1 = Active)
-    gpio_put(FPGA_SPI_CSN_GP, 0);
+}
 
-    sleep_ms(1);  // t_CRESET_N = 320 ns
-    gpio_put(FPGA_CRESET_GP, 1);
-    sleep_ms(1);  // t_CRESET_N = 320 ns
+// Configure the FPGA from the flash copy of the bitstream, if there is one, without waiting for
+// the SD card.
+void fpga_load_flash() {
+    if (!fpga_programmer_attached) {
+        fpga_from_flash = FPGA_BITSTREAM_FROM_FLASH && fpga_configure(/* from_flash: */ true);
+    }
+}
 
-    // Send bitstream to FPGA. To generate a '*.hex.bin' file, you must enable 'Generate SPI Raw
-    // Binary Configuration File' under ~File ~Edit Project ~Bitstream Generation.
-    sd_read_file("/fpga/EconoPET.hex.bin", fpga_read_bitstream_callback, NULL, SIZE_MAX);
+// Configure the FPGA from the SD card unless fpga_init() already configured it from a flash copy
+// of the same file. A copy that no longer matches the card is replaced, so the PET's video
+// restarts briefly after the bitstream on the card changes.
+void fpga_check() {
+    vet(!boot_core1_busy(), "FPGA: SD card must be mounted before fpga_check()");
 
-    // To ensure successful configuration, the microprocessor must continue to supply the
-    // configuration clock to the Trion FPGA for at least 100 cycles after sending the last
-    // configuration data.
-    //
-    // Efinix example clocks out 1000 zero bits to generate extra clock cycles.
-    fpga_write_zeros(/* count: */ 125);
+    if (fpga_programmer_attached) {
+        return;
+    }
 
-    // Deassert CS_N to signal end of configuration.
-    sleep_ms(1);  // t_CRESET_N = 320 ns
-    gpio_put(FPGA_SPI_CSN_GP, 1);
+    if (fpga_from_flash) {
+        uint32_t size;
+        uint32_t mtime;
+        if (!sd_stat(bitstream_path, &size, &mtime)) {
+            log_warn("FPGA: '%s' not on SD card; keeping the flash copy", bitstream_path);
+            return;
+        }
+        if (size == fpga_flash_size && mtime == fpga_flash_mtime) {
+            return;
+        }
+        log_info("FPGA: '%s' changed on the SD card", bitstream_path);
+    }
 
-    // Restore SPI mode 0
-    spi_set_format(FPGA_SPI_INSTANCE, 8, SPI_CPOL_0, SPI_CPHA_0, SPI_MSB_FIRST);
+    fpga_configure(/* from_flash: */ false);
+}
 
-    // Changes in clock polarity do not seem to take effect until the next write.  Send
-    // a single byte while CS_N is deasserted to transition SCK to low.
-    fpga_write_zeros(/* count: */ 1);
+// Result of sd_card_init() on core1.
+static int sd_card_error;
 
-    log_info("FPGA configured");
+static void init_sd_card(void* context) {
+    (void)context;
+    sd_card_error = sd_card_init();
 }
 
+// Run 'call' as the boot phase 'name' (see boot_profile.h).
+#define BOOT_PHASE(name, call) do { boot_phase_begin(name, NULL); call; boot_phase_end(); } while (0)
+
 int main() {
     // Note: A prolonged period without a valid sync signal may cause the PET monitor to
     // display a "bright spot" which can damage the CRT phosphor. Therefore, we initialize
@@ -167,21 +307,38 @@ int main() {
     gpio_set_dir(PICO_DEFAULT_LED_PIN, GPIO_OUT);
     gpio_put(PICO_DEFAULT_LED_PIN, 1);
 
-    log_init();     // Initialize logging subsystem early for boot diagnostics
-    input_init();   // Begin charging debounce capacitor for menu button (if any)
-    sd_init();      // SD card is required to read the FPGA's bitstream file
-    fpga_init();    // Setup sys_clock, FPGA_SPI, and configure FPGA
+    BOOT_PHASE("log_init()", log_init());                // Initialize logging subsystem early for boot diagnostics
+    BOOT_PHASE("input_init()", input_init());            // Begin charging debounce capacitor for menu button (if any)
+    BOOT_PHASE("sd_flash_init()", sd_flash_init());      // Flash may hold a copy of the FPGA's bitstream file
+    BOOT_PHASE("fpga_init()", fpga_init());              // Setup sys_clock and FPGA_SPI
+
+    // Bring up the SD card (on core1 if BOOT_CORE1, see boot_core1.h) before or while core0
+    // configures the FPGA from flash.  The SD card's SPI baud rate is derived from 'peri_clk', so
+    // this must follow fpga_init().  Only the card's bring-up may run on core1.  Creating the
+    // block device and mounting it use the heap, errno, and the VFS mount table, which core0 is
+    // using to read the bitstream from /flash, so both stay on core0.  Core1 is joined before the
+    // card is mounted, and before video_init() launches the DVI loop.
+    sd_create();
+    boot_core1_start("sd_card_init()", init_sd_card, NULL);
+    BOOT_PHASE("fpga_load_flash()", fpga_load_flash());  // Configure FPGA from flash if possible
+    boot_core1_join();
+    if (sd_card_error != 0) {
+        log_warn("sd: card init error %d", sd_card_error);
+    }
+    BOOT_PHASE("sd_init()", sd_init());                  // SD card holds the FPGA's bitstream file
+    BOOT_PHASE("fpga_check()", fpga_check());            // Configure FPGA from the SD card if the flash copy is missing or stale
 
     // We now are generating a valid video signal for the PET, so it's safe to proceed
     // with the rest of the initialization.
 
-    display_init(); // Initialize firmware display subsystem
-    usb_init();     // Initialize USB subsystem
-    cli_init();     // Start CLI on UART serial
-    bp_init();      // Initialize breakpoint subsystem
-    
+    BOOT_PHASE("display_init()", display_init());        // Initialize firmware display subsystem
+    BOOT_PHASE("usb_init()", usb_init());                // Initialize USB subsystem
+    BOOT_PHASE("cli_init()", cli_init());                // Start CLI on UART serial
+    BOOT_PHASE("bp_init()", bp_init());                  // Initialize breakpoint subsystem
+
     // Enter boot menu
-    menu_enter(/* is_boot: */ true);
+    BOOT_PHASE("menu_enter()", menu_enter(/* is_boot: */ true));
+    boot_profile_finish();
 
     // PET is configured and running.  Enter main loop to synchronize displays, service
     // input queues, and check for menu/reset button.
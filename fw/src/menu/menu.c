@@ -6,6 +6,8 @@
 
 #include <dirent.h>
 
+#include "crc_sniff.h"
+#include "diag/boot_profile.h"
 #include "diag/log/log.h"
 #include "display/char_encoding.h"
 #include "display/display.h"
@@ -14,16 +16,21 @@
 #include "driver.h"
 #include "fatal.h"
 #include "filesystem/vfs.h"
-#include "global.h"
 #include "hw.h"
+#include "ieee/ieee.h"
 #include "input.h"
 #include "menu_config.h"
 #include "pet.h"
+#include "pool.h"
 #include "roms/checksum.h"
+#include "roms/rom_digest.h"
+#include "roms/rom_pages.h"
 #include "roms/roms.h"
 #include "sd/sd.h"
+#include "sd/sd_stream.h"
 #include "system_state.h"
 #include "tape.h"
+#include "term_inject.h"
 #include "usb/keyboard.h"
 
 // When navigating the SD card's file system, this is the maximum number
@@ -35,7 +42,45 @@ const uint screen_height = 25;
 
 #define CH_SPACE 0x20
 
-#define CHUNK_SIZE 2048
+// Streams file contents into PET memory. FPGA writes are CPU-driven (each byte
+// waits on SPI_STALL), so the sink is synchronous and the SD read of the next
+// chunk follows it. Soft-ROM pages that already hold the data are skipped
+// (see rom_pages.h).
+typedef struct {
+    rom_pages_stream_t stream;
+    size_t length;          // Bytes written so far
+    uint8_t checksum;
+    bool sniff;             // Add the data to the DMA sniffer's CRC-32 (see crc_sniff.h)
+} sram_sink_t;
+
+static void sram_sink_begin(void* context, size_t offset, const uint8_t* buffer, size_t length) {
+    sram_sink_t* const sink = context;
+
+    // The sniffer reads 'buffer' while the CPU writes it to the FPGA.
+    if (sink->sniff) {
+        crc_sniff_start(buffer, length);
+    }
+    checksum_add(buffer, length, &sink->checksum);
+    rom_pages_stream_write(&sink->stream, buffer, length);
+    sink->length = offset + length;
+    if (sink->sniff) {
+        crc_sniff_wait();
+    }
+}
+
+// Stream the rest of 'file' to PET memory at 'address'. Returns false on a
+// read error.
+static bool stream_to_sram(FILE* file, const char* filename, uint32_t address, sram_sink_t* sram) {
+    *sram = (sram_sink_t) { 0 };
+    rom_pages_stream_begin(&sram->stream, address);
+    const sd_stream_sink_t sink = { .begin = sram_sink_begin, .context = sram };
+
+    sd_stream_stats_t stats;
+    const bool ok = sd_stream_file(file, &sink, SIZE_MAX, &stats);
+    rom_pages_stream_end(&sram->stream);
+    sd_stream_log(filename, &stats);
+    return ok;
+}
 
 void load_prg(const char *filename) {
     FILE *file = sd_open(filename, "rb"); // Open file in binary read mode
@@ -51,21 +96,11 @@ void load_prg(const char *filename) {
     }
 
     // Read remaining bytes to the destination address.
-    uint8_t buffer[CHUNK_SIZE];
-    size_t bytes_read;
-    size_t total_bytes = 0;
-
-    while ((bytes_read = fread(buffer, 1, CHUNK_SIZE, file)) > 0) {
-        spi_write(dest, buffer, bytes_read);
-        dest += bytes_read;
-        total_bytes += bytes_read;
-
-        // Check for read errors (other than EOF)
-        if (bytes_read < CHUNK_SIZE && ferror(file)) {
-            perror("Error reading file");
-            break;
-        }
+    sram_sink_t sram;
+    if (!stream_to_sram(file, filename, dest, &sram)) {
+        perror("Error reading file");
     }
+    const size_t total_bytes = sram.length;
 
     fclose(file);  // Close the file
 
@@ -81,68 +116,88 @@ typedef struct action_context_s {
     system_state_t* system_state;
 } action_context_t;
 
-void action_load(void* const context, const char* filename, uint32_t address) {
+// Record the CRC-32 of a loaded file for the 'roms' CLI command, and stop if
+// it is not the one config.yaml expects.
+static void check_digest(const char* filename, uint32_t address, uint32_t length, uint32_t crc,
+                         const uint32_t* expected) {
+    if (!rom_digest_add(filename, address, length, crc, expected)) {
+        fatal("'%s' has CRC-32 %08lx, but config.yaml expects %08lx", filename, crc, *expected);
+    }
+}
+
+void action_load(void* const context, const char* filename, uint32_t address, const uint32_t* crc) {
     (void) context;
 
     log_debug("0x%04lx", address);
-    FILE *file = sd_open(filename, "rb"); // Open file in binary read mode
-    if (!file) {
-        fatal("Failed to open file '%s'", filename);
+    boot_phase_begin("load", filename);
+
+    // If the previous config loaded the same file here and its pages have not
+    // been touched since, there is nothing to read.
+    uint32_t mtime;
+    uint32_t length;
+    uint32_t actual_crc;
+    const bool dated = sd_mtime(filename, &mtime);
+    if (dated && rom_pages_reuse(filename, mtime, address, &length, &actual_crc)) {
+        boot_phase_end();
+        log_debug("%s: unchanged", filename);
+        check_digest(filename, address, length, actual_crc, crc);
+        return;
     }
 
-    // Read remaining bytes to the destination address.
-    uint8_t* temp_buffer = acquire_temp_buffer();
-    size_t bytes_read;
-    uint8_t checksum = 0;
-
-    while ((bytes_read = fread(temp_buffer, 1, TEMP_BUFFER_SIZE, file)) > 0) {
-        checksum_add(temp_buffer, bytes_read, &checksum);
-        spi_write(address, temp_buffer, bytes_read);
-        address += bytes_read;
-
-        // Check for read errors (other than EOF)
-        if (bytes_read < TEMP_BUFFER_SIZE && ferror(file)) {
-            fatal("Failed to read file '%s'", filename);
-        }
+    // ROMs are read whole, so bypass stdio for multi-block SD reads.
+    sram_sink_t sram = { .sniff = true };
+    rom_pages_stream_begin(&sram.stream, address);
+    crc_sniff_begin();
+    const sd_stream_sink_t sink = { .begin = sram_sink_begin, .context = &sram };
+    sd_stream_stats_t stats;
+    if (!sd_stream_path(filename, /* cache: */ true, &sink, SIZE_MAX, &stats)) {
+        fatal("Failed to read file '%s'", filename);
+    }
+    rom_pages_stream_end(&sram.stream);
+    actual_crc = crc_sniff_end();
+    boot_phase_end();
+    sd_stream_log(filename, &stats);
+
+    check_digest(filename, address, sram.length, actual_crc, crc);
+    if (dated) {
+        rom_pages_remember(filename, mtime, address, sram.length, actual_crc);
     }
 
-    log_debug("-%04lx: %s ($%02x)", address - 1, filename, checksum);
-
-    release_temp_buffer(&temp_buffer);
-    fclose(file);
+    log_debug("-%04lx: %s ($%02x, CRC-32 %08lx)", address + sram.length - 1, filename, sram.checksum, actual_crc);
 }
 
 void action_patch(void* context, uint32_t address, const binary_t* binary) {
     (void) context;
 
     log_debug("0x%04lx: patching %zu bytes", address, binary->size);
-    spi_write(address, binary->data, binary->size);
+    rom_pages_write(address, binary->data, binary->size);
 }
 
 void action_copy(void* context, uint32_t source, uint32_t destination, uint32_t length) {
     (void)context;
 
     log_debug("0x%04lx: copying %lu bytes from 0x%04lx", source, length, destination);
-    uint8_t* temp_buffer = acquire_temp_buffer();
+    uint8_t* temp_buffer = pool_alloc(POOL_MEDIUM_SIZE, "copy");
+    rom_pages_flush(source, length);
 
     if (destination > source) {
         while (length > 0) {
-            size_t chunk_size = MIN(length, TEMP_BUFFER_SIZE);
+            size_t chunk_size = MIN(length, POOL_MEDIUM_SIZE);
             spi_read(source + length - chunk_size, chunk_size, temp_buffer);
-            spi_write(destination + length - chunk_size, temp_buffer, chunk_size);
+            rom_pages_write(destination + length - chunk_size, temp_buffer, chunk_size);
             length -= chunk_size;
         }
     } else {
         uint32_t offset = 0;
         while (offset < length) {
-            size_t chunk_size = MIN(length - offset, TEMP_BUFFER_SIZE);
+            size_t chunk_size = MIN(length - offset, POOL_MEDIUM_SIZE);
             spi_read(source + offset, chunk_size, temp_buffer);
-            spi_write(destination + offset, temp_buffer, chunk_size);
+            rom_pages_write(destination + offset, temp_buffer, chunk_size);
             offset += chunk_size;
         }
     }
 
-    release_temp_buffer(&temp_buffer);
+    pool_free(temp_buffer);
 }
 
 void action_set_options(void* context, options_t* options) {
@@ -170,12 +225,15 @@ void action_set_options(void* context, options_t* options) {
 
     write_pet_model(ctx->system_state);
 
-    tape_init(options->tape_enabled ? &options->tape : NULL);
+    tape_init(options->tape_enabled ? &options->tape : NULL,
+              options->tape_save_enabled ? &options->tape_save : NULL);
+    term_inject_init(options->key_buffer_enabled ? &options->key_buffer : NULL);
+    ieee_init(options->ieee_enabled ? &options->ieee : NULL);
 
     log_debug("Set options: %lu columns, video RAM mask %lu", options->columns, options->video_ram_mask);
 }
 
-void read_keymap_callback(size_t offset, uint8_t* buffer, size_t bytes_read, void* context) {
+void read_keymap_callback(size_t offset, const uint8_t* buffer, size_t bytes_read, void* context) {
     memcpy(context + offset, buffer, bytes_read);
 }
 
@@ -191,15 +249,16 @@ void action_set_keymap(void* context, const char* filename) {
     read_keymap(filename, ctx->system_state);
 }
 
+// Read back the range to check a fixed checksum (see ROM_PAGES_VERIFY).
 static uint8_t checksum_ram(uint32_t start_addr, uint32_t end_addr) {
     uint8_t checksum = 0;
-    uint8_t* temp_buffer = acquire_temp_buffer();
+    uint8_t* temp_buffer = pool_alloc(POOL_MEDIUM_SIZE, "checksum");
     
     uint32_t addr = start_addr;
     uint32_t remaining_bytes = end_addr - start_addr;
 
     while (remaining_bytes > 0) {
-        size_t chunk_size = MIN(remaining_bytes, TEMP_BUFFER_SIZE);
+        size_t chunk_size = MIN(remaining_bytes, POOL_MEDIUM_SIZE);
         spi_read(addr, chunk_size, temp_buffer);
         checksum_add(temp_buffer, chunk_size, &checksum);
         
@@ -207,25 +266,30 @@ static uint8_t checksum_ram(uint32_t start_addr, uint32_t end_addr) {
         remaining_bytes -= chunk_size;
     }
 
-    release_temp_buffer(&temp_buffer);
+    pool_free(temp_buffer);
     return checksum;
 }
 
 void action_fix_checksum(void* context, uint32_t start_addr, uint32_t end_addr, uint32_t fix_addr, uint32_t expected) {
     (void) context;
 
-    uint8_t actual_sum = checksum_ram(start_addr, end_addr + 1);
+    // Computed from the checksums rom_pages kept as the ROM was written.
+    uint8_t actual_sum = rom_pages_checksum(start_addr, end_addr + 1 - start_addr);
 
     if (actual_sum != expected) {
+        rom_pages_flush(fix_addr, 1);
         uint8_t current_byte = spi_read_at(fix_addr);
         uint8_t adjusted_byte = checksum_fix(current_byte, actual_sum, expected);
 
         log_debug("0x%04lx: fixing checksum for $%04lx-%04lx ($%02x -> $%02lx)", 
             fix_addr, start_addr, end_addr, actual_sum, expected);
 
-        spi_write_at(fix_addr, adjusted_byte);
+        rom_pages_write(fix_addr, &adjusted_byte, 1);
 
-        assert(checksum_ram(start_addr, end_addr + 1) == expected);
+        if (ROM_PAGES_VERIFY) {
+            vet(checksum_ram(start_addr, end_addr + 1) == expected,
+                "Checksum of $%04lx-%04lx did not read back as fixed", start_addr, end_addr);
+        }
     }
 }
 
@@ -233,6 +297,7 @@ void menu_enter(bool is_boot) {
     log_info("-- Enter Menu --");
 
     tape_deinit();
+    ieee_deinit();
 
     system_state.video_source = video_source_firmware;
     
@@ -258,10 +323,14 @@ void menu_enter(bool is_boot) {
         .system_state = &system_state,
     };
 
-    menu_config_show(&window, &setup_sink, is_boot);
+    const bool reset = menu_config_show(&window, &setup_sink, is_boot);
 
     system_state.video_source = video_source_pet;
-    pet_reset();
+    if (reset) {
+        boot_phase_begin("pet_reset", NULL);
+        pet_reset();
+        boot_phase_end();
+    }
 
     log_info("-- Exit Menu --");
 }
@@ -4,21 +4,113 @@
 #include "pch.h"
 #include "menu_config.h"
 
+#include <inttypes.h>
+
 #include "config/config.h"
+#include "config/config_cache.h"
+#include "diag/boot_profile.h"
 #include "diag/log/log.h"
 #include "diag/mem.h"
 #include "display/display.h"
 #include "display/window.h"
 #include "driver.h"
 #include "fatal.h"
-#include "global.h"
 #include "input.h"
 #include "pet.h"
+#include "roms/rom_digest.h"
+#include "roms/rom_pages.h"
 #include "roms/roms.h"
+#include "sd/sd.h"
+#include "snapshot/snapshot.h"
+
+#define CONFIG_PATH "/config.yaml"
+
+// Compiled copy of config.yaml (see config_cache.h), kept in flash.
+#define CONFIG_CACHE_PATH SD_FLASH_MOUNT_POINT "/config.bin"
+#define CONFIG_CACHE_TEMP_PATH SD_FLASH_MOUNT_POINT "/config.tmp"
+
+// The compiled copy opened while listing the configs for the menu. It is kept
+// open so that load_config() can run just the selected config's actions
+// instead of going through config.yaml again.
+static FILE* compiled = NULL;
+static config_cache_index_t compiled_index;
+
+static void close_compiled(void) {
+    if (compiled != NULL) {
+        fclose(compiled);
+        compiled = NULL;
+    }
+}
+
+// Keep 'file' open for load_config() after listing the configs.
+static void keep_compiled(FILE* file, int target_index) {
+    if (target_index < 0) {
+        compiled = file;
+    } else {
+        fclose(file);
+    }
+}
+
+// Invoke 'sink' for config.yaml. Replays the compiled copy if it matches the
+// YAML on the SD card. Otherwise parses the YAML (reporting any errors as
+// usual) and compiles it for next time.
+static void run_config(const config_sink_t* const sink, int target_index) {
+    close_compiled();
+
+    config_cache_key_t key;
+    if (!sd_stat(CONFIG_PATH, &key.size, &key.mtime)) {
+        // Let the parser report the missing file.
+        parse_config_file(CONFIG_PATH, sink, target_index);
+        return;
+    }
+
+    FILE* file = fopen(CONFIG_CACHE_PATH, "rb");
+    if (file != NULL) {
+        if (config_cache_replay(file, &key, sink, target_index, &compiled_index)) {
+            log_debug("config: using compiled %s", CONFIG_PATH);
+            keep_compiled(file, target_index);
+            return;
+        }
+        fclose(file);
+    }
+
+    file = fopen(CONFIG_CACHE_TEMP_PATH, "w+b");
+    if (file == NULL) {
+        // No flash file system. Parse every time.
+        parse_config_file(CONFIG_PATH, sink, target_index);
+        return;
+    }
+
+    config_cache_writer_t writer;
+    config_cache_write_begin(&writer, file);
+    parse_config_file_compiled(CONFIG_PATH, sink, target_index, &writer);
+    const bool ok = config_cache_write_end(&writer, &key);
+
+    if (fclose(file) != 0 || !ok) {
+        log_warn("config: cannot compile %s", CONFIG_PATH);
+        remove(CONFIG_CACHE_TEMP_PATH);
+        return;
+    }
+
+    // littlefs replaces the old copy atomically.
+    rename(CONFIG_CACHE_TEMP_PATH, CONFIG_CACHE_PATH);
+    log_info("config: compiled %s", CONFIG_PATH);
+
+    // Index the new copy (without invoking 'sink' again) for load_config().
+    file = fopen(CONFIG_CACHE_PATH, "rb");
+    if (file != NULL) {
+        if (config_cache_replay(file, &key, NULL, -1, &compiled_index)) {
+            keep_compiled(file, target_index);
+        } else {
+            fclose(file);
+        }
+    }
+}
 
 void load_config(const setup_sink_t* const setup_sink, int selected_config) {
     // Load the selected config
     log_info("Loading config: %d", selected_config);
+    boot_phase_begin("config:apply", NULL);
 
     // Suspend the CPU while we're loading the config.
     set_cpu(/* ready: */ false, /* reset: */ false, /* nmi: */ false);
@@ -36,9 +128,11 @@ void load_config(const setup_sink_t* const setup_sink, int selected_config) {
     // In the EconoPET, all "unmapped" memory regions fall through to RAM (or soft-ROM),
     // so we approximate this effect by prefilling $9000-$FFFF with the high byte of the
     // address.  The loaded config will overwrite the populated ROM regions.
-    for (uint16_t a = 0x90; a <= 0xff; a++) {
-        spi_fill(a << 8, a, 0x100);
-    }
+    //
+    // rom_pages defers the prefill to rom_pages_end() so that only the pages the config
+    // leaves unmapped are filled, and skips pages that already hold what is written.
+    rom_pages_begin();
+    rom_digest_clear();
 
     config_sink_t sink = {
         .context = NULL,
@@ -46,10 +140,29 @@ void load_config(const setup_sink_t* const setup_sink, int selected_config) {
         .on_enter_config = NULL,
         .on_exit_config = NULL,
         .on_default = NULL,
+        .on_search_order = NULL,
     };
     
-    parse_config_file("/config.yaml", &sink, selected_config);
+    // The menu normally left the compiled config.yaml open, so only the
+    // selected config's actions need to be read. config_cache_run() fails only
+    // before running any action, so the YAML can be run in its place.
+    if (compiled != NULL && config_cache_run(compiled, &compiled_index, selected_config, setup_sink)) {
+        log_debug("config: applied compiled config %d", selected_config);
+    } else {
+        run_config(&sink, selected_config);
+    }
+    close_compiled();
+
+    rom_pages_stats_t stats;
+    rom_pages_end(ROM_PAGES_VERIFY, &stats);
+    log_info("ROM pages: %" PRIu32 " written, %" PRIu32 " unchanged (%" PRIu32 " files reused), %" PRIu32 " checksummed",
+        stats.written, stats.unchanged, stats.reused, stats.summed);
+    if (ROM_PAGES_VERIFY) {
+        log_info("ROM pages: %" PRIu32 " verified, %" PRIu32 " mismatched", stats.verified, stats.mismatched);
+    }
+
     roms_refresh_char_rom();
+    boot_phase_end();
 }
 
 typedef struct context_s {
@@ -65,6 +178,11 @@ static void on_default_callback(void* context, const char* id) {
     ctx->default_id[sizeof(ctx->default_id) - 1] = '\0';
 }
 
+static void on_search_order_callback(void* context, const char* order) {
+    (void) context;
+    vet(sd_set_search_order(order), "/config.yaml: invalid search-order '%s'", order);
+}
+
 static void on_config_callback(void* context, const char* id, const char* name) {
     context_t* const ctx = (context_t*) context;
     window_puts(ctx->window, window_xy(ctx->window, 0, ctx->config_count), name);
@@ -76,7 +194,7 @@ static void on_config_callback(void* context, const char* id, const char* name)
     ctx->config_count++;
 }
 
-void menu_config_show(const window_t* const window, const setup_sink_t* const setup_sink, bool is_boot) {
+bool menu_config_show(const window_t* const window, const setup_sink_t* const setup_sink, bool is_boot) {
     context_t context = {
         .window = window,
         .config_count = 0,
@@ -90,12 +208,15 @@ void menu_config_show(const window_t* const window, const setup_sink_t* const se
         .on_enter_config = NULL,
         .on_exit_config = on_config_callback,
         .on_default = on_default_callback,
+        .on_search_order = on_search_order_callback,
     };
 
     // Fill window with spaces
     window_fill(window, 0x20);
 
-    parse_config_file("/config.yaml", &sink, -1);
+    boot_phase_begin("config:list", NULL);
+    run_config(&sink, -1);
+    boot_phase_end();
 
     bool has_default = context.default_id[0] != '\0';
     bool default_matched = has_default && context.default_index >= 0;
@@ -107,7 +228,8 @@ void menu_config_show(const window_t* const window, const setup_sink_t* const se
     // boot it without showing the menu.
     if (is_boot && default_matched) {
         log_info("Auto-booting default config: '%s' (index %d)", context.default_id, context.default_index);
-        return load_config(setup_sink, context.default_index);
+        load_config(setup_sink, context.default_index);
+        return true;
     }
 
     // Play the happy boot tune via NMI now that we know we are showing the menu.
@@ -147,7 +269,20 @@ void menu_config_show(const window_t* const window, const setup_sink_t* const se
             case '\r':
             case '\n':
             case KEY_BTN_LONG: {
-                return load_config(setup_sink, selected_config);
+                load_config(setup_sink, selected_config);
+                return true;
+            }
+            case 'R':
+            case 'r': {
+                // Restore the snapshot saved by 'snap save' over the selected
+                // config (which should be the one it was saved from). Without a
+                // usable snapshot, stay in the menu rather than apply the config.
+                // If the restore fails after all, the PET is reset into the config.
+                if (!snapshot_check(SNAPSHOT_DEFAULT_PATH)) {
+                    break;
+                }
+                load_config(setup_sink, selected_config);
+                return !snapshot_restore(SNAPSHOT_DEFAULT_PATH);
             }
             case 'T':
             case 't': {
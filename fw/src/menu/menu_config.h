@@ -6,4 +6,6 @@
 #include "config/config_setup.h"
 #include "display/window.h"
 
-void menu_config_show(const window_t* const window, const setup_sink_t* const setup_sink, bool is_boot);
+// Show the configs and apply the one chosen. Returns true if the PET should be
+// reset to start it (i.e., unless a snapshot was restored over it).
+bool menu_config_show(const window_t* const window, const setup_sink_t* const setup_sink, bool is_boot);
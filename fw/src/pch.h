@@ -41,6 +41,8 @@
     #include "pico/flash.h"
     #include "pico/multicore.h"
     #include "pico/sem.h"
+    #include "pico/stdio/driver.h"
+    #include "pico/stdio_uart.h"
     #include "pico/stdlib.h"
     #include "pico/types.h"
 
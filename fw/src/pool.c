@@ -0,0 +1,139 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#include "pch.h"
+#include "pool.h"
+
+#include "fatal.h"
+
+static uint8_t __attribute__((aligned(4))) small_blocks[POOL_SMALL_COUNT][POOL_SMALL_SIZE];
+static uint8_t __attribute__((aligned(4))) medium_blocks[POOL_MEDIUM_COUNT][POOL_MEDIUM_SIZE];
+static uint8_t __attribute__((aligned(4))) large_blocks[POOL_LARGE_COUNT][POOL_LARGE_SIZE];
+
+static const char* small_owners[POOL_SMALL_COUNT];
+static const char* medium_owners[POOL_MEDIUM_COUNT];
+static const char* large_owners[POOL_LARGE_COUNT];
+
+typedef struct {
+    uint8_t* storage;
+    const char** owners;    // NULL entries are free
+    pool_class_stats_t stats;
+} pool_class_t;
+
+// Ordered by block size.
+static pool_class_t classes[POOL_CLASS_COUNT] = {
+    { &small_blocks[0][0],  small_owners,  { .block_size = POOL_SMALL_SIZE,  .blocks = POOL_SMALL_COUNT } },
+    { &medium_blocks[0][0], medium_owners, { .block_size = POOL_MEDIUM_SIZE, .blocks = POOL_MEDIUM_COUNT } },
+    { &large_blocks[0][0],  large_owners,  { .block_size = POOL_LARGE_SIZE,  .blocks = POOL_LARGE_COUNT } },
+};
+
+static void* take_block(pool_class_t* pool_class, const char* owner) {
+    pool_class_stats_t* const stats = &pool_class->stats;
+
+    for (size_t i = 0; i < stats->blocks; i++) {
+        if (pool_class->owners[i] == NULL) {
+            pool_class->owners[i] = owner;
+            stats->allocs++;
+            if (++stats->in_use > stats->high_water) {
+                stats->high_water = stats->in_use;
+            }
+            return &pool_class->storage[i * stats->block_size];
+        }
+    }
+
+    return NULL;
+}
+
+void* pool_try_alloc(size_t size, const char* owner) {
+    assert(owner != NULL);
+
+    pool_class_t* best_fit = NULL;
+    for (size_t i = 0; i < POOL_CLASS_COUNT; i++) {
+        pool_class_t* const pool_class = &classes[i];
+        if (pool_class->stats.block_size < size) {
+            continue;
+        }
+
+        if (best_fit == NULL) {
+            best_fit = pool_class;
+        }
+
+        void* const block = take_block(pool_class, owner);
+        if (block != NULL) {
+            return block;
+        }
+    }
+
+    // Charge the failure to the class that should have served the request
+    // (the largest class if the request is larger than any block).
+    if (best_fit == NULL) {
+        best_fit = &classes[POOL_CLASS_COUNT - 1];
+    }
+    best_fit->stats.failures++;
+    return NULL;
+}
+
+void* pool_alloc(size_t size, const char* owner) {
+    void* const block = pool_try_alloc(size, owner);
+    vet(block != NULL, "pool: no free block of %zu bytes for '%s'", size, owner);
+    return block;
+}
+
+// Find the class and index of 'block', which must have come from the pool.
+static pool_class_t* find_block(const void* block, size_t* index) {
+    const uint8_t* const p = block;
+
+    for (size_t i = 0; i < POOL_CLASS_COUNT; i++) {
+        pool_class_t* const pool_class = &classes[i];
+        const size_t block_size = pool_class->stats.block_size;
+        const uint8_t* const start = pool_class->storage;
+        const uint8_t* const end = start + pool_class->stats.blocks * block_size;
+
+        if (start <= p && p < end) {
+            const size_t offset = (size_t) (p - start);
+            vet(offset % block_size == 0, "pool: %p is not the start of a block", block);
+            *index = offset / block_size;
+            return pool_class;
+        }
+    }
+
+    fatal("pool: %p is not a pool block", block);
+}
+
+void pool_free(void* block) {
+    if (block == NULL) {
+        return;
+    }
+
+    size_t index;
+    pool_class_t* const pool_class = find_block(block, &index);
+    vet(pool_class->owners[index] != NULL, "pool: double free of %p", block);
+
+    pool_class->owners[index] = NULL;
+    pool_class->stats.in_use--;
+}
+
+size_t pool_block_size(const void* block) {
+    size_t index;
+    return find_block(block, &index)->stats.block_size;
+}
+
+void pool_get_stats(size_t class_index, pool_class_stats_t* stats) {
+    vet_index(class_index, POOL_CLASS_COUNT);
+    *stats = classes[class_index].stats;
+}
+
+const char* pool_block_owner(size_t class_index, size_t block_index) {
+    vet_index(class_index, POOL_CLASS_COUNT);
+    vet_index(block_index, classes[class_index].stats.blocks);
+    return classes[class_index].owners[block_index];
+}
+
+void pool_reset_stats(void) {
+    for (size_t i = 0; i < POOL_CLASS_COUNT; i++) {
+        pool_class_stats_t* const stats = &classes[i].stats;
+        stats->high_water = stats->in_use;
+        stats->allocs = 0;
+        stats->failures = 0;
+    }
+}
@@ -0,0 +1,76 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Fixed-block pool for temporary buffers. Blocks come in a few size classes,
+// each a static array, so several buffers can be held at once (e.g., while
+// streaming or DMA is in flight) without large stack frames or a heap.
+//
+// A request is served from the smallest class whose blocks are large enough,
+// falling back to the next larger class when that one is exhausted. Each block
+// is tagged with its owner for the 'pool' CLI report.
+//
+// The pool is not locked: allocate and free from the main loop only (not from
+// interrupt handlers).
+
+// Configuration: block size and number of blocks in each class.
+#ifndef POOL_SMALL_SIZE
+#define POOL_SMALL_SIZE 256
+#endif
+
+#ifndef POOL_SMALL_COUNT
+#define POOL_SMALL_COUNT 4
+#endif
+
+#ifndef POOL_MEDIUM_SIZE
+#define POOL_MEDIUM_SIZE 2048
+#endif
+
+#ifndef POOL_MEDIUM_COUNT
+#define POOL_MEDIUM_COUNT 3
+#endif
+
+#ifndef POOL_LARGE_SIZE
+#define POOL_LARGE_SIZE 5120
+#endif
+
+#ifndef POOL_LARGE_COUNT
+#define POOL_LARGE_COUNT 2
+#endif
+
+#define POOL_CLASS_COUNT 3
+
+typedef struct {
+    size_t block_size;
+    uint8_t blocks;         // Number of blocks in the class
+    uint8_t in_use;         // Blocks currently allocated
+    uint8_t high_water;     // Most blocks allocated at once
+    uint32_t allocs;        // Successful allocations
+    uint32_t failures;      // Requests that could not be served by any class
+} pool_class_stats_t;
+
+// Allocate a block of at least 'size' bytes, tagged with 'owner' (a string
+// literal). Returns NULL if no suitable block is free.
+void* pool_try_alloc(size_t size, const char* owner);
+
+// As pool_try_alloc(), but calls fatal() if no suitable block is free.
+void* pool_alloc(size_t size, const char* owner);
+
+// Return a block to the pool. 'block' may be NULL.
+void pool_free(void* block);
+
+// Usable size of an allocated block (may exceed the size requested).
+size_t pool_block_size(const void* block);
+
+void pool_get_stats(size_t class_index, pool_class_stats_t* stats);
+
+// Owner of the given block, or NULL if the block is free.
+const char* pool_block_owner(size_t class_index, size_t block_index);
+
+// Restart the high-water marks from the current usage and clear the counters.
+void pool_reset_stats(void);
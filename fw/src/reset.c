@@ -4,7 +4,13 @@
 #include "pch.h"
 #include "reset.h"
 
+#include "uart/uart_tx.h"
+
 void system_reset(void) {
+    // Let any queued console output (e.g., "Resetting...") reach the terminal.
+    fflush(stdout);
+    uart_tx_drain();
+
     // We use the watchdog to reset the cores and peripherals to get back to
     // a known state before running the firmware.
     watchdog_enable(/* delay_ms: */ 0, /* pause_on_debug: */ true);
@@ -0,0 +1,37 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#include "pch.h"
+#include "rom_digest.h"
+
+static rom_digest_t digests[ROM_DIGEST_COUNT];
+static unsigned int count;
+
+void rom_digest_clear(void) {
+    count = 0;
+}
+
+bool rom_digest_add(const char* path, uint32_t address, uint32_t length, uint32_t crc, const uint32_t* expected) {
+    const rom_digest_status_t status = expected == NULL
+        ? rom_digest_unchecked
+        : (*expected == crc ? rom_digest_matched : rom_digest_mismatched);
+
+    if (count < ROM_DIGEST_COUNT) {
+        rom_digest_t* const digest = &digests[count++];
+        snprintf(digest->path, sizeof(digest->path), "%s", path);
+        digest->address = address;
+        digest->length = length;
+        digest->crc = crc;
+        digest->status = status;
+    }
+
+    return status != rom_digest_mismatched;
+}
+
+unsigned int rom_digest_count(void) {
+    return count;
+}
+
+const rom_digest_t* rom_digest_get(unsigned int index) {
+    return index < count ? &digests[index] : NULL;
+}
@@ -0,0 +1,41 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// CRC-32 of each file loaded by the current config, for the 'roms' CLI
+// command. A 'load' entry in config.yaml may give the expected CRC-32 of the
+// file (after decompression) as 'crc', which action_load() checks.
+
+// Configuration: number of files remembered per config. Loads beyond this
+// are still checked, but not listed.
+#ifndef ROM_DIGEST_COUNT
+#define ROM_DIGEST_COUNT 16
+#endif
+
+typedef enum {
+    rom_digest_unchecked,       // No 'crc' in config.yaml
+    rom_digest_matched,
+    rom_digest_mismatched,
+} rom_digest_status_t;
+
+typedef struct {
+    char path[64];              // Truncated if longer
+    uint32_t address;
+    uint32_t length;
+    uint32_t crc;
+    rom_digest_status_t status;
+} rom_digest_t;
+
+// Forget the previous config's files.
+void rom_digest_clear(void);
+
+// Record the CRC-32 of 'length' bytes of 'path' loaded at 'address', checking
+// it against 'expected' unless NULL. Returns false on a mismatch.
+bool rom_digest_add(const char* path, uint32_t address, uint32_t length, uint32_t crc, const uint32_t* expected);
+
+unsigned int rom_digest_count(void);
+const rom_digest_t* rom_digest_get(unsigned int index);
@@ -0,0 +1,381 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#include "pch.h"
+#include "rom_pages.h"
+
+#include <inttypes.h>
+
+#include "checksum.h"
+#include "crc.h"
+#include "diag/log/log.h"
+#include "driver.h"
+
+_Static_assert(ROM_PAGES_SOURCES < UINT8_MAX, "source indices must fit in 'page_t.source'");
+
+typedef struct {
+    uint32_t crc;               // CRC-32 of the page's content if 'known'
+    uint8_t sum;                // Commodore checksum of the page's content if 'known'
+    bool known;
+    bool prefill;               // Prefill deferred by rom_pages_begin()
+    bool written;               // Written since rom_pages_begin()
+    uint8_t source;             // 1 + index of the file in 'sources' loaded here, or 0
+} page_t;
+
+typedef struct {
+    char path[ROM_PAGES_PATH_LENGTH];   // "" if unused
+    uint32_t mtime;
+    uint32_t address;
+    uint32_t length;
+    uint32_t crc;
+} source_t;
+
+static struct {
+    page_t pages[ROM_PAGE_COUNT];
+    source_t sources[ROM_PAGES_SOURCES];
+    unsigned int next_source;           // Next entry of 'sources' to replace
+    rom_pages_stats_t stats;
+    uint8_t scratch[ROM_PAGE_SIZE];
+
+    // Page saved by rom_pages_save() for the next rom_pages_begin().
+    struct {
+        bool valid;
+        unsigned int index;
+        page_t page;
+        uint8_t data[ROM_PAGE_SIZE];
+    } saved;
+} state;
+
+static bool in_rom(uint32_t address) {
+    return ROM_PAGES_START <= address && address < ROM_PAGES_END;
+}
+
+static unsigned int page_index(uint32_t address) {
+    return (address - ROM_PAGES_START) / ROM_PAGE_SIZE;
+}
+
+static uint32_t page_address(unsigned int index) {
+    return ROM_PAGES_START + index * ROM_PAGE_SIZE;
+}
+
+// Write a whole page with CRC 'crc' unless it already holds it.
+static void write_page(unsigned int index, const uint8_t* data, uint32_t crc) {
+    page_t* const page = &state.pages[index];
+    page->prefill = false;
+
+    if (page->known && page->crc == crc) {
+        state.stats.unchanged++;
+        return;
+    }
+
+    spi_write(page_address(index), data, ROM_PAGE_SIZE);     // Forgets the page
+    page->crc = crc;
+    page->sum = 0;
+    checksum_add(data, ROM_PAGE_SIZE, &page->sum);
+    page->known = true;
+    page->written = true;
+    state.stats.written++;
+}
+
+// Fill the page with the high byte of its address if rom_pages_begin()
+// deferred it.
+static void prefill(unsigned int index) {
+    if (!state.pages[index].prefill) {
+        return;
+    }
+
+    const uint8_t byte = (uint8_t) (page_address(index) >> 8);
+    memset(state.scratch, byte, sizeof(state.scratch));
+    write_page(index, state.scratch, crc32_update(CRC32_INIT, state.scratch, sizeof(state.scratch)));
+}
+
+// Write part of a page. The rest of the page is not known here, so the page
+// is read back to learn its new content.
+static void write_partial(unsigned int index, uint32_t address, const uint8_t* data, size_t length) {
+    prefill(index);
+    spi_write(address, data, length);                       // Forgets the page
+
+    page_t* const page = &state.pages[index];
+    spi_read(page_address(index), sizeof(state.scratch), state.scratch);
+    page->crc = crc32_update(CRC32_INIT, state.scratch, sizeof(state.scratch));
+    page->sum = 0;
+    checksum_add(state.scratch, sizeof(state.scratch), &page->sum);
+    page->known = true;
+    page->written = true;
+    state.stats.written++;
+}
+
+// Put back the page saved by rom_pages_save(), along with what was known
+// about it, if it has been overwritten since.
+static void restore_saved(void) {
+    if (!state.saved.valid) {
+        return;
+    }
+    state.saved.valid = false;
+
+    page_t* const page = &state.pages[state.saved.index];
+    if (page->known) {
+        return;
+    }
+
+    spi_write(page_address(state.saved.index), state.saved.data, ROM_PAGE_SIZE);   // Forgets the page
+    *page = state.saved.page;
+}
+
+void rom_pages_begin(void) {
+    restore_saved();
+
+    for (unsigned int i = 0; i < ROM_PAGE_COUNT; i++) {
+        state.pages[i].prefill = true;
+        state.pages[i].written = false;
+    }
+    memset(&state.stats, 0, sizeof(state.stats));
+}
+
+bool rom_pages_end(bool verify, rom_pages_stats_t* stats) {
+    for (unsigned int i = 0; i < ROM_PAGE_COUNT; i++) {
+        prefill(i);
+    }
+
+    bool ok = true;
+    for (unsigned int i = 0; verify && i < ROM_PAGE_COUNT; i++) {
+        page_t* const page = &state.pages[i];
+        if (!page->written || !page->known) {
+            continue;
+        }
+
+        spi_read(page_address(i), sizeof(state.scratch), state.scratch);
+        state.stats.verified++;
+        if (crc32_update(CRC32_INIT, state.scratch, sizeof(state.scratch)) != page->crc) {
+            log_warn("rom: $%04" PRIx32 "-$%04" PRIx32 " did not read back as written",
+                page_address(i), page_address(i) + ROM_PAGE_SIZE - 1);
+            rom_pages_forget(page_address(i), ROM_PAGE_SIZE);
+            state.stats.mismatched++;
+            ok = false;
+        }
+    }
+
+    if (stats != NULL) {
+        *stats = state.stats;
+    }
+    return ok;
+}
+
+void rom_pages_write(uint32_t address, const uint8_t* data, size_t length) {
+    while (length > 0) {
+        size_t n = length;
+
+        if (!in_rom(address)) {
+            // Up to the start of soft-ROM, if the write reaches it.
+            if (address < ROM_PAGES_START && ROM_PAGES_START - address < length) {
+                n = ROM_PAGES_START - address;
+            }
+            spi_write(address, data, n);
+        } else {
+            const size_t room = ROM_PAGE_SIZE - address % ROM_PAGE_SIZE;
+            if (room < n) {
+                n = room;
+            }
+
+            const unsigned int index = page_index(address);
+            if (n == ROM_PAGE_SIZE) {
+                write_page(index, data, crc32_update(CRC32_INIT, data, n));
+            } else {
+                write_partial(index, address, data, n);
+            }
+        }
+
+        address += n;
+        data += n;
+        length -= n;
+    }
+}
+
+void rom_pages_flush(uint32_t address, size_t length) {
+    if (length == 0 || address >= ROM_PAGES_END || address + length <= ROM_PAGES_START) {
+        return;
+    }
+
+    const uint32_t start = address < ROM_PAGES_START ? ROM_PAGES_START : address;
+    const uint32_t end = address + length > ROM_PAGES_END ? ROM_PAGES_END : address + length;
+    for (unsigned int i = page_index(start); i <= page_index(end - 1); i++) {
+        prefill(i);
+    }
+}
+
+uint8_t rom_pages_checksum(uint32_t address, size_t length) {
+    rom_pages_flush(address, length);
+
+    // The checksum adds with end-around carry, so a page's checksum can be
+    // added in place of its bytes.
+    uint8_t sum = 0;
+    while (length > 0) {
+        const size_t room = ROM_PAGE_SIZE - address % ROM_PAGE_SIZE;
+        const size_t n = length < room ? length : room;
+        const page_t* const page = in_rom(address) ? &state.pages[page_index(address)] : NULL;
+
+        if (n == ROM_PAGE_SIZE && page != NULL && page->known) {
+            checksum_add(&page->sum, 1, &sum);
+            state.stats.summed++;
+        } else {
+            spi_read(address, n, state.scratch);
+            checksum_add(state.scratch, n, &sum);
+        }
+
+        address += n;
+        length -= n;
+    }
+
+    return sum;
+}
+
+void rom_pages_forget(uint32_t address, size_t length) {
+    if (length == 0 || address >= ROM_PAGES_END || address + length <= ROM_PAGES_START) {
+        return;
+    }
+
+    const uint32_t start = address < ROM_PAGES_START ? ROM_PAGES_START : address;
+    const uint32_t end = address + length > ROM_PAGES_END ? ROM_PAGES_END : address + length;
+    for (unsigned int i = page_index(start); i <= page_index(end - 1); i++) {
+        state.pages[i].known = false;
+        state.pages[i].source = 0;
+    }
+}
+
+void rom_pages_save(uint32_t address) {
+    if (!in_rom(address)) {
+        return;
+    }
+
+    // Only a page whose content is known is worth putting back. If the page
+    // is already saved (e.g., the menu is entered twice in a row), the saved
+    // copy is the older and better one.
+    const unsigned int index = page_index(address);
+    const page_t* const page = &state.pages[index];
+    if (!page->known || (state.saved.valid && state.saved.index == index)) {
+        return;
+    }
+
+    spi_read(page_address(index), sizeof(state.saved.data), state.saved.data);
+    state.saved.page = *page;
+    state.saved.index = index;
+    state.saved.valid = true;
+}
+
+void rom_pages_reset(void) {
+    memset(&state, 0, sizeof(state));
+}
+
+static int find_source(const char* path, uint32_t address) {
+    for (unsigned int i = 0; i < ROM_PAGES_SOURCES; i++) {
+        const source_t* const source = &state.sources[i];
+        if (source->address == address && strcmp(source->path, path) == 0) {
+            return (int) i;
+        }
+    }
+    return -1;
+}
+
+bool rom_pages_reuse(const char* path, uint32_t mtime, uint32_t address, uint32_t* length, uint32_t* crc) {
+    const int index = find_source(path, address);
+    if (index < 0 || path[0] == '\0' || state.sources[index].mtime != mtime) {
+        return false;
+    }
+
+    const source_t* const source = &state.sources[index];
+    const unsigned int first = page_index(source->address);
+    const unsigned int count = source->length / ROM_PAGE_SIZE;
+    for (unsigned int i = first; i < first + count; i++) {
+        if (!state.pages[i].known || state.pages[i].source != index + 1) {
+            return false;
+        }
+    }
+
+    for (unsigned int i = first; i < first + count; i++) {
+        state.pages[i].prefill = false;
+    }
+    state.stats.unchanged += count;
+    state.stats.reused++;
+    *length = source->length;
+    *crc = source->crc;
+    return true;
+}
+
+void rom_pages_remember(const char* path, uint32_t mtime, uint32_t address, size_t length, uint32_t crc) {
+    if (length == 0 || address % ROM_PAGE_SIZE != 0 || length % ROM_PAGE_SIZE != 0
+        || !in_rom(address) || length > ROM_PAGES_END - address
+        || strlen(path) >= ROM_PAGES_PATH_LENGTH) {
+        return;
+    }
+
+    int index = find_source(path, address);
+    if (index < 0) {
+        index = (int) state.next_source;
+        state.next_source = (state.next_source + 1) % ROM_PAGES_SOURCES;
+
+        // Pages still holding the file this entry remembered no longer match it.
+        for (unsigned int i = 0; i < ROM_PAGE_COUNT; i++) {
+            if (state.pages[i].source == index + 1) {
+                state.pages[i].source = 0;
+            }
+        }
+        if (state.saved.page.source == index + 1) {
+            state.saved.page.source = 0;
+        }
+    }
+
+    source_t* const source = &state.sources[index];
+    snprintf(source->path, sizeof(source->path), "%s", path);
+    source->mtime = mtime;
+    source->address = address;
+    source->length = (uint32_t) length;
+    source->crc = crc;
+
+    const unsigned int first = page_index(address);
+    for (unsigned int i = first; i < first + length / ROM_PAGE_SIZE; i++) {
+        state.pages[i].source = state.pages[i].known ? (uint8_t) (index + 1) : 0;
+    }
+}
+
+static void stream_flush(rom_pages_stream_t* stream) {
+    rom_pages_write(stream->address, stream->page, stream->staged);
+    stream->address += stream->staged;
+    stream->staged = 0;
+}
+
+void rom_pages_stream_begin(rom_pages_stream_t* stream, uint32_t address) {
+    stream->address = address;
+    stream->staged = 0;
+}
+
+void rom_pages_stream_write(rom_pages_stream_t* stream, const uint8_t* data, size_t length) {
+    while (length > 0) {
+        const size_t room = ROM_PAGE_SIZE - (stream->address + stream->staged) % ROM_PAGE_SIZE;
+
+        // Whole pages are written straight from 'data'.
+        if (stream->staged == 0 && room == ROM_PAGE_SIZE && length >= ROM_PAGE_SIZE) {
+            const size_t n = length - length % ROM_PAGE_SIZE;
+            rom_pages_write(stream->address, data, n);
+            stream->address += n;
+            data += n;
+            length -= n;
+            continue;
+        }
+
+        const size_t n = length < room ? length : room;
+        memcpy(&stream->page[stream->staged], data, n);
+        stream->staged += n;
+        data += n;
+        length -= n;
+
+        if (n == room) {
+            stream_flush(stream);
+        }
+    }
+}
+
+void rom_pages_stream_end(rom_pages_stream_t* stream) {
+    if (stream->staged > 0) {
+        stream_flush(stream);
+    }
+}
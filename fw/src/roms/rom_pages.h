@@ -0,0 +1,124 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Tracks what the firmware last wrote to each 256-byte page of soft-ROM
+// ($9000-$FFFF) so that switching between configs only rewrites the pages
+// that differ. The 6502 cannot write soft-ROM (see address_decoding.sv), so
+// the firmware's own writes are the only way its content changes.
+//
+// Applying a config is bracketed by rom_pages_begin() and rom_pages_end().
+// Writes in between are compared with the CRC-32 of the page's current
+// content and skipped if it matches. The prefill of unmapped pages with the
+// high byte of their address is deferred until rom_pages_end() (or until a
+// page is read or partially written), so pages that a ROM then overwrites are
+// not filled first.
+//
+// Each known page's Commodore checksum is kept alongside its CRC-32, so
+// 'fix-checksum' need not read the ROM back (see rom_pages_checksum()).
+//
+// Loaded files are also remembered by path, modification time, and address,
+// so a ROM whose pages have not been touched since it was loaded need not be
+// read from the SD card again (see rom_pages_reuse()).
+//
+// Any other write to soft-ROM (breakpoints, 'xfer', the menu ROM, the RAM
+// test) goes through spi_write() or spi_write_at(), which call
+// rom_pages_forget() for the range. The menu ROM first saves the KERNAL page
+// it overwrites with rom_pages_save(), so that the KERNAL can still be reused
+// when the menu applies a config.
+
+#define ROM_PAGES_START     0x9000
+#define ROM_PAGES_END       0x10000
+#define ROM_PAGE_SIZE       0x100
+#define ROM_PAGE_COUNT      ((ROM_PAGES_END - ROM_PAGES_START) / ROM_PAGE_SIZE)
+
+// Configuration: number of loaded files remembered for rom_pages_reuse().
+#ifndef ROM_PAGES_SOURCES
+#define ROM_PAGES_SOURCES 8
+#endif
+
+// Configuration: longest path (including the NUL) remembered for
+// rom_pages_reuse(). Longer paths are always read.
+#ifndef ROM_PAGES_PATH_LENGTH
+#define ROM_PAGES_PATH_LENGTH 64
+#endif
+
+// Configuration: when 1, rom_pages_end() reads back every page written since
+// rom_pages_begin() and checks it against the content that was written, and
+// 'fix-checksum' reads back the range it fixed.
+#ifndef ROM_PAGES_VERIFY
+#define ROM_PAGES_VERIFY 0
+#endif
+
+typedef struct {
+    uint32_t written;           // Pages written to SRAM (including fills)
+    uint32_t unchanged;         // Pages skipped because they already held the content
+    uint32_t reused;            // Files not read because their pages were intact
+    uint32_t summed;            // Pages checksummed without reading them back
+    uint32_t verified;          // Pages read back by rom_pages_end()
+    uint32_t mismatched;        // Pages that did not read back as written
+} rom_pages_stats_t;
+
+// Writes a stream of data (e.g., a file as it is read) to consecutive
+// addresses, staging partial pages so that rom_pages_write() sees whole pages
+// even when the data arrives in arbitrary spans.
+typedef struct {
+    uint32_t address;           // Destination of page[0]
+    size_t staged;              // Bytes in 'page'
+    uint8_t page[ROM_PAGE_SIZE];
+} rom_pages_stream_t;
+
+// Start applying a config. Every page is due to be prefilled with the high
+// byte of its address unless something else is written to it first.
+void rom_pages_begin(void);
+
+// Finish applying a config: prefill the pages nothing was written to and, if
+// 'verify', read back the pages written since rom_pages_begin(). Returns false
+// if any page did not read back as written.
+bool rom_pages_end(bool verify, rom_pages_stats_t* stats);
+
+// Write 'length' bytes to SRAM at 'address', skipping whole soft-ROM pages
+// that already hold the same content. Addresses outside soft-ROM are written
+// as spi_write() would.
+void rom_pages_write(uint32_t address, const uint8_t* data, size_t length);
+
+// Complete any deferred prefill in the given range before it is read (e.g.,
+// by 'copy' or 'fix-checksum').
+void rom_pages_flush(uint32_t address, size_t length);
+
+// The Commodore checksum (see checksum.h) of 'length' bytes of SRAM at
+// 'address'. Whole soft-ROM pages with known content use the checksum kept
+// when they were written. Other bytes are read.
+uint8_t rom_pages_checksum(uint32_t address, size_t length);
+
+// Stop trusting the pages in the given range (called by the SPI driver).
+void rom_pages_forget(uint32_t address, size_t length);
+
+// Save the content of the page at 'address' before writing over it outside a
+// config (e.g., the menu ROM at $FF00). The next rom_pages_begin() puts the
+// page back as it was, so that the file it came from can still be reused.
+// Only one page is saved at a time, and only if its content is known.
+void rom_pages_save(uint32_t address);
+
+// Forget everything (e.g., for tests).
+void rom_pages_reset(void);
+
+// True if 'path' (with modification time 'mtime') was the last file loaded
+// at 'address' and its pages are unchanged since, in which case its pages are
+// kept as they are and the file need not be read. The length and CRC-32 given
+// to rom_pages_remember() are returned in 'length' and 'crc'.
+bool rom_pages_reuse(const char* path, uint32_t mtime, uint32_t address, uint32_t* length, uint32_t* crc);
+
+// Note that 'length' bytes of 'path' (with CRC-32 'crc') were just written to
+// 'address' for rom_pages_reuse(). Only files that cover whole soft-ROM pages
+// are remembered.
+void rom_pages_remember(const char* path, uint32_t mtime, uint32_t address, size_t length, uint32_t crc);
+
+void rom_pages_stream_begin(rom_pages_stream_t* stream, uint32_t address);
+void rom_pages_stream_write(rom_pages_stream_t* stream, const uint8_t* data, size_t length);
+void rom_pages_stream_end(rom_pages_stream_t* stream);
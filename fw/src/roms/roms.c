@@ -5,6 +5,7 @@
 #include "fatal.h"
 #include "menu/menu.h"
 #include "pet.h"
+#include "roms/rom_pages.h"
 #include "system_state.h"
 #include "usb/keyboard.h"
 
@@ -19,9 +20,6 @@ const uint8_t __in_flash(".rom_menu_ff00") rom_menu_ff00[] = {
 const uint8_t* const p_video_font_000 = rom_chars_e800;
 const uint8_t* const p_video_font_400 = rom_chars_e800 + 0x400;
 
-#define CHAR_ROM_SRAM_ADDRESS 0x68000
-#define CHAR_ROM_SRAM_SIZE 4096
-
 static uint8_t custom_char_rom[CHAR_ROM_SRAM_SIZE];
 
 void roms_refresh_char_rom(void) {
@@ -58,6 +56,12 @@ void start_menu_rom(menu_rom_boot_reason_t reason) {
     // Menu is keymap agnostic (only uses cursor/enter keys), so any keymap will do.
     read_keymap("/ukm/us.bin", &system_state);
 
+    // The menu ROM and its reset vector share the KERNAL's last page, which the next config puts
+    // back (see rom_pages_save()).
+    _Static_assert(MENU_ROM_START_ADDRESS % ROM_PAGE_SIZE == 0 && sizeof(rom_menu_ff00) <= ROM_PAGE_SIZE,
+                   "Menu ROM must fit in the page saved by rom_pages_save()");
+    rom_pages_save(MENU_ROM_START_ADDRESS);
+
     spi_write(/* dest: */ MENU_ROM_START_ADDRESS, /* pSrc: */ rom_menu_ff00,  sizeof(rom_menu_ff00));   // Load menu ROM
     spi_write(/* dest: */ CHAR_ROM_SRAM_ADDRESS, /* pSrc: */ rom_chars_e800, sizeof(rom_chars_e800));   // Load character ROM
     roms_refresh_char_rom();
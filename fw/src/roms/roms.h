@@ -5,6 +5,10 @@
 
 #define MENU_ROM_START_ADDRESS 0xFF00
 
+// Character ROM in FPGA block RAM (outside the 6502's address space).
+#define CHAR_ROM_SRAM_ADDRESS 0x68000
+#define CHAR_ROM_SRAM_SIZE 4096
+
 extern const uint8_t rom_chars_e800[0x800];
 extern const uint8_t* const p_video_font_000;
 extern const uint8_t* const p_video_font_400;
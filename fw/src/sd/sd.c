@@ -15,20 +15,73 @@
 #include "diag/log/log.h"
 #include "driver.h"
 #include "fatal.h"
-#include "global.h"
 #include "hw.h"
+#include "lzss.h"
+#include "sd_cache.h"
+#include "sd_stream.h"
+
+// Configuration: flash reserved for the SD file cache (see sd_cache.h), at the
+// top of flash. The firmware image occupies the bottom.
+#ifndef SD_CACHE_FLASH_SIZE
+#define SD_CACHE_FLASH_SIZE (8 * 1024 * 1024)
+#endif
+
+// The USB stick is the second FatFs volume ("1:").
+_Static_assert(FF_VOLUMES >= 2, "FatFs must allow a second volume for USB mass storage");
+
+typedef struct {
+    const char* name;
+    const char* mount_point;        // VFS prefix ("" for the SD card, which is mounted at "/")
+    const char* drive;              // FatFs logical drive
+    bool mounted;
+    sd_volume_stats_t stats;
+} volume_t;
+
+static volume_t volumes[sd_volume_count] = {
+    [sd_volume_sd]  = { .name = "sd",  .mount_point = "",                 .drive = "0:" },
+    [sd_volume_usb] = { .name = "usb", .mount_point = SD_USB_MOUNT_POINT, .drive = "1:" },
+};
+
+// Volumes searched for a file, in order. A USB stick takes precedence by
+// default, so plugging one in overrides files of the same name on the card.
+static sd_volume_t search_order[sd_volume_count] = { sd_volume_usb, sd_volume_sd };
+static unsigned int search_count = sd_volume_count;
+
+// Whole-sector chunks let FatFs read straight into the stream buffers.
+_Static_assert(SD_STREAM_CHUNK_SIZE % FF_MIN_SS == 0,
+               "SD_STREAM_CHUNK_SIZE must be a multiple of the sector size");
 
 // Ensure FatFs is built with variable sector size support.
 _Static_assert(FF_MAX_SS != FF_MIN_SS,
                "FatFs must use a variable sector size so FATFS::ssize exists");
 
-bool sd_init() {
+void sd_flash_init(void) {
+    blockdevice_t* flash = blockdevice_flash_create(
+        PICO_FLASH_SIZE_BYTES - SD_CACHE_FLASH_SIZE, SD_CACHE_FLASH_SIZE);
+    filesystem_t* lfs = filesystem_littlefs_create(/* block_cycles: */ 500, /* lookahead_size: */ 16);
+
+    if (fs_mount(SD_FLASH_MOUNT_POINT, lfs, flash) == -1) {
+        log_info("cache: formatting flash");
+        if (fs_format(lfs, flash) == -1 || fs_mount(SD_FLASH_MOUNT_POINT, lfs, flash) == -1) {
+            log_warn("cache: cannot mount flash: %s", strerror(errno));
+            return;
+        }
+    }
+
+    // Leave room for littlefs metadata and copy-on-write blocks.
+    sd_cache_init(SD_FLASH_MOUNT_POINT, SD_CACHE_FLASH_SIZE - SD_CACHE_FLASH_SIZE / 16);
+}
+
+// Created on core0 by sd_create(), since pico-vfs allocates it from the heap.
+static blockdevice_t* sd_card;
+
+void sd_create(void) {
     // Deassert SD CS
     gpio_init(SD_CSN_GP);
     gpio_set_dir(SD_CSN_GP, GPIO_OUT);
     gpio_put(SD_CSN_GP, 1);
 
-    blockdevice_t* sd = blockdevice_sd_create(
+    sd_card = blockdevice_sd_create(
         SD_SPI_INSTANCE,
         /* tx: */ SD_CMD_GP,
         /* rx: */ SD_DAT_GP,
@@ -36,14 +89,21 @@ bool sd_init() {
         SD_CSN_GP,
         SD_SPI_MHZ * MHZ,
         /* enable_crc: */ false);
+}
 
+int sd_card_init(void) {
+    return sd_card->init(sd_card);
+}
+
+bool sd_init() {
     filesystem_t* fat = filesystem_fat_create();
 
-    if (fs_mount("/", fat, sd) == -1) {
+    if (fs_mount("/", fat, sd_card) == -1) {
         log_warn("fs_mount error: %s", strerror(errno));
         return false;
     }
 
+    volumes[sd_volume_sd].mounted = true;
     return true;
 }
 
@@ -70,34 +130,24 @@ size_t sd_read(const char* filename, FILE* file, uint8_t* dest, size_t size) {
     return bytes_read;
 }
 
-void sd_read_file(const char* filename, sd_read_callback_t callback, void* context, size_t max_bytes) {
-    FILE* file = sd_open(filename, "rb");
-    if (!file) {
-        fatal("failed to open file '%s'", filename);
-    }
-
-    uint8_t* buffer = acquire_temp_buffer();
-    size_t offset = 0;
-    size_t remaining = max_bytes;
-
-    while (remaining > 0) {
-        size_t to_read = remaining < TEMP_BUFFER_SIZE
-            ? remaining
-            : TEMP_BUFFER_SIZE;
+typedef struct {
+    sd_read_callback_t callback;
+    void* context;
+} read_file_sink_t;
 
-        size_t bytes_read = sd_read(filename, file, buffer, to_read);
-
-        if (bytes_read == 0) {
-            break;
-        }
+static void read_file_begin(void* context, size_t offset, const uint8_t* buffer, size_t length) {
+    const read_file_sink_t* const reader = context;
+    reader->callback(offset, buffer, length, reader->context);
+}
 
-        callback(offset, buffer, bytes_read, context);
-        
-        offset += bytes_read;
-        remaining -= bytes_read;
+void sd_read_file(const char* filename, sd_read_callback_t callback, void* context, size_t max_bytes) {
+    // Streaming decompresses LZSS files transparently. Keymaps are read at
+    // every boot, so they are cached.
+    read_file_sink_t reader = { callback, context };
+    const sd_stream_sink_t sink = { .begin = read_file_begin, .context = &reader };
+    if (!sd_stream_path(filename, /* cache: */ true, &sink, max_bytes, NULL)) {
+        fatal("error reading '%s'", filename);
     }
-
-    release_temp_buffer(&buffer);
 }
 
 uint64_t sd_free_bytes(void) {
@@ -105,10 +155,360 @@ uint64_t sd_free_bytes(void) {
     // "0:". Query it directly for the free cluster count.
     FATFS* fs = NULL;
     DWORD free_clusters = 0;
-    if (f_getfree("0:", &free_clusters, &fs) != FR_OK || fs == NULL) {
+    if (f_getfree(volumes[sd_volume_sd].drive, &free_clusters, &fs) != FR_OK || fs == NULL) {
         log_warn("sd: f_getfree failed");
         return 0;
     }
 
     return (uint64_t)free_clusters * fs->csize * fs->ssize;
 }
+
+// The FAT backend (pico-vfs) registers each volume as a FatFs logical drive.
+// Prefix absolute paths with the drive so they can be passed straight to FatFs.
+static bool fatfs_path(sd_volume_t volume, const char* path, char* out, size_t out_size) {
+    const int n = snprintf(out, out_size, "%s%s", volumes[volume].drive, path);
+    return n > 0 && (size_t) n < out_size;
+}
+
+static bool volume_stat(sd_volume_t volume, const char* path, FILINFO* info) {
+    char fs_path[PATH_MAX];
+    return volumes[volume].mounted
+        && fatfs_path(volume, path, fs_path, sizeof(fs_path))
+        && f_stat(fs_path, info) == FR_OK;
+}
+
+// Find the first volume in the search order that has 'path'. Returns
+// sd_volume_count if none does.
+static sd_volume_t resolve(const char* path, FILINFO* info) {
+    for (unsigned int i = 0; i < search_count; i++) {
+        if (volume_stat(search_order[i], path, info)) {
+            return search_order[i];
+        }
+    }
+    return sd_volume_count;
+}
+
+bool sd_resolve(const char* path, char* out, size_t out_size) {
+    FILINFO info;
+    const sd_volume_t volume = resolve(path, &info);
+    if (volume == sd_volume_count) {
+        return false;
+    }
+
+    const int n = snprintf(out, out_size, "%s%s", volumes[volume].mount_point, path);
+    return n > 0 && (size_t) n < out_size;
+}
+
+// True if 'name' in 'dir' is on a volume that precedes search_order['index'].
+static bool shadowed(const char* dir, const char* name, unsigned int index) {
+    char path[PATH_MAX];
+    const int n = snprintf(path, sizeof(path), "%s/%s", dir, name);
+    if (n < 0 || (size_t) n >= sizeof(path)) {
+        return false;
+    }
+
+    FILINFO info;
+    for (unsigned int i = 0; i < index; i++) {
+        if (volume_stat(search_order[i], path, &info) && !(info.fattrib & AM_DIR)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// List the files in 'path' on 'volume', skipping those shadowed by the first
+// 'index' volumes in the search order.
+static bool scan_volume(sd_volume_t volume, unsigned int index, const char* path, sd_dir_callback_t callback,
+                        void* context) {
+    char fs_path[PATH_MAX];
+    DIR dir;
+    if (!volumes[volume].mounted
+        || !fatfs_path(volume, path, fs_path, sizeof(fs_path))
+        || f_opendir(&dir, fs_path) != FR_OK) {
+        return false;
+    }
+
+    FILINFO info;
+    while (f_readdir(&dir, &info) == FR_OK && info.fname[0] != '\0') {
+        if ((info.fattrib & AM_DIR) || shadowed(path, info.fname, index)) {
+            continue;
+        }
+        callback(info.fname, (uint32_t) info.fsize, context);
+    }
+
+    f_closedir(&dir);
+    return true;
+}
+
+bool sd_scan_dir(const char* path, sd_dir_callback_t callback, void* context) {
+    bool found = false;
+    for (unsigned int i = 0; i < search_count; i++) {
+        found |= scan_volume(search_order[i], i, path, callback, context);
+    }
+
+    if (!found) {
+        log_warn("sd: cannot open directory '%s'", path);
+    }
+    return found;
+}
+
+bool sd_scan_volume(sd_volume_t volume, const char* path, sd_dir_callback_t callback, void* context) {
+    if (!scan_volume(volume, 0, path, callback, context)) {
+        log_warn("%s: cannot open directory '%s'", volumes[volume].name, path);
+        return false;
+    }
+    return true;
+}
+
+bool sd_stat(const char* path, uint32_t* size, uint32_t* mtime) {
+    FILINFO info;
+    if (!volume_stat(sd_volume_sd, path, &info)) {
+        return false;
+    }
+
+    *size = (uint32_t) info.fsize;
+    *mtime = ((uint32_t) info.fdate << 16) | info.ftime;
+    return true;
+}
+
+bool sd_mtime(const char* path, uint32_t* mtime) {
+    bool found = false;
+    uint32_t combined = 0;
+
+    for (unsigned int i = 0; i < search_count; i++) {
+        const sd_volume_t volume = search_order[i];
+        FILINFO info;
+        if (!volume_stat(volume, path, &info)) {
+            continue;
+        }
+
+        const uint32_t m = ((uint32_t) info.fdate << 16) | info.ftime;
+        combined = found ? (combined * 31) ^ (m + volume) : m;
+        found = true;
+    }
+
+    *mtime = combined;
+    return found;
+}
+
+bool sd_set_search_order(const char* order) {
+    sd_volume_t parsed[sd_volume_count];
+    unsigned int count = 0;
+
+    const char* p = order;
+    while (*p != '\0') {
+        while (*p == ' ' || *p == ',') {
+            p++;
+        }
+        const char* const start = p;
+        while (*p != '\0' && *p != ' ' && *p != ',') {
+            p++;
+        }
+        const size_t length = (size_t) (p - start);
+        if (length == 0) {
+            break;
+        }
+
+        sd_volume_t volume = sd_volume_count;
+        for (unsigned int v = 0; v < sd_volume_count; v++) {
+            if (strlen(volumes[v].name) == length && strncmp(volumes[v].name, start, length) == 0) {
+                volume = (sd_volume_t) v;
+            }
+        }
+
+        if (volume == sd_volume_count || count == sd_volume_count) {
+            log_warn("sd: invalid search order '%s'", order);
+            return false;
+        }
+        for (unsigned int i = 0; i < count; i++) {
+            if (parsed[i] == volume) {
+                log_warn("sd: invalid search order '%s'", order);
+                return false;
+            }
+        }
+        parsed[count++] = volume;
+    }
+
+    if (count == 0) {
+        log_warn("sd: invalid search order '%s'", order);
+        return false;
+    }
+
+    memcpy(search_order, parsed, sizeof(parsed[0]) * count);
+    search_count = count;
+    return true;
+}
+
+void sd_volume_set_mounted(sd_volume_t volume, bool mounted) {
+    volume_t* const v = &volumes[volume];
+    v->mounted = mounted;
+
+    if (!mounted && v->stats.files > 0) {
+        sd_volume_log(volume);
+    }
+    memset(&v->stats, 0, sizeof(v->stats));
+}
+
+void sd_volume_get_stats(sd_volume_t volume, sd_volume_stats_t* stats) {
+    *stats = volumes[volume].stats;
+}
+
+const char* sd_volume_name(sd_volume_t volume) {
+    return volumes[volume].name;
+}
+
+bool sd_volume_is_mounted(sd_volume_t volume) {
+    return volumes[volume].mounted;
+}
+
+unsigned int sd_get_search_order(sd_volume_t order[sd_volume_count]) {
+    memcpy(order, search_order, sizeof(search_order[0]) * search_count);
+    return search_count;
+}
+
+void sd_volume_log(sd_volume_t volume) {
+    const sd_volume_stats_t* const stats = &volumes[volume].stats;
+    const uint32_t kbps = stats->read_us > 0
+        ? (uint32_t) ((uint64_t) stats->bytes * 1000 / stats->read_us)
+        : 0;
+
+    log_info("%s: read %" PRIu32 " files, %" PRIu64 " bytes in %" PRIu32 " ms (%" PRIu32 " KB/s)",
+        volumes[volume].name, stats->files, stats->bytes, stats->read_us / 1000, kbps);
+}
+
+// Only one file is streamed at a time (the stream buffers are shared).
+static FIL stream_file;
+
+// Reads the SD card file, copying what was read into the cache (if any).
+typedef struct {
+    FIL* file;
+    FILE* copy;
+    bool copy_ok;
+} fatfs_source_t;
+
+static bool fatfs_read(void* context, uint8_t* buffer, size_t length, size_t* bytes_read) {
+    fatfs_source_t* const source = context;
+    UINT n;
+    const bool ok = f_read(source->file, buffer, (UINT) length, &n) == FR_OK;
+    *bytes_read = n;
+
+    if (ok && source->copy != NULL && n > 0) {
+        source->copy_ok = source->copy_ok && fwrite(buffer, 1, n, source->copy) == n;
+    }
+    return ok;
+}
+
+bool sd_stream_path(const char* path, bool cache, const sd_stream_sink_t* sink, size_t max_bytes,
+                    sd_stream_stats_t* stats) {
+    if (path[0] != '/') {
+        fatal("path must start with '/', but got '%s'", path);
+    }
+
+    FILINFO info;
+    const sd_volume_t volume = resolve(path, &info);
+    char fs_path[PATH_MAX];
+    char vfs_path[PATH_MAX];
+    if (volume == sd_volume_count
+        || !fatfs_path(volume, path, fs_path, sizeof(fs_path))
+        || !sd_resolve(path, vfs_path, sizeof(vfs_path))) {
+        fatal("file not found '%s'", path);
+    }
+
+    // The directory entry is enough to validate a cached copy. Files on a USB
+    // stick come and go with the stick, so only the SD card is cached.
+    cache = cache && volume == sd_volume_sd;
+    const uint32_t size = (uint32_t) info.fsize;
+    const uint32_t mtime = ((uint32_t) info.fdate << 16) | info.ftime;
+    FILE* cached = cache ? sd_cache_open(vfs_path, size, mtime) : NULL;
+    if (cached != NULL) {
+        log_debug("cache: reading '%s' from flash", vfs_path);
+        const bool ok = sd_stream_file(cached, sink, max_bytes, stats);
+        fclose(cached);
+        return ok;
+    }
+
+    if (f_open(&stream_file, fs_path, FA_READ) != FR_OK) {
+        fatal("file not found '%s'", path);
+    }
+
+    // f_read() transfers whole sectors at a sector-aligned file position
+    // directly into the caller's buffer with one disk_read() per run of
+    // sectors within a cluster, which the SD block device issues as a single
+    // multi-block read (CMD18). Only partial sectors go through the FatFs
+    // sector window.
+    fatfs_source_t fatfs = { &stream_file, cache ? sd_cache_store_begin(vfs_path, size, mtime) : NULL, true };
+    const sd_stream_source_t source = { .read = fatfs_read, .context = &fatfs };
+    sd_stream_stats_t local;
+    const bool ok = sd_stream(&source, sink, max_bytes, &local);
+
+    f_close(&stream_file);
+
+    volume_t* const v = &volumes[volume];
+    v->stats.files++;
+    v->stats.bytes += local.read_bytes;
+    v->stats.read_us += local.read_us;
+    log_debug("%s: '%s' %zu bytes in %" PRIu32 " ms", v->name, path, local.read_bytes, local.read_us / 1000);
+    if (stats != NULL) {
+        *stats = local;
+    }
+
+    // Only a complete copy is kept (e.g., not if 'max_bytes' cut the read short).
+    sd_cache_store_end(fatfs.copy, ok && fatfs.copy_ok);
+    return ok;
+}
+
+bool sd_stream_flash(const char* path, const sd_stream_sink_t* sink, sd_stream_stats_t* stats, uint32_t* size,
+                     uint32_t* mtime) {
+    FILE* cached = sd_cache_open_unchecked(path, size, mtime);
+    if (cached == NULL) {
+        return false;
+    }
+
+    // Without the card there is nothing else to check the copy against, so
+    // only a compressed copy (which carries a CRC) is used.
+    uint8_t data[LZSS_HEADER_SIZE];
+    lzss_header_t header;
+    const bool compressed = fread(data, 1, sizeof(data), cached) == sizeof(data)
+        && lzss_read_header(data, sizeof(data), &header)
+        && fseek(cached, 0, SEEK_SET) == 0;
+
+    const bool ok = compressed && sd_stream_file(cached, sink, SIZE_MAX, stats);
+    fclose(cached);
+    return ok;
+}
+
+static FIL image_file;
+static bool image_is_open;
+
+bool sd_image_open(const char* path, uint32_t* size) {
+    sd_image_close();
+
+    FILINFO info;
+    const sd_volume_t volume = resolve(path, &info);
+    char fs_path[PATH_MAX];
+    if (volume == sd_volume_count
+        || !fatfs_path(volume, path, fs_path, sizeof(fs_path))
+        || f_open(&image_file, fs_path, FA_READ) != FR_OK) {
+        log_warn("sd: cannot open image '%s'", path);
+        return false;
+    }
+    image_is_open = true;
+
+    *size = (uint32_t) f_size(&image_file);
+    return true;
+}
+
+bool sd_image_read(uint32_t offset, uint8_t* buffer, size_t length) {
+    UINT bytes_read;
+    return image_is_open
+        && f_lseek(&image_file, offset) == FR_OK
+        && f_read(&image_file, buffer, (UINT) length, &bytes_read) == FR_OK
+        && bytes_read == length;
+}
+
+void sd_image_close(void) {
+    if (image_is_open) {
+        f_close(&image_file);
+        image_is_open = false;
+    }
+}
@@ -8,14 +8,130 @@
 #include <stdint.h>
 #include <stdio.h>
 
+#include "sd_stream.h"
+
+// Create the SD card's block device. Must precede sd_card_init() and sd_init().
+void sd_create(void);
+
+// Bring up the SD card without mounting it, so that this part can run on
+// core1 while core0 configures the FPGA (see boot_core1.h). Only calls the
+// block device's init(), which drives the card's SPI bus and GPIOs. Does not
+// log. Returns 0 or the block device's error code.
+int sd_card_init(void);
+
+// Mount the SD card at the root of the VFS. Returns false (and logs why) if
+// the card cannot be mounted.
 bool sd_init();
 
+// Mount the littlefs partition in the RP2040's flash at SD_FLASH_MOUNT_POINT
+// and load the cache index (see sd_cache.h), formatting the partition on
+// first use. The cache stays disabled if the partition cannot be mounted.
+// Independent of the SD card, so it may be called before sd_init().
+void sd_flash_init(void);
+
+// Volumes that programs and ROMs can be read from. The SD card is mounted at
+// the root of the VFS and a USB mass storage device at SD_USB_MOUNT_POINT.
+typedef enum {
+    sd_volume_sd,
+    sd_volume_usb,
+    sd_volume_count,
+} sd_volume_t;
+
+#define SD_USB_MOUNT_POINT "/usb"
+
+// The littlefs partition in the RP2040's flash (see sd_cache.h).
+#define SD_FLASH_MOUNT_POINT "/flash"
+
+// Read throughput of a volume since it was mounted.
+typedef struct {
+    uint32_t files;
+    uint64_t bytes;
+    uint32_t read_us;
+} sd_volume_stats_t;
+
+// Set the order in which volumes are searched for files read by path (see
+// sd_resolve()), as a comma separated list of volume names (e.g., "usb, sd").
+// Volumes left out are not searched. Returns false if 'order' is invalid.
+bool sd_set_search_order(const char* order);
+
+// Copy the current search order to 'order' and return its length.
+unsigned int sd_get_search_order(sd_volume_t order[sd_volume_count]);
+
+// Called by the USB host when a mass storage device is mounted at
+// SD_USB_MOUNT_POINT or removed.
+void sd_volume_set_mounted(sd_volume_t volume, bool mounted);
+bool sd_volume_is_mounted(sd_volume_t volume);
+const char* sd_volume_name(sd_volume_t volume);
+void sd_volume_get_stats(sd_volume_t volume, sd_volume_stats_t* stats);
+void sd_volume_log(sd_volume_t volume);
+
+// Find 'path' (an absolute path such as "/prgs/game.prg") on the first volume
+// in the search order that has it, and write the VFS path for fopen() to
+// 'out'. Returns false if no mounted volume has the file.
+bool sd_resolve(const char* path, char* out, size_t out_size);
+
 FILE* sd_open(const char* path, const char* mode);
 
 size_t sd_read(const char* filename, FILE* file, uint8_t* dest, size_t size);
 
-typedef void (*sd_read_callback_t)(size_t offset, uint8_t* buffer, size_t bytes_read, void* context);
+// Read up to 'max_bytes' of the file at 'path' (decompressing it if it is
+// LZSS compressed), passing each chunk to 'callback'.
+typedef void (*sd_read_callback_t)(size_t offset, const uint8_t* buffer, size_t bytes_read, void* context);
 void sd_read_file(const char* path, sd_read_callback_t callback, void* context, size_t max_bytes);
 
+// Stream up to 'max_bytes' of the file at 'path' to 'sink' (see sd_stream()).
+// Unlike sd_stream_file(), this bypasses stdio and reads whole-sector chunks
+// straight from FatFs into the stream buffers as multi-block SD reads, which
+// suits large sequential loads such as the FPGA bitstream and ROMs. 'path' is
+// resolved through the volume search order (see sd_resolve()). If 'cache', a
+// file on the SD card is read from (or copied into) the flash cache (see
+// sd_cache.h). Only files read at every boot should be cached. Fatal if the
+// file cannot be opened. Returns false on a read error.
+bool sd_stream_path(const char* path, bool cache, const sd_stream_sink_t* sink, size_t max_bytes,
+                    sd_stream_stats_t* stats);
+
+// Stream the flash copy of the SD card file 'path' to 'sink' without reading
+// the card, which need not be mounted yet, setting the 'size' and 'mtime' the
+// copy was made from (see sd_cache_open_unchecked()). Only an LZSS compressed
+// copy is used, so its contents are verified by the CRC. Returns false if
+// there is no such copy, or if it is corrupt (after some of it may already
+// have reached 'sink').
+bool sd_stream_flash(const char* path, const sd_stream_sink_t* sink, sd_stream_stats_t* stats, uint32_t* size,
+                     uint32_t* mtime);
+
 // Return the free space on the SD card in bytes. Returns 0 on error.
 uint64_t sd_free_bytes(void);
+
+// Called by sd_scan_dir for each regular file, with its size in bytes.
+typedef void (*sd_dir_callback_t)(const char* name, uint32_t size, void* context);
+
+// List the regular files in the directory at 'path' in a single pass. Sizes
+// come from the directory entries, so no per-file stat() is needed. The
+// directory is merged across the mounted volumes in search order, and a name
+// found on an earlier volume hides the same name on later ones. Returns false
+// if the directory cannot be opened on any volume.
+bool sd_scan_dir(const char* path, sd_dir_callback_t callback, void* context);
+
+// Like sd_scan_dir(), but for a single volume.
+bool sd_scan_volume(sd_volume_t volume, const char* path, sd_dir_callback_t callback, void* context);
+
+// Get the size and modification timestamp (as for sd_mtime()) of 'path' on
+// the SD card. Returns false on error.
+bool sd_stat(const char* path, uint32_t* size, uint32_t* mtime);
+
+// Get the modification timestamp of 'path' as (FAT date << 16 | FAT time).
+// When 'path' exists on more than one volume the timestamps are combined, so
+// the value also changes when a volume is mounted or removed. Returns false
+// on error.
+bool sd_mtime(const char* path, uint32_t* mtime);
+
+// Open 'path' (resolved through the search order) for random access as the
+// (single) disk image file, closing any previous one. Sets 'size' to the file
+// size. Returns false if the file cannot be opened.
+bool sd_image_open(const char* path, uint32_t* size);
+
+// Read 'length' bytes at 'offset' in the open image file. Returns false on
+// error or a short read.
+bool sd_image_read(uint32_t offset, uint8_t* buffer, size_t length);
+
+void sd_image_close(void);
@@ -0,0 +1,338 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#include "sd_cache.h"
+
+#include <inttypes.h>
+#include <limits.h>
+#include <string.h>
+
+#include "crc.h"
+#include "diag/log/log.h"
+
+// "EPC" + format version
+#define INDEX_MAGIC 0x01435045
+
+typedef struct {
+    char path[SD_CACHE_PATH_MAX];   // SD card path, or "" if the slot is free
+    uint32_t size;
+    uint32_t mtime;                 // FAT date << 16 | FAT time
+    uint32_t last_used;             // Larger is more recent
+} cache_entry_t;
+
+// On-flash index. Slot 'i' keeps its data in '<root>/<i>.bin'.
+typedef struct {
+    uint32_t magic;
+    cache_entry_t entries[SD_CACHE_ENTRIES];
+    uint32_t crc;
+} cache_index_t;
+
+static struct {
+    bool enabled;
+    char root[32];
+    uint32_t budget;
+    cache_index_t index;
+    uint32_t clock;                 // Last 'last_used' handed out
+
+    // In-progress store (-1 if none)
+    int storing;
+    cache_entry_t pending;
+
+    sd_cache_stats_t stats;
+} cache = { .storing = -1 };
+
+static void slot_path(unsigned int slot, char* out, size_t size) {
+    snprintf(out, size, "%s/%u.bin", cache.root, slot);
+}
+
+static void index_path(char* out, size_t size, const char* suffix) {
+    snprintf(out, size, "%s/index%s", cache.root, suffix);
+}
+
+static uint32_t index_crc(const cache_index_t* index) {
+    return crc32_update(CRC32_INIT, (const uint8_t*) index, offsetof(cache_index_t, crc));
+}
+
+static bool is_free(const cache_entry_t* entry) {
+    return entry->path[0] == '\0';
+}
+
+static uint32_t used_bytes(void) {
+    uint32_t total = 0;
+    for (unsigned int i = 0; i < SD_CACHE_ENTRIES; i++) {
+        if (!is_free(&cache.index.entries[i])) {
+            total += cache.index.entries[i].size;
+        }
+    }
+    return total;
+}
+
+// Write the index to a temporary file and rename it over the old one, so a
+// power loss leaves either the old or the new index.
+static void write_index(void) {
+    char path[PATH_MAX];
+    char temp_path[PATH_MAX];
+    index_path(path, sizeof(path), "");
+    index_path(temp_path, sizeof(temp_path), ".tmp");
+
+    cache.index.magic = INDEX_MAGIC;
+    cache.index.crc = index_crc(&cache.index);
+
+    FILE* file = fopen(temp_path, "wb");
+    if (file == NULL) {
+        log_warn("cache: cannot write index");
+        return;
+    }
+    const bool ok = fwrite(&cache.index, sizeof(cache.index), 1, file) == 1;
+    if (fclose(file) != 0 || !ok) {
+        log_warn("cache: cannot write index");
+        remove(temp_path);
+        return;
+    }
+
+    // littlefs replaces 'path' atomically, so a power loss leaves either
+    // index intact.
+    rename(temp_path, path);
+}
+
+static void drop_entry(unsigned int slot) {
+    char path[PATH_MAX];
+    slot_path(slot, path, sizeof(path));
+    remove(path);
+    memset(&cache.index.entries[slot], 0, sizeof(cache_entry_t));
+}
+
+static int find_entry(const char* path) {
+    for (unsigned int i = 0; i < SD_CACHE_ENTRIES; i++) {
+        if (strcmp(cache.index.entries[i].path, path) == 0) {
+            return (int) i;
+        }
+    }
+    return -1;
+}
+
+void sd_cache_init(const char* root, uint32_t budget) {
+    memset(&cache, 0, sizeof(cache));
+    cache.storing = -1;
+    cache.budget = budget;
+
+    if (strlen(root) >= sizeof(cache.root)) {
+        log_warn("cache: root path too long");
+        return;
+    }
+    strcpy(cache.root, root);
+    cache.enabled = true;
+
+    char path[PATH_MAX];
+    index_path(path, sizeof(path), "");
+    FILE* file = fopen(path, "rb");
+    const bool loaded = file != NULL
+        && fread(&cache.index, sizeof(cache.index), 1, file) == 1
+        && cache.index.magic == INDEX_MAGIC
+        && cache.index.crc == index_crc(&cache.index);
+    if (file != NULL) {
+        fclose(file);
+    }
+
+    if (!loaded) {
+        // Missing, from another firmware version, or corrupt. Start over.
+        sd_cache_clear();
+        return;
+    }
+
+    for (unsigned int i = 0; i < SD_CACHE_ENTRIES; i++) {
+        cache_entry_t* const entry = &cache.index.entries[i];
+        entry->path[SD_CACHE_PATH_MAX - 1] = '\0';
+        if (entry->last_used > cache.clock) {
+            cache.clock = entry->last_used;
+        }
+    }
+
+    sd_cache_stats_t stats;
+    sd_cache_get_stats(&stats);
+    log_info("cache: %" PRIu32 " files, %" PRIu32 " of %" PRIu32 " KB", stats.entries, stats.bytes / 1024,
+        budget / 1024);
+}
+
+FILE* sd_cache_open(const char* path, uint32_t size, uint32_t mtime) {
+    if (!cache.enabled) {
+        return NULL;
+    }
+
+    const int slot = find_entry(path);
+    if (slot < 0) {
+        cache.stats.misses++;
+        return NULL;
+    }
+
+    cache_entry_t* const entry = &cache.index.entries[slot];
+    if (entry->size != size || entry->mtime != mtime) {
+        // Stale. The caller re-reads the SD card and stores the new version.
+        log_info("cache: '%s' changed on the SD card", path);
+        cache.stats.misses++;
+        return NULL;
+    }
+
+    char data_path[PATH_MAX];
+    slot_path((unsigned int) slot, data_path, sizeof(data_path));
+    FILE* file = fopen(data_path, "rb");
+    if (file == NULL) {
+        log_warn("cache: '%s' is missing from flash", path);
+        drop_entry((unsigned int) slot);
+        write_index();
+        cache.stats.misses++;
+        return NULL;
+    }
+
+    entry->last_used = ++cache.clock;
+    cache.stats.hits++;
+    return file;
+}
+
+FILE* sd_cache_open_unchecked(const char* path, uint32_t* size, uint32_t* mtime) {
+    if (!cache.enabled) {
+        return NULL;
+    }
+
+    const int slot = find_entry(path);
+    if (slot < 0) {
+        return NULL;
+    }
+
+    char data_path[PATH_MAX];
+    slot_path((unsigned int) slot, data_path, sizeof(data_path));
+    FILE* file = fopen(data_path, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+
+    // A use like any other, so a copy read early on every boot is not evicted
+    // first. As for sd_cache_open(), the index records it with the next store.
+    cache_entry_t* const entry = &cache.index.entries[slot];
+    entry->last_used = ++cache.clock;
+    *size = entry->size;
+    *mtime = entry->mtime;
+    return file;
+}
+
+// Evict the least recently used entry. Returns false if the cache is empty.
+static bool evict_one(void) {
+    int victim = -1;
+    for (unsigned int i = 0; i < SD_CACHE_ENTRIES; i++) {
+        const cache_entry_t* const entry = &cache.index.entries[i];
+        if (!is_free(entry) && (victim < 0 || entry->last_used < cache.index.entries[victim].last_used)) {
+            victim = (int) i;
+        }
+    }
+
+    if (victim < 0) {
+        return false;
+    }
+
+    log_debug("cache: evicting '%s'", cache.index.entries[victim].path);
+    drop_entry((unsigned int) victim);
+    cache.stats.evictions++;
+    return true;
+}
+
+static int free_slot(void) {
+    for (unsigned int i = 0; i < SD_CACHE_ENTRIES; i++) {
+        if (is_free(&cache.index.entries[i])) {
+            return (int) i;
+        }
+    }
+    return -1;
+}
+
+FILE* sd_cache_store_begin(const char* path, uint32_t size, uint32_t mtime) {
+    if (!cache.enabled || cache.storing >= 0 || size > cache.budget || strlen(path) >= SD_CACHE_PATH_MAX) {
+        return NULL;
+    }
+
+    bool changed = false;
+
+    // Replace a stale copy.
+    const int existing = find_entry(path);
+    if (existing >= 0) {
+        drop_entry((unsigned int) existing);
+        changed = true;
+    }
+
+    while (free_slot() < 0 || used_bytes() + size > cache.budget) {
+        evict_one();
+        changed = true;
+    }
+
+    // Persist the evictions before writing over the freed space.
+    if (changed) {
+        write_index();
+    }
+
+    const int slot = free_slot();
+    char data_path[PATH_MAX];
+    slot_path((unsigned int) slot, data_path, sizeof(data_path));
+    FILE* file = fopen(data_path, "wb");
+    if (file == NULL) {
+        log_warn("cache: cannot create '%s'", data_path);
+        return NULL;
+    }
+
+    cache.storing = slot;
+    memset(&cache.pending, 0, sizeof(cache.pending));
+    strcpy(cache.pending.path, path);
+    cache.pending.size = size;
+    cache.pending.mtime = mtime;
+    return file;
+}
+
+void sd_cache_store_end(FILE* file, bool complete) {
+    if (file == NULL || cache.storing < 0) {
+        return;
+    }
+
+    const unsigned int slot = (unsigned int) cache.storing;
+    cache.storing = -1;
+
+    complete = complete && ftell(file) == (long) cache.pending.size;
+    if (fclose(file) != 0) {
+        complete = false;
+    }
+
+    if (!complete) {
+        char data_path[PATH_MAX];
+        slot_path(slot, data_path, sizeof(data_path));
+        remove(data_path);
+        return;
+    }
+
+    cache.pending.last_used = ++cache.clock;
+    cache.index.entries[slot] = cache.pending;
+    write_index();
+
+    cache.stats.stores++;
+    log_info("cache: stored '%s' (%" PRIu32 " bytes)", cache.pending.path, cache.pending.size);
+}
+
+void sd_cache_clear(void) {
+    if (!cache.enabled) {
+        return;
+    }
+
+    for (unsigned int i = 0; i < SD_CACHE_ENTRIES; i++) {
+        drop_entry(i);
+    }
+    cache.clock = 0;
+    write_index();
+}
+
+void sd_cache_get_stats(sd_cache_stats_t* stats) {
+    *stats = cache.stats;
+    stats->budget = cache.budget;
+    stats->entries = 0;
+    for (unsigned int i = 0; i < SD_CACHE_ENTRIES; i++) {
+        if (!is_free(&cache.index.entries[i])) {
+            stats->entries++;
+        }
+    }
+    stats->bytes = used_bytes();
+}
@@ -0,0 +1,77 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Read-through cache of SD card files in the RP2040's flash. Files read whole
+// through sd_stream_path() with 'cache' set (the FPGA bitstream, ROMs loaded
+// by config.yaml, and USB keymaps) are copied into a littlefs partition the
+// first time they are read, and later reads come from flash instead of the SD
+// card. Programs loaded from tape or the IEEE drive are read from the card, so
+// they neither cost flash writes nor push the boot files out of the cache.
+//
+// Each entry is validated against the SD card's directory entry (size and
+// modification time), so a file replaced on the card is read from the card
+// again and re-cached. When a new file does not fit in the budget, the least
+// recently used entries are evicted.
+//
+// The index lives in RAM and is written to flash only when entries are added
+// or evicted, so a hit costs no flash writes. (Recency from hits is persisted
+// with the next write.)
+
+// Configuration: maximum number of cached files.
+#ifndef SD_CACHE_ENTRIES
+#define SD_CACHE_ENTRIES 24
+#endif
+
+// Configuration: longest SD card path that can be cached (including the NUL).
+#ifndef SD_CACHE_PATH_MAX
+#define SD_CACHE_PATH_MAX 64
+#endif
+
+typedef struct {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t stores;        // Files copied into the cache
+    uint32_t evictions;
+    uint32_t entries;       // Files currently cached
+    uint32_t bytes;         // Bytes currently cached
+    uint32_t budget;
+} sd_cache_stats_t;
+
+// Use the directory 'root' (on the flash file system) for the cache, holding
+// at most 'budget' bytes of file data. Loads the index, discarding the cache
+// if it is missing or corrupt.
+void sd_cache_init(const char* root, uint32_t budget);
+
+// Open the cached copy of the SD card file 'path' if its size and mtime (see
+// sd_mtime()) match. Returns NULL on a miss.
+FILE* sd_cache_open(const char* path, uint32_t size, uint32_t mtime);
+
+// Open the cached copy of 'path' without checking it against the SD card
+// (e.g., before the card is mounted), setting the 'size' and 'mtime' it was
+// cached with. The caller must compare them with the card's directory entry
+// once it can. Returns NULL if 'path' is not cached.
+FILE* sd_cache_open_unchecked(const char* path, uint32_t* size, uint32_t* mtime);
+
+// Start copying the SD card file 'path' into the cache, evicting entries as
+// needed. The caller writes the file's contents to the returned stream and
+// then calls sd_cache_store_end(). Returns NULL if the file cannot be cached
+// (too large, path too long, or the cache is disabled). Only one file is
+// stored at a time.
+FILE* sd_cache_store_begin(const char* path, uint32_t size, uint32_t mtime);
+
+// Finish the copy started by sd_cache_store_begin(). The entry is added only
+// if 'complete' is true and the whole file was written; otherwise the partial
+// copy is discarded.
+void sd_cache_store_end(FILE* file, bool complete);
+
+// Remove all cached files.
+void sd_cache_clear(void);
+
+void sd_cache_get_stats(sd_cache_stats_t* stats);
@@ -0,0 +1,174 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#include "pch.h"
+#include "sd_stream.h"
+
+#include <inttypes.h>
+
+#include "diag/log/log.h"
+#include "lzss.h"
+
+// Aligned for the SD card's DMA, which transfers directly into these buffers.
+static uint8_t buffers[2][SD_STREAM_CHUNK_SIZE] __attribute__((aligned(4)));
+
+// Only one file is streamed at a time, so a single decoder (and its window)
+// is shared.
+static lzss_decoder_t decoder;
+
+// Read the next chunk into 'buffer'. Returns 0 at the end of the source or if
+// the read failed, which sets 'failed'.
+static size_t read_chunk(const sd_stream_source_t* source, uint8_t* buffer, size_t remaining,
+                         sd_stream_stats_t* stats, bool* failed) {
+    const uint64_t start = time_us_64();
+    size_t length = 0;
+    if (!source->read(source->context, buffer, remaining < SD_STREAM_CHUNK_SIZE ? remaining : SD_STREAM_CHUNK_SIZE,
+                      &length)) {
+        *failed = true;
+        length = 0;
+    }
+    stats->read_us += (uint32_t) (time_us_64() - start);
+    stats->reads++;
+    stats->read_bytes += length;
+    return length;
+}
+
+typedef struct {
+    const sd_stream_sink_t* sink;
+    size_t max_bytes;
+    sd_stream_stats_t* stats;
+} inflate_context_t;
+
+// Pass a span of decompressed output (which lives in the decoder's window) to
+// the sink. The window is overwritten by the next span, so each one is
+// consumed before decoding continues.
+static void inflate_span(void* context, size_t offset, const uint8_t* data, size_t length) {
+    inflate_context_t* const inflate = context;
+    if (offset >= inflate->max_bytes) {
+        return;
+    }
+    if (length > inflate->max_bytes - offset) {
+        length = inflate->max_bytes - offset;
+    }
+
+    const sd_stream_sink_t* const sink = inflate->sink;
+    sink->begin(sink->context, offset, data, length);
+    if (sink->wait != NULL) {
+        const uint64_t wait_start = time_us_64();
+        sink->wait(sink->context);
+        inflate->stats->wait_us += (uint32_t) (time_us_64() - wait_start);
+    }
+    inflate->stats->bytes += length;
+}
+
+// Decompress an LZSS file whose first 'length' bytes are already in
+// 'buffers[0]'. The compressed input is still read ahead into the other
+// buffer while the current one is decoded.
+static bool inflate_file(const sd_stream_source_t* source, const lzss_header_t* header, size_t length,
+                         const sd_stream_sink_t* sink, size_t max_bytes, sd_stream_stats_t* stats, bool* failed) {
+    inflate_context_t inflate = { sink, max_bytes, stats };
+    lzss_decoder_init(&decoder, header);
+
+    unsigned int current = 0;
+    const uint8_t* data = &buffers[current][LZSS_HEADER_SIZE];
+    length -= LZSS_HEADER_SIZE;
+
+    lzss_status_t status = lzss_more;
+    while (status == lzss_more && stats->bytes < max_bytes) {
+        const size_t next = read_chunk(source, buffers[current ^ 1], SIZE_MAX, stats, failed);
+        if (length == 0 && next == 0) {
+            break;          // Truncated
+        }
+
+        status = lzss_decode(&decoder, data, length, inflate_span, &inflate);
+
+        current ^= 1;
+        data = buffers[current];
+        length = next;
+    }
+
+    if (status == lzss_error) {
+        log_warn("sd: corrupt compressed file (at byte %" PRIu32 ")", decoder.produced);
+        return false;
+    }
+    return status == lzss_done || stats->bytes == max_bytes;
+}
+
+bool sd_stream(const sd_stream_source_t* source, const sd_stream_sink_t* sink, size_t max_bytes,
+               sd_stream_stats_t* stats) {
+    sd_stream_stats_t local = { 0 };
+    bool failed = false;
+    const uint64_t start = time_us_64();
+
+    size_t remaining = max_bytes;
+    unsigned int current = 0;
+
+    // Read a full first chunk regardless of 'max_bytes', which counts
+    // decompressed bytes if the file turns out to be compressed.
+    size_t length = read_chunk(source, buffers[current], SIZE_MAX, &local, &failed);
+
+    lzss_header_t header;
+    if (lzss_read_header(buffers[current], length, &header)) {
+        const bool ok = inflate_file(source, &header, length, sink, max_bytes, &local, &failed);
+        local.elapsed_us = (uint32_t) (time_us_64() - start);
+        if (stats != NULL) {
+            *stats = local;
+        }
+        return ok && !failed;
+    }
+
+    if (length > remaining) {
+        length = remaining;
+    }
+
+    while (length > 0) {
+        sink->begin(sink->context, local.bytes, buffers[current], length);
+        local.bytes += length;
+        remaining -= length;
+
+        // Read the next chunk into the other buffer while the sink is busy.
+        const size_t next = remaining > 0
+            ? read_chunk(source, buffers[current ^ 1], remaining, &local, &failed)
+            : 0;
+
+        if (sink->wait != NULL) {
+            const uint64_t wait_start = time_us_64();
+            sink->wait(sink->context);
+            local.wait_us += (uint32_t) (time_us_64() - wait_start);
+        }
+
+        current ^= 1;
+        length = next;
+    }
+
+    local.elapsed_us = (uint32_t) (time_us_64() - start);
+    if (stats != NULL) {
+        *stats = local;
+    }
+
+    return !failed;
+}
+
+static bool stdio_read(void* context, uint8_t* buffer, size_t length, size_t* bytes_read) {
+    FILE* const file = context;
+    *bytes_read = fread(buffer, 1, length, file);
+    return !ferror(file);
+}
+
+bool sd_stream_file(FILE* file, const sd_stream_sink_t* sink, size_t max_bytes, sd_stream_stats_t* stats) {
+    const sd_stream_source_t source = { .read = stdio_read, .context = file };
+    return sd_stream(&source, sink, max_bytes, stats);
+}
+
+void sd_stream_log(const char* what, const sd_stream_stats_t* stats) {
+    const uint32_t ms = stats->elapsed_us / 1000;
+    const uint32_t kbps = stats->elapsed_us > 0
+        ? (uint32_t) ((uint64_t) stats->bytes * 1000 / stats->elapsed_us)
+        : 0;
+
+    const uint32_t bytes_per_read = stats->reads > 0 ? (uint32_t) (stats->read_bytes / stats->reads) : 0;
+
+    log_info("%s: %zu bytes in %" PRIu32 " ms (%" PRIu32 " KB/s, read %" PRIu32 " ms in %" PRIu32 " x %" PRIu32
+        " B, sink wait %" PRIu32 " ms)",
+        what, stats->bytes, ms, kbps, stats->read_us / 1000, stats->reads, bytes_per_read, stats->wait_us / 1000);
+}
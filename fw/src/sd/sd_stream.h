@@ -0,0 +1,65 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Double-buffered streaming from an SD card file to a consumer. While the sink
+// consumes one chunk, the next chunk is read from the card into the other
+// buffer, so an asynchronous sink (e.g., DMA to the FPGA) overlaps with the SD
+// transfer instead of alternating with it.
+
+// Configuration: size of each of the two buffers. A multiple of the SD sector
+// size, so each read from sd_stream_path() is a single multi-block transfer.
+#ifndef SD_STREAM_CHUNK_SIZE
+#define SD_STREAM_CHUNK_SIZE 4096
+#endif
+
+typedef struct {
+    // Read up to 'length' bytes into 'buffer', setting 'bytes_read' (0 at the
+    // end of the file). Returns false on a read error.
+    bool (*read)(void* context, uint8_t* buffer, size_t length, size_t* bytes_read);
+
+    void* context;
+} sd_stream_source_t;
+
+typedef struct {
+    // Start consuming 'length' bytes of 'buffer', which hold the file's
+    // contents at 'offset'. 'buffer' is not modified until wait() returns.
+    void (*begin)(void* context, size_t offset, const uint8_t* buffer, size_t length);
+
+    // Block until the chunk passed to begin() has been consumed. May be NULL
+    // if begin() is synchronous.
+    void (*wait)(void* context);
+
+    void* context;
+} sd_stream_sink_t;
+
+typedef struct {
+    size_t bytes;           // Bytes streamed
+    size_t read_bytes;      // Bytes read from the source (less than 'bytes' if compressed)
+    uint32_t reads;         // Calls to the source's read()
+    uint32_t elapsed_us;    // Total time
+    uint32_t read_us;       // Time spent reading the card
+    uint32_t wait_us;       // Time spent waiting for the sink after reading
+} sd_stream_stats_t;
+
+// Stream up to 'max_bytes' from 'source' to 'sink'. Returns false if the
+// source could not be read. 'stats' may be NULL.
+//
+// Files that start with an LZSS header (see lzss.h) are decompressed on the
+// fly. 'max_bytes' and 'stats->bytes' then count decompressed bytes, and each
+// span is consumed (begin() then wait()) before the next one is decoded. A
+// corrupt stream or CRC mismatch returns false.
+bool sd_stream(const sd_stream_source_t* source, const sd_stream_sink_t* sink, size_t max_bytes,
+               sd_stream_stats_t* stats);
+
+// As sd_stream(), reading from the current position of 'file' through stdio.
+bool sd_stream_file(FILE* file, const sd_stream_sink_t* sink, size_t max_bytes, sd_stream_stats_t* stats);
+
+// Log a one-line summary of 'stats' (throughput and where the time went).
+void sd_stream_log(const char* what, const sd_stream_stats_t* stats);
@@ -0,0 +1,453 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#include "pch.h"
+#include "snapshot.h"
+
+#include <inttypes.h>
+
+#include "breakpoint.h"
+#include "diag/log/log.h"
+#include "driver.h"
+#include "ieee/ieee.h"
+#include "pet.h"
+#include "pool.h"
+#include "roms/rom_pages.h"
+#include "roms/roms.h"
+#include "sd/sd.h"
+#include "snapshot_file.h"
+#include "system_state.h"
+#include "usb/keyboard.h"
+
+// A snapshot holds what the FPGA can give back over SPI: all of SRAM (RAM,
+// video RAM, and soft-ROM), the character ROM, and the CRTC and video
+// registers. The PIAs and VIA are real chips, so their state is not saved.
+//
+// The CPU registers are not visible over SPI either. To save them, the
+// firmware borrows a few bytes of RAM for a stub, points the NMI vector at it,
+// and pulses NMI. The stub stores A, X, Y, and S, then halts on STP (as for a
+// breakpoint). P and PC are on the stack where the NMI pushed them. While the
+// CPU is halted, SRAM is consistent and is written to the file (with the
+// borrowed bytes as they were). The stub then returns from the NMI.
+//
+// Restoring works the other way around: an NMI to a lone STP parks the CPU,
+// the snapshot is written to SRAM and the FPGA, and a stub then loads the
+// registers and returns from the NMI into the saved program.
+
+#define SRAM_SIZE   0x20000
+#define NMI_VECTOR  0xFFFA
+#define STACK_PAGE  0x0100
+
+#define STP_OPCODE  0xDB
+#define RTI_OPCODE  0x40
+
+#define STUB_SIZE    0x14
+#define CAPTURE_STP  (SNAPSHOT_STUB_ADDRESS + 0x0D)
+#define CAPTURE_REGS (SNAPSHOT_STUB_ADDRESS + 0x10)    // A, X, Y, S
+#define RESTORE_STP  (SNAPSHOT_STUB_ADDRESS + 0x12)
+
+// Time for the CPU (at 1 MHz) to run the last few instructions of a stub
+// before the firmware puts back the bytes it borrowed.
+#define STUB_EXIT_US 100
+
+// RAM the firmware borrows while saving or restoring.
+typedef struct {
+    uint8_t stub[STUB_SIZE];
+    uint8_t vector[2];
+} borrowed_t;
+
+static void borrow(borrowed_t* borrowed) {
+    spi_read(SNAPSHOT_STUB_ADDRESS, sizeof(borrowed->stub), borrowed->stub);
+    spi_read(NMI_VECTOR, sizeof(borrowed->vector), borrowed->vector);
+}
+
+static void give_back(const borrowed_t* borrowed) {
+    spi_write(SNAPSHOT_STUB_ADDRESS, borrowed->stub, sizeof(borrowed->stub));
+    spi_write(NMI_VECTOR, borrowed->vector, sizeof(borrowed->vector));
+}
+
+static void set_nmi_vector(uint16_t address) {
+    const uint8_t vector[] = { (uint8_t) address, (uint8_t) (address >> 8) };
+    spi_write(NMI_VECTOR, vector, sizeof(vector));
+}
+
+// Copy the part of 'src' (at 'src_address') that overlaps 'dest' (at
+// 'dest_address').
+static void copy_overlap(uint32_t dest_address, uint8_t* dest, size_t dest_length,
+                         uint32_t src_address, const uint8_t* src, size_t src_length) {
+    const uint32_t start = MAX(dest_address, src_address);
+    const uint32_t end = MIN(dest_address + dest_length, src_address + src_length);
+    if (start < end) {
+        memcpy(&dest[start - dest_address], &src[start - src_address], end - start);
+    }
+}
+
+// The stub must not overwrite code that the firmware has put in RAM itself.
+static bool stub_is_free(void) {
+    if (ieee_uses_ram(SNAPSHOT_STUB_ADDRESS, STUB_SIZE)) {
+        log_warn("snapshot: $%04X-$%04X is in use by the IEEE drive's trap",
+            SNAPSHOT_STUB_ADDRESS, SNAPSHOT_STUB_ADDRESS + STUB_SIZE - 1);
+        return false;
+    }
+    return true;
+}
+
+// Wait for the CPU to halt on the STP at 'address'.
+static bool wait_for_stp(uint16_t address) {
+    const uint64_t start = time_us_64();
+    do {
+        sync_state();
+        if (system_state.bp_halted) {
+            const uint16_t pc = bp_hit_addr();
+            if (pc != address) {
+                log_warn("snapshot: CPU halted at $%04X instead of $%04X", pc, address);
+                return false;
+            }
+            return true;
+        }
+    } while (time_us_64() - start < SNAPSHOT_NMI_TIMEOUT_US);
+
+    log_warn("snapshot: CPU did not reach $%04X after NMI", address);
+    return false;
+}
+
+// Resume the CPU halted on the STP at 'pc' with 'code' in place of the STP,
+// and put back the bytes borrowed for the stub (in 'stub') once it has run.
+static void leave_stub(uint16_t pc, const uint8_t* code, size_t length, const uint8_t stub[STUB_SIZE]) {
+    const size_t offset = pc - SNAPSHOT_STUB_ADDRESS;
+    spi_write(SNAPSHOT_STUB_ADDRESS, stub, offset);
+    spi_write(pc + length, &stub[offset + length], STUB_SIZE - offset - length);
+    spi_write(pc, code, length);
+
+    // The halted CPU fetches the opcode at 'pc' again once the halt is cleared.
+    bp_clear_halt();
+    sleep_us(STUB_EXIT_US);
+
+    spi_write(pc, &stub[offset], length);
+}
+
+// Replace the bytes the firmware has patched in the given chunk of SRAM with
+// what the program would see.
+static void hide_patches(uint32_t address, uint8_t* data, size_t length, const borrowed_t* borrowed) {
+    copy_overlap(address, data, length, SNAPSHOT_STUB_ADDRESS, borrowed->stub, sizeof(borrowed->stub));
+    copy_overlap(address, data, length, NMI_VECTOR, borrowed->vector, sizeof(borrowed->vector));
+
+    for (int i = 0; i < bp_count(); i++) {
+        const bp_entry_t* const bp = bp_get(i);
+        if (bp->active) {
+            copy_overlap(address, data, length, bp->addr, &bp->original, 1);
+        }
+    }
+}
+
+static bool write_file(const char* path, bool compress, const snapshot_machine_t* machine,
+                       const borrowed_t* borrowed) {
+    FILE* const file = fopen(path, "wb");
+    if (file == NULL) {
+        log_warn("snapshot: cannot create %s", path);
+        return false;
+    }
+
+    uint8_t* const data = pool_alloc(SNAPSHOT_CHUNK_SIZE, "snapshot");
+    snapshot_writer_t writer;
+    snapshot_write_begin(&writer, file, compress);
+
+    for (uint32_t address = 0; address < SRAM_SIZE && writer.ok; address += SNAPSHOT_CHUNK_SIZE) {
+        spi_read(address, SNAPSHOT_CHUNK_SIZE, data);
+        hide_patches(address, data, SNAPSHOT_CHUNK_SIZE, borrowed);
+        snapshot_write_chunk(&writer, address, data, SNAPSHOT_CHUNK_SIZE);
+    }
+
+    for (uint32_t offset = 0; offset < CHAR_ROM_SRAM_SIZE && writer.ok; offset += SNAPSHOT_CHUNK_SIZE) {
+        spi_read(CHAR_ROM_SRAM_ADDRESS + offset, SNAPSHOT_CHUNK_SIZE, data);
+        snapshot_write_chunk(&writer, CHAR_ROM_SRAM_ADDRESS + offset, data, SNAPSHOT_CHUNK_SIZE);
+    }
+
+    snapshot_machine_encode(machine, data);
+    snapshot_write_chunk(&writer, SNAPSHOT_MACHINE_ADDRESS, data, SNAPSHOT_MACHINE_SIZE);
+
+    const bool ok = snapshot_write_end(&writer);
+    pool_free(data);
+
+    if (fclose(file) != 0 || !ok) {
+        log_warn("snapshot: error writing %s", path);
+        remove(path);
+        return false;
+    }
+
+    log_info("snapshot: saved %s (%" PRIu32 " bytes)", path, writer.written);
+    return true;
+}
+
+bool snapshot_save(const char* path, bool compress) {
+    sync_state();
+    if (system_state.bp_halted) {
+        log_warn("snapshot: CPU is halted at a breakpoint");
+        return false;
+    }
+
+    if (!stub_is_free()) {
+        return false;
+    }
+
+    borrowed_t borrowed;
+    borrow(&borrowed);
+
+    const uint8_t r = (uint8_t) CAPTURE_REGS;
+    const uint8_t rh = (uint8_t) (CAPTURE_REGS >> 8);
+    const uint8_t stub[] = {
+        0x8D, r,                rh,         // STA regs
+        0x8E, (uint8_t) (r + 1), rh,        // STX regs+1
+        0x8C, (uint8_t) (r + 2), rh,        // STY regs+2
+        0xBA,                               // TSX
+        0x8E, (uint8_t) (r + 3), rh,        // STX regs+3
+        STP_OPCODE,                         // STP (the firmware saves SRAM here)
+    };
+    _Static_assert(SNAPSHOT_STUB_ADDRESS + 13 == CAPTURE_STP, "STP must be at CAPTURE_STP");
+    _Static_assert((CAPTURE_REGS & 0xFF) <= 0xFC, "registers must not cross a page");
+
+    spi_write(SNAPSHOT_STUB_ADDRESS, stub, sizeof(stub));
+    set_nmi_vector(SNAPSHOT_STUB_ADDRESS);
+    pet_nmi();
+
+    if (!wait_for_stp(CAPTURE_STP)) {
+        give_back(&borrowed);
+        return false;
+    }
+
+    // The NMI pushed PC and P below the program's stack pointer.
+    uint8_t regs[4];
+    spi_read(CAPTURE_REGS, sizeof(regs), regs);
+    const uint8_t s = regs[3];
+    const uint8_t pcl = spi_read_at(STACK_PAGE | (uint8_t) (s + 2));
+    const uint8_t pch = spi_read_at(STACK_PAGE | (uint8_t) (s + 3));
+
+    sync_state();
+    snapshot_machine_t machine = {
+        .a = regs[0],
+        .x = regs[1],
+        .y = regs[2],
+        .sp = (uint8_t) (s + 3),
+        .p = spi_read_at(STACK_PAGE | (uint8_t) (s + 1)),
+        .pc = (uint16_t) (pcl | (pch << 8)),
+        .columns = (uint8_t) system_state.pet_display_columns,
+        .video_ram_mask = system_state.video_ram_mask,
+    };
+    memcpy(machine.crtc, system_state.pet_crtc_registers, sizeof(machine.crtc));
+
+    const bool ok = write_file(path, compress, &machine, &borrowed);
+
+    // Return from the NMI with X as it was.
+    spi_write(NMI_VECTOR, borrowed.vector, sizeof(borrowed.vector));
+    const uint8_t code[] = {
+        0xA2, machine.x,                    // LDX #x
+        RTI_OPCODE,                         // RTI
+    };
+    leave_stub(CAPTURE_STP, code, sizeof(code), borrowed.stub);
+
+    log_info("snapshot: PC=$%04X A=$%02X X=$%02X Y=$%02X P=$%02X S=$%02X",
+        machine.pc, machine.a, machine.x, machine.y, machine.p, machine.sp);
+    return ok;
+}
+
+static bool in_range(const snapshot_chunk_t* chunk, uint32_t start, uint32_t size) {
+    return chunk->address >= start && chunk->address - start <= size
+        && chunk->length <= size - (chunk->address - start);
+}
+
+// Read the whole snapshot, checking each chunk, before anything is written.
+static bool check_file(FILE* file, uint8_t* data, snapshot_machine_t* machine) {
+    snapshot_reader_t reader;
+    bool ok = snapshot_read_begin(&reader, file);
+    bool has_machine = false;
+
+    while (ok) {
+        snapshot_chunk_t chunk;
+        const snapshot_chunk_status_t status = snapshot_read_chunk(&reader, &chunk, data);
+        if (status == snapshot_chunk_end) {
+            break;
+        }
+
+        if (status != snapshot_chunk_ok) {
+            ok = false;
+        } else if (chunk.address == SNAPSHOT_MACHINE_ADDRESS) {
+            ok = snapshot_machine_decode(data, chunk.length, machine)
+                && (machine->columns == pet_display_columns_40 || machine->columns == pet_display_columns_80)
+                && machine->video_ram_mask <= 3;
+            has_machine = true;
+        } else {
+            ok = in_range(&chunk, 0, SRAM_SIZE) || in_range(&chunk, CHAR_ROM_SRAM_ADDRESS, CHAR_ROM_SRAM_SIZE);
+        }
+    }
+
+    snapshot_read_end(&reader);
+    return ok && has_machine;
+}
+
+// Write the snapshot's SRAM and character ROM, keeping the snapshot's content
+// of the stub's bytes in 'stub'.
+static bool apply_file(FILE* file, uint8_t* data, uint8_t stub[STUB_SIZE]) {
+    snapshot_reader_t reader;
+    bool ok = snapshot_read_begin(&reader, file);
+
+    while (ok) {
+        snapshot_chunk_t chunk;
+        const snapshot_chunk_status_t status = snapshot_read_chunk(&reader, &chunk, data);
+        if (status == snapshot_chunk_end) {
+            break;
+        }
+
+        if (status != snapshot_chunk_ok) {
+            ok = false;
+        } else if (chunk.address < SRAM_SIZE) {
+            // Soft-ROM pages that already hold the snapshot's content are skipped.
+            rom_pages_write(chunk.address, data, chunk.length);
+            copy_overlap(SNAPSHOT_STUB_ADDRESS, stub, STUB_SIZE, chunk.address, data, chunk.length);
+        } else if (chunk.address != SNAPSHOT_MACHINE_ADDRESS) {
+            spi_write(chunk.address, data, chunk.length);
+        }
+    }
+
+    snapshot_read_end(&reader);
+    return ok;
+}
+
+// Open 'path' on the first volume that has it (see sd_resolve()). Unlike
+// sd_open(), a missing file is not fatal.
+static FILE* open_snapshot(const char* path) {
+    char resolved[PATH_MAX];
+    FILE* const file = sd_resolve(path, resolved, sizeof(resolved)) ? fopen(resolved, "rb") : NULL;
+    if (file == NULL) {
+        log_warn("snapshot: cannot open %s", path);
+    }
+    return file;
+}
+
+// Open and check the snapshot in 'path', leaving 'file' open on success.
+static bool check_path(const char* path, FILE** file, uint8_t* data, snapshot_machine_t* machine) {
+    *file = open_snapshot(path);
+    if (*file == NULL) {
+        return false;
+    }
+
+    if (!check_file(*file, data, machine)) {
+        log_warn("snapshot: %s is not a valid snapshot", path);
+        fclose(*file);
+        *file = NULL;
+        return false;
+    }
+    return true;
+}
+
+bool snapshot_check(const char* path) {
+    uint8_t* const data = pool_alloc(SNAPSHOT_CHUNK_SIZE, "snapshot");
+    snapshot_machine_t machine;
+    FILE* file;
+    const bool ok = check_path(path, &file, data, &machine);
+    if (ok) {
+        fclose(file);
+    }
+    pool_free(data);
+    return ok;
+}
+
+bool snapshot_restore(const char* path) {
+    if (!stub_is_free()) {
+        return false;
+    }
+
+    uint8_t* const data = pool_alloc(SNAPSHOT_CHUNK_SIZE, "snapshot");
+    snapshot_machine_t machine;
+    uint8_t stub[STUB_SIZE];
+    FILE* file;
+    bool ok = check_path(path, &file, data, &machine);
+
+    // Park the CPU on a STP so that nothing runs while SRAM is replaced.
+    borrowed_t borrowed;
+    if (ok) {
+        borrow(&borrowed);
+        spi_write_at(SNAPSHOT_STUB_ADDRESS, STP_OPCODE);
+        set_nmi_vector(SNAPSHOT_STUB_ADDRESS);
+        pet_nmi();
+
+        ok = wait_for_stp(SNAPSHOT_STUB_ADDRESS);
+        if (!ok) {
+            give_back(&borrowed);
+        }
+    }
+
+    if (ok) {
+        memcpy(stub, borrowed.stub, sizeof(stub));     // In case the file does not cover it
+        rewind(file);
+        ok = apply_file(file, data, stub);
+        if (!ok) {
+            // The file was read once already, so this is an SD card error. SRAM
+            // is partly replaced and the CPU is halted: start over.
+            log_warn("snapshot: error reading %s", path);
+            bp_clear_halt();
+            pet_reset();
+        }
+    }
+
+    if (file != NULL) {
+        fclose(file);
+    }
+    pool_free(data);
+    if (!ok) {
+        return false;
+    }
+
+    write_crtc_registers(machine.crtc);
+    system_state.pet_display_columns = (pet_display_columns_t) machine.columns;
+    system_state_set_video_ram_mask(&system_state, machine.video_ram_mask);
+    write_pet_model(&system_state);
+    roms_refresh_char_rom();
+
+    // Keys held when the snapshot was saved are not held now.
+    memset(usb_key_matrix, 0xff, sizeof(usb_key_matrix));
+
+    // The snapshot was saved without the firmware's breakpoints. Those in the
+    // stub's bytes are armed in 'stub', which leave_stub() writes back after the
+    // stub has run.
+    bp_rearm();
+    static const uint8_t stp[] = { STP_OPCODE };
+    for (int i = 0; i < bp_count(); i++) {
+        const bp_entry_t* const bp = bp_get(i);
+        if (bp->active) {
+            copy_overlap(SNAPSHOT_STUB_ADDRESS, stub, STUB_SIZE, bp->addr, stp, sizeof(stp));
+        }
+    }
+
+    // The parked CPU fetches the opcode at the stub's address again when the
+    // halt is cleared, so it runs the new stub from the start.
+    const uint8_t code[] = {
+        0xA2, machine.sp,                   // LDX #sp
+        0x9A,                               // TXS
+        0xA9, (uint8_t) (machine.pc >> 8),  // LDA #>pc
+        0x48,                               // PHA
+        0xA9, (uint8_t) machine.pc,         // LDA #<pc
+        0x48,                               // PHA
+        0xA9, machine.p,                    // LDA #p
+        0x48,                               // PHA
+        0xA9, machine.a,                    // LDA #a
+        0xA2, machine.x,                    // LDX #x
+        0xA0, machine.y,                    // LDY #y
+        STP_OPCODE,                         // STP (the firmware puts back the stub's bytes here)
+    };
+    _Static_assert(SNAPSHOT_STUB_ADDRESS + 18 == RESTORE_STP, "STP must be at RESTORE_STP");
+
+    spi_write(SNAPSHOT_STUB_ADDRESS, code, sizeof(code));
+    bp_clear_halt();
+    if (!wait_for_stp(RESTORE_STP)) {
+        // SRAM holds the snapshot but the CPU did not get back into it: start over.
+        bp_clear_halt();
+        pet_reset();
+        return false;
+    }
+
+    static const uint8_t rti[] = { RTI_OPCODE };
+    leave_stub(RESTORE_STP, rti, sizeof(rti), stub);
+
+    log_info("snapshot: restored %s (PC=$%04X)", path, machine.pc);
+    return true;
+}
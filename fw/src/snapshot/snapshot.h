@@ -0,0 +1,41 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#pragma once
+
+#include <stdbool.h>
+
+// Save the running machine to 'path' on the SD card: SRAM, the character ROM,
+// the CPU registers, the CRTC registers, and the video configuration. The CPU
+// is stopped by an NMI while the snapshot is written and then resumes where it
+// was. Chunks are LZSS compressed if 'compress'. Returns false (and logs why)
+// on failure.
+bool snapshot_save(const char* path, bool compress);
+
+// Replace the running machine with the snapshot in 'path'. The file is read
+// and checked in full before anything is written, so a bad file leaves the
+// machine running as it was. If a failure comes after SRAM has been written
+// (the SD card cannot be read again, or the CPU does not reach the restore
+// stub), the PET is reset instead. Returns false (and logs why) on failure.
+bool snapshot_restore(const char* path);
+
+// Read and check the snapshot in 'path' as snapshot_restore() does, without
+// writing anything. Returns false (and logs why) if it could not be restored.
+bool snapshot_check(const char* path);
+
+// Configuration: where the menu looks for a snapshot to restore.
+#ifndef SNAPSHOT_DEFAULT_PATH
+#define SNAPSHOT_DEFAULT_PATH "/snapshot.eps"
+#endif
+
+// Configuration: the RAM borrowed for the code that captures and restores the
+// CPU registers. It holds the snapshot's own content again before the CPU
+// resumes. The default is in the second cassette buffer.
+#ifndef SNAPSHOT_STUB_ADDRESS
+#define SNAPSHOT_STUB_ADDRESS 0x033A
+#endif
+
+// Configuration: how long to wait for the CPU to reach the stub after NMI.
+#ifndef SNAPSHOT_NMI_TIMEOUT_US
+#define SNAPSHOT_NMI_TIMEOUT_US 100000
+#endif
@@ -0,0 +1,189 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#include "pch.h"
+#include "snapshot_file.h"
+
+#include "crc.h"
+#include "pool.h"
+
+static const char magic[8] = { 'E', 'P', 'E', 'T', 'S', 'N', 'A', 'P' };
+
+static void put_u32(uint8_t* p, uint32_t value) {
+    p[0] = (uint8_t) value;
+    p[1] = (uint8_t) (value >> 8);
+    p[2] = (uint8_t) (value >> 16);
+    p[3] = (uint8_t) (value >> 24);
+}
+
+static uint32_t get_u32(const uint8_t* p) {
+    return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+void snapshot_machine_encode(const snapshot_machine_t* machine, uint8_t out[SNAPSHOT_MACHINE_SIZE]) {
+    out[0] = machine->a;
+    out[1] = machine->x;
+    out[2] = machine->y;
+    out[3] = machine->sp;
+    out[4] = machine->p;
+    out[5] = (uint8_t) machine->pc;
+    out[6] = (uint8_t) (machine->pc >> 8);
+    out[7] = machine->columns;
+    out[8] = machine->video_ram_mask;
+    memcpy(&out[9], machine->crtc, CRTC_REG_COUNT);
+}
+
+bool snapshot_machine_decode(const uint8_t* data, size_t length, snapshot_machine_t* machine) {
+    if (length != SNAPSHOT_MACHINE_SIZE) {
+        return false;
+    }
+
+    machine->a = data[0];
+    machine->x = data[1];
+    machine->y = data[2];
+    machine->sp = data[3];
+    machine->p = data[4];
+    machine->pc = (uint16_t) (data[5] | (data[6] << 8));
+    machine->columns = data[7];
+    machine->video_ram_mask = data[8];
+    memcpy(machine->crtc, &data[9], CRTC_REG_COUNT);
+    return true;
+}
+
+static void write_bytes(snapshot_writer_t* writer, const uint8_t* data, size_t length) {
+    if (writer->ok && fwrite(data, 1, length, writer->file) != length) {
+        writer->ok = false;
+    }
+    writer->written += (uint32_t) length;
+}
+
+static void write_header(snapshot_writer_t* writer, uint32_t address, uint32_t length, uint32_t stored, uint32_t crc) {
+    uint8_t header[SNAPSHOT_CHUNK_HEADER_SIZE];
+    put_u32(&header[0], address);
+    put_u32(&header[4], length);
+    put_u32(&header[8], stored);
+    put_u32(&header[12], crc);
+    write_bytes(writer, header, sizeof(header));
+}
+
+void snapshot_write_begin(snapshot_writer_t* writer, FILE* file, bool compress) {
+    *writer = (snapshot_writer_t) {
+        .file = file,
+        .compress = compress,
+        .ok = true,
+    };
+
+    if (compress) {
+        writer->packed = pool_alloc(LZSS_PACK_BOUND(SNAPSHOT_CHUNK_SIZE), "snapshot");
+        writer->head = pool_alloc(LZSS_PACK_FAST_HASH_SIZE * sizeof(uint16_t), "snapshot");
+    }
+
+    uint8_t header[SNAPSHOT_HEADER_SIZE];
+    memcpy(header, magic, sizeof(magic));
+    put_u32(&header[8], SNAPSHOT_VERSION);
+    write_bytes(writer, header, sizeof(header));
+}
+
+void snapshot_write_chunk(snapshot_writer_t* writer, uint32_t address, const uint8_t* data, size_t length) {
+    assert(length <= SNAPSHOT_CHUNK_SIZE);
+
+    const uint32_t crc = crc32_update(CRC32_INIT, data, length);
+
+    if (writer->compress && length > 0) {
+        const size_t packed = lzss_pack_fast(data, length, writer->packed, writer->head);
+        if (packed < length) {
+            write_header(writer, address, (uint32_t) length, (uint32_t) packed, crc);
+            write_bytes(writer, writer->packed, packed);
+            return;
+        }
+    }
+
+    write_header(writer, address, (uint32_t) length, (uint32_t) length, crc);
+    write_bytes(writer, data, length);
+}
+
+bool snapshot_write_end(snapshot_writer_t* writer) {
+    write_header(writer, SNAPSHOT_END_ADDRESS, 0, 0, 0);
+
+    pool_free(writer->head);
+    pool_free(writer->packed);
+    writer->head = NULL;
+    writer->packed = NULL;
+    return writer->ok;
+}
+
+bool snapshot_read_begin(snapshot_reader_t* reader, FILE* file) {
+    *reader = (snapshot_reader_t) {
+        .file = file,
+        .stored = pool_alloc(SNAPSHOT_CHUNK_SIZE, "snapshot"),
+        .decoder = pool_alloc(sizeof(lzss_decoder_t), "snapshot"),
+    };
+
+    uint8_t header[SNAPSHOT_HEADER_SIZE];
+    return fread(header, 1, sizeof(header), file) == sizeof(header)
+        && memcmp(header, magic, sizeof(magic)) == 0
+        && get_u32(&header[8]) == SNAPSHOT_VERSION;
+}
+
+static void inflate_span(void* context, size_t offset, const uint8_t* data, size_t length) {
+    snapshot_reader_t* const reader = (snapshot_reader_t*) context;
+
+    // lzss_decode() stops at the length in the LZSS header, which was checked
+    // against 'out_length' before decoding.
+    assert(offset + length <= reader->out_length);
+    memcpy(&reader->out[offset], data, length);
+}
+
+snapshot_chunk_status_t snapshot_read_chunk(snapshot_reader_t* reader, snapshot_chunk_t* chunk, uint8_t* data) {
+    uint8_t header[SNAPSHOT_CHUNK_HEADER_SIZE];
+    if (fread(header, 1, sizeof(header), reader->file) != sizeof(header)) {
+        return snapshot_chunk_error;
+    }
+
+    chunk->address = get_u32(&header[0]);
+    chunk->length = get_u32(&header[4]);
+    const uint32_t stored = get_u32(&header[8]);
+    const uint32_t crc = get_u32(&header[12]);
+
+    if (chunk->address == SNAPSHOT_END_ADDRESS) {
+        return chunk->length == 0 ? snapshot_chunk_end : snapshot_chunk_error;
+    }
+
+    if (chunk->length > SNAPSHOT_CHUNK_SIZE || stored > chunk->length) {
+        return snapshot_chunk_error;
+    }
+
+    if (stored == chunk->length) {
+        if (fread(data, 1, stored, reader->file) != stored) {
+            return snapshot_chunk_error;
+        }
+    } else {
+        if (fread(reader->stored, 1, stored, reader->file) != stored) {
+            return snapshot_chunk_error;
+        }
+
+        lzss_header_t lzss;
+        if (!lzss_read_header(reader->stored, stored, &lzss) || lzss.size != chunk->length) {
+            return snapshot_chunk_error;
+        }
+
+        reader->out = data;
+        reader->out_length = chunk->length;
+        lzss_decoder_init(reader->decoder, &lzss);
+        if (lzss_decode(reader->decoder, &reader->stored[LZSS_HEADER_SIZE], stored - LZSS_HEADER_SIZE,
+                        inflate_span, reader) != lzss_done) {
+            return snapshot_chunk_error;
+        }
+    }
+
+    return crc32_update(CRC32_INIT, data, chunk->length) == crc
+        ? snapshot_chunk_ok
+        : snapshot_chunk_error;
+}
+
+void snapshot_read_end(snapshot_reader_t* reader) {
+    pool_free(reader->decoder);
+    pool_free(reader->stored);
+    reader->decoder = NULL;
+    reader->stored = NULL;
+}
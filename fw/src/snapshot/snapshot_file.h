@@ -0,0 +1,109 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "lzss.h"
+#include "system_state.h"
+
+// Machine snapshot file (see snapshot.c for what is saved). A snapshot is a
+// 12-byte header followed by chunks, each a 16-byte header and its data:
+//
+//   Offset  Size  Field
+//   0       8     Magic "EPETSNAP"
+//   8       4     Version (little-endian)
+//
+//   Offset  Size  Field (chunk header, little-endian)
+//   0       4     FPGA address of the data (or SNAPSHOT_MACHINE_ADDRESS)
+//   4       4     Length of the data once restored (at most SNAPSHOT_CHUNK_SIZE)
+//   8       4     Length stored in the file
+//   12      4     CRC-32 of the data once restored
+//
+// If the stored length is less than the restored length, the stored data is
+// an LZSS file (see lzss.h), including its header. Otherwise it is the data
+// itself. The file ends with a chunk at SNAPSHOT_END_ADDRESS with length 0.
+
+#define SNAPSHOT_VERSION        1
+#define SNAPSHOT_HEADER_SIZE    12
+#define SNAPSHOT_CHUNK_HEADER_SIZE 16
+
+#define SNAPSHOT_CHUNK_SIZE     2048
+#define SNAPSHOT_END_ADDRESS    0xFFFFFFFF
+
+// The CPU registers and the FPGA's video configuration are saved as a chunk
+// at this address (beyond the FPGA's 20-bit address space).
+#define SNAPSHOT_MACHINE_ADDRESS 0x100000
+
+typedef struct {
+    uint8_t a;
+    uint8_t x;
+    uint8_t y;
+    uint8_t sp;
+    uint8_t p;
+    uint16_t pc;
+    uint8_t columns;                    // pet_display_columns_t
+    uint8_t video_ram_mask;
+    uint8_t crtc[CRTC_REG_COUNT];
+} snapshot_machine_t;
+
+#define SNAPSHOT_MACHINE_SIZE (9 + CRTC_REG_COUNT)
+
+void snapshot_machine_encode(const snapshot_machine_t* machine, uint8_t out[SNAPSHOT_MACHINE_SIZE]);
+
+// Returns false if 'length' is not SNAPSHOT_MACHINE_SIZE.
+bool snapshot_machine_decode(const uint8_t* data, size_t length, snapshot_machine_t* machine);
+
+typedef struct {
+    FILE* file;
+    bool compress;
+    bool ok;                            // False once a write has failed
+    uint8_t* packed;                    // LZSS_PACK_BOUND(SNAPSHOT_CHUNK_SIZE) bytes
+    uint16_t* head;                     // Hash table for lzss_pack_fast()
+    uint32_t written;                   // Bytes written to 'file'
+} snapshot_writer_t;
+
+// Start a snapshot in 'file'. If 'compress', chunks that LZSS shrinks are
+// stored compressed. Scratch space comes from the pool until
+// snapshot_write_end().
+void snapshot_write_begin(snapshot_writer_t* writer, FILE* file, bool compress);
+
+// Add a chunk of at most SNAPSHOT_CHUNK_SIZE bytes.
+void snapshot_write_chunk(snapshot_writer_t* writer, uint32_t address, const uint8_t* data, size_t length);
+
+// Add the end chunk and free the scratch space. Returns false if any write
+// failed. 'file' is not closed.
+bool snapshot_write_end(snapshot_writer_t* writer);
+
+typedef struct {
+    uint32_t address;
+    uint32_t length;
+} snapshot_chunk_t;
+
+typedef enum {
+    snapshot_chunk_ok,
+    snapshot_chunk_end,
+    snapshot_chunk_error,               // Read error, corrupt data, or CRC mismatch
+} snapshot_chunk_status_t;
+
+typedef struct {
+    FILE* file;
+    uint8_t* stored;                    // SNAPSHOT_CHUNK_SIZE bytes
+    lzss_decoder_t* decoder;
+    uint8_t* out;                       // Destination of the chunk being decoded
+    uint32_t out_length;
+} snapshot_reader_t;
+
+// Start reading a snapshot from 'file'. Returns false if it does not begin
+// with the header of a supported version. Scratch space comes from the pool
+// until snapshot_read_end() (which must be called either way).
+bool snapshot_read_begin(snapshot_reader_t* reader, FILE* file);
+
+// Read the next chunk's data (at most SNAPSHOT_CHUNK_SIZE bytes) into 'data'.
+snapshot_chunk_status_t snapshot_read_chunk(snapshot_reader_t* reader, snapshot_chunk_t* chunk, uint8_t* data);
+
+void snapshot_read_end(snapshot_reader_t* reader);
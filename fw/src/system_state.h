@@ -59,12 +59,15 @@ typedef enum term_mode_e {
     term_mode_cli,          // Terminal shows CLI prompt, accepts commands
     term_mode_log,          // Terminal shows log messages (legacy, for echo)
     term_mode_video,        // Terminal mirrors video buffer
+    term_mode_stream,       // Terminal receives binary screen stream frames
+    term_mode_xfer,         // Terminal carries binary transfer protocol frames
 } term_mode_t;
 
 typedef enum term_input_dest_e {
     term_input_ignore,      // Discard terminal input
     term_input_to_pet,      // Inject as PET keystrokes
     term_input_to_firmware, // Route to firmware (menu, etc.)
+    term_input_to_xfer,     // Raw bytes to the binary transfer protocol
 } term_input_dest_t;
 
 typedef struct __attribute__((packed)) usb_keymap_entry_s {
@@ -4,22 +4,32 @@
 #include "pch.h"
 #include "tape.h"
 
-#include <ctype.h>
-#include <dirent.h>
-#include <sys/stat.h>
-
 #include "breakpoint.h"
 #include "cbm/filename.h"
+#include "cbm/image.h"
 #include "cbm/petscii.h"
 #include "diag/log/log.h"
 #include "driver.h"
-#include "global.h"
+#include "ieee/ieee.h"
+#include "pool.h"
 #include "sd/sd.h"
+#include "sd/sd_stream.h"
 #include "system_state.h"
 #include "tape_dir.h"
+#include "tape_index.h"
 
 #define PRGS_DIR "/prgs"
 
+// Copy of the .prg index kept on the card so it survives a reboot. The name
+// does not end in ".prg", so the index never lists itself.
+#define PRGS_INDEX_PATH PRGS_DIR "/.index"
+
+// Configuration: set to 0 to keep the index in RAM only (nothing is written
+// to the SD card, at the cost of a directory scan after every boot).
+#ifndef TAPE_INDEX_PERSIST
+#define TAPE_INDEX_PERSIST 1
+#endif
+
 // BASIC program start address (universal across all PET ROM versions). The
 // synthesized directory listing loads here, just like LOAD "$" on a disk drive.
 #define BASIC_START 0x0401
@@ -47,69 +57,324 @@ static const uint8_t print_loop[] = {
 };
 
 #define PRINT_LOOP_SIZE  sizeof(print_loop)     // 13 bytes
-#define JMP_SIZE         3                      // JMP ld210
+#define EXIT_SIZE        4                      // CLC / JMP exit
 #define TAPE_BUFFER_CAPACITY 192
 
 typedef struct {
     tape_config_t cfg;      // Parsed from config.yaml hex blob
     bool enabled;           // Virtual tape enabled (config had 'tape' key)
+    tape_save_config_t save_cfg; // Parsed from the 'tape-save' hex blob
+    bool save_enabled;      // SAVE hook installed (config had 'tape-save' key)
     uint8_t saved_buf[TAPE_BUFFER_CAPACITY]; // Original tape buffer contents
 } tape_state_t;
 
 static tape_state_t state;
 
+// Index of PRGS_DIR. Kept outside 'state' so it survives reconfiguration.
+static tape_index_t prgs_index;
+
+// Set when the index is known to be out of date even though the directory
+// signature has not changed (e.g. a file was renamed on the PC).
+static bool prgs_index_stale;
+
+// Disk or tape image that LOADs resolve in instead of PRGS_DIR. Kept outside
+// 'state' so it survives reconfiguration, like a tape left in the drive.
+typedef struct {
+    bool mounted;
+    char path[PATH_MAX];
+    cbm_image_t image;      // Directory cached at mount time
+} tape_mount_t;
+
+static tape_mount_t mount;
+
+// Bytes per CBM block, for reporting an image's free blocks.
+#define CBM_BLOCK_SIZE 254
+
+#define INDEX_FILE_MAGIC   0x58444950   // "PIDX"
+#define INDEX_FILE_VERSION 1
+
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t entry_size;        // sizeof(tape_index_entry_t)
+    uint16_t count;
+    uint16_t names_used;
+    uint16_t checksum;          // tape_index_checksum()
+    uint8_t complete;
+    uint32_t dir_mtime;         // Signature the index was built for
+    uint64_t free_bytes;
+} index_file_header_t;
+
+static bool read_signature(tape_index_signature_t* sig) {
+    if (!sd_mtime(PRGS_DIR, &sig->dir_mtime)) {
+        log_warn("tape: cannot stat " PRGS_DIR);
+        return false;
+    }
+    sig->free_bytes = sd_free_bytes();
+    return true;
+}
+
+static bool same_signature(const tape_index_signature_t* a, const tape_index_signature_t* b) {
+    return a->dir_mtime == b->dir_mtime && a->free_bytes == b->free_bytes;
+}
+
+static void add_to_index(const char* name, uint32_t size, void* context) {
+    tape_index_t* const index = context;
+    if (tape_index_is_prg(name)) {
+        tape_index_add(index, name, size);
+    }
+}
+
+static bool build_index(const tape_index_signature_t* sig) {
+    tape_index_clear(&prgs_index);
+    if (!sd_scan_dir(PRGS_DIR, add_to_index, &prgs_index)) {
+        return false;
+    }
+    tape_index_sort(&prgs_index);
+
+    if (!prgs_index.complete) {
+        log_warn("tape: index full, some files in " PRGS_DIR " are not indexed");
+    }
+
+    prgs_index.signature = *sig;
+    prgs_index.valid = true;
+    log_info("tape: indexed %u files in " PRGS_DIR, prgs_index.count);
+    return true;
+}
+
+#if TAPE_INDEX_PERSIST
+
+// Restore the index from PRGS_INDEX_PATH if it was saved for 'sig'.
+static bool load_index_file(const tape_index_signature_t* sig) {
+    FILE* file = fopen(PRGS_INDEX_PATH, "rb");
+    if (file == NULL) {
+        return false;
+    }
+
+    index_file_header_t header;
+    bool ok = fread(&header, sizeof(header), 1, file) == 1
+        && header.magic == INDEX_FILE_MAGIC
+        && header.version == INDEX_FILE_VERSION
+        && header.entry_size == sizeof(tape_index_entry_t)
+        && header.count <= TAPE_INDEX_MAX_ENTRIES
+        && header.names_used <= TAPE_INDEX_NAMES_SIZE
+        && header.dir_mtime == sig->dir_mtime
+        && header.free_bytes == sig->free_bytes;
+
+    if (ok) {
+        tape_index_clear(&prgs_index);
+        prgs_index.count = header.count;
+        prgs_index.names_used = header.names_used;
+        prgs_index.complete = header.complete != 0;
+
+        ok = fread(prgs_index.entries, sizeof(prgs_index.entries[0]), header.count, file) == header.count
+            && fread(prgs_index.names, 1, header.names_used, file) == header.names_used
+            && tape_index_checksum(&prgs_index) == header.checksum;
+    }
+
+    fclose(file);
+
+    if (!ok) {
+        tape_index_clear(&prgs_index);
+        return false;
+    }
+
+    prgs_index.signature = *sig;
+    prgs_index.valid = true;
+    log_info("tape: loaded index of %u files from " PRGS_INDEX_PATH, prgs_index.count);
+    return true;
+}
+
+static void fill_header(index_file_header_t* header, uint16_t checksum) {
+    *header = (index_file_header_t) {
+        .magic = INDEX_FILE_MAGIC,
+        .version = INDEX_FILE_VERSION,
+        .entry_size = sizeof(tape_index_entry_t),
+        .count = prgs_index.count,
+        .names_used = prgs_index.names_used,
+        .checksum = checksum,
+        .complete = prgs_index.complete,
+        .dir_mtime = prgs_index.signature.dir_mtime,
+        .free_bytes = prgs_index.signature.free_bytes,
+    };
+}
+
+// Write the index to PRGS_INDEX_PATH. Writing the file changes the free space
+// it is validated against, so the header is rewritten in place afterward with
+// the final signature. (Rewriting it does not allocate, so it is stable.)
+static void save_index_file(void) {
+    const uint16_t checksum = tape_index_checksum(&prgs_index);
+    index_file_header_t header;
+
+    // Skip rewriting the body if the saved copy already has the same contents.
+    FILE* file = fopen(PRGS_INDEX_PATH, "rb");
+    bool unchanged = false;
+    if (file != NULL) {
+        unchanged = fread(&header, sizeof(header), 1, file) == 1
+            && header.magic == INDEX_FILE_MAGIC
+            && header.version == INDEX_FILE_VERSION
+            && header.entry_size == sizeof(tape_index_entry_t)
+            && header.count == prgs_index.count
+            && header.names_used == prgs_index.names_used
+            && header.complete == prgs_index.complete
+            && header.checksum == checksum;
+        fclose(file);
+    }
+
+    if (!unchanged) {
+        file = fopen(PRGS_INDEX_PATH, "wb");
+        if (file == NULL) {
+            log_warn("tape: cannot write " PRGS_INDEX_PATH);
+            return;
+        }
+
+        fill_header(&header, checksum);
+        const bool ok = fwrite(&header, sizeof(header), 1, file) == 1
+            && fwrite(prgs_index.entries, sizeof(prgs_index.entries[0]), prgs_index.count, file) == prgs_index.count
+            && fwrite(prgs_index.names, 1, prgs_index.names_used, file) == prgs_index.names_used;
+        if (fclose(file) != 0 || !ok) {
+            log_warn("tape: error writing " PRGS_INDEX_PATH);
+            remove(PRGS_INDEX_PATH);
+            return;
+        }
+    }
+
+    tape_index_signature_t sig;
+    if (!read_signature(&sig)) {
+        return;
+    }
+    prgs_index.signature = sig;
+
+    file = fopen(PRGS_INDEX_PATH, "r+b");
+    if (file == NULL) {
+        return;
+    }
+    fill_header(&header, checksum);
+    if (fwrite(&header, sizeof(header), 1, file) != 1) {
+        log_warn("tape: error writing " PRGS_INDEX_PATH);
+    }
+    fclose(file);
+}
+
+#else
+
+static bool load_index_file(const tape_index_signature_t* sig) {
+    (void)sig;
+    return false;
+}
+
+static void save_index_file(void) {}
+
+#endif // TAPE_INDEX_PERSIST
+
+// Bring prgs_index up to date with PRGS_DIR. Checking the signature costs a
+// stat() and a (cached) free space query. The directory is only rescanned
+// when the signature changes and no saved copy matches it. Sets 'rebuilt' if
+// the directory was just scanned.
+static bool refresh_index(bool* rebuilt) {
+    *rebuilt = false;
+
+    tape_index_signature_t sig;
+    if (!read_signature(&sig)) {
+        return false;
+    }
+
+    if (!prgs_index_stale) {
+        if (prgs_index.valid && same_signature(&sig, &prgs_index.signature)) {
+            return true;
+        }
+        if (load_index_file(&sig)) {
+            return true;
+        }
+    }
+
+    prgs_index_stale = false;
+    if (!build_index(&sig)) {
+        return false;
+    }
+
+    *rebuilt = true;
+    save_index_file();
+    return true;
+}
+
+typedef struct {
+    const uint8_t* pattern;
+    uint8_t pattern_len;
+    char* path_out;
+    size_t path_out_size;
+    bool found;
+} scan_match_t;
+
+static void match_entry(const char* name, uint32_t size, void* context) {
+    (void)size;
+    scan_match_t* const scan = context;
+
+    if (scan->found || !tape_index_is_prg(name)
+        || !cbm_filename_match(scan->pattern, scan->pattern_len, name)) {
+        return;
+    }
+
+    int n = snprintf(scan->path_out, scan->path_out_size, "%s/%s", PRGS_DIR, name);
+    if (n < 0 || (size_t)n >= scan->path_out_size) {
+        log_warn("tape: path too long for %s", name);
+        return;
+    }
+    scan->found = true;
+}
+
 // Search PRGS_DIR for a .prg file matching 'pattern'. On success, writes the
 // full path (e.g. "/prgs/game.prg") to 'path_out' and returns true.
 static bool find_prg_file(const uint8_t* pattern, uint8_t pattern_len,
                           char* path_out, size_t path_out_size) {
-    DIR* dir = opendir(PRGS_DIR);
-    if (dir == NULL) {
-        log_warn("tape: cannot open " PRGS_DIR);
+    bool rebuilt;
+    if (!refresh_index(&rebuilt)) {
         return false;
     }
 
-    bool found = false;
-    struct dirent* ent;
-
-    while ((ent = readdir(dir)) != NULL) {
-        const char* name = ent->d_name;
+    const tape_index_entry_t* entry = tape_index_find(&prgs_index, pattern, pattern_len);
 
-        // Skip entries that do not end with ".prg" (case-insensitive)
-        size_t len = strlen(name);
-        if (len < 5) continue;
-        const char* ext = name + len - 4;
-        if (tolower((unsigned char)ext[0]) != '.'
-            || tolower((unsigned char)ext[1]) != 'p'
-            || tolower((unsigned char)ext[2]) != 'r'
-            || tolower((unsigned char)ext[3]) != 'g') {
-            continue;
+    // Renaming a file changes neither the directory timestamp nor the free
+    // space, so rescan once before reporting a miss.
+    if (entry == NULL && !rebuilt) {
+        prgs_index_stale = true;
+        if (!refresh_index(&rebuilt)) {
+            return false;
         }
+        entry = tape_index_find(&prgs_index, pattern, pattern_len);
+    }
 
-        if (cbm_filename_match(pattern, pattern_len, name)) {
-            int n = snprintf(path_out, path_out_size, "%s/%s", PRGS_DIR, name);
-            if (n < 0 || (size_t)n >= path_out_size) {
-                log_warn("tape: path too long for %s", name);
-                continue;
-            }
-            found = true;
-            break;
+    if (entry != NULL) {
+        const char* name = tape_index_name(&prgs_index, entry);
+        int n = snprintf(path_out, path_out_size, "%s/%s", PRGS_DIR, name);
+        if (n < 0 || (size_t)n >= path_out_size) {
+            log_warn("tape: path too long for %s", name);
+            return false;
         }
+        return true;
     }
 
-    closedir(dir);
-    return found;
+    if (prgs_index.complete) {
+        return false;
+    }
+
+    // The file may be one of those that did not fit in the index.
+    scan_match_t scan = { pattern, pattern_len, path_out, path_out_size, false };
+    sd_scan_dir(PRGS_DIR, match_entry, &scan);
+    return scan.found;
 }
 
 // "loading" message printed after 'line1' (encoded for the active PET charset).
 static const char stub_loading[] = "loading";
 
-// Fixed overhead written around 'line1' in tape_build_stub: print loop, JMP,
-// the CR separator, the trailing "loading", and the null terminator.
+// Fixed overhead written around the message in tape_build_stub: print loop,
+// the CLC + JMP exit, the CR separator, the trailing "loading", and the null
+// terminator.
 #define STUB_FIXED_OVERHEAD \
-    (PRINT_LOOP_SIZE + JMP_SIZE + 1 + (sizeof(stub_loading) - 1) + 1)
+    (PRINT_LOOP_SIZE + EXIT_SIZE + 1 + (sizeof(stub_loading) - 1) + 1)
 
 // The stub overhead must leave room for at least one message byte. This catches
-// any future growth of the print loop, JMP, or "loading" string at compile time.
+// any future growth of the print loop, exit, or "loading" string at compile time.
 static_assert(STUB_FIXED_OVERHEAD < TAPE_BUFFER_CAPACITY,
               "tape stub overhead must leave room for message text");
 
@@ -117,27 +382,33 @@ static_assert(STUB_FIXED_OVERHEAD < TAPE_BUFFER_CAPACITY,
 // overhead. Messages longer than this are truncated so the stub always fits.
 #define STUB_MAX_LINE1 (TAPE_BUFFER_CAPACITY - STUB_FIXED_OVERHEAD)
 
-// Build the tape buffer stub: print loop + JMP ld210 + message string.
-// 'line1' is printed (encoded for the active PET charset) followed by a newline
-// and "LOADING". 'graphics_charset' selects the same case handling the directory
-// listing uses. 'line1' is truncated to STUB_MAX_LINE1 so the stub (written to a
-// TAPE_BUFFER_CAPACITY buffer) never overflows. Returns the bytes written.
-static size_t tape_build_stub(uint8_t* buf, const char* line1, bool graphics_charset) {
+// Build the tape buffer stub: print loop + CLC + JMP exit + message string.
+// 'line1' is printed (encoded for the active PET charset), followed by a
+// newline and 'line2' if it is not NULL. 'line2' must be no longer than
+// "loading". 'graphics_charset' selects the same case handling the directory
+// listing uses. 'line1' is truncated to STUB_MAX_LINE1 so the stub (written to
+// a TAPE_BUFFER_CAPACITY buffer) never overflows. The carry is cleared before
+// jumping to 'exit' so KERNAL callers see success. Returns the bytes written.
+static size_t tape_build_stub(uint8_t* buf, uint16_t exit, const char* line1, const char* line2,
+                              bool graphics_charset) {
+    assert(line2 == NULL || strlen(line2) <= sizeof(stub_loading) - 1);
+
     // Print loop (13 bytes)
     memcpy(buf, print_loop, PRINT_LOOP_SIZE);
 
     // Patch LDA operand with the message address
-    uint16_t msg_addr = TAPE_BUFFER + PRINT_LOOP_SIZE + JMP_SIZE;
+    uint16_t msg_addr = TAPE_BUFFER + PRINT_LOOP_SIZE + EXIT_SIZE;
     buf[3] = (uint8_t)(msg_addr & 0xFF);
     buf[4] = (uint8_t)(msg_addr >> 8);
 
-    // JMP ld210 (3 bytes) - jump to KERNAL post-load fixup
-    buf[PRINT_LOOP_SIZE]     = 0x4C;    // JMP
-    buf[PRINT_LOOP_SIZE + 1] = (uint8_t)(state.cfg.ld210 & 0xFF);
-    buf[PRINT_LOOP_SIZE + 2] = (uint8_t)(state.cfg.ld210 >> 8);
+    // CLC / JMP exit (4 bytes)
+    buf[PRINT_LOOP_SIZE]     = 0x18;    // CLC
+    buf[PRINT_LOOP_SIZE + 1] = 0x4C;    // JMP
+    buf[PRINT_LOOP_SIZE + 2] = (uint8_t)(exit & 0xFF);
+    buf[PRINT_LOOP_SIZE + 3] = (uint8_t)(exit >> 8);
 
-    // Message string: <LINE1>\rLOADING\0
-    size_t off = PRINT_LOOP_SIZE + JMP_SIZE;
+    // Message string: <LINE1>[\r<LINE2>]\0
+    size_t off = PRINT_LOOP_SIZE + EXIT_SIZE;
 
     // First line encoded for the PET display, matching the directory listing's
     // charset handling so letters display correctly and relocated punctuation
@@ -147,19 +418,22 @@ static size_t tape_build_stub(uint8_t* buf, const char* line1, bool graphics_cha
         buf[off++] = ascii_to_petscii((uint8_t)line1[i], graphics_charset);
     }
 
-    buf[off++] = '\r';      // CR (newline on PET)
+    if (line2 != NULL) {
+        buf[off++] = '\r';  // CR (newline on PET)
 
-    for (size_t i = 0; i < sizeof(stub_loading) - 1; i++) {
-        buf[off++] = ascii_to_petscii((uint8_t)stub_loading[i], graphics_charset);
+        for (size_t i = 0; line2[i] != '\0'; i++) {
+            buf[off++] = ascii_to_petscii((uint8_t)line2[i], graphics_charset);
+        }
     }
     buf[off++] = '\0';      // Null terminator for print loop
 
     return off;
 }
 
-// One-shot breakpoint callback at LD210. Restores the tape buffer contents
-// that were saved before the stub was written, then resumes LD210 normally.
-static bp_result_t tape_ld210_callback(uint16_t pc, void* context) {
+// One-shot breakpoint callback at the stub's exit (LD210 for LOAD, the RTS
+// ending SV60 for SAVE). Restores the tape buffer contents that were saved
+// before the stub was written, then resumes at the exit normally.
+static bp_result_t tape_restore_callback(uint16_t pc, void* context) {
     (void)context;
 
     spi_write(TAPE_BUFFER, state.saved_buf, TAPE_BUFFER_CAPACITY);
@@ -167,136 +441,189 @@ static bp_result_t tape_ld210_callback(uint16_t pc, void* context) {
     return (bp_result_t){ .pc = pc, .rearm = false };
 }
 
-// Case-insensitive comparator for sorting directory entries by name.
-static int dir_entry_cmp(const void* a, const void* b) {
-    const char* sa = ((const tape_dir_entry_t*)a)->name;
-    const char* sb = ((const tape_dir_entry_t*)b)->name;
+// Finish a virtual LOAD that ended at 'end_addr'. Points EAL/EAH at the end
+// (LD210 copies them into VARTAB before relinking), then redirects to a tape
+// buffer stub that prints "found <what>" and "loading" and continues at LD210.
+static bp_result_t tape_finish_load(uint16_t end_addr, const char* what) {
+    spi_write_at(state.cfg.eal, (uint8_t)(end_addr & 0xFF));
+    spi_write_at(state.cfg.eah, (uint8_t)(end_addr >> 8));
 
-    while (*sa != '\0' && *sb != '\0') {
-        int ca = tolower((unsigned char)*sa);
-        int cb = tolower((unsigned char)*sb);
-        if (ca != cb) return ca - cb;
-        sa++;
-        sb++;
-    }
-    return (int)(unsigned char)*sa - (int)(unsigned char)*sb;
-}
+    // Save the tape buffer contents before overwriting with the stub.
+    spi_read(TAPE_BUFFER, TAPE_BUFFER_CAPACITY, state.saved_buf);
 
-// Scan PRGS_DIR for loadable .prg files. For each, record the display name
-// (with the ".prg" extension suppressed) and the block count derived from the
-// file size. Returns the number of entries collected (up to 'max').
-static int gather_dir_entries(tape_dir_entry_t* out, int max) {
-    DIR* dir = opendir(PRGS_DIR);
-    if (dir == NULL) {
-        log_warn("tape: cannot open " PRGS_DIR);
-        return 0;
-    }
-
-    int count = 0;
-    struct dirent* ent;
-
-    while (count < max && (ent = readdir(dir)) != NULL) {
-        const char* name = ent->d_name;
-
-        // Skip entries that do not end with ".prg" (case-insensitive).
-        size_t len = strlen(name);
-        if (len < 5) continue;
-        const char* ext = name + len - 4;
-        if (tolower((unsigned char)ext[0]) != '.'
-            || tolower((unsigned char)ext[1]) != 'p'
-            || tolower((unsigned char)ext[2]) != 'r'
-            || tolower((unsigned char)ext[3]) != 'g') {
-            continue;
-        }
+    // Arm a one-shot breakpoint at LD210 to restore the tape buffer
+    // after the stub has finished executing.
+    bp_set(state.cfg.ld210, tape_restore_callback, NULL);
 
-        // Display name with the ".prg" extension suppressed.
-        size_t base_len = len - 4;
-        if (base_len > TAPE_DIR_MAX_NAME) base_len = TAPE_DIR_MAX_NAME;
-        memcpy(out[count].name, name, base_len);
-        out[count].name[base_len] = '\0';
-
-        // Block count from the file size (rounded up, at least one block).
-        uint16_t blocks = 1;
-        char path[PATH_MAX];
-        int n = snprintf(path, sizeof(path), "%s/%s", PRGS_DIR, name);
-        struct stat st;
-        if (n > 0 && (size_t)n < sizeof(path) && stat(path, &st) == 0) {
-            blocks = tape_dir_blocks_from_bytes((uint64_t)st.st_size, true);
-        }
-        out[count].blocks = blocks;
+    // Build the stub in the tape buffer and write it to SRAM. The message is
+    // bounded to STUB_MAX_LINE1 so it always fits (tape_build_stub also truncates
+    // as a backstop). Cap 'what' so the prefix plus 'what' cannot exceed it.
+    static const char found_prefix[] = "found ";
+    char msg[STUB_MAX_LINE1 + 1];
+    snprintf(msg, sizeof(msg), "%s%.*s", found_prefix,
+             (int)(STUB_MAX_LINE1 - (sizeof(found_prefix) - 1)), what);
+    bool graphics_charset = !system_state.video_graphics;
+    uint8_t stub_buf[TAPE_BUFFER_CAPACITY];
+    size_t stub_len = tape_build_stub(stub_buf, state.cfg.ld210, msg, stub_loading, graphics_charset);
+    spi_write(TAPE_BUFFER, stub_buf, stub_len);
+
+    // Redirect execution to the tape buffer.
+    return (bp_result_t){ .pc = TAPE_BUFFER, .rearm = true };
+}
 
-        count++;
+// Decode a raw PETSCII name from an image for the directory listing, which
+// re-encodes it for the active charset.
+static void image_name_to_ascii(char* out, const uint8_t* name, uint8_t name_len) {
+    for (uint8_t i = 0; i < name_len; i++) {
+        out[i] = petscii_to_ascii(name[i]);
     }
+    out[name_len] = '\0';
+}
 
-    closedir(dir);
+// List the files of the mounted image, in directory order.
+static size_t image_dir_entries(tape_dir_entry_t* entries, size_t max) {
+    const cbm_image_t* const image = &mount.image;
+    const size_t count = image->count < max ? image->count : max;
+
+    for (size_t i = 0; i < count; i++) {
+        image_name_to_ascii(entries[i].name, image->files[i].name, image->files[i].name_len);
+        entries[i].blocks = image->files[i].blocks;
+    }
     return count;
 }
 
 // Handle LOAD "$" by synthesizing a Commodore-style directory listing of the
-// loadable .prg files in PRGS_DIR. The listing is a fake BASIC program written
-// to SRAM at the BASIC start. Reusing the LD210 fixup path relinks the lines
-// and returns to READY, so the user can LIST the directory.
+// loadable .prg files in PRGS_DIR (or in the mounted image). The listing is a
+// fake BASIC program written to SRAM at the BASIC start. Reusing the LD210
+// fixup path relinks the lines and returns to READY, so the user can LIST the
+// directory.
 static bp_result_t tape_load_directory(uint16_t pc) {
-    static tape_dir_entry_t entries[MAX_DIR_ENTRIES];
-    int count = gather_dir_entries(entries, MAX_DIR_ENTRIES);
-
-    qsort(entries, (size_t)count, sizeof(entries[0]), dir_entry_cmp);
+    // An open "$" channel on the emulated drive may hold a large block (see
+    // dos.h), so running out is not fatal(). Falling through leaves the LOAD
+    // to the KERNAL: the drive then reports 70,NO CHANNEL, and a tape device
+    // goes to the datasette.
+    tape_dir_entry_t* const entries = pool_try_alloc(MAX_DIR_ENTRIES * sizeof(tape_dir_entry_t), "tape dir");
+    uint8_t* const image = pool_try_alloc(DIR_IMAGE_CAPACITY, "tape dir");
+    if (entries == NULL || image == NULL) {
+        pool_free(image);
+        pool_free(entries);
+        log_warn("tape: no memory for the directory listing");
+        return (bp_result_t){ .pc = pc, .rearm = true };
+    }
 
-    uint64_t free_bytes = sd_free_bytes();
+    char disk_name[CBM_IMAGE_NAME_SIZE + 1] = DIR_DISK_NAME;
+    const char* source = PRGS_DIR;
+    int count;
+    uint64_t free_bytes;
+
+    if (mount.mounted) {
+        // Render from the directory cached when the image was mounted.
+        count = (int)image_dir_entries(entries, MAX_DIR_ENTRIES);
+        image_name_to_ascii(disk_name, mount.image.name, mount.image.name_len);
+        free_bytes = (uint64_t)mount.image.free_blocks * CBM_BLOCK_SIZE;
+        source = mount.path;
+    } else {
+        // Render from the index, which is already sorted by folded name.
+        bool rebuilt;
+        count = refresh_index(&rebuilt)
+            ? (int)tape_index_dir_entries(&prgs_index, entries, MAX_DIR_ENTRIES)
+            : 0;
+        free_bytes = sd_free_bytes();
+    }
 
     // system_state.video_graphics mirrors the PET's CA2/char-ROM A10 line, where
     // 0 selects the graphics charset and 1 selects the text/business charset. So
     // the graphics charset is active when video_graphics is false.
     bool graphics_charset = !system_state.video_graphics;
 
-    static uint8_t image[DIR_IMAGE_CAPACITY];
-    size_t image_len = tape_dir_render(image, sizeof(image), BASIC_START,
-                                       DIR_DISK_NAME, entries, (size_t)count,
+    size_t image_len = tape_dir_render(image, DIR_IMAGE_CAPACITY, BASIC_START,
+                                       disk_name, entries, (size_t)count,
                                        free_bytes, graphics_charset);
+    pool_free(entries);
+
+    // Copy the synthesized program into SRAM at the BASIC start.
+    if (image_len > 0) {
+        spi_write(BASIC_START, image, image_len);
+    }
+    pool_free(image);
+
     if (image_len == 0) {
         log_warn("tape: directory image too large");
         return (bp_result_t){ .pc = pc, .rearm = true };
     }
 
-    // Copy the synthesized program into SRAM at the BASIC start.
-    uint16_t dest = BASIC_START;
-    size_t written = 0;
-    while (written < image_len) {
-        size_t chunk = image_len - written;
-        if (chunk > TEMP_BUFFER_SIZE) chunk = TEMP_BUFFER_SIZE;
-        spi_write(dest, image + written, chunk);
-        dest += (uint16_t)chunk;
-        written += chunk;
-    }
-
     uint16_t end_addr = (uint16_t)(BASIC_START + image_len);
     log_info("tape: directory listing, %d entries, $%04X-$%04X",
              count, (unsigned)BASIC_START, end_addr);
 
-    // Set EAL/EAH so LD210 updates VARTAB and relinks the (fake) BASIC lines.
-    spi_write_at(state.cfg.eal, (uint8_t)(end_addr & 0xFF));
-    spi_write_at(state.cfg.eah, (uint8_t)(end_addr >> 8));
+    // Mirror the regular load path's "found <path>" message so the user sees
+    // the same clue that the virtual tape drive intercepted the command.
+    char what[PATH_MAX];
+    snprintf(what, sizeof(what), "%s/$", source);
+    return tape_finish_load(end_addr, what);
+}
 
-    // Save the tape buffer, arm the one-shot LD210 restore, write the stub.
-    spi_read(TAPE_BUFFER, TAPE_BUFFER_CAPACITY, state.saved_buf);
-    bp_set(state.cfg.ld210, tape_ld210_callback, NULL);
+// Read an image file through the FatFs handle opened by tape_mount().
+static bool tape_image_read(void* context, uint32_t offset, uint8_t* buffer, size_t length) {
+    (void)context;
+    return sd_image_read(offset, buffer, length);
+}
 
-    // Mirror the regular SD load path's "FOUND <path>" message so the user sees
-    // the same clue that the virtual tape drive intercepted the command.
-    uint8_t stub_buf[TAPE_BUFFER_CAPACITY];
-    size_t stub_len = tape_build_stub(stub_buf, "FOUND " PRGS_DIR "/$", graphics_charset);
-    spi_write(TAPE_BUFFER, stub_buf, stub_len);
+// Write each chunk of a streamed PRG image (from a .prg file or a mounted
+// image) to SRAM. The first two bytes are the load address, which is collected
+// into 'context'. Data that would wrap past $FFFF is dropped.
+static void tape_prg_sink(void* context, size_t offset, const uint8_t* data, size_t length) {
+    uint16_t* const load_addr = context;
 
-    return (bp_result_t){ .pc = TAPE_BUFFER, .rearm = true };
+    for (; offset < 2 && length > 0; offset++, data++, length--) {
+        *load_addr |= (uint16_t)(*data << (offset * 8));
+    }
+
+    const uint32_t dest = *load_addr + (uint32_t)(offset - 2);
+    if (length > 0 && dest <= UINT16_MAX) {
+        spi_write(dest, data, MIN(length, UINT16_MAX + 1 - dest));
+    }
+}
+
+// LOAD a file from the mounted image, following its sector chain straight
+// into SRAM.
+static bp_result_t tape_load_image(uint16_t pc, const uint8_t* pattern, uint8_t fnlen, const char* log_name) {
+    const cbm_image_file_t* file = cbm_image_find(&mount.image, pattern, fnlen);
+    if (file == NULL) {
+        log_info("tape: no match for \"%s\" in %s", log_name, mount.path);
+        return (bp_result_t){ .pc = pc, .rearm = true };
+    }
+
+    uint16_t load_addr = 0;
+    size_t bytes;
+    const uint64_t start = time_us_64();
+    const bool ok = cbm_image_read_file(&mount.image, file, tape_prg_sink, &load_addr,
+                                        UINT16_MAX + 1 + 2, &bytes);
+    if (!ok || bytes < 2) {
+        log_warn("tape: error reading \"%s\" from %s", log_name, mount.path);
+        return (bp_result_t){ .pc = pc, .rearm = true };
+    }
+
+    const uint32_t length = MIN(bytes - 2, UINT16_MAX + 1u - load_addr);
+    uint16_t end_addr = (uint16_t)(load_addr + length);
+    log_info("tape: loaded $%04X-$%04X from %s in %lu us", load_addr, end_addr, mount.path,
+             (unsigned long)(time_us_64() - start));
+
+    char name[CBM_IMAGE_NAME_SIZE + 1];
+    image_name_to_ascii(name, file->name, file->name_len);
+    char what[PATH_MAX];
+    snprintf(what, sizeof(what), "%s/%s", mount.path, name);
+    return tape_finish_load(end_addr, what);
 }
 
 static bp_result_t tape_load_callback(uint16_t pc, void* context) {
     (void)context;
 
     // The breakpoint fires for every LOAD (tape, disk, etc.), so check
-    // the device number first. Only intercept tape devices (1 or 2).
+    // the device number first. Only intercept tape devices (1 or 2) and the
+    // emulated disk drive, whose files are loaded the same way.
     uint8_t devnum = spi_read_at(state.cfg.devnum);
-    if (devnum != 1 && devnum != 2) {
+    if (devnum != 1 && devnum != 2 && !ieee_is_device(devnum)) {
         return (bp_result_t){ .pc = pc, .rearm = true };
     }
 
@@ -337,6 +664,10 @@ static bp_result_t tape_load_callback(uint16_t pc, void* context) {
         return tape_load_directory(pc);
     }
 
+    if (mount.mounted) {
+        return tape_load_image(pc, pattern, fnlen, log_name);
+    }
+
     // Search SD card for a matching .prg file.
     char path[PATH_MAX];
     if (!find_prg_file(pattern, fnlen, path, sizeof(path))) {
@@ -344,68 +675,185 @@ static bp_result_t tape_load_callback(uint16_t pc, void* context) {
         return (bp_result_t){ .pc = pc, .rearm = true };
     }
 
-    log_info("tape: found %s", path);
-
-    // Open the PRG file and read the 2-byte load address.
-    FILE* file = fopen(path, "rb");
-    if (file == NULL) {
+    // The index merges the SD card and a USB stick. Find which one has it.
+    char resolved[PATH_MAX];
+    if (!sd_resolve(path, resolved, sizeof(resolved))) {
+        // The file was removed or renamed since the index was built.
         log_warn("tape: cannot open %s", path);
+        prgs_index_stale = true;
         return (bp_result_t){ .pc = pc, .rearm = true };
     }
 
-    uint8_t hdr[2];
-    if (fread(hdr, 1, 2, file) != 2) {
-        log_warn("tape: short read on header of %s", path);
-        fclose(file);
+    log_info("tape: found %s", resolved);
+
+    // Copy the program into SRAM via SPI. The file is streamed whole (it may
+    // be LZSS compressed), and the sink picks off the 2-byte load address.
+    uint16_t load_addr = 0;
+    const sd_stream_sink_t sink = { .begin = tape_prg_sink, .context = &load_addr };
+    sd_stream_stats_t stats;
+    const bool ok = sd_stream_path(path, /* cache: */ false, &sink, UINT16_MAX + 1 + 2, &stats);
+
+    if (!ok || stats.bytes < 2) {
+        log_warn("tape: error reading %s", path);
         return (bp_result_t){ .pc = pc, .rearm = true };
     }
-    uint16_t load_addr = (uint16_t)(hdr[0] | (hdr[1] << 8));
-    uint16_t dest = load_addr;
+    sd_stream_log("tape", &stats);
+
+    const uint32_t length = MIN(stats.bytes - 2, UINT16_MAX + 1u - load_addr);
+    uint16_t end_addr = (uint16_t)(load_addr + length);
+    log_info("tape: loaded $%04X-$%04X from %s", load_addr, end_addr, path);
 
-    // Step 5: Copy program data into SRAM via SPI.
-    uint8_t* temp = acquire_temp_buffer();
-    size_t bytes_read;
+    return tape_finish_load(end_addr, path);
+}
 
-    while ((bytes_read = fread(temp, 1, TEMP_BUFFER_SIZE, file)) > 0) {
-        spi_write(dest, temp, bytes_read);
-        dest += bytes_read;
+// Characters a saved filename may not contain: wildcards and the CBM
+// drive/type separators, plus those FAT rejects.
+static const char save_name_reserved[] = "*?$:\"/\\<>|";
+
+// Parse the filename given to SAVE into 'name' (ASCII, NUL-terminated). A
+// leading "@:" or "@0:" requests that an existing file be replaced, as on a
+// Commodore disk drive. Returns false if the name cannot be used on the card.
+static bool parse_save_name(const uint8_t* pattern, uint8_t len, char* name, bool* overwrite) {
+    uint8_t i = 0;
+    *overwrite = false;
+
+    if (len > 0 && pattern[0] == '@') {
+        i = 1;
+        if (i < len && pattern[i] == '0') {
+            i++;
+        }
+        if (i >= len || pattern[i] != ':') {
+            return false;
+        }
+        i++;
+        *overwrite = true;
     }
 
-    release_temp_buffer(&temp);
-    fclose(file);
+    size_t n = 0;
+    for (; i < len; i++) {
+        const char ch = petscii_to_ascii(pattern[i]);
+        if ((uint8_t)ch < 0x20 || (uint8_t)ch >= 0x7F || strchr(save_name_reserved, ch) != NULL) {
+            return false;
+        }
+        name[n++] = ch;
+    }
+    name[n] = '\0';
 
-    uint16_t end_addr = dest;
-    log_info("tape: loaded $%04X-$%04X from %s", load_addr, end_addr, path);
+    // FAT silently drops trailing dots and spaces, which would save under a
+    // different name than the one LOAD later matches.
+    return n > 0 && name[n - 1] != '.' && name[n - 1] != ' ';
+}
 
-    // Set EAL/EAH to the end address. The KERNAL's LD210 routine
-    // copies these into VARTAB before calling FINI to relink and clear.
-    spi_write_at(state.cfg.eal, (uint8_t)(end_addr & 0xFF));
-    spi_write_at(state.cfg.eah, (uint8_t)(end_addr >> 8));
+// Write the PET memory range [start, end) to 'path' as a .prg file.
+static bool save_prg_file(const char* path, uint16_t start, uint16_t end) {
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        return false;
+    }
 
-    // Save the tape buffer contents before overwriting with the stub.
-    spi_read(TAPE_BUFFER, TAPE_BUFFER_CAPACITY, state.saved_buf);
+    const uint8_t hdr[2] = { (uint8_t)(start & 0xFF), (uint8_t)(start >> 8) };
+    bool ok = fwrite(hdr, 1, sizeof(hdr), file) == sizeof(hdr);
 
-    // Arm a one-shot breakpoint at LD210 to restore the tape buffer
-    // after the stub has finished executing.
-    bp_set(state.cfg.ld210, tape_ld210_callback, NULL);
+    uint8_t* temp_buffer = pool_alloc(POOL_MEDIUM_SIZE, "tape save");
+    uint32_t addr = start;
+    while (ok && addr < end) {
+        const size_t chunk = MIN(end - addr, POOL_MEDIUM_SIZE);
+        spi_read(addr, chunk, temp_buffer);
+        ok = fwrite(temp_buffer, 1, chunk, file) == chunk;
+        addr += chunk;
+    }
+    pool_free(temp_buffer);
 
-    // Build the stub in the tape buffer and write it to SRAM. The message is
-    // bounded to STUB_MAX_LINE1 so it always fits (tape_build_stub also truncates
-    // as a backstop). Cap the path so the prefix plus path cannot exceed it.
-    static const char found_prefix[] = "found ";
+    if (fclose(file) != 0 || !ok) {
+        remove(path);
+        return false;
+    }
+    return true;
+}
+
+// Breakpoint callback at SV5. Saves the program bounded by STAL/STAH and
+// EAL/EAH to PRGS_DIR, then prints the result from a tape buffer stub that
+// returns from SAVE through the RTS ending SV60.
+static bp_result_t tape_save_callback(uint16_t pc, void* context) {
+    (void)context;
+
+    // Only intercept tape devices (1 or 2) and the emulated drive, as for LOAD.
+    uint8_t devnum = spi_read_at(state.cfg.devnum);
+    if (devnum != 1 && devnum != 2 && !ieee_is_device(devnum)) {
+        return (bp_result_t){ .pc = pc, .rearm = true };
+    }
+
+    uint8_t fnlen = spi_read_at(state.cfg.fnlen);
+    if (fnlen > 16) fnlen = 16;
+
+    // SAVE without a name writes to the datasette.
+    if (fnlen == 0) {
+        log_info("tape: SAVE fall through to datasette");
+        return (bp_result_t){ .pc = pc, .rearm = true };
+    }
+
+    uint8_t fnadr_lo = spi_read_at(state.cfg.fnadr);
+    uint8_t fnadr_hi = spi_read_at(state.cfg.fnadr + 1);
+    uint16_t fnadr = (uint16_t)(fnadr_lo | (fnadr_hi << 8));
+
+    uint8_t pattern[16];
+    spi_read(fnadr, fnlen, pattern);
+
+    uint16_t start = (uint16_t)(spi_read_at(state.save_cfg.stal) | (spi_read_at(state.save_cfg.stal + 1) << 8));
+    uint16_t end = (uint16_t)(spi_read_at(state.cfg.eal) | (spi_read_at(state.cfg.eah) << 8));
+
+    char name[17];
+    bool overwrite;
+    char path[PATH_MAX];
+    const char* result;
+
+    if (!parse_save_name(pattern, fnlen, name, &overwrite)) {
+        log_info("tape: SAVE rejected invalid filename");
+        result = "?bad file name";
+    } else {
+        snprintf(path, sizeof(path), "%s/%s%s", PRGS_DIR, name, tape_index_is_prg(name) ? "" : ".prg");
+        log_info("tape: SAVE \"%s\" $%04X-$%04X", name, start, end);
+
+        FILE* existing = overwrite ? NULL : fopen(path, "rb");
+        if (existing != NULL) {
+            fclose(existing);
+            log_info("tape: %s exists", path);
+            result = "?file exists";
+        } else if (end < start || !save_prg_file(path, start, end)) {
+            log_warn("tape: error writing %s", path);
+            result = "?write error";
+        } else {
+            log_info("tape: saved %s", path);
+            result = path;
+        }
+
+        // The file was created, replaced, or removed after a failed write.
+        prgs_index_stale = true;
+    }
+
+    // Mirror the LOAD stub: "saved <path>" on success, or the error.
     char msg[STUB_MAX_LINE1 + 1];
-    snprintf(msg, sizeof(msg), "%s%.*s", found_prefix,
-             (int)(STUB_MAX_LINE1 - (sizeof(found_prefix) - 1)), path);
+    if (result == path) {
+        static const char saved_prefix[] = "saved ";
+        snprintf(msg, sizeof(msg), "%s%.*s", saved_prefix,
+                 (int)(STUB_MAX_LINE1 - (sizeof(saved_prefix) - 1)), path);
+    } else {
+        snprintf(msg, sizeof(msg), "%s", result);
+    }
+
+    // Save the tape buffer, arm the one-shot restore at the exit, write the stub.
+    spi_read(TAPE_BUFFER, TAPE_BUFFER_CAPACITY, state.saved_buf);
+    bp_set(state.save_cfg.exit, tape_restore_callback, NULL);
+
     bool graphics_charset = !system_state.video_graphics;
     uint8_t stub_buf[TAPE_BUFFER_CAPACITY];
-    size_t stub_len = tape_build_stub(stub_buf, msg, graphics_charset);
+    size_t stub_len = tape_build_stub(stub_buf, state.save_cfg.exit, msg, NULL, graphics_charset);
     spi_write(TAPE_BUFFER, stub_buf, stub_len);
 
-    // Redirect execution to the tape buffer.
     return (bp_result_t){ .pc = TAPE_BUFFER, .rearm = true };
 }
 
-void tape_init(const tape_config_t* cfg) {
+void tape_init(const tape_config_t* cfg, const tape_save_config_t* save_cfg) {
     memset(&state, 0, sizeof(state));
 
     if (cfg == NULL) {
@@ -416,12 +864,64 @@ void tape_init(const tape_config_t* cfg) {
     state.cfg = *cfg;
     state.enabled = true;
     bp_set(state.cfg.bp_addr, tape_load_callback, NULL);
+
+    if (save_cfg != NULL) {
+        state.save_cfg = *save_cfg;
+        state.save_enabled = true;
+        bp_set(state.save_cfg.bp_addr, tape_save_callback, NULL);
+    }
 }
 
 void tape_deinit(void) {
     if (state.enabled) {
         bp_remove(state.cfg.bp_addr);
+        if (state.save_enabled) {
+            bp_remove(state.save_cfg.bp_addr);
+            state.save_enabled = false;
+        }
         state.enabled = false;
         log_info("tape: disabled");
     }
 }
+
+bool tape_mount(const char* path) {
+    tape_unmount();
+
+    cbm_image_format_t format;
+    if (!cbm_image_format_from_name(path, &format)) {
+        log_warn("tape: %s is not a .d64 or .t64 image", path);
+        return false;
+    }
+
+    uint32_t size;
+    if (!sd_image_open(path, &size)) {
+        return false;
+    }
+
+    if (!cbm_image_open(&mount.image, format, size, tape_image_read, NULL)) {
+        log_warn("tape: %s is not a valid image", path);
+        sd_image_close();
+        return false;
+    }
+
+    if (!mount.image.complete) {
+        log_warn("tape: only the first %u files of %s are listed", mount.image.count, path);
+    }
+
+    snprintf(mount.path, sizeof(mount.path), "%s", path);
+    mount.mounted = true;
+    log_info("tape: mounted %s (%u files)", path, mount.image.count);
+    return true;
+}
+
+void tape_unmount(void) {
+    if (mount.mounted) {
+        sd_image_close();
+        mount.mounted = false;
+        log_info("tape: unmounted %s", mount.path);
+    }
+}
+
+const char* tape_mounted(void) {
+    return mount.mounted ? mount.path : NULL;
+}
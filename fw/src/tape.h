@@ -34,13 +34,46 @@ typedef struct __attribute__((packed)) {
 
 #define TAPE_CONFIG_SIZE sizeof(tape_config_t)
 
+// Configuration blob for virtual tape SAVEs. The filename, device number, and
+// end address locations are shared with tape_config_t, so SAVE support
+// requires the 'tape' blob as well.
+typedef struct __attribute__((packed)) {
+    // Breakpoint address (2 bytes, little-endian).
+    // Set at SV5 (ROM 2/4), just after SV60 has copied the BASIC program
+    // bounds into STAL/STAH and EAL/EAH and before the KERNAL dispatches on
+    // the device number.
+    uint16_t bp_addr;
+
+    // Return address (2 bytes, little-endian).
+    // The RTS that ends SV60. Jumping here with the stack as it is at SV5
+    // returns from SAVE to its caller (the BASIC interpreter).
+    uint16_t exit;
+
+    // ZP addr of STAL (start address low). STAH follows at stal + 1.
+    uint8_t stal;
+} tape_save_config_t;   // 5 bytes total
+
+#define TAPE_SAVE_CONFIG_SIZE sizeof(tape_save_config_t)
+
 // Tape buffer address in PET memory (same across all ROM versions).
 #define TAPE_BUFFER 0x027A
 
-// Initialize the virtual tape drive with the config blob parsed from
+// Initialize the virtual tape drive with the config blobs parsed from
 // config.yaml. If cfg is NULL, the virtual tape is disabled and all
-// LOADs fall through to the physical datasette.
-void tape_init(const tape_config_t* cfg);
+// LOADs fall through to the physical datasette. If save_cfg is NULL,
+// SAVEs always go to the physical datasette.
+void tape_init(const tape_config_t* cfg, const tape_save_config_t* save_cfg);
 
-// Remove the tape breakpoint and disable the virtual tape drive.
+// Remove the tape breakpoints and disable the virtual tape drive.
 void tape_deinit(void);
+
+// Mount the .d64 or .t64 image at 'path'. While an image is mounted, LOAD and
+// LOAD "$" resolve inside it instead of /prgs (SAVE still writes to /prgs).
+// The directory is read once here. Returns false, leaving nothing mounted, if
+// the image cannot be opened or parsed.
+bool tape_mount(const char* path);
+
+void tape_unmount(void);
+
+// Path of the mounted image, or NULL if none.
+const char* tape_mounted(void);
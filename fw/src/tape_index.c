@@ -0,0 +1,191 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#include "tape_index.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cbm/filename.h"
+#include "crc.h"
+
+static const char prg_ext[] = ".prg";
+#define PRG_EXT_LEN (sizeof(prg_ext) - 1)
+
+bool tape_index_is_prg(const char* filename) {
+    const size_t len = strlen(filename);
+    if (len <= PRG_EXT_LEN) {
+        return false;
+    }
+
+    const char* ext = filename + len - PRG_EXT_LEN;
+    for (size_t i = 0; i < PRG_EXT_LEN; i++) {
+        if (tolower((unsigned char) ext[i]) != prg_ext[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void tape_index_clear(tape_index_t* index) {
+    index->valid = false;
+    index->complete = true;
+    index->count = 0;
+    index->names_used = 0;
+}
+
+bool tape_index_add(tape_index_t* index, const char* filename, uint32_t size) {
+    const size_t name_size = strlen(filename) + 1;
+    if (index->count >= TAPE_INDEX_MAX_ENTRIES
+        || name_size > (size_t) (TAPE_INDEX_NAMES_SIZE - index->names_used)) {
+        index->complete = false;
+        return false;
+    }
+
+    // Zero the padding too, so the checksum only depends on the contents.
+    tape_index_entry_t* const entry = &index->entries[index->count++];
+    memset(entry, 0, sizeof(*entry));
+
+    const size_t len = name_size - 1;
+    const size_t key_len = len < TAPE_INDEX_MAX_KEY ? len : TAPE_INDEX_MAX_KEY;
+    for (size_t i = 0; i < key_len; i++) {
+        entry->key[i] = cbm_filename_fold_host(filename[i]);
+    }
+    entry->key_len = (uint8_t) (len <= TAPE_INDEX_MAX_KEY ? len : TAPE_INDEX_MAX_KEY + 1);
+
+    entry->blocks = tape_dir_blocks_from_bytes(size, /* round_up: */ true);
+    entry->size = size;
+    entry->name = index->names_used;
+
+    memcpy(&index->names[index->names_used], filename, name_size);
+    index->names_used += (uint16_t) name_size;
+    return true;
+}
+
+// Order by the folded key, so that all names sharing a prefix are adjacent.
+// A truncated key sorts after every stored key it starts with.
+static int compare_key(const tape_index_entry_t* entry, const uint8_t* key, size_t key_len) {
+    const size_t stored = entry->key_len < TAPE_INDEX_MAX_KEY ? entry->key_len : TAPE_INDEX_MAX_KEY;
+    const size_t common = stored < key_len ? stored : key_len;
+
+    const int result = memcmp(entry->key, key, common);
+    if (result != 0) {
+        return result;
+    }
+    return (int) entry->key_len - (int) key_len;
+}
+
+// qsort() has no context argument, so the names pool is passed through here.
+static const tape_index_t* sort_index;
+
+static int compare_entries(const void* a, const void* b) {
+    const tape_index_entry_t* const ea = a;
+    const tape_index_entry_t* const eb = b;
+
+    const int result = compare_key(ea, eb->key, eb->key_len);
+    if (result != 0) {
+        return result;
+    }
+
+    // Keys only collide when truncated. Keep the order deterministic.
+    return strcmp(tape_index_name(sort_index, ea), tape_index_name(sort_index, eb));
+}
+
+void tape_index_sort(tape_index_t* index) {
+    sort_index = index;
+    qsort(index->entries, index->count, sizeof(index->entries[0]), compare_entries);
+    sort_index = NULL;
+}
+
+// Index of the first entry whose key is not less than 'key'.
+static size_t lower_bound(const tape_index_t* index, const uint8_t* key, size_t key_len) {
+    size_t lo = 0;
+    size_t hi = index->count;
+
+    while (lo < hi) {
+        const size_t mid = lo + (hi - lo) / 2;
+        if (compare_key(&index->entries[mid], key, key_len) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static const tape_index_entry_t* find_exact(const tape_index_t* index, const uint8_t* key, size_t key_len) {
+    const size_t i = lower_bound(index, key, key_len);
+    if (i < index->count && compare_key(&index->entries[i], key, key_len) == 0) {
+        return &index->entries[i];
+    }
+    return NULL;
+}
+
+const tape_index_entry_t* tape_index_find(const tape_index_t* index,
+                                          const uint8_t* pattern, uint8_t pattern_len) {
+    if (pattern_len == 0 || (pattern_len == 1 && pattern[0] == '*')) {
+        return NULL;
+    }
+
+    const bool has_wildcard = pattern[pattern_len - 1] == '*';
+    const size_t match_len = has_wildcard ? pattern_len - 1u : pattern_len;
+    if (match_len > TAPE_INDEX_MAX_KEY - PRG_EXT_LEN) {
+        return NULL;    // Longer than any CBM filename
+    }
+
+    uint8_t key[TAPE_INDEX_MAX_KEY];
+    for (size_t i = 0; i < match_len; i++) {
+        key[i] = cbm_filename_fold(pattern[i]);
+    }
+
+    if (has_wildcard) {
+        const size_t i = lower_bound(index, key, match_len);
+        if (i < index->count
+            && index->entries[i].key_len >= match_len
+            && memcmp(index->entries[i].key, key, match_len) == 0) {
+            return &index->entries[i];
+        }
+        return NULL;
+    }
+
+    // "NAME" matches "name.prg", and "NAME.PRG" matches "name.prg" as typed.
+    for (size_t i = 0; i < PRG_EXT_LEN; i++) {
+        key[match_len + i] = cbm_filename_fold_host(prg_ext[i]);
+    }
+
+    const tape_index_entry_t* entry = find_exact(index, key, match_len + PRG_EXT_LEN);
+    if (entry == NULL) {
+        entry = find_exact(index, key, match_len);
+    }
+    return entry;
+}
+
+size_t tape_index_dir_entries(const tape_index_t* index, tape_dir_entry_t* out, size_t max) {
+    const size_t count = index->count < max ? index->count : max;
+
+    for (size_t i = 0; i < count; i++) {
+        const tape_index_entry_t* const entry = &index->entries[i];
+        const char* const name = tape_index_name(index, entry);
+
+        // Display name with the ".prg" extension suppressed.
+        size_t base_len = strlen(name) - PRG_EXT_LEN;
+        if (base_len > TAPE_DIR_MAX_NAME) {
+            base_len = TAPE_DIR_MAX_NAME;
+        }
+        memcpy(out[i].name, name, base_len);
+        out[i].name[base_len] = '\0';
+        out[i].blocks = entry->blocks;
+    }
+
+    return count;
+}
+
+uint16_t tape_index_checksum(const tape_index_t* index) {
+    uint16_t crc = CRC16_INIT;
+    crc = crc16_update(crc, (const uint8_t*) &index->count, sizeof(index->count));
+    crc = crc16_update(crc, (const uint8_t*) &index->names_used, sizeof(index->names_used));
+    crc = crc16_update(crc, (const uint8_t*) index->entries, index->count * sizeof(index->entries[0]));
+    crc = crc16_update(crc, (const uint8_t*) index->names, index->names_used);
+    return crc;
+}
@@ -0,0 +1,86 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "tape_dir.h"
+
+// Sorted index of the .prg files in the virtual tape directory. Each entry
+// keeps the host filename pre-encoded and case-folded in PETSCII space (the
+// same folding cbm_filename_match applies), so a LOAD is resolved with a
+// binary search instead of a directory scan, and LOAD "$" is rendered without
+// touching the card.
+
+// Configuration: maximum number of files indexed. Files beyond this are left
+// out and the index is marked incomplete (lookups then fall back to a scan).
+#ifndef TAPE_INDEX_MAX_ENTRIES
+#define TAPE_INDEX_MAX_ENTRIES 256
+#endif
+
+// Configuration: bytes reserved for host filenames (NUL-terminated).
+#ifndef TAPE_INDEX_NAMES_SIZE
+#define TAPE_INDEX_NAMES_SIZE 6144
+#endif
+
+// Longest folded key stored: a 16-character CBM name plus ".prg". Longer
+// names can only be matched by a '*' prefix, which never exceeds this.
+#define TAPE_INDEX_MAX_KEY (TAPE_DIR_MAX_NAME + 4)
+
+typedef struct {
+    uint8_t key[TAPE_INDEX_MAX_KEY];    // Folded PETSCII of the host filename
+    uint8_t key_len;                    // TAPE_INDEX_MAX_KEY + 1 if truncated
+    uint16_t blocks;                    // CBM blocks (at least 1)
+    uint16_t name;                      // Offset of the host filename in 'names'
+    uint32_t size;                      // File size in bytes
+} tape_index_entry_t;
+
+// Cheap fingerprint of the directory, used to decide when to rebuild.
+typedef struct {
+    uint32_t dir_mtime;                 // Directory timestamp (FAT date << 16 | time)
+    uint64_t free_bytes;                // Volume free space
+} tape_index_signature_t;
+
+typedef struct {
+    tape_index_signature_t signature;
+    bool valid;                         // Built for 'signature'
+    bool complete;                      // False if any file was left out
+    uint16_t count;
+    uint16_t names_used;
+    tape_index_entry_t entries[TAPE_INDEX_MAX_ENTRIES];
+    char names[TAPE_INDEX_NAMES_SIZE];
+} tape_index_t;
+
+// Returns true if 'filename' ends in ".prg" (case-insensitive) and has a
+// non-empty base name.
+bool tape_index_is_prg(const char* filename);
+
+// Empty the index and mark it complete but not yet valid.
+void tape_index_clear(tape_index_t* index);
+
+// Add a .prg file. Returns false (and marks the index incomplete) if it does
+// not fit. Call tape_index_sort() once all files have been added.
+bool tape_index_add(tape_index_t* index, const char* filename, uint32_t size);
+
+void tape_index_sort(tape_index_t* index);
+
+static inline const char* tape_index_name(const tape_index_t* index, const tape_index_entry_t* entry) {
+    return &index->names[entry->name];
+}
+
+// Find the file a LOAD of 'pattern' (raw PETSCII, as typed) selects, following
+// the rules of cbm_filename_match. When several files match a '*' prefix, the
+// first in sorted order is returned. Returns NULL if nothing matches.
+const tape_index_entry_t* tape_index_find(const tape_index_t* index,
+                                          const uint8_t* pattern, uint8_t pattern_len);
+
+// Fill 'out' with up to 'max' directory listing entries, in index order.
+// Returns the number of entries written.
+size_t tape_index_dir_entries(const tape_index_t* index, tape_dir_entry_t* out, size_t max);
+
+// Checksum over the indexed contents (not the signature), used to validate a
+// copy persisted to the SD card and to skip rewriting an unchanged one.
+uint16_t tape_index_checksum(const tape_index_t* index);
@@ -4,11 +4,15 @@
 #include "pch.h"
 #include "term_inject.h"
 
+#include "cbm/petscii.h"
 #include "class/hid/hid.h"
 #include "diag/log/log.h"
+#include "driver.h"
+#include "fatal.h"
 #include "input.h"
 #include "system_state.h"
 #include "tusb.h"
+#include "uart/uart_tx.h"
 #include "usb/keyboard.h"
 
 // HID key entry: keycode + shift modifier state
@@ -187,84 +191,237 @@ static const hid_key_t extended_to_hid[EXTENDED_KEY_COUNT] = {
     /* KEY_PGDN  (1007) */ {HID_KEY_PAGE_DOWN,   false},
 };
 
-#define INJECT_QUEUE_SIZE 16
-static hid_key_t inject_queue[INJECT_QUEUE_SIZE];
-static uint8_t inject_queue_head = 0;
-static uint8_t inject_queue_tail = 0;
+// XON/XOFF flow control thresholds (queue occupancy in characters).
+#define INJECT_XOFF_LEVEL (TERM_INJECT_QUEUE_SIZE / 2)
+#define INJECT_XON_LEVEL  (TERM_INJECT_QUEUE_SIZE / 8)
+
+#define ASCII_XON  0x11
+#define ASCII_XOFF 0x13
+
+// After a matrix keystroke, wait this long before touching the KERNAL
+// keyboard queue so the PET's keyscan IRQ (50/60 Hz) has stored the key.
+// Otherwise a bulk refill could overtake it.
+#define INJECT_SETTLE_US 40000
+
+// Characters waiting to be injected (ASCII or extended keycodes). Head and
+// tail are free-running counters.
+static uint16_t inject_queue[TERM_INJECT_QUEUE_SIZE];
+static uint32_t inject_queue_head = 0;
+static uint32_t inject_queue_tail = 0;
+
+static bool xoff_sent = false;
+static bool overflowing = false;
+static uint32_t dropped = 0;
+static bool last_was_cr = false;
+
+static key_buffer_config_t key_buffer;
+static bool key_buffer_enabled = false;
 
 // Injection state machine
 typedef enum {
     INJECT_IDLE,
     INJECT_KEY_DOWN,
     INJECT_KEY_UP,
+    INJECT_SETTLE,
 } inject_state_t;
 
 static inject_state_t inject_state = INJECT_IDLE;
 static uint8_t inject_keycode = 0;
 static uint8_t inject_modifiers = 0;
+static absolute_time_t inject_settle_until;
 
-bool term_inject_char(int ch) {
-    // Check if queue is full
-    uint8_t next_head = (inject_queue_head + 1) % INJECT_QUEUE_SIZE;
-    if (next_head == inject_queue_tail) {
-        return false;  // Queue full
-    }
-    
-    // Translate character to HID keycode + shift state
-    const hid_key_t* mapping;
+static uint32_t queue_used(void) {
+    return inject_queue_head - inject_queue_tail;
+}
+
+static void send_flow_control(uint8_t byte) {
+    // Bypass stdio so the byte is not delayed behind newlib's buffer.
+    uart_tx_write(&byte, 1);
+}
+
+static const hid_key_t* find_hid_key(int ch) {
     if (ch >= 0 && ch <= 127) {
-        // ASCII character
-        mapping = &ascii_to_hid[ch];
-        if (mapping->hid_keycode == 0) {
-            log_debug("term_inject: no mapping for ASCII char 0x%02x", ch);
-            return false;
-        }
-    } else if (ch >= EXTENDED_KEY_BASE && ch < EXTENDED_KEY_BASE + EXTENDED_KEY_COUNT) {
-        // Extended keycode (navigation key)
-        mapping = &extended_to_hid[ch - EXTENDED_KEY_BASE];
-        if (mapping->hid_keycode == 0) {
-            log_debug("term_inject: no mapping for extended key %d", ch);
-            return false;
-        }
+        return &ascii_to_hid[ch];
+    }
+    if (ch >= EXTENDED_KEY_BASE && ch < EXTENDED_KEY_BASE + EXTENDED_KEY_COUNT) {
+        return &extended_to_hid[ch - EXTENDED_KEY_BASE];
+    }
+    return NULL;
+}
+
+// PETSCII code the KERNAL would store in its keyboard queue for 'ch', or -1
+// if 'ch' must be typed through the matrix. Only characters that every keymap
+// types the same way are translated, so both paths produce identical input.
+static int to_key_buffer_petscii(int ch) {
+    switch (ch) {
+        case '\r':
+        case '\n':      return 0x0D;    // RETURN
+        case 0x08:
+        case 0x7F:      return 0x14;    // INST/DEL
+        case KEY_UP:    return 0x91;
+        case KEY_DOWN:  return 0x11;
+        case KEY_RIGHT: return 0x1D;
+        case KEY_LEFT:  return 0x9D;
+        case KEY_HOME:  return 0x13;
+        default:        break;
+    }
+
+    // Letters, digits, and the punctuation PETSCII shares with ASCII. The
+    // rest ('\', '^', '_', '`', braces, etc.) depend on the USB keymap.
+    if ((ch >= ' ' && ch <= '[') || ch == ']' || (ch >= 'a' && ch <= 'z')) {
+        return ascii_to_petscii((uint8_t) ch, /* fold_case: */ false);
+    }
+
+    return -1;
+}
+
+void term_inject_init(const key_buffer_config_t* cfg) {
+    if (cfg != NULL) {
+        vet(cfg->size > 0 && cfg->size <= KEY_BUFFER_MAX_SIZE,
+            "Invalid 'key-buffer' size in config (got %u, expected 1-%u)", cfg->size, KEY_BUFFER_MAX_SIZE);
+        key_buffer = *cfg;
+        key_buffer_enabled = true;
+        log_debug("term_inject: key buffer KEYD=$%04x NDX=$%04x size=%u",
+                  key_buffer.keyd, key_buffer.ndx, key_buffer.size);
     } else {
-        // Unsupported keycode
+        key_buffer_enabled = false;
+    }
+}
+
+bool term_inject_char(int ch) {
+    // Terminals and pasted text may end lines with CR LF. Both map to RETURN,
+    // so drop the LF to avoid a blank line after every line.
+    const bool is_lf_after_cr = ch == '\n' && last_was_cr;
+    last_was_cr = ch == '\r';
+    if (is_lf_after_cr) {
+        return true;
+    }
+
+    // Translate character to HID keycode + shift state to verify it can be typed
+    const hid_key_t* mapping = find_hid_key(ch);
+    if (mapping == NULL) {
         log_debug("term_inject: unsupported keycode %d", ch);
         return false;
     }
-    
-    // Queue the pre-translated HID keycode and shift state
-    inject_queue[inject_queue_head] = *mapping;
-    inject_queue_head = next_head;
+    if (mapping->hid_keycode == 0) {
+        log_debug("term_inject: no mapping for char 0x%02x", ch);
+        return false;
+    }
+
+    if (queue_used() == TERM_INJECT_QUEUE_SIZE) {
+        // The terminal ignored XOFF (or flow control is disabled).
+        dropped++;
+        if (!overflowing) {
+            overflowing = true;
+            log_warn("term_inject: queue full, dropping input (%lu dropped)", dropped);
+        }
+        return false;
+    }
+
+    inject_queue[inject_queue_head & (TERM_INJECT_QUEUE_SIZE - 1)] = (uint16_t) ch;
+    inject_queue_head++;
+
+    if (!xoff_sent && queue_used() >= INJECT_XOFF_LEVEL) {
+        send_flow_control(ASCII_XOFF);
+        xoff_sent = true;
+    }
+
     return true;
 }
 
-static bool dequeue_entry(hid_key_t* entry) {
-    if (inject_queue_head == inject_queue_tail) {
+void term_inject_cancel(void) {
+    inject_queue_tail = inject_queue_head;
+    last_was_cr = false;
+
+    if (xoff_sent) {
+        send_flow_control(ASCII_XON);
+        xoff_sent = false;
+    }
+}
+
+static bool peek_entry(int* ch) {
+    if (queue_used() == 0) {
         return false;  // Queue empty
     }
-    *entry = inject_queue[inject_queue_tail];
-    inject_queue_tail = (inject_queue_tail + 1) % INJECT_QUEUE_SIZE;
+    *ch = inject_queue[inject_queue_tail & (TERM_INJECT_QUEUE_SIZE - 1)];
     return true;
 }
 
+static void consume_entry(void) {
+    inject_queue_tail++;
+    overflowing = false;
+
+    if (xoff_sent && queue_used() <= INJECT_XON_LEVEL) {
+        send_flow_control(ASCII_XON);
+        xoff_sent = false;
+    }
+}
+
+// Move as many queued characters as fit into the KERNAL keyboard queue. Only
+// called once NDX is zero: the KERNAL shifts KEYD down while removing a key, so
+// appending to a non-empty queue could race with the running program. Stops at
+// the first character that needs matrix typing to preserve order.
+static void refill_key_buffer(void) {
+    uint8_t petscii[KEY_BUFFER_MAX_SIZE];
+    uint8_t count = 0;
+
+    int ch;
+    while (count < key_buffer.size && peek_entry(&ch)) {
+        const int code = to_key_buffer_petscii(ch);
+        if (code < 0) {
+            break;
+        }
+        petscii[count++] = (uint8_t) code;
+        consume_entry();
+    }
+
+    // Write the characters before the count so the KERNAL never sees a
+    // partially filled queue.
+    spi_write(key_buffer.keyd, petscii, count);
+    spi_write_at(key_buffer.ndx, count);
+}
+
 void term_inject_task(void) {
     switch (inject_state) {
+        case INJECT_SETTLE:
+            if (!time_reached(inject_settle_until)) {
+                return;
+            }
+            inject_state = INJECT_IDLE;
+            // Fall through
+
         case INJECT_IDLE: {
-            hid_key_t entry;
-            if (!dequeue_entry(&entry)) {
+            int ch;
+            if (!peek_entry(&ch)) {
                 return;  // Nothing to inject
             }
+
+            if (key_buffer_enabled) {
+                // Wait for the PET to empty its keyboard queue. Matrix typing
+                // also lands in this queue, so waiting keeps the order intact.
+                if (spi_read_at(key_buffer.ndx) != 0) {
+                    return;
+                }
+
+                if (to_key_buffer_petscii(ch) >= 0) {
+                    refill_key_buffer();
+                    return;
+                }
+            }
+
+            const hid_key_t* const entry = find_hid_key(ch);
+            consume_entry();
             
             // Store keycode and compute modifiers for the key-up event
-            inject_keycode = entry.hid_keycode;
-            inject_modifiers = entry.shifted ? KEYBOARD_MODIFIER_LEFTSHIFT : 0;
+            inject_keycode = entry->hid_keycode;
+            inject_modifiers = entry->shifted ? KEYBOARD_MODIFIER_LEFTSHIFT : 0;
             
             // Enqueue key-down event to USB keyboard queue
             usb_keyboard_enqueue_key_down(inject_keycode, inject_modifiers);
             
             inject_state = INJECT_KEY_DOWN;
             log_debug("term_inject: enqueue key down HID=0x%02x (shift=%d)", 
-                     inject_keycode, entry.shifted);
+                     inject_keycode, entry->shifted);
             break;
         }
         
@@ -278,7 +435,13 @@ void term_inject_task(void) {
             usb_keyboard_enqueue_key_up(inject_keycode, inject_modifiers);
             
             log_debug("term_inject: enqueue key up");
-            inject_state = INJECT_IDLE;
+
+            if (key_buffer_enabled) {
+                inject_settle_until = make_timeout_time_us(INJECT_SETTLE_US);
+                inject_state = INJECT_SETTLE;
+            } else {
+                inject_state = INJECT_IDLE;
+            }
             break;
     }
 }
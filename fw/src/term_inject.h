@@ -4,22 +4,68 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stdint.h>
+
+// Location of the KERNAL keyboard queue for a given ROM set. Like
+// tape_config_t, the packed struct maps directly to a hex string in
+// config.yaml ('key-buffer').
+typedef struct __attribute__((packed)) {
+    uint16_t keyd;      // Address of the keyboard buffer (KEYD)
+    uint16_t ndx;       // Address of the count of characters in KEYD (NDX)
+    uint8_t size;       // Capacity of KEYD in bytes (10 on all stock ROMs)
+} key_buffer_config_t;  // 5 bytes total
+
+#define KEY_BUFFER_CONFIG_SIZE sizeof(key_buffer_config_t)
+
+// Largest 'size' accepted in key_buffer_config_t.
+#define KEY_BUFFER_MAX_SIZE 16
+
+// Configuration: log2 of the number of characters that can be queued for
+// injection (default 1024). Sized to absorb what a terminal sends after XOFF.
+#ifndef TERM_INJECT_QUEUE_LOG2_SIZE
+#define TERM_INJECT_QUEUE_LOG2_SIZE 10
+#endif
+
+#define TERM_INJECT_QUEUE_SIZE (1u << TERM_INJECT_QUEUE_LOG2_SIZE)
+
+/**
+ * Select how queued characters reach the PET.
+ *
+ * With a config, characters that have a PETSCII equivalent are written
+ * directly into the KERNAL keyboard queue whenever the PET has emptied it,
+ * which is limited only by how fast the running program reads keys. Other
+ * characters (and all characters when 'cfg' is NULL) are typed through the
+ * keyboard matrix, one press/release at a time.
+ *
+ * @param cfg KERNAL keyboard queue location, or NULL for matrix typing only
+ */
+void term_inject_init(const key_buffer_config_t* cfg);
 
 /**
  * Inject an ASCII character as a PET keystroke.
- * 
+ *
  * This function queues the character to be injected. The actual keystroke
- * injection happens during input_task() processing, which handles press/release
- * timing and syncs the keyboard matrix to the FPGA.
- * 
- * @param ch The ASCII character to inject (0-127)
+ * injection happens during input_task() processing, which either refills the
+ * KERNAL keyboard queue or handles press/release timing and syncs the keyboard
+ * matrix to the FPGA.
+ *
+ * When the queue passes its high-water mark, XOFF is sent to the terminal.
+ * XON follows once the PET has drained it.
+ *
+ * @param ch The ASCII character (0-127) or extended keycode (KEY_*) to inject
  * @return true if the character was queued, false if queue is full or char unsupported
  */
 bool term_inject_char(int ch);
 
+/**
+ * Discard any characters that have not yet been injected (e.g., when leaving
+ * remote mode in the middle of a paste) and release XOFF.
+ */
+void term_inject_cancel(void);
+
 /**
  * Process pending keystroke injections.
- * 
+ *
  * This function should be called from input_task() to handle the timing of
  * key press and release events. It modifies usb_key_matrix and relies on
  * sync_state() being called afterward to send the matrix to the FPGA.
@@ -0,0 +1,100 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#include "byte_ring.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+void byte_ring_init(byte_ring_t* ring, uint8_t* data, uint32_t capacity) {
+    assert(capacity != 0 && (capacity & (capacity - 1)) == 0);
+
+    ring->data = data;
+    ring->capacity = capacity;
+    ring->mask = capacity - 1;
+    ring->head = 0;
+    ring->tail = 0;
+}
+
+uint32_t byte_ring_used(const byte_ring_t* ring) {
+    return ring->head - ring->tail;
+}
+
+uint32_t byte_ring_free(const byte_ring_t* ring) {
+    return ring->capacity - byte_ring_used(ring);
+}
+
+size_t byte_ring_write(byte_ring_t* ring, const uint8_t* src, size_t length) {
+    const uint32_t available = byte_ring_free(ring);
+    if (length > available) {
+        length = available;
+    }
+
+    // Copy in at most two pieces: up to the end of the storage, then the
+    // remainder from the start.
+    const uint32_t head = ring->head;
+    const uint32_t start = head & ring->mask;
+    const size_t first = (length < ring->capacity - start) ? length : ring->capacity - start;
+
+    memcpy(&ring->data[start], src, first);
+    memcpy(&ring->data[0], src + first, length - first);
+
+    // Publish the new bytes only after they are in place.
+    ring->head = head + (uint32_t) length;
+    return length;
+}
+
+size_t byte_ring_read(byte_ring_t* ring, uint8_t* dest, size_t length) {
+    const uint32_t available = byte_ring_used(ring);
+    if (length > available) {
+        length = available;
+    }
+
+    const uint32_t tail = ring->tail;
+    const uint32_t start = tail & ring->mask;
+    const size_t first = (length < ring->capacity - start) ? length : ring->capacity - start;
+
+    memcpy(dest, &ring->data[start], first);
+    memcpy(dest + first, &ring->data[0], length - first);
+
+    ring->tail = tail + (uint32_t) length;
+    return length;
+}
+
+bool byte_ring_put(byte_ring_t* ring, uint8_t value) {
+    const uint32_t head = ring->head;
+    if (head - ring->tail == ring->capacity) {
+        return false;
+    }
+
+    ring->data[head & ring->mask] = value;
+    ring->head = head + 1;
+    return true;
+}
+
+int byte_ring_get(byte_ring_t* ring) {
+    const uint32_t tail = ring->tail;
+    if (tail == ring->head) {
+        return EOF;
+    }
+
+    const uint8_t value = ring->data[tail & ring->mask];
+    ring->tail = tail + 1;
+    return value;
+}
+
+size_t byte_ring_peek_span(const byte_ring_t* ring, const uint8_t** span) {
+    const uint32_t used = byte_ring_used(ring);
+    const uint32_t start = ring->tail & ring->mask;
+    const uint32_t to_end = ring->capacity - start;
+
+    *span = &ring->data[start];
+    return used < to_end ? used : to_end;
+}
+
+void byte_ring_consume(byte_ring_t* ring, size_t length) {
+    assert(length <= byte_ring_used(ring));
+    ring->tail += (uint32_t) length;
+}
@@ -0,0 +1,58 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Single-producer / single-consumer byte ring buffer.
+ *
+ * The capacity must be a power of 2. The head and tail are free-running
+ * 32-bit counters that are masked on access, so the ring can use its full
+ * capacity without a sacrificial slot. Each counter is written by only one
+ * side (head by the producer, tail by the consumer), which makes the ring
+ * safe to share between thread context and an interrupt handler on the
+ * RP2040 without locking.
+ */
+typedef struct byte_ring_s {
+    uint8_t* data;              // Backing storage ('capacity' bytes)
+    uint32_t capacity;          // Number of bytes (power of 2)
+    uint32_t mask;              // capacity - 1, for bitwise AND indexing
+    volatile uint32_t head;     // Total bytes written (producer)
+    volatile uint32_t tail;     // Total bytes consumed (consumer)
+} byte_ring_t;
+
+// Initialize 'ring' to use 'capacity' bytes of 'data'. 'capacity' must be a
+// non-zero power of 2.
+void byte_ring_init(byte_ring_t* ring, uint8_t* data, uint32_t capacity);
+
+// Number of bytes currently queued.
+uint32_t byte_ring_used(const byte_ring_t* ring);
+
+// Number of bytes that can be written without overwriting queued data.
+uint32_t byte_ring_free(const byte_ring_t* ring);
+
+// Copy up to 'length' bytes from 'src' into the ring. Returns the number of
+// bytes written, which is less than 'length' if the ring fills.
+size_t byte_ring_write(byte_ring_t* ring, const uint8_t* src, size_t length);
+
+// Copy up to 'length' bytes out of the ring into 'dest'. Returns the number
+// of bytes read.
+size_t byte_ring_read(byte_ring_t* ring, uint8_t* dest, size_t length);
+
+// Append a single byte. Returns false if the ring is full.
+bool byte_ring_put(byte_ring_t* ring, uint8_t value);
+
+// Remove a single byte. Returns EOF if the ring is empty.
+int byte_ring_get(byte_ring_t* ring);
+
+// Return the longest contiguous run of queued bytes starting at the tail
+// without consuming it. Sets '*span' to the first byte of the run. Used to
+// hand a block of the ring directly to DMA.
+size_t byte_ring_peek_span(const byte_ring_t* ring, const uint8_t** span);
+
+// Discard 'length' bytes from the tail (after a peeked span has been sent).
+void byte_ring_consume(byte_ring_t* ring, size_t length);
@@ -0,0 +1,67 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#include "pch.h"
+#include "uart_rx.h"
+
+#include "byte_ring.h"
+
+static uint8_t ring_data[UART_RX_RING_SIZE];
+static byte_ring_t ring;
+
+static bool handler_installed = false;
+static uart_rx_stats_t stats;
+
+static uint uart_rx_irq(void) {
+    return uart_get_index(uart_default) == 0 ? UART0_IRQ : UART1_IRQ;
+}
+
+static void __isr uart_rx_irq_handler(void) {
+    uart_hw_t* const hw = uart_get_hw(uart_default);
+
+    while (uart_is_readable(uart_default)) {
+        const uint32_t dr = hw->dr;
+
+        if (dr & UART_UARTDR_OE_BITS) {
+            stats.overruns++;
+        }
+
+        if (byte_ring_put(&ring, (uint8_t) dr)) {
+            stats.received++;
+        } else {
+            stats.dropped++;
+        }
+    }
+
+    const uint32_t used = byte_ring_used(&ring);
+    if (used > stats.high_water) {
+        stats.high_water = used;
+    }
+}
+
+void uart_rx_init(void) {
+    const uint irq = uart_rx_irq();
+
+    if (!handler_installed) {
+        byte_ring_init(&ring, ring_data, UART_RX_RING_SIZE);
+        irq_add_shared_handler(irq, uart_rx_irq_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+        handler_installed = true;
+    }
+
+    // (Re)enable the RX and receive timeout interrupts. uart_init() clears
+    // them, so this must follow any re-initialization of the UART.
+    uart_set_irq_enables(uart_default, /* rx_has_data: */ true, /* tx_needs_data: */ false);
+    irq_set_enabled(irq, true);
+}
+
+int uart_rx_getc(void) {
+    return byte_ring_get(&ring);
+}
+
+size_t uart_rx_read(uint8_t* dest, size_t length) {
+    return byte_ring_read(&ring, dest, length);
+}
+
+void uart_rx_get_stats(uart_rx_stats_t* out) {
+    *out = stats;
+}
@@ -0,0 +1,44 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Interrupt-driven UART receive ring.
+ *
+ * The UART RX interrupt (including the receive timeout, so a partially
+ * filled FIFO is not left waiting) moves bytes from the 32-byte hardware
+ * FIFO into a RAM ring. Input is no longer lost when the main loop spends
+ * longer than a FIFO's worth of characters in display_task() or on SD I/O.
+ */
+
+// Configuration: log2 of the ring size in bytes (default 2 KB, ~170 ms at
+// 115200 baud)
+#ifndef UART_RX_RING_LOG2_SIZE
+#define UART_RX_RING_LOG2_SIZE 11
+#endif
+
+#define UART_RX_RING_SIZE (1u << UART_RX_RING_LOG2_SIZE)
+
+typedef struct {
+    uint32_t received;      // Total bytes stored in the ring
+    uint32_t dropped;       // Bytes discarded because the ring was full
+    uint32_t overruns;      // Hardware FIFO overruns (bytes lost before the IRQ ran)
+    uint32_t high_water;    // Peak ring occupancy in bytes
+} uart_rx_stats_t;
+
+// Install the RX interrupt handler. Must be called after stdio_init_all().
+// Safe to call again after something re-initializes the UART (e.g., TinyUSB
+// board_init).
+void uart_rx_init(void);
+
+// Return the next received byte, or EOF if none is pending.
+int uart_rx_getc(void);
+
+// Copy up to 'length' pending bytes into 'dest'. Returns the number copied.
+size_t uart_rx_read(uint8_t* dest, size_t length);
+
+void uart_rx_get_stats(uart_rx_stats_t* stats);
@@ -0,0 +1,198 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#include "pch.h"
+#include "uart_tx.h"
+
+#include "byte_ring.h"
+
+// Use DMA_IRQ_1 since PicoDVI owns DMA_IRQ_0 on core 1.
+#define UART_TX_DMA_IRQ DMA_IRQ_1
+
+static uint8_t ring_data[UART_TX_RING_SIZE];
+static byte_ring_t ring;
+
+static int dma_channel = -1;
+static volatile size_t in_flight = 0;      // Bytes handed to the active DMA transfer
+static uart_tx_policy_t policy = UART_TX_DEFAULT_POLICY;
+static uart_tx_stats_t stats;
+
+// Start a DMA transfer for the next contiguous span of the ring, unless one
+// is already running. Must be called with interrupts disabled or from the
+// DMA IRQ handler.
+static void uart_tx_kick(void) {
+    if (in_flight != 0) {
+        return;
+    }
+
+    const uint8_t* span;
+    const size_t length = byte_ring_peek_span(&ring, &span);
+    if (length == 0) {
+        return;
+    }
+
+    in_flight = length;
+    dma_channel_transfer_from_buffer_now((uint) dma_channel, span, length);
+}
+
+// Retire a completed transfer (if any) and start the next. Same calling
+// constraints as uart_tx_kick().
+static void uart_tx_service(void) {
+    if (in_flight != 0 && !dma_channel_is_busy((uint) dma_channel)) {
+        byte_ring_consume(&ring, in_flight);
+        in_flight = 0;
+    }
+    uart_tx_kick();
+}
+
+static void __isr uart_tx_dma_irq_handler(void) {
+    const uint32_t bit = 1u << dma_channel;
+
+    // The IRQ line is shared. Ignore completions for other channels.
+    if ((dma_hw->ints1 & bit) == 0) {
+        return;
+    }
+
+    dma_hw->ints1 = bit;
+    uart_tx_service();
+}
+
+static void uart_tx_kick_from_thread(void) {
+    const uint32_t saved = save_and_disable_interrupts();
+    uart_tx_service();
+    restore_interrupts(saved);
+}
+
+// Copy 'length' bytes into the ring, applying the backpressure policy when
+// the ring fills.
+static void uart_tx_queue(const uint8_t* src, size_t length) {
+    while (length > 0) {
+        const size_t written = byte_ring_write(&ring, src, length);
+        stats.queued += written;
+        src += written;
+        length -= written;
+
+        const uint32_t used = byte_ring_used(&ring);
+        if (used > stats.high_water) {
+            stats.high_water = used;
+        }
+
+        uart_tx_kick_from_thread();
+
+        if (length == 0) {
+            break;
+        }
+
+        if (policy == uart_tx_policy_drop) {
+            stats.dropped += length;
+            break;
+        }
+
+        // Waiting: poll for completion directly so this also makes progress
+        // when called with interrupts disabled.
+        while (byte_ring_free(&ring) == 0) {
+            uart_tx_kick_from_thread();
+            tight_loop_contents();
+        }
+    }
+}
+
+static void uart_tx_out_chars(const char* buf, int length) {
+    uart_tx_queue((const uint8_t*) buf, (size_t) length);
+}
+
+static void uart_tx_out_flush(void) {
+    // Intentionally non-blocking. 'fflush(stdout)' is used throughout the
+    // firmware to push newlib's buffer into the driver, not to wait for the
+    // wire. Use uart_tx_drain() when the bytes must actually leave the chip.
+    uart_tx_kick_from_thread();
+}
+
+static stdio_driver_t uart_tx_stdio_driver = {
+    .out_chars = uart_tx_out_chars,
+    .out_flush = uart_tx_out_flush,
+#if PICO_STDIO_ENABLE_CRLF_SUPPORT
+    .crlf_enabled = PICO_STDIO_DEFAULT_CRLF
+#endif
+};
+
+void uart_tx_init(void) {
+    if (dma_channel < 0) {
+        byte_ring_init(&ring, ring_data, UART_TX_RING_SIZE);
+
+        dma_channel = dma_claim_unused_channel(/* required: */ true);
+
+        dma_channel_config config = dma_channel_get_default_config((uint) dma_channel);
+        channel_config_set_transfer_data_size(&config, DMA_SIZE_8);
+        channel_config_set_read_increment(&config, true);
+        channel_config_set_write_increment(&config, false);
+        channel_config_set_dreq(&config, uart_get_dreq(uart_default, /* is_tx: */ true));
+        dma_channel_configure(
+            (uint) dma_channel, &config,
+            &uart_get_hw(uart_default)->dr,     // Write address (UART data register)
+            ring_data,                          // Read address (updated per transfer)
+            0,                                  // Transfer count (set per transfer)
+            /* trigger: */ false);
+
+        dma_channel_set_irq1_enabled((uint) dma_channel, true);
+        irq_add_shared_handler(UART_TX_DMA_IRQ, uart_tx_dma_irq_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+        irq_set_enabled(UART_TX_DMA_IRQ, true);
+    }
+
+    // Route stdout through the ring instead of the blocking stdio_uart driver.
+    // stdio_uart stays initialized so the UART pins and baud rate remain
+    // configured, but it no longer receives output.
+    stdio_set_driver_enabled(&stdio_uart, false);
+    stdio_set_driver_enabled(&uart_tx_stdio_driver, true);
+}
+
+size_t uart_tx_write(const void* data, size_t length) {
+    const size_t written = byte_ring_write(&ring, (const uint8_t*) data, length);
+    stats.queued += written;
+
+    const uint32_t used = byte_ring_used(&ring);
+    if (used > stats.high_water) {
+        stats.high_water = used;
+    }
+
+    uart_tx_kick_from_thread();
+    return written;
+}
+
+void uart_tx_write_all(const void* data, size_t length) {
+    const uint8_t* p = (const uint8_t*) data;
+    while (length > 0) {
+        const size_t written = uart_tx_write(p, length);
+        p += written;
+        length -= written;
+        tight_loop_contents();
+    }
+}
+
+size_t uart_tx_pending(void) {
+    return byte_ring_used(&ring);
+}
+
+size_t uart_tx_free(void) {
+    return byte_ring_free(&ring);
+}
+
+void uart_tx_drain(void) {
+    while (byte_ring_used(&ring) != 0) {
+        uart_tx_kick_from_thread();
+        tight_loop_contents();
+    }
+    uart_tx_wait_blocking(uart_default);
+}
+
+void uart_tx_set_policy(uart_tx_policy_t new_policy) {
+    policy = new_policy;
+}
+
+uart_tx_policy_t uart_tx_get_policy(void) {
+    return policy;
+}
+
+void uart_tx_get_stats(uart_tx_stats_t* out) {
+    *out = stats;
+}
@@ -0,0 +1,71 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * DMA-driven UART transmit ring.
+ *
+ * Replaces the blocking stdio UART driver for output. Writers copy bytes into
+ * a RAM ring and return immediately. A DMA channel paced by the UART TX DREQ
+ * drains the ring in the background and the DMA completion interrupt starts
+ * the next contiguous span.
+ *
+ * When the ring is full, the backpressure policy decides what happens to the
+ * overflow: 'wait' spins until DMA frees enough space (lossless, the old
+ * behavior), while 'drop' discards the bytes that do not fit and counts them.
+ */
+
+// Configuration: log2 of the ring size in bytes (default 4 KB)
+#ifndef UART_TX_RING_LOG2_SIZE
+#define UART_TX_RING_LOG2_SIZE 12
+#endif
+
+#define UART_TX_RING_SIZE (1u << UART_TX_RING_LOG2_SIZE)
+
+typedef enum {
+    uart_tx_policy_wait,    // Block the writer until space is available
+    uart_tx_policy_drop,    // Discard bytes that do not fit
+} uart_tx_policy_t;
+
+// Configuration: initial backpressure policy
+#ifndef UART_TX_DEFAULT_POLICY
+#define UART_TX_DEFAULT_POLICY uart_tx_policy_wait
+#endif
+
+typedef struct {
+    uint32_t queued;        // Total bytes accepted into the ring
+    uint32_t dropped;       // Total bytes discarded by the 'drop' policy
+    uint32_t high_water;    // Peak ring occupancy in bytes
+} uart_tx_stats_t;
+
+// Claim the DMA channel and install the ring as the stdio output driver in
+// place of stdio_uart. Must be called after stdio_init_all(). Safe to call
+// again after something re-initializes stdio_uart (e.g., TinyUSB board_init).
+void uart_tx_init(void);
+
+// Queue up to 'length' bytes without blocking. Returns the number of bytes
+// accepted. Bytes that do not fit are neither queued nor counted as dropped.
+size_t uart_tx_write(const void* data, size_t length);
+
+// Queue all 'length' bytes, waiting for space regardless of the policy. Binary
+// streams (e.g., 'xfer' and the screen stream) use this instead of stdio so
+// they are not subject to CRLF translation.
+void uart_tx_write_all(const void* data, size_t length);
+
+// Number of bytes queued but not yet handed to the UART.
+size_t uart_tx_pending(void);
+
+// Number of bytes that can be queued without blocking or dropping.
+size_t uart_tx_free(void);
+
+// Block until every queued byte has been shifted out of the UART.
+void uart_tx_drain(void);
+
+void uart_tx_set_policy(uart_tx_policy_t policy);
+uart_tx_policy_t uart_tx_get_policy(void);
+
+void uart_tx_get_stats(uart_tx_stats_t* stats);
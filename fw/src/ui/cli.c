@@ -6,11 +6,22 @@
 
 #include "breakpoint.h"
 #include "console.h"
+#include "diag/boot_profile.h"
 #include "diag/log/log.h"
 #include "display/display.h"
+#include "pool.h"
 #include "reset.h"
+#include "roms/rom_digest.h"
+#include "sd/sd.h"
+#include "sd/sd_cache.h"
+#include "snapshot/snapshot.h"
 #include "system_state.h"
+#include "tape.h"
+#include "term_inject.h"
+#include "uart/uart_rx.h"
+#include "uart/uart_tx.h"
 #include "version.h"
+#include "xfer/xfer.h"
 
 // CLI state
 static char line_buffer[CONSOLE_LINE_MAX];
@@ -18,11 +29,21 @@ static size_t line_length = 0;
 static bool in_remote_mode = false;
 
 // Forward declarations for command handlers
+static void cmd_boot(const char* args);
 static void cmd_bp(const char* args);
+static void cmd_cache(const char* args);
 static void cmd_help(const char* args);
 static void cmd_log(const char* args);
+static void cmd_mount(const char* args);
+static void cmd_pool(const char* args);
 static void cmd_remote(const char* args);
 static void cmd_reset(const char* args);
+static void cmd_roms(const char* args);
+static void cmd_snap(const char* args);
+static void cmd_umount(const char* args);
+static void cmd_uart(const char* args);
+static void cmd_vol(const char* args);
+static void cmd_xfer(const char* args);
 
 // Command table
 typedef struct {
@@ -32,11 +53,21 @@ typedef struct {
 } cli_command_t;
 
 static const cli_command_t commands[] = {
+    { "boot",   "Show boot phase timeline [export]",         cmd_boot },
     { "bp",     "List active breakpoints",                   cmd_bp },
+    { "cache",  "Show flash file cache usage [clear]",       cmd_cache },
     { "help",   "Show this help message",                    cmd_help },
     { "log",    "Show log [debug|info|warn]",                cmd_log },
-    { "remote", "Remote control PET (Ctrl+C to exit)",       cmd_remote },
+    { "mount",  "Mount a .d64/.t64 image on the tape [path]", cmd_mount },
+    { "pool",   "Show buffer pool usage [reset]",            cmd_pool },
+    { "remote", "Remote control PET [bin] (Ctrl+C to exit)", cmd_remote },
     { "reset",  "Reset the RP2040",                          cmd_reset },
+    { "roms",   "Show CRC-32 of the files loaded by the config", cmd_roms },
+    { "snap",   "Save or load a snapshot <save|load> [path] [raw]", cmd_snap },
+    { "umount", "Unmount the tape image",                    cmd_umount },
+    { "uart",   "Show UART stats [wait|drop]",               cmd_uart },
+    { "vol",    "Show volumes and read rates [search order]", cmd_vol },
+    { "xfer",   "Binary memory transfer (tools/host/xfer)",  cmd_xfer },
     { NULL, NULL, NULL }  // Sentinel
 };
 
@@ -47,6 +78,59 @@ static const char* const level_prefixes[] = {
     "W"   // WARN
 };
 
+// Print microseconds as milliseconds with one decimal place.
+static void print_ms(uint64_t us) {
+    printf("%6" PRIu32 ".%" PRIu32, (uint32_t) (us / 1000), (uint32_t) (us / 100 % 10));
+}
+
+static void cmd_boot(const char* args) {
+    const unsigned int count = boot_profile_count();
+    const uint64_t ready_us = boot_profile_ready_us();
+
+    // 'boot export' prints the lines read by 'bootdiff' (tools/host), which
+    // compares the boot profiles of two firmware versions.
+    if (strncmp(args, "export", 6) == 0) {
+        printf(BOOT_PROFILE_EXPORT_HEADER " v%s (%s%s)\r\n", FW_VERSION_STRING, FW_GIT_HASH,
+            FW_GIT_DIRTY ? "-dirty" : "");
+        for (unsigned int i = 0; i < count; i++) {
+            char line[128];
+            boot_profile_format(i, line, sizeof(line));
+            printf("%s\r\n", line);
+        }
+        if (ready_us != 0) {
+            printf("%" PRIu64 "\t0\tready\r\n", ready_us);
+        }
+        fflush(stdout);
+        return;
+    }
+
+    console_puts("Start ms   Time ms  Phase\r\n");
+    for (unsigned int i = 0; i < count; i++) {
+        const boot_phase_t* const phase = boot_profile_get(i);
+        print_ms(phase->start_us);
+        console_puts("  ");
+        if (phase->end_us != 0) {
+            print_ms(phase->end_us - phase->start_us);
+        } else {
+            console_puts("       -");
+        }
+        printf("  %*s%s", phase->depth * 2, "", phase->name);
+        if (phase->detail[0] != '\0') {
+            printf(" %s", phase->detail);
+        }
+        console_puts("\r\n");
+    }
+
+    if (ready_us != 0) {
+        print_ms(ready_us);
+        console_puts("            PET running\r\n");
+    }
+    if (boot_profile_dropped() > 0) {
+        printf("(%" PRIu32 " phases dropped)\r\n", boot_profile_dropped());
+    }
+    fflush(stdout);
+}
+
 static void cmd_bp(const char* args) {
     (void)args;
 
@@ -63,6 +147,20 @@ static void cmd_bp(const char* args) {
     fflush(stdout);
 }
 
+static void cmd_cache(const char* args) {
+    if (strncmp(args, "clear", 5) == 0) {
+        sd_cache_clear();
+    }
+
+    sd_cache_stats_t stats;
+    sd_cache_get_stats(&stats);
+    printf("%" PRIu32 " files, %" PRIu32 " of %" PRIu32 " KB\r\n",
+        stats.entries, stats.bytes / 1024, stats.budget / 1024);
+    printf("hits %" PRIu32 ", misses %" PRIu32 ", stored %" PRIu32 ", evicted %" PRIu32 "\r\n",
+        stats.hits, stats.misses, stats.stores, stats.evictions);
+    fflush(stdout);
+}
+
 static void cmd_help(const char* args) {
     (void)args;
     
@@ -122,16 +220,63 @@ static void cmd_log(const char* args) {
     fflush(stdout);
 }
 
+static void cmd_mount(const char* args) {
+    if (*args != '\0') {
+        if (!tape_mount(args)) {
+            printf("Cannot mount '%s' (see 'log warn')\r\n", args);
+            fflush(stdout);
+            return;
+        }
+    }
+
+    const char* path = tape_mounted();
+    printf("Tape: %s\r\n", path != NULL ? path : "(no image, LOAD reads /prgs)");
+    fflush(stdout);
+}
+
+static void cmd_pool(const char* args) {
+    if (strncmp(args, "reset", 5) == 0) {
+        pool_reset_stats();
+    }
+
+    console_puts("Size  Used  Peak  Allocs  Fails  Owners\r\n");
+    for (size_t i = 0; i < POOL_CLASS_COUNT; i++) {
+        pool_class_stats_t stats;
+        pool_get_stats(i, &stats);
+
+        printf("%4zu  %2u/%-2u %4u  %6" PRIu32 "  %5" PRIu32 " ",
+            stats.block_size, stats.in_use, stats.blocks, stats.high_water, stats.allocs, stats.failures);
+        for (size_t j = 0; j < stats.blocks; j++) {
+            const char* owner = pool_block_owner(i, j);
+            if (owner != NULL) {
+                printf(" '%s'", owner);
+            }
+        }
+        console_puts("\r\n");
+    }
+    fflush(stdout);
+}
+
 static void cmd_remote(const char* args) {
-    (void)args;
-    
-    console_puts("[entering remote mode - Ctrl+C to exit]\r\n");
+    // 'remote bin' streams binary screen frames for the host viewer
+    // (tools/host/screen-view) instead of rendering ANSI text.
+    const bool binary = strncmp(args, "bin", 3) == 0;
+
+    console_puts(binary
+        ? "[entering binary remote mode - Ctrl+C to exit]\r\n"
+        : "[entering remote mode - Ctrl+C to exit]\r\n");
     
     in_remote_mode = true;
-    system_state.term_mode = term_mode_video;
     system_state.term_input_dest = term_input_to_pet;
-    display_term_begin();
-    display_term_refresh();  // Immediately render video buffer to terminal
+
+    if (binary) {
+        system_state.term_mode = term_mode_stream;
+        display_stream_begin();
+    } else {
+        system_state.term_mode = term_mode_video;
+        display_term_begin();
+        display_term_refresh();  // Immediately render video buffer to terminal
+    }
 }
 
 static void cmd_reset(const char* args) {
@@ -141,6 +286,109 @@ static void cmd_reset(const char* args) {
     system_reset();
 }
 
+static void cmd_roms(const char* args) {
+    (void)args;
+
+    // 'ok' and 'BAD' are checked against the 'crc' in config.yaml.
+    static const char* const status_names[] = { "", "ok", "BAD" };
+
+    const unsigned int count = rom_digest_count();
+    console_puts("Address  Length  CRC-32    File\r\n");
+    for (unsigned int i = 0; i < count; i++) {
+        const rom_digest_t* const digest = rom_digest_get(i);
+        printf("$%05" PRIX32 "  %6" PRIu32 "  %08" PRIx32 "  %s %s\r\n",
+            digest->address, digest->length, digest->crc, digest->path, status_names[digest->status]);
+    }
+    fflush(stdout);
+}
+
+static void cmd_snap(const char* args) {
+    // 'snap save' compresses the snapshot unless 'raw' follows the path.
+    char verb[8] = "";
+    char path[256] = "";
+    char option[8] = "";
+    sscanf(args, "%7s %255s %7s", verb, path, option);
+
+    const char* const target = path[0] != '\0' ? path : SNAPSHOT_DEFAULT_PATH;
+    bool ok;
+    if (strcmp(verb, "save") == 0) {
+        ok = snapshot_save(target, /* compress: */ strcmp(option, "raw") != 0);
+    } else if (strcmp(verb, "load") == 0) {
+        ok = snapshot_restore(target);
+    } else {
+        console_puts("Usage: snap <save|load> [path] [raw]\r\n");
+        return;
+    }
+
+    printf(ok ? "%s: done\r\n" : "%s: failed (see 'log warn')\r\n", target);
+    fflush(stdout);
+}
+
+static void cmd_umount(const char* args) {
+    (void)args;
+
+    tape_unmount();
+    console_puts("Tape: (no image, LOAD reads /prgs)\r\n");
+}
+
+static void cmd_uart(const char* args) {
+    if (strncmp(args, "wait", 4) == 0) {
+        uart_tx_set_policy(uart_tx_policy_wait);
+    } else if (strncmp(args, "drop", 4) == 0) {
+        uart_tx_set_policy(uart_tx_policy_drop);
+    }
+
+    // Snapshot before printing so the report does not count itself.
+    uart_tx_stats_t stats;
+    uart_tx_get_stats(&stats);
+    const size_t pending = uart_tx_pending();
+
+    uart_rx_stats_t rx_stats;
+    uart_rx_get_stats(&rx_stats);
+
+    printf("TX ring:  %u bytes, policy '%s'\r\n",
+        UART_TX_RING_SIZE,
+        uart_tx_get_policy() == uart_tx_policy_drop ? "drop" : "wait");
+    printf("Queued:   %" PRIu32 " bytes\r\n", stats.queued);
+    printf("Dropped:  %" PRIu32 " bytes\r\n", stats.dropped);
+    printf("Pending:  %zu bytes (peak %" PRIu32 ")\r\n", pending, stats.high_water);
+    printf("RX ring:  %u bytes (peak %" PRIu32 ")\r\n", UART_RX_RING_SIZE, rx_stats.high_water);
+    printf("Received: %" PRIu32 " bytes\r\n", rx_stats.received);
+    printf("Lost:     %" PRIu32 " ring full, %" PRIu32 " FIFO overrun\r\n", rx_stats.dropped, rx_stats.overruns);
+    fflush(stdout);
+}
+
+static void cmd_vol(const char* args) {
+    if (*args != '\0' && !sd_set_search_order(args)) {
+        console_puts("Usage: vol [usb, sd]\r\n");
+        return;
+    }
+
+    sd_volume_t order[sd_volume_count];
+    const unsigned int count = sd_get_search_order(order);
+    console_puts("search order:");
+    for (unsigned int i = 0; i < count; i++) {
+        printf(" %s", sd_volume_name(order[i]));
+    }
+    console_puts("\r\n");
+
+    for (unsigned int v = 0; v < sd_volume_count; v++) {
+        sd_volume_stats_t stats;
+        sd_volume_get_stats((sd_volume_t) v, &stats);
+        const uint32_t kbps = stats.read_us > 0 ? (uint32_t) (stats.bytes * 1000 / stats.read_us) : 0;
+        printf("  %-4s %-9s %" PRIu32 " files, %" PRIu64 " bytes, %" PRIu32 " KB/s\r\n",
+            sd_volume_name((sd_volume_t) v), sd_volume_is_mounted((sd_volume_t) v) ? "mounted" : "-",
+            stats.files, stats.bytes, kbps);
+    }
+    fflush(stdout);
+}
+
+static void cmd_xfer(const char* args) {
+    (void)args;
+
+    xfer_begin();
+}
+
 static void execute_command(const char* line) {
     // Skip leading whitespace
     while (*line == ' ') line++;
@@ -214,7 +462,15 @@ bool cli_in_remote_mode(void) {
 void cli_exit_remote(void) {
     if (in_remote_mode) {
         in_remote_mode = false;
-        display_term_end();
+
+        // Abandon any paste still in flight.
+        term_inject_cancel();
+
+        if (system_state.term_mode == term_mode_stream) {
+            display_stream_end();
+        } else {
+            display_term_end();
+        }
         
         system_state.term_mode = term_mode_cli;
         system_state.term_input_dest = term_input_to_firmware;
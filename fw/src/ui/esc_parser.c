@@ -0,0 +1,93 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#include "esc_parser.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "input.h"
+
+#define ASCII_ESC 0x1B
+
+// Map escape sequences to key constants. (ESC [ has already been matched.)
+typedef struct {
+    const char* sequence;
+    int key;
+} escape_sequence_t;
+
+static const escape_sequence_t escape_sequences[] = {
+    { "A",  KEY_UP },
+    { "B",  KEY_DOWN },
+    { "C",  KEY_RIGHT },
+    { "D",  KEY_LEFT },
+    { "F",  KEY_END },
+    { "H",  KEY_HOME },
+    { "5~", KEY_PGUP },
+    { "6~", KEY_PGDN },
+    { NULL, EOF }
+};
+
+static bool is_sequence_terminator(int ch) {
+    return (64 <= ch && ch <= 126)
+        || (0 <= ch && ch <= 31);
+}
+
+static int lookup_sequence(const char* sequence, size_t length) {
+    for (const escape_sequence_t* entry = &escape_sequences[0]; entry->sequence != NULL; entry++) {
+        if (strlen(entry->sequence) == length && memcmp(sequence, entry->sequence, length) == 0) {
+            return entry->key;
+        }
+    }
+
+    return EOF;  // Unknown sequence
+}
+
+void esc_parser_init(esc_parser_t* parser) {
+    memset(parser, 0, sizeof(*parser));
+    parser->state = esc_state_idle;
+}
+
+int esc_parser_feed(esc_parser_t* parser, uint8_t ch, uint64_t now_us) {
+    parser->deadline_us = now_us + ESC_PARSER_TIMEOUT_US;
+
+    switch (parser->state) {
+        case esc_state_idle:
+            if (ch == ASCII_ESC) {
+                parser->state = esc_state_escape;
+                return EOF;
+            }
+            return ch;
+
+        case esc_state_escape:
+            if (ch == '[') {
+                parser->state = esc_state_csi;
+                parser->length = 0;
+                return EOF;
+            }
+            // Not a CSI sequence. Return the second character.
+            parser->state = esc_state_idle;
+            return ch;
+
+        case esc_state_csi:
+            parser->sequence[parser->length++] = (char) ch;
+            if (parser->length < ESC_PARSER_MAX_SEQUENCE && !is_sequence_terminator(ch)) {
+                return EOF;
+            }
+            parser->state = esc_state_idle;
+            return lookup_sequence(parser->sequence, parser->length);
+    }
+
+    return EOF;
+}
+
+int esc_parser_poll(esc_parser_t* parser, uint64_t now_us) {
+    if (parser->state == esc_state_idle || now_us < parser->deadline_us) {
+        return EOF;
+    }
+
+    const bool lone_escape = parser->state == esc_state_escape;
+    parser->state = esc_state_idle;
+    return lone_escape ? ASCII_ESC : EOF;
+}
@@ -0,0 +1,50 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Non-blocking VT100 escape sequence parser.
+ *
+ * Translates cursor and navigation key sequences (ESC [ ...) from the
+ * terminal into KEY_* codes one byte at a time. A partial sequence is held
+ * across calls, so the caller never has to wait for the rest of it to
+ * arrive. Timestamps are passed in by the caller.
+ */
+
+// Configuration: how long to wait for the next byte of a sequence before
+// giving up. VT100 sequences arrive back-to-back at any baud rate, so a lone
+// ESC is recognized as the Escape key after this delay.
+#ifndef ESC_PARSER_TIMEOUT_US
+#define ESC_PARSER_TIMEOUT_US 10000
+#endif
+
+// Longest CSI sequence body (after ESC [) that is buffered.
+#define ESC_PARSER_MAX_SEQUENCE 10
+
+typedef enum {
+    esc_state_idle,         // Not in a sequence
+    esc_state_escape,       // Received ESC
+    esc_state_csi,          // Received ESC [
+} esc_state_t;
+
+typedef struct {
+    esc_state_t state;
+    char sequence[ESC_PARSER_MAX_SEQUENCE];
+    size_t length;
+    uint64_t deadline_us;   // When the pending sequence times out
+} esc_parser_t;
+
+void esc_parser_init(esc_parser_t* parser);
+
+// Feed one received byte. Returns the character or KEY_* code it completes,
+// or EOF if the byte was absorbed into a pending (or unrecognized) sequence.
+int esc_parser_feed(esc_parser_t* parser, uint8_t ch, uint64_t now_us);
+
+// Call when no byte is available. Once a pending sequence has timed out, a
+// lone ESC is returned as the Escape key and a partial CSI sequence is
+// discarded. Returns EOF otherwise.
+int esc_parser_poll(esc_parser_t* parser, uint64_t now_us);
@@ -25,13 +25,24 @@
 
 #include "pch.h"
 
+#include "filesystem/fat.h"
+#include "filesystem/vfs.h"
+
 #include "diag/log/log.h"
+#include "msc_disk.h"
+#include "sd/sd.h"
 
 //--------------------------------------------------------------------+
 // MACRO TYPEDEF CONSTANT ENUM DECLARATION
 //--------------------------------------------------------------------+
 static scsi_inquiry_resp_t inquiry_resp;
 
+// Mounting reads the disk, which needs the host task, so the callbacks only
+// record what to do and msc_app_task() does it outside of tuh_task().
+static uint8_t pending_mount;     // Device address to mount (0 = none)
+static bool pending_unmount;
+static bool mounted;
+
 bool inquiry_complete_cb(uint8_t dev_addr, tuh_msc_complete_data_t const * cb_data)
 {
   msc_cbw_t const* cbw = cb_data->cbw;
@@ -53,6 +64,7 @@ bool inquiry_complete_cb(uint8_t dev_addr, tuh_msc_complete_data_t const * cb_da
   log_debug("Disk Size: %lu MB", block_count / ((1024*1024)/block_size));
   log_debug("Block Count = %lu, Block Size: %lu", block_count, block_size);
 
+  pending_mount = dev_addr;
   return true;
 }
 
@@ -69,4 +81,42 @@ void tuh_msc_umount_cb(uint8_t dev_addr)
 {
   (void) dev_addr;
   log_info("A MassStorage device is unmounted");
+
+  msc_disk_detach();
+  pending_mount = 0;
+  pending_unmount = mounted;
+}
+
+void msc_app_task(void)
+{
+  static filesystem_t* fat = NULL;
+
+  if (pending_unmount)
+  {
+    pending_unmount = false;
+    mounted = false;
+    fs_unmount(SD_USB_MOUNT_POINT);
+    sd_volume_set_mounted(sd_volume_usb, false);
+  }
+
+  if (pending_mount != 0)
+  {
+    const uint8_t dev_addr = pending_mount;
+    pending_mount = 0;
+
+    if (fat == NULL)
+    {
+      fat = filesystem_fat_create();
+    }
+
+    if (fs_mount(SD_USB_MOUNT_POINT, fat, msc_disk_create(dev_addr)) == -1)
+    {
+      log_warn("usb: cannot mount: %s", strerror(errno));
+      return;
+    }
+
+    mounted = true;
+    sd_volume_set_mounted(sd_volume_usb, true);
+    log_info("usb: mounted at %s", SD_USB_MOUNT_POINT);
+  }
 }
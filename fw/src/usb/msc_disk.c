@@ -0,0 +1,147 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#include "pch.h"
+#include "msc_disk.h"
+
+#include "diag/log/log.h"
+
+// Largest transfer per SCSI command (READ(10) counts blocks in 16 bits, but
+// the host stack moves one command at a time, so bound the time spent in each).
+#define MSC_DISK_MAX_BLOCKS 64
+
+static struct {
+    uint8_t dev_addr;
+    bool attached;
+    uint32_t block_size;
+    uint32_t block_count;
+
+    // Completion of the command in flight
+    volatile bool done;
+    volatile bool ok;
+} disk;
+
+static blockdevice_t device;
+
+static bool command_complete_cb(uint8_t dev_addr, tuh_msc_complete_data_t const* cb_data) {
+    (void) dev_addr;
+
+    disk.ok = cb_data->csw->status == MSC_CSW_STATUS_PASSED;
+    disk.done = true;
+    return true;
+}
+
+// Run the host stack until the command in flight completes or the device is
+// removed.
+static bool wait_for_command(void) {
+    while (!disk.done) {
+        tuh_task();
+        if (!disk.attached || !tuh_msc_mounted(disk.dev_addr)) {
+            return false;
+        }
+    }
+    return disk.ok;
+}
+
+static bool to_blocks(bd_size_t addr, bd_size_t length, uint32_t* lba, uint32_t* count) {
+    if (addr % disk.block_size != 0 || length % disk.block_size != 0) {
+        return false;
+    }
+    *lba = (uint32_t) (addr / disk.block_size);
+    *count = (uint32_t) (length / disk.block_size);
+    return *lba + *count <= disk.block_count;
+}
+
+static int transfer(uint8_t* buffer, bd_size_t addr, bd_size_t length, bool write) {
+    uint32_t lba;
+    uint32_t count;
+    if (!disk.attached || !to_blocks(addr, length, &lba, &count)) {
+        return -1;
+    }
+
+    while (count > 0) {
+        const uint16_t blocks = count < MSC_DISK_MAX_BLOCKS ? (uint16_t) count : MSC_DISK_MAX_BLOCKS;
+
+        disk.done = false;
+        const bool queued = write
+            ? tuh_msc_write10(disk.dev_addr, 0, buffer, lba, blocks, command_complete_cb, 0)
+            : tuh_msc_read10(disk.dev_addr, 0, buffer, lba, blocks, command_complete_cb, 0);
+        if (!queued || !wait_for_command()) {
+            log_warn("usb: %s error at block %" PRIu32, write ? "write" : "read", lba);
+            return -1;
+        }
+
+        buffer += (size_t) blocks * disk.block_size;
+        lba += blocks;
+        count -= blocks;
+    }
+
+    return 0;
+}
+
+static int msc_init(blockdevice_t* device) {
+    device->is_initialized = true;
+    return 0;
+}
+
+static int msc_deinit(blockdevice_t* device) {
+    device->is_initialized = false;
+    return 0;
+}
+
+static int msc_read(blockdevice_t* device, const void* buffer, bd_size_t addr, bd_size_t length) {
+    (void) device;
+    return transfer((uint8_t*) buffer, addr, length, /* write: */ false);
+}
+
+static int msc_program(blockdevice_t* device, const void* buffer, bd_size_t addr, bd_size_t length) {
+    (void) device;
+    return transfer((uint8_t*) buffer, addr, length, /* write: */ true);
+}
+
+static int msc_erase(blockdevice_t* device, bd_size_t addr, bd_size_t length) {
+    (void) device;
+    (void) addr;
+    (void) length;
+    return 0;
+}
+
+static int msc_sync(blockdevice_t* device) {
+    (void) device;
+    return 0;
+}
+
+static bd_size_t msc_size(blockdevice_t* device) {
+    (void) device;
+    return (bd_size_t) disk.block_count * disk.block_size;
+}
+
+blockdevice_t* msc_disk_create(uint8_t dev_addr) {
+    disk.dev_addr = dev_addr;
+    disk.attached = true;
+    disk.block_size = tuh_msc_get_block_size(dev_addr, 0);
+    disk.block_count = tuh_msc_get_block_count(dev_addr, 0);
+
+    device = (blockdevice_t) {
+        .init = msc_init,
+        .deinit = msc_deinit,
+        .read = msc_read,
+        .erase = msc_erase,
+        .program = msc_program,
+        .trim = msc_erase,
+        .sync = msc_sync,
+        .size = msc_size,
+        .read_size = disk.block_size,
+        .erase_size = disk.block_size,
+        .program_size = disk.block_size,
+        .name = "usb-msc",
+        .config = &disk,
+        .is_initialized = false,
+    };
+
+    return &device;
+}
+
+void msc_disk_detach(void) {
+    disk.attached = false;
+}
@@ -0,0 +1,22 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#pragma once
+
+#include <stdint.h>
+
+#include "blockdevice/blockdevice.h"
+
+// Adapts LUN 0 of a USB mass storage device to a pico-vfs block device, so
+// that it can be mounted with FatFs like the SD card. Reads and writes are
+// synchronous: each one issues a SCSI READ(10)/WRITE(10) and runs the TinyUSB
+// host task until it completes. There is a single instance, since only one
+// stick is mounted at a time.
+//
+// Must not be used from inside a TinyUSB callback.
+
+// Return the block device for the mass storage device at 'dev_addr'.
+blockdevice_t* msc_disk_create(uint8_t dev_addr);
+
+// Fail further I/O (the device was removed).
+void msc_disk_detach(void);
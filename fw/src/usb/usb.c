@@ -5,15 +5,22 @@
 #include "usb.h"
 
 #include "diag/log/log.h"
+#include "uart/uart_rx.h"
+#include "uart/uart_tx.h"
 
 void usb_init() {
     // Something in 'board_init()' interrupts the UART, losing characters pending in the FIFO.
-    // Wait for the FIFO to empty before continuing.
+    // Wait for the TX ring and FIFO to empty before continuing.
     fflush(stdout);
-    uart_default_tx_wait_blocking();
+    uart_tx_drain();
 
     board_init();
 
+    // 'board_init()' also re-enables the blocking stdio_uart driver and
+    // re-initializes the UART. Reclaim stdout and the RX interrupt.
+    uart_tx_init();
+    uart_rx_init();
+
     // init host stack on configured roothub port
     tuh_init(BOARD_TUH_RHPORT);
 
@@ -5,5 +5,6 @@
 
 extern void cdc_app_task(void);
 extern void hid_app_task(void);
+extern void msc_app_task(void);
 
 void usb_init();
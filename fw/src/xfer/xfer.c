@@ -0,0 +1,139 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#include "pch.h"
+#include "xfer.h"
+
+#include "diag/log/log.h"
+#include "driver.h"
+#include "fatal.h"
+#include "system_state.h"
+#include "term_inject.h"
+#include "uart/uart_rx.h"
+#include "uart/uart_tx.h"
+#include "ui/console.h"
+#include "xfer_target.h"
+
+// Memory reachable over the transfer protocol (see diag/mem.c).
+#define SRAM_ADDR_MIN 0x00000
+#define SRAM_ADDR_MAX 0x1FFFF
+#define BRAM_ADDR_MIN 0x68000
+#define BRAM_ADDR_MAX 0x68FFF
+
+// Target state (allocated only while a session is active).
+static xfer_target_t* target = NULL;
+static uint64_t last_rx_time;
+static bool quit_requested;
+
+static bool in_region(uint32_t addr, size_t length, uint32_t min, uint32_t max) {
+    return addr >= min && addr <= max && length <= (size_t) (max - addr) + 1;
+}
+
+static bool xfer_valid_range(void* context, uint32_t addr, size_t length) {
+    (void)context;
+
+    return in_region(addr, length, SRAM_ADDR_MIN, SRAM_ADDR_MAX)
+        || in_region(addr, length, BRAM_ADDR_MIN, BRAM_ADDR_MAX);
+}
+
+static void xfer_read(void* context, uint32_t addr, uint8_t* dest, size_t length) {
+    (void)context;
+    spi_read(addr, length, dest);
+}
+
+static void xfer_write(void* context, uint32_t addr, const uint8_t* src, size_t length) {
+    (void)context;
+    spi_write(addr, src, length);
+}
+
+static void xfer_send(void* context, const uint8_t* data, size_t length) {
+    (void)context;
+    uart_tx_write_all(data, length);
+}
+
+static void xfer_jump(void* context, uint16_t addr) {
+    (void)context;
+
+    // Type the command at the READY prompt. Lowercase letters are typed
+    // unshifted, which BASIC reads as keywords.
+    char command[16];
+    if (addr == 0) {
+        snprintf(command, sizeof(command), "run\r");
+    } else {
+        snprintf(command, sizeof(command), "sys %u\r", addr);
+    }
+
+    for (const char* p = command; *p != '\0'; p++) {
+        term_inject_char(*p);
+    }
+}
+
+static void xfer_end(void) {
+    const xfer_target_stats_t* const stats = &target->stats;
+    log_info("xfer: %lu requests, %lu bytes written, %lu bytes read, %lu CRC errors, %lu NAKs, %lu repeats",
+        stats->frames, stats->bytes_written, stats->bytes_read,
+        target->decoder.crc_errors, stats->naks, stats->repeats);
+
+    free(target);
+    target = NULL;
+
+    system_state.term_mode = term_mode_cli;
+    system_state.term_input_dest = term_input_to_firmware;
+
+    console_puts("\r\n[exited transfer mode]\r\n");
+    console_prompt();
+}
+
+static void xfer_quit(void* context) {
+    (void)context;
+
+    // The target is still executing. End the session once it returns.
+    quit_requested = true;
+}
+
+static const xfer_target_ops_t xfer_ops = {
+    .valid_range = xfer_valid_range,
+    .read = xfer_read,
+    .write = xfer_write,
+    .send = xfer_send,
+    .jump = xfer_jump,
+    .quit = xfer_quit,
+};
+
+void xfer_begin(void) {
+    if (target == NULL) {
+        target = vetted_malloc(sizeof(xfer_target_t));
+    }
+    xfer_target_init(target, &xfer_ops, NULL);
+    last_rx_time = time_us_64();
+    quit_requested = false;
+
+    console_puts("[entering transfer mode]\r\n");
+
+    system_state.term_mode = term_mode_xfer;
+    system_state.term_input_dest = term_input_to_xfer;
+}
+
+void xfer_task(void) {
+    if (target == NULL) {
+        return;
+    }
+
+    uint8_t buffer[64];
+    const size_t count = uart_rx_read(buffer, sizeof(buffer));
+
+    const uint64_t now = time_us_64();
+    if (count != 0) {
+        last_rx_time = now;
+        xfer_target_receive(target, buffer, count);
+
+        if (quit_requested) {
+            // Let the acknowledgement leave before the prompt follows it.
+            uart_tx_drain();
+            xfer_end();
+        }
+    } else if (now - last_rx_time > XFER_IDLE_TIMEOUT_US) {
+        log_warn("xfer: idle timeout");
+        xfer_end();
+    }
+}
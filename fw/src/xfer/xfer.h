@@ -0,0 +1,19 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#pragma once
+
+// Configuration: return to the CLI if no byte arrives for this long (the
+// host cannot send Ctrl+C once the session is binary).
+#ifndef XFER_IDLE_TIMEOUT_US
+#define XFER_IDLE_TIMEOUT_US 30000000
+#endif
+
+// Switch the UART to the binary transfer protocol (see xfer_proto.h). Input
+// is routed to xfer_task() until the host sends XFER_QUIT or the session
+// idles out, after which the CLI prompt returns.
+void xfer_begin(void);
+
+// Read pending UART bytes and execute completed requests. Called from
+// input_task() while term_input_dest is term_input_to_xfer.
+void xfer_task(void);
@@ -0,0 +1,88 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#include "xfer_proto.h"
+
+#include <assert.h>
+#include <string.h>
+
+#include "crc.h"
+
+size_t xfer_encode(uint8_t* out, uint8_t type, uint8_t seq, const uint8_t* payload, size_t length) {
+    assert(length <= XFER_MAX_PAYLOAD);
+
+    out[0] = XFER_MAGIC_0;
+    out[1] = XFER_MAGIC_1;
+    out[2] = type;
+    out[3] = seq;
+    xfer_put_u16(&out[4], (uint16_t) length);
+    if (length != 0 && payload != &out[XFER_HEADER_SIZE]) {
+        memcpy(&out[XFER_HEADER_SIZE], payload, length);
+    }
+
+    // The magic is excluded from the CRC.
+    const size_t crc_offset = XFER_HEADER_SIZE + length;
+    xfer_put_u16(&out[crc_offset], crc16_update(CRC16_INIT, &out[2], crc_offset - 2));
+    return crc_offset + XFER_CRC_SIZE;
+}
+
+void xfer_decoder_init(xfer_decoder_t* decoder) {
+    memset(decoder, 0, sizeof(*decoder));
+}
+
+// True if the buffered bytes could be the start of a frame.
+static bool prefix_is_valid(const xfer_decoder_t* decoder) {
+    return decoder->frame[1] == XFER_MAGIC_1
+        && (decoder->received < XFER_HEADER_SIZE
+            || xfer_get_u16(&decoder->frame[4]) <= XFER_MAX_PAYLOAD);
+}
+
+// Drop the first buffered byte and skip ahead to the next candidate magic.
+static void decoder_resync(xfer_decoder_t* decoder) {
+    size_t skip = 1;
+    while (skip < decoder->received && decoder->frame[skip] != XFER_MAGIC_0) {
+        skip++;
+    }
+
+    decoder->received -= skip;
+    memmove(decoder->frame, &decoder->frame[skip], decoder->received);
+}
+
+xfer_decode_result_t xfer_decode_byte(xfer_decoder_t* decoder, uint8_t byte) {
+    // Skip bytes between frames without buffering them.
+    if (decoder->received == 0 && byte != XFER_MAGIC_0) {
+        return xfer_decode_pending;
+    }
+
+    decoder->frame[decoder->received++] = byte;
+
+    while (decoder->received >= 2 && !prefix_is_valid(decoder)) {
+        decoder_resync(decoder);
+    }
+
+    if (decoder->received < XFER_HEADER_SIZE) {
+        return xfer_decode_pending;
+    }
+
+    const uint16_t length = xfer_get_u16(&decoder->frame[4]);
+    const size_t crc_offset = XFER_HEADER_SIZE + length;
+    if (decoder->received < crc_offset + XFER_CRC_SIZE) {
+        return xfer_decode_pending;
+    }
+
+    // The whole frame is consumed either way. A corrupted frame is not
+    // rescanned for an embedded magic: its payload is arbitrary data.
+    decoder->received = 0;
+
+    const uint16_t crc = crc16_update(CRC16_INIT, &decoder->frame[2], crc_offset - 2);
+    if (crc != xfer_get_u16(&decoder->frame[crc_offset])) {
+        decoder->crc_errors++;
+        return xfer_decode_error;
+    }
+
+    decoder->type = decoder->frame[2];
+    decoder->seq = decoder->frame[3];
+    decoder->payload = &decoder->frame[XFER_HEADER_SIZE];
+    decoder->length = length;
+    return xfer_decode_frame;
+}
@@ -0,0 +1,133 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Binary transfer protocol ('xfer' CLI command)
+ *
+ * Moves blocks of memory between a host and the PET's SRAM/BRAM over the
+ * UART. Both directions use the same frame layout (multi-byte fields are
+ * little-endian):
+ *
+ *   Offset  Size  Field
+ *   0       2     Magic ($EC $58)
+ *   2       1     Type (XFER_*)
+ *   3       1     Sequence number
+ *   4       2     Payload length in bytes
+ *   6       n     Payload
+ *   6+n     2     CRC-16/CCITT of bytes [2, 6+n)
+ *
+ * The host numbers its requests consecutively and may have up to
+ * XFER_WINDOW of them unacknowledged (Go-Back-N). The target answers each
+ * in-order request with XFER_ACK (or XFER_DATA for reads, or XFER_ERROR)
+ * carrying the request's sequence number. A CRC error or a gap in the
+ * sequence is answered once with XFER_NAK naming the sequence number the
+ * target expects next. The host then resends from that request. Requests
+ * the target has already executed are executed again and re-acknowledged,
+ * so a lost acknowledgement only costs a retransmit.
+ *
+ * Requests (host -> target):
+ *
+ *   XFER_HELLO  (empty)                 Resynchronize. The reply's sequence
+ *                                       number restarts the count.
+ *   XFER_WRITE  addr:u32, data[n]       Write 'n' bytes at 'addr'
+ *   XFER_READ   addr:u32, length:u16    Read 'length' bytes at 'addr'
+ *   XFER_BASIC  vartab:u8, end:u16      Set VARTAB/ARYTAB/STREND to 'end'
+ *   XFER_JUMP   addr:u16                Type "SYS addr" (or "RUN" if 0)
+ *   XFER_QUIT   (empty)                 Return to the CLI prompt
+ *
+ * Replies (target -> host):
+ *
+ *   XFER_HELLO  version:u8, window:u8, max_data:u16
+ *   XFER_ACK    (empty)
+ *   XFER_DATA   addr:u32, data[n]
+ *   XFER_NAK    (empty, sequence = next expected)
+ *   XFER_ERROR  code:u8 (XFER_ERROR_*)
+ */
+
+#define XFER_MAGIC_0 0xEC
+#define XFER_MAGIC_1 0x58
+
+#define XFER_VERSION 1
+
+#define XFER_HELLO 'H'
+#define XFER_WRITE 'W'
+#define XFER_READ  'R'
+#define XFER_BASIC 'B'
+#define XFER_JUMP  'J'
+#define XFER_QUIT  'Q'
+#define XFER_ACK   'A'
+#define XFER_DATA  'D'
+#define XFER_NAK   'N'
+#define XFER_ERROR 'E'
+
+#define XFER_ERROR_BAD_REQUEST 1    // Unknown type or malformed payload
+#define XFER_ERROR_BAD_RANGE   2    // Address range outside SRAM/BRAM
+
+#define XFER_HEADER_SIZE 6
+#define XFER_CRC_SIZE    2
+#define XFER_ADDR_SIZE   4
+
+// Largest block of memory carried by a single XFER_WRITE or XFER_DATA frame.
+#define XFER_MAX_DATA 1024
+
+// Number of requests the host may have in flight.
+#define XFER_WINDOW 4
+
+#define XFER_MAX_PAYLOAD (XFER_ADDR_SIZE + XFER_MAX_DATA)
+#define XFER_MAX_FRAME   (XFER_HEADER_SIZE + XFER_MAX_PAYLOAD + XFER_CRC_SIZE)
+
+// Encode one frame into 'out' (at least XFER_HEADER_SIZE + length +
+// XFER_CRC_SIZE bytes). The payload may already be in place at
+// 'out + XFER_HEADER_SIZE' to avoid a copy. Returns the frame size.
+size_t xfer_encode(uint8_t* out, uint8_t type, uint8_t seq, const uint8_t* payload, size_t length);
+
+typedef enum {
+    xfer_decode_pending,    // Need more bytes
+    xfer_decode_frame,      // A valid frame is in 'decoder->frame'
+    xfer_decode_error,      // A frame was dropped (bad CRC)
+} xfer_decode_result_t;
+
+typedef struct {
+    uint8_t frame[XFER_MAX_FRAME];
+    size_t received;            // Bytes of 'frame' received so far
+
+    // Fields of the last valid frame (valid after xfer_decode_frame).
+    uint8_t type;
+    uint8_t seq;
+    const uint8_t* payload;
+    uint16_t length;
+
+    uint32_t crc_errors;        // Frames rejected by CRC
+} xfer_decoder_t;
+
+void xfer_decoder_init(xfer_decoder_t* decoder);
+
+// Feed one byte. Bytes outside a frame (e.g., CLI echo) are skipped. The
+// decoded frame stays valid until the next call.
+xfer_decode_result_t xfer_decode_byte(xfer_decoder_t* decoder, uint8_t byte);
+
+static inline uint16_t xfer_get_u16(const uint8_t* p) {
+    return (uint16_t) (p[0] | (p[1] << 8));
+}
+
+static inline uint32_t xfer_get_u32(const uint8_t* p) {
+    return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static inline void xfer_put_u16(uint8_t* p, uint16_t value) {
+    p[0] = (uint8_t) value;
+    p[1] = (uint8_t) (value >> 8);
+}
+
+static inline void xfer_put_u32(uint8_t* p, uint32_t value) {
+    p[0] = (uint8_t) value;
+    p[1] = (uint8_t) (value >> 8);
+    p[2] = (uint8_t) (value >> 16);
+    p[3] = (uint8_t) (value >> 24);
+}
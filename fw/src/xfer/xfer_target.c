@@ -0,0 +1,188 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#include "xfer_target.h"
+
+#include <string.h>
+
+void xfer_target_init(xfer_target_t* target, const xfer_target_ops_t* ops, void* context) {
+    memset(target, 0, sizeof(*target));
+    target->ops = ops;
+    target->context = context;
+    xfer_decoder_init(&target->decoder);
+}
+
+static void reply(xfer_target_t* target, uint8_t type, uint8_t seq, const uint8_t* payload, size_t length) {
+    const size_t size = xfer_encode(target->reply, type, seq, payload, length);
+    target->ops->send(target->context, target->reply, size);
+}
+
+static void reply_error(xfer_target_t* target, uint8_t seq, uint8_t code) {
+    reply(target, XFER_ERROR, seq, &code, 1);
+}
+
+static void reply_nak(xfer_target_t* target) {
+    // Only NAK once per gap. Frames that were already in flight when the
+    // error occurred are silently dropped until the host goes back.
+    if (!target->nak_sent) {
+        target->nak_sent = true;
+        target->stats.naks++;
+        reply(target, XFER_NAK, target->expected_seq, NULL, 0);
+    }
+}
+
+static void execute_write(xfer_target_t* target, uint8_t seq, const uint8_t* payload, uint16_t length) {
+    if (length < XFER_ADDR_SIZE) {
+        reply_error(target, seq, XFER_ERROR_BAD_REQUEST);
+        return;
+    }
+
+    const uint32_t addr = xfer_get_u32(payload);
+    const size_t count = length - XFER_ADDR_SIZE;
+    if (!target->ops->valid_range(target->context, addr, count)) {
+        reply_error(target, seq, XFER_ERROR_BAD_RANGE);
+        return;
+    }
+
+    // Write straight from the receive buffer in a single burst.
+    target->ops->write(target->context, addr, &payload[XFER_ADDR_SIZE], count);
+    target->stats.bytes_written += count;
+    reply(target, XFER_ACK, seq, NULL, 0);
+}
+
+static void execute_read(xfer_target_t* target, uint8_t seq, const uint8_t* payload, uint16_t length) {
+    if (length != XFER_ADDR_SIZE + 2) {
+        reply_error(target, seq, XFER_ERROR_BAD_REQUEST);
+        return;
+    }
+
+    const uint32_t addr = xfer_get_u32(payload);
+    const uint16_t count = xfer_get_u16(&payload[XFER_ADDR_SIZE]);
+    if (count > XFER_MAX_DATA) {
+        reply_error(target, seq, XFER_ERROR_BAD_REQUEST);
+        return;
+    }
+    if (!target->ops->valid_range(target->context, addr, count)) {
+        reply_error(target, seq, XFER_ERROR_BAD_RANGE);
+        return;
+    }
+
+    // Read directly into the reply frame's payload.
+    uint8_t* const out = &target->reply[XFER_HEADER_SIZE];
+    xfer_put_u32(out, addr);
+    target->ops->read(target->context, addr, &out[XFER_ADDR_SIZE], count);
+    target->stats.bytes_read += count;
+    reply(target, XFER_DATA, seq, out, XFER_ADDR_SIZE + count);
+}
+
+// BASIC keeps the end of the program in VARTAB, and the variable and array
+// areas start out empty immediately after it. The three pointers are
+// consecutive words in zero page (VARTAB, ARYTAB, STREND) on every ROM.
+static void execute_basic(xfer_target_t* target, uint8_t seq, const uint8_t* payload, uint16_t length) {
+    enum { POINTER_COUNT = 3 };
+
+    if (length != 3) {
+        reply_error(target, seq, XFER_ERROR_BAD_REQUEST);
+        return;
+    }
+
+    const uint8_t vartab = payload[0];
+    if (!target->ops->valid_range(target->context, vartab, POINTER_COUNT * 2)) {
+        reply_error(target, seq, XFER_ERROR_BAD_RANGE);
+        return;
+    }
+
+    uint8_t pointers[POINTER_COUNT * 2];
+    for (unsigned int i = 0; i < POINTER_COUNT; i++) {
+        pointers[i * 2] = payload[1];
+        pointers[i * 2 + 1] = payload[2];
+    }
+
+    target->ops->write(target->context, vartab, pointers, sizeof(pointers));
+    reply(target, XFER_ACK, seq, NULL, 0);
+}
+
+static void execute(xfer_target_t* target, bool repeat) {
+    const xfer_decoder_t* const d = &target->decoder;
+
+    target->stats.frames++;
+
+    switch (d->type) {
+        case XFER_WRITE:
+            execute_write(target, d->seq, d->payload, d->length);
+            break;
+        case XFER_READ:
+            execute_read(target, d->seq, d->payload, d->length);
+            break;
+        case XFER_BASIC:
+            execute_basic(target, d->seq, d->payload, d->length);
+            break;
+        case XFER_JUMP:
+            if (d->length != 2) {
+                reply_error(target, d->seq, XFER_ERROR_BAD_REQUEST);
+                break;
+            }
+            // Typing the command twice would run the program twice.
+            if (!repeat) {
+                target->ops->jump(target->context, xfer_get_u16(d->payload));
+            }
+            reply(target, XFER_ACK, d->seq, NULL, 0);
+            break;
+        case XFER_QUIT:
+            reply(target, XFER_ACK, d->seq, NULL, 0);
+            target->ops->quit(target->context);
+            break;
+        default:
+            reply_error(target, d->seq, XFER_ERROR_BAD_REQUEST);
+            break;
+    }
+}
+
+static void on_frame(xfer_target_t* target) {
+    const xfer_decoder_t* const d = &target->decoder;
+
+    if (d->type == XFER_HELLO) {
+        // Restart the sequence from the host's numbering.
+        target->expected_seq = (uint8_t) (d->seq + 1);
+        target->nak_sent = false;
+
+        uint8_t payload[4] = { XFER_VERSION, XFER_WINDOW };
+        xfer_put_u16(&payload[2], XFER_MAX_DATA);
+        reply(target, XFER_HELLO, d->seq, payload, sizeof(payload));
+        return;
+    }
+
+    if (d->seq == target->expected_seq) {
+        target->expected_seq++;
+        target->nak_sent = false;
+        execute(target, /* repeat: */ false);
+        return;
+    }
+
+    // A request the host resent because our reply was lost. Executing it
+    // again is harmless (other than XFER_JUMP, handled above).
+    const uint8_t behind = (uint8_t) (target->expected_seq - d->seq);
+    if (behind <= XFER_WINDOW) {
+        target->stats.repeats++;
+        execute(target, /* repeat: */ true);
+        return;
+    }
+
+    // A request from beyond a lost frame.
+    reply_nak(target);
+}
+
+void xfer_target_receive(xfer_target_t* target, const uint8_t* data, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        switch (xfer_decode_byte(&target->decoder, data[i])) {
+            case xfer_decode_frame:
+                on_frame(target);
+                break;
+            case xfer_decode_error:
+                reply_nak(target);
+                break;
+            case xfer_decode_pending:
+                break;
+        }
+    }
+}
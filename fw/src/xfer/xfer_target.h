@@ -0,0 +1,54 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "xfer_proto.h"
+
+// Target (PET) side of the transfer protocol. Memory access and the UART are
+// supplied by the caller so the state machine can be tested on the host.
+typedef struct {
+    // Returns true if [addr, addr + length) may be read and written.
+    bool (*valid_range)(void* context, uint32_t addr, size_t length);
+    void (*read)(void* context, uint32_t addr, uint8_t* dest, size_t length);
+    void (*write)(void* context, uint32_t addr, const uint8_t* src, size_t length);
+
+    // Transmit an encoded reply frame.
+    void (*send)(void* context, const uint8_t* data, size_t length);
+
+    // Start the uploaded program: "SYS addr", or "RUN" when 'addr' is 0.
+    void (*jump)(void* context, uint16_t addr);
+
+    // Leave transfer mode. Called after the XFER_QUIT acknowledgement is sent.
+    void (*quit)(void* context);
+} xfer_target_ops_t;
+
+typedef struct {
+    uint32_t frames;        // Requests executed (including repeats)
+    uint32_t bytes_written;
+    uint32_t bytes_read;
+    uint32_t naks;          // NAKs sent
+    uint32_t repeats;       // Requests received again after being executed
+} xfer_target_stats_t;
+
+typedef struct {
+    const xfer_target_ops_t* ops;
+    void* context;
+
+    xfer_decoder_t decoder;
+    uint8_t expected_seq;       // Sequence number of the next new request
+    bool nak_sent;              // True while waiting for the host to go back
+    xfer_target_stats_t stats;
+
+    uint8_t reply[XFER_MAX_FRAME];
+} xfer_target_t;
+
+void xfer_target_init(xfer_target_t* target, const xfer_target_ops_t* ops, void* context);
+
+// Feed bytes received from the host. Requests are executed and answered as
+// soon as their last byte arrives.
+void xfer_target_receive(xfer_target_t* target, const uint8_t* data, size_t length);
@@ -0,0 +1,149 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#include "pch.h"
+#include "boot_profile_test.h"
+
+#include "diag/boot_profile.h"
+
+static void setup(void) {
+    boot_profile_reset();
+}
+
+// Return the path field (after the second tab) of the export line for 'index'.
+static const char* path(unsigned int index) {
+    static char line[256];
+    ck_assert_int_lt(boot_profile_format(index, line, sizeof(line)), (int) sizeof(line));
+
+    const char* tab = strchr(line, '\t');
+    ck_assert_ptr_nonnull(tab);
+    tab = strchr(tab + 1, '\t');
+    ck_assert_ptr_nonnull(tab);
+    return tab + 1;
+}
+
+START_TEST(test_nested_phases) {
+    boot_phase_begin("menu_enter()", NULL);
+    boot_phase_begin("config:apply", NULL);
+    boot_phase_begin("load", "/roms/basic-4.bin");
+    boot_phase_end();
+    boot_phase_begin("load", "/roms/kernal-4.bin");
+    boot_phase_end();
+    boot_phase_end();
+    boot_phase_end();
+    boot_phase_begin("usb_init()", NULL);
+    boot_phase_end();
+
+    ck_assert_uint_eq(boot_profile_count(), 5);
+    ck_assert_str_eq(path(0), "menu_enter()");
+    ck_assert_str_eq(path(1), "menu_enter()/config:apply");
+    ck_assert_str_eq(path(2), "menu_enter()/config:apply/load[/roms/basic-4.bin]");
+    ck_assert_str_eq(path(3), "menu_enter()/config:apply/load[/roms/kernal-4.bin]");
+    ck_assert_str_eq(path(4), "usb_init()");
+
+    // Children fall within their parent.
+    const boot_phase_t* const outer = boot_profile_get(1);
+    const boot_phase_t* const inner = boot_profile_get(3);
+    ck_assert_uint_eq(inner->depth, 2);
+    ck_assert_uint_le(outer->start_us, inner->start_us);
+    ck_assert_uint_ge(outer->end_us, inner->end_us);
+    ck_assert_ptr_null(boot_profile_get(5));
+}
+END_TEST
+
+START_TEST(test_add) {
+    // A phase that ran elsewhere (e.g., on core1) is nested where it is added.
+    boot_phase_begin("fpga_init()", NULL);
+    boot_phase_add("sd_card_init()", "core1", 1000, 1500);
+    boot_phase_end();
+
+    ck_assert_uint_eq(boot_profile_count(), 2);
+    ck_assert_str_eq(path(1), "fpga_init()/sd_card_init()[core1]");
+    ck_assert_uint_eq(boot_profile_get(1)->start_us, 1000);
+    ck_assert_uint_eq(boot_profile_get(1)->end_us, 1500);
+    ck_assert_uint_ne(boot_profile_get(0)->end_us, 0);
+}
+END_TEST
+
+START_TEST(test_format) {
+    boot_phase_begin("fpga_init()", NULL);
+    boot_phase_begin("bitstream", "flash");
+
+    // An open phase has no duration.
+    char line[128];
+    boot_profile_format(1, line, sizeof(line));
+    unsigned long long start;
+    long long duration;
+    char name[64];
+    ck_assert_int_eq(sscanf(line, "%llu\t%lld\t%63s", &start, &duration, name), 3);
+    ck_assert_int_eq(duration, -1);
+    ck_assert_str_eq(name, "fpga_init()/bitstream[flash]");
+
+    boot_phase_end();
+    boot_profile_format(1, line, sizeof(line));
+    ck_assert_int_eq(sscanf(line, "%llu\t%lld\t%63s", &start, &duration, name), 3);
+    ck_assert_int_ge(duration, 0);
+    ck_assert_uint_eq(start, boot_profile_get(1)->start_us);
+
+    // Truncated output still reports the full length.
+    const int length = boot_profile_format(1, line, sizeof(line));
+    char small[8];
+    ck_assert_int_eq(boot_profile_format(1, small, sizeof(small)), length);
+    ck_assert_uint_eq(strlen(small), sizeof(small) - 1);
+}
+END_TEST
+
+START_TEST(test_dropped) {
+    // Phases nested too deeply are dropped, but still pair with their ends.
+    for (int i = 0; i < BOOT_PROFILE_MAX_DEPTH + 2; i++) {
+        boot_phase_begin("nested", NULL);
+    }
+    for (int i = 0; i < BOOT_PROFILE_MAX_DEPTH + 2; i++) {
+        boot_phase_end();
+    }
+    ck_assert_uint_eq(boot_profile_count(), BOOT_PROFILE_MAX_DEPTH);
+    ck_assert_uint_eq(boot_profile_dropped(), 2);
+    for (unsigned int i = 0; i < boot_profile_count(); i++) {
+        ck_assert_uint_ne(boot_profile_get(i)->end_us, 0);
+    }
+
+    // So are phases past the end of the table.
+    boot_profile_reset();
+    for (int i = 0; i < BOOT_PROFILE_PHASES + 3; i++) {
+        boot_phase_begin("load", NULL);
+        boot_phase_end();
+    }
+    ck_assert_uint_eq(boot_profile_count(), BOOT_PROFILE_PHASES);
+    ck_assert_uint_eq(boot_profile_dropped(), 3);
+}
+END_TEST
+
+START_TEST(test_finish) {
+    ck_assert_uint_eq(boot_profile_ready_us(), 0);
+    boot_phase_begin("menu_enter()", NULL);
+    boot_phase_end();
+    boot_profile_finish();
+    ck_assert_uint_ge(boot_profile_ready_us(), boot_profile_get(0)->end_us);
+
+    // Nothing is recorded after the PET is running (e.g., when the menu is
+    // entered again).
+    boot_phase_begin("config:apply", NULL);
+    boot_phase_end();
+    ck_assert_uint_eq(boot_profile_count(), 1);
+}
+END_TEST
+
+Suite *boot_profile_suite(void) {
+    Suite* s = suite_create("boot_profile");
+    TCase* tc = tcase_create("boot_profile");
+
+    tcase_add_checked_fixture(tc, setup, NULL);
+    tcase_add_test(tc, test_nested_phases);
+    tcase_add_test(tc, test_add);
+    tcase_add_test(tc, test_format);
+    tcase_add_test(tc, test_dropped);
+    tcase_add_test(tc, test_finish);
+
+    suite_add_tcase(s, tc);
+    return s;
+}
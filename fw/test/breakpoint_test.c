@@ -134,6 +134,20 @@ START_TEST(test_bp_remove_restores_sram) {
     ck_assert_uint_eq(mock_ram[0x0400], 0xA9);
 } END_TEST
 
+START_TEST(test_bp_rearm_after_sram_replaced) {
+    mock_reset();
+    mock_ram[0x0400] = 0xA9;
+    bp_set(0x0400, default_callback, NULL);
+
+    // SRAM is replaced (e.g., by a snapshot) with a different original byte.
+    mock_ram[0x0400] = 0x4C;
+    bp_rearm();
+    ck_assert_uint_eq(mock_ram[0x0400], 0xDB);
+
+    ck_assert(bp_remove(0x0400));
+    ck_assert_uint_eq(mock_ram[0x0400], 0x4C);
+} END_TEST
+
 START_TEST(test_bp_remove_nonexistent_fails) {
     mock_reset();
     ck_assert(!bp_remove(0x0400));
@@ -389,6 +403,7 @@ Suite *breakpoint_suite(void) {
     tcase_add_test(tc, test_bp_init_clears_table);
     tcase_add_test(tc, test_bp_set_patches_sram);
     tcase_add_test(tc, test_bp_remove_restores_sram);
+    tcase_add_test(tc, test_bp_rearm_after_sram_replaced);
     tcase_add_test(tc, test_bp_remove_nonexistent_fails);
     tcase_add_test(tc, test_bp_remove_compacts_table);
     tcase_add_test(tc, test_bp_task_restores_and_rearms);
@@ -0,0 +1,140 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#include "pch.h"
+#include "byte_ring_test.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "uart/byte_ring.h"
+
+#define CAPACITY 16
+
+static uint8_t storage[CAPACITY];
+static byte_ring_t ring;
+
+static void setup(void) {
+    memset(storage, 0, sizeof(storage));
+    byte_ring_init(&ring, storage, CAPACITY);
+}
+
+START_TEST(test_empty) {
+    ck_assert_uint_eq(byte_ring_used(&ring), 0);
+    ck_assert_uint_eq(byte_ring_free(&ring), CAPACITY);
+    ck_assert_int_eq(byte_ring_get(&ring), EOF);
+
+    const uint8_t* span;
+    ck_assert_uint_eq(byte_ring_peek_span(&ring, &span), 0);
+}
+
+START_TEST(test_put_get_order) {
+    for (int i = 0; i < 5; i++) {
+        ck_assert(byte_ring_put(&ring, (uint8_t) (0xA0 + i)));
+    }
+    ck_assert_uint_eq(byte_ring_used(&ring), 5);
+
+    for (int i = 0; i < 5; i++) {
+        ck_assert_int_eq(byte_ring_get(&ring), 0xA0 + i);
+    }
+    ck_assert_int_eq(byte_ring_get(&ring), EOF);
+}
+
+START_TEST(test_full_capacity_usable) {
+    // Free-running counters mean no slot is sacrificed to distinguish full
+    // from empty.
+    for (int i = 0; i < CAPACITY; i++) {
+        ck_assert(byte_ring_put(&ring, (uint8_t) i));
+    }
+    ck_assert_uint_eq(byte_ring_free(&ring), 0);
+    ck_assert(!byte_ring_put(&ring, 0xFF));
+}
+
+START_TEST(test_partial_write_when_full) {
+    uint8_t src[CAPACITY + 4];
+    for (size_t i = 0; i < sizeof(src); i++) {
+        src[i] = (uint8_t) i;
+    }
+
+    ck_assert_uint_eq(byte_ring_write(&ring, src, 10), 10);
+    ck_assert_uint_eq(byte_ring_write(&ring, src + 10, 10), CAPACITY - 10);
+    ck_assert_uint_eq(byte_ring_write(&ring, src, 1), 0);
+
+    uint8_t dest[CAPACITY];
+    ck_assert_uint_eq(byte_ring_read(&ring, dest, sizeof(dest) + 8), CAPACITY);
+    ck_assert_mem_eq(dest, src, CAPACITY);
+}
+
+START_TEST(test_wraparound_write_read) {
+    uint8_t src[12];
+    uint8_t dest[12];
+
+    // Advance the indices so the next write straddles the end of storage.
+    for (int round = 0; round < 10; round++) {
+        for (size_t i = 0; i < sizeof(src); i++) {
+            src[i] = (uint8_t) (round * 16 + i);
+        }
+
+        ck_assert_uint_eq(byte_ring_write(&ring, src, sizeof(src)), sizeof(src));
+        ck_assert_uint_eq(byte_ring_read(&ring, dest, sizeof(dest)), sizeof(dest));
+        ck_assert_mem_eq(dest, src, sizeof(src));
+    }
+}
+
+START_TEST(test_peek_span_stops_at_end_of_storage) {
+    uint8_t src[CAPACITY];
+    for (size_t i = 0; i < sizeof(src); i++) {
+        src[i] = (uint8_t) i;
+    }
+
+    // Leave the tail 4 bytes before the end of storage, then queue 8 bytes.
+    byte_ring_write(&ring, src, 12);
+    byte_ring_consume(&ring, 12);
+    byte_ring_write(&ring, src, 8);
+
+    const uint8_t* span;
+    ck_assert_uint_eq(byte_ring_peek_span(&ring, &span), 4);
+    ck_assert_ptr_eq(span, &storage[12]);
+    ck_assert_mem_eq(span, src, 4);
+
+    // Consuming the first span exposes the wrapped remainder.
+    byte_ring_consume(&ring, 4);
+    ck_assert_uint_eq(byte_ring_peek_span(&ring, &span), 4);
+    ck_assert_ptr_eq(span, &storage[0]);
+    ck_assert_mem_eq(span, src + 4, 4);
+
+    byte_ring_consume(&ring, 4);
+    ck_assert_uint_eq(byte_ring_used(&ring), 0);
+}
+
+START_TEST(test_counter_overflow) {
+    // The free-running counters wrap at 2^32. Start just below the wrap
+    // point to verify the unsigned arithmetic still reports correct sizes.
+    ring.head = ring.tail = UINT32_MAX - 2;
+
+    const uint8_t src[6] = { 1, 2, 3, 4, 5, 6 };
+    ck_assert_uint_eq(byte_ring_write(&ring, src, sizeof(src)), sizeof(src));
+    ck_assert_uint_eq(byte_ring_used(&ring), sizeof(src));
+
+    uint8_t dest[6];
+    ck_assert_uint_eq(byte_ring_read(&ring, dest, sizeof(dest)), sizeof(dest));
+    ck_assert_mem_eq(dest, src, sizeof(src));
+    ck_assert_uint_eq(byte_ring_used(&ring), 0);
+}
+
+Suite *byte_ring_suite(void) {
+    Suite* s = suite_create("byte_ring");
+    TCase* tc = tcase_create("ring");
+
+    tcase_add_checked_fixture(tc, setup, NULL);
+    tcase_add_test(tc, test_empty);
+    tcase_add_test(tc, test_put_get_order);
+    tcase_add_test(tc, test_full_capacity_usable);
+    tcase_add_test(tc, test_partial_write_when_full);
+    tcase_add_test(tc, test_wraparound_write_read);
+    tcase_add_test(tc, test_peek_span_stops_at_end_of_storage);
+    tcase_add_test(tc, test_counter_overflow);
+
+    suite_add_tcase(s, tc);
+    return s;
+}
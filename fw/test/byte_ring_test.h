@@ -0,0 +1,8 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#pragma once
+
+#include <check.h>
+
+Suite *byte_ring_suite(void);
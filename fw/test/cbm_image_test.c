@@ -0,0 +1,316 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#include "pch.h"
+#include "cbm_image_test.h"
+
+#include <string.h>
+
+#include "cbm/image.h"
+#include "cbm/petscii.h"
+
+#define D64_SIZE 174848
+#define T64_DATA 0xC0               // Header + 4 directory slots
+
+static uint8_t disk[D64_SIZE];
+static uint32_t disk_size;
+static unsigned int reads;
+static uint32_t bytes_read;
+
+static cbm_image_t image;
+
+static uint8_t received[0x10000];
+static size_t expected_offset;
+
+static bool read_disk(void* context, uint32_t offset, uint8_t* buffer, size_t length) {
+    (void) context;
+    if (offset > disk_size || length > disk_size - offset) {
+        return false;
+    }
+    memcpy(buffer, &disk[offset], length);
+    reads++;
+    bytes_read += (uint32_t) length;
+    return true;
+}
+
+static void receive(void* context, size_t offset, const uint8_t* data, size_t length) {
+    (void) context;
+    ck_assert_uint_eq(offset, expected_offset);
+    memcpy(&received[offset], data, length);
+    expected_offset += length;
+}
+
+static uint8_t* sector_at(uint8_t track, uint8_t sector) {
+    // Only tracks 1-24 are used below.
+    uint32_t index = sector;
+    for (uint8_t t = 1; t < track; t++) {
+        index += t <= 17 ? 21 : 19;
+    }
+    return &disk[index * 256];
+}
+
+static void put_name(uint8_t* dest, const char* name) {
+    memset(dest, 0xA0, 16);
+    for (size_t i = 0; name[i] != '\0'; i++) {
+        dest[i] = ascii_to_petscii((uint8_t) name[i], /* fold_case: */ true);
+    }
+}
+
+static void put_dir_entry(uint8_t* entry, uint8_t type, uint8_t track, uint8_t sector, const char* name, uint16_t blocks) {
+    entry[2] = type;
+    entry[3] = track;
+    entry[4] = sector;
+    put_name(&entry[5], name);
+    entry[30] = (uint8_t) blocks;
+    entry[31] = (uint8_t) (blocks >> 8);
+}
+
+// Fill a file's data: the load address followed by a counting pattern.
+static uint8_t file_byte(size_t offset, uint16_t load_addr) {
+    if (offset == 0) return (uint8_t) load_addr;
+    if (offset == 1) return (uint8_t) (load_addr >> 8);
+    return (uint8_t) (offset * 7);
+}
+
+static void build_d64(void) {
+    memset(disk, 0, sizeof(disk));
+    disk_size = D64_SIZE;
+
+    uint8_t* const bam = sector_at(18, 0);
+    bam[0] = 18;
+    bam[1] = 1;
+    bam[4 * 1] = 10;
+    bam[4 * 2] = 5;
+    bam[4 * 18] = 17;               // The directory track is not counted
+    put_name(&bam[0x90], "test disk");
+
+    uint8_t* const dir = sector_at(18, 1);
+    dir[0] = 0;
+    dir[1] = 0xFF;
+    put_dir_entry(&dir[0 * 32], 0x82, 17, 0, "hello", 2);
+    put_dir_entry(&dir[1 * 32], 0x81, 17, 5, "seqfile", 1);     // SEQ
+    put_dir_entry(&dir[2 * 32], 0x00, 17, 6, "scratched", 1);   // Deleted
+    put_dir_entry(&dir[3 * 32], 0x02, 17, 7, "splat", 1);       // Not closed
+    put_dir_entry(&dir[4 * 32], 0xC2, 17, 2, "hello2", 1);      // Locked PRG
+    put_dir_entry(&dir[5 * 32], 0x82, 19, 0, "loop", 1);
+
+    // "hello": 254 bytes in 17/0, then 64 bytes in 17/1 (320 bytes total).
+    uint8_t* s = sector_at(17, 0);
+    s[0] = 17;
+    s[1] = 1;
+    for (size_t i = 0; i < 254; i++) s[2 + i] = file_byte(i, 0x0401);
+    s = sector_at(17, 1);
+    s[0] = 0;
+    s[1] = 65;
+    for (size_t i = 0; i < 64; i++) s[2 + i] = file_byte(254 + i, 0x0401);
+
+    // "hello2": 10 bytes in 17/2.
+    s = sector_at(17, 2);
+    s[0] = 0;
+    s[1] = 11;
+    for (size_t i = 0; i < 10; i++) s[2 + i] = file_byte(i, 0x1000);
+
+    // "loop": a chain that links back to itself.
+    s = sector_at(19, 0);
+    s[0] = 19;
+    s[1] = 0;
+}
+
+static void setup(void) {
+    build_d64();
+    reads = 0;
+    bytes_read = 0;
+    expected_offset = 0;
+    memset(received, 0, sizeof(received));
+}
+
+static uint8_t to_pattern(const char* text, uint8_t* out) {
+    uint8_t len = 0;
+    for (; text[len] != '\0'; len++) {
+        out[len] = ascii_to_petscii((uint8_t) text[len], /* fold_case: */ true);
+    }
+    return len;
+}
+
+static const cbm_image_file_t* find(const char* text) {
+    uint8_t pattern[32];
+    const uint8_t len = to_pattern(text, pattern);
+    return cbm_image_find(&image, pattern, len);
+}
+
+START_TEST(test_format_from_name) {
+    cbm_image_format_t format;
+    ck_assert(cbm_image_format_from_name("games.d64", &format));
+    ck_assert_int_eq(format, cbm_image_d64);
+    ck_assert(cbm_image_format_from_name("GAMES.T64", &format));
+    ck_assert_int_eq(format, cbm_image_t64);
+    ck_assert(!cbm_image_format_from_name("games.prg", &format));
+    ck_assert(!cbm_image_format_from_name(".d64", &format));
+    ck_assert(!cbm_image_format_from_name("d64", &format));
+}
+
+START_TEST(test_d64_directory) {
+    ck_assert(cbm_image_open(&image, cbm_image_d64, disk_size, read_disk, NULL));
+
+    // Only the BAM and the one directory sector are read.
+    ck_assert_uint_eq(reads, 2);
+
+    ck_assert_uint_eq(image.tracks, 35);
+    ck_assert_uint_eq(image.name_len, 9);
+    ck_assert_uint_eq(image.free_blocks, 15);
+    ck_assert(image.complete);
+
+    // Only closed PRG files are kept, in directory order.
+    ck_assert_uint_eq(image.count, 3);
+    ck_assert_uint_eq(image.files[0].name_len, 5);
+    ck_assert_uint_eq(image.files[0].blocks, 2);
+    ck_assert_uint_eq(image.files[0].start, (17 << 8) | 0);
+    ck_assert_uint_eq(image.files[1].name_len, 6);
+    ck_assert_uint_eq(image.files[2].start, (19 << 8) | 0);
+}
+
+START_TEST(test_d64_rejects_bad_size) {
+    ck_assert(!cbm_image_open(&image, cbm_image_d64, D64_SIZE - 1, read_disk, NULL));
+}
+
+START_TEST(test_d64_find) {
+    ck_assert(cbm_image_open(&image, cbm_image_d64, disk_size, read_disk, NULL));
+
+    ck_assert_ptr_eq(find("hello"), &image.files[0]);
+    ck_assert_ptr_eq(find("hello2"), &image.files[1]);
+    ck_assert_ptr_eq(find("hel*"), &image.files[0]);     // First in directory order
+    ck_assert_ptr_null(find("hell"));
+    ck_assert_ptr_null(find("seqfile"));
+    ck_assert_ptr_null(find("*"));
+
+    // Shifted letters match their unshifted form.
+    uint8_t pattern[] = { 0xC8, 0xC5, 0xCC, 0xCC, 0xCF };
+    ck_assert_ptr_eq(cbm_image_find(&image, pattern, sizeof(pattern)), &image.files[0]);
+}
+
+START_TEST(test_d64_read_file) {
+    ck_assert(cbm_image_open(&image, cbm_image_d64, disk_size, read_disk, NULL));
+    reads = 0;
+
+    size_t bytes;
+    ck_assert(cbm_image_read_file(&image, find("hello"), receive, NULL, sizeof(received), &bytes));
+    ck_assert_uint_eq(bytes, 254 + 64);
+    ck_assert_uint_eq(reads, 2);            // One read per sector in the chain
+    for (size_t i = 0; i < bytes; i++) {
+        ck_assert_uint_eq(received[i], file_byte(i, 0x0401));
+    }
+}
+
+START_TEST(test_d64_read_file_limit) {
+    ck_assert(cbm_image_open(&image, cbm_image_d64, disk_size, read_disk, NULL));
+    reads = 0;
+
+    size_t bytes;
+    ck_assert(cbm_image_read_file(&image, find("hello"), receive, NULL, 100, &bytes));
+    ck_assert_uint_eq(bytes, 100);
+    ck_assert_uint_eq(reads, 1);
+}
+
+START_TEST(test_d64_broken_chain) {
+    ck_assert(cbm_image_open(&image, cbm_image_d64, disk_size, read_disk, NULL));
+
+    size_t bytes;
+    ck_assert(!cbm_image_read_file(&image, find("loop"), receive, NULL, sizeof(received), &bytes));
+}
+
+// T64 with a bogus end address on the first file, a free slot, and 5 bytes
+// of trailing garbage after the second file.
+static void build_t64(void) {
+    memset(disk, 0, sizeof(disk));
+    memcpy(disk, "C64S tape image file", 20);
+    disk[0x22] = 4;                 // Max entries
+    disk[0x24] = 2;                 // Used entries
+    memset(&disk[0x28], ' ', 24);
+    memcpy(&disk[0x28], "MY TAPE", 7);
+
+    uint8_t* entry = &disk[0x40];
+    entry[0] = 1;
+    entry[1] = 0x82;
+    entry[2] = 0x01; entry[3] = 0x04;   // $0401
+    entry[4] = 0xC6; entry[5] = 0xC3;   // $C3C6 (wrong)
+    entry[8] = T64_DATA;
+    memset(&entry[16], ' ', 16);
+    memcpy(&entry[16], "FIRST", 5);
+
+    entry = &disk[0x60];
+    entry[0] = 1;
+    entry[1] = 0x82;
+    entry[2] = 0x00; entry[3] = 0x10;   // $1000
+    entry[4] = 0x10; entry[5] = 0x10;   // $1010
+    entry[8] = (uint8_t) (T64_DATA + 300);
+    entry[9] = (uint8_t) ((T64_DATA + 300) >> 8);
+    memset(&entry[16], 0xA0, 16);
+    memcpy(&entry[16], "SECOND", 6);
+
+    for (size_t i = 0; i < 300; i++) disk[T64_DATA + i] = file_byte(i + 2, 0x0401);
+    for (size_t i = 0; i < 21; i++) disk[T64_DATA + 300 + i] = file_byte(i + 2, 0x1000);
+    disk_size = T64_DATA + 300 + 21;
+}
+
+START_TEST(test_t64_directory) {
+    build_t64();
+    ck_assert(cbm_image_open(&image, cbm_image_t64, disk_size, read_disk, NULL));
+
+    ck_assert_uint_eq(image.name_len, 7);
+    ck_assert_uint_eq(image.free_blocks, 0);
+    ck_assert_uint_eq(image.count, 2);
+
+    // The bogus end address is limited by the next file's data.
+    ck_assert_uint_eq(image.files[0].size, 300);
+    ck_assert_uint_eq(image.files[0].blocks, 2);
+    ck_assert_uint_eq(image.files[0].load_addr, 0x0401);
+
+    // The declared size is used when it fits.
+    ck_assert_uint_eq(image.files[1].name_len, 6);
+    ck_assert_uint_eq(image.files[1].size, 16);
+    ck_assert_uint_eq(image.files[1].blocks, 1);
+}
+
+START_TEST(test_t64_read_file) {
+    build_t64();
+    ck_assert(cbm_image_open(&image, cbm_image_t64, disk_size, read_disk, NULL));
+
+    size_t bytes;
+    ck_assert(cbm_image_read_file(&image, find("first"), receive, NULL, sizeof(received), &bytes));
+    ck_assert_uint_eq(bytes, 302);
+    for (size_t i = 0; i < bytes; i++) {
+        ck_assert_uint_eq(received[i], file_byte(i, 0x0401));
+    }
+
+    expected_offset = 0;
+    ck_assert(cbm_image_read_file(&image, find("sec*"), receive, NULL, sizeof(received), &bytes));
+    ck_assert_uint_eq(bytes, 18);
+    ck_assert_uint_eq(received[0], 0x00);
+    ck_assert_uint_eq(received[1], 0x10);
+}
+
+START_TEST(test_t64_rejects_bad_signature) {
+    build_t64();
+    disk[0] = 'X';
+    ck_assert(!cbm_image_open(&image, cbm_image_t64, disk_size, read_disk, NULL));
+}
+
+Suite *cbm_image_suite(void) {
+    Suite* s = suite_create("cbm_image");
+    TCase* tc = tcase_create("image");
+
+    tcase_add_checked_fixture(tc, setup, NULL);
+    tcase_add_test(tc, test_format_from_name);
+    tcase_add_test(tc, test_d64_directory);
+    tcase_add_test(tc, test_d64_rejects_bad_size);
+    tcase_add_test(tc, test_d64_find);
+    tcase_add_test(tc, test_d64_read_file);
+    tcase_add_test(tc, test_d64_read_file_limit);
+    tcase_add_test(tc, test_d64_broken_chain);
+    tcase_add_test(tc, test_t64_directory);
+    tcase_add_test(tc, test_t64_read_file);
+    tcase_add_test(tc, test_t64_rejects_bad_signature);
+
+    suite_add_tcase(s, tc);
+    return s;
+}
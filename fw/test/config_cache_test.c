@@ -0,0 +1,451 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#include "pch.h"
+#include "config_cache_test.h"
+
+
+#include "config/config.h"
+#include "config/config_cache.h"
+#include "mock.h"
+
+// Every callback is appended to 'trace' as a line of text, so a replay can be
+// compared against a parse of the same YAML.
+static char trace[16384];
+static size_t trace_length;
+static system_state_t sys_state;
+
+static void record(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    const int n = vsnprintf(&trace[trace_length], sizeof(trace) - trace_length, format, args);
+    va_end(args);
+
+    ck_assert_int_gt(n, 0);
+    ck_assert_uint_lt(trace_length + (size_t) n, sizeof(trace));
+    trace_length += (size_t) n;
+}
+
+static void on_enter_config(void* context) {
+    (void)context;
+    record("enter\n");
+}
+
+static void on_exit_config(void* context, const char* id, const char* name) {
+    (void)context;
+    record("exit %s '%s'\n", id, name);
+}
+
+static void on_default(void* context, const char* id) {
+    (void)context;
+    record("default %s\n", id);
+}
+
+static void on_search_order(void* context, const char* order) {
+    (void)context;
+    record("search-order %s\n", order);
+}
+
+static void on_load(void* context, const char* filename, uint32_t address, const uint32_t* crc) {
+    (void)context;
+    record("load %s $%04X", filename, address);
+    if (crc != NULL) {
+        record(" crc %08X", *crc);
+    }
+    record("\n");
+}
+
+static void on_patch(void* context, uint32_t address, const binary_t* binary) {
+    (void)context;
+    record("patch $%04X", address);
+    for (size_t i = 0; i < binary->size; i++) {
+        record(" %02X", binary->data[i]);
+    }
+    record("\n");
+}
+
+static void on_copy(void* context, uint32_t source, uint32_t destination, uint32_t length) {
+    (void)context;
+    record("copy $%04X $%04X %u\n", source, destination, length);
+}
+
+static void on_set_options(void* context, options_t* options) {
+    (void)context;
+    record("set %u %u '%s' %d %d %d %d\n", options->columns, options->video_ram_mask, options->usb_keymap,
+        options->tape_enabled, options->tape_save_enabled, options->key_buffer_enabled, options->ieee_enabled);
+}
+
+static void on_fix_checksum(void* context, uint32_t start_addr, uint32_t end_addr, uint32_t fix_addr,
+                            uint32_t checksum) {
+    (void)context;
+    record("fix-checksum $%04X $%04X $%04X $%02X\n", start_addr, end_addr, fix_addr, checksum);
+}
+
+static const setup_sink_t setup_sink = {
+    .context = NULL,
+    .on_load = on_load,
+    .on_patch = on_patch,
+    .on_copy = on_copy,
+    .on_set_options = on_set_options,
+    .on_fix_checksum = on_fix_checksum,
+    .system_state = &sys_state,
+};
+
+// The compiled file places 'default' and 'search-order' first, so the YAML
+// in these tests does too.
+static const config_sink_t sink = {
+    .context = NULL,
+    .on_enter_config = on_enter_config,
+    .on_exit_config = on_exit_config,
+    .on_default = on_default,
+    .on_search_order = on_search_order,
+    .setup = &setup_sink,
+};
+
+static const config_cache_key_t key = { .size = 1234, .mtime = 0x5A2B6000 };
+
+static const char yaml[] =
+    "default: second\n"
+    "search-order: \"sd\"\n"
+    "configs:\n"
+    "  - id: first\n"
+    "    name: First\n"
+    "    setup:\n"
+    "      - action: load\n"
+    "        files:\n"
+    "          - file: roms/basic.bin\n"
+    "            address: 0xB000\n"
+    "          - file: roms/kernal.bin\n"
+    "            address: 0xF000\n"
+    "            crc: 0x8A4D2EBE\n"
+    "      - action: patch\n"
+    "        address: 0xE000\n"
+    "        hex: 0102A9FF\n"
+    "      - action: set\n"
+    "        columns: 80\n"
+    "        video-ram-kb: 2\n"
+    "        usb-keymap: ukm/us.bin\n"
+    "  - id: second\n"
+    "    name: Second\n"
+    "    setup:\n"
+    "      - if: graphics\n"
+    "        then:\n"
+    "          - action: copy\n"
+    "            source: 0x1000\n"
+    "            destination: 0x2000\n"
+    "            length: 256\n"
+    "          - if: graphics\n"
+    "            then:\n"
+    "              - action: patch\n"
+    "                address: 0x3000\n"
+    "                hex: EA\n"
+    "        else:\n"
+    "          - action: fix-checksum\n"
+    "            start-addr: 0xC000\n"
+    "            end-addr: 0xE000\n"
+    "            fix-addr: 0xE001\n"
+    "            checksum: 0x42\n"
+    "      - action: set\n"
+    "        columns: 40\n";
+
+static void setup(void) {
+    mock_clear_files();
+    trace_length = 0;
+    trace[0] = '\0';
+    sys_state.pet_keyboard_model = pet_keyboard_model_graphics;
+    sys_state.pet_video_type = pet_video_type_crtc;
+}
+
+static void teardown(void) {
+    mock_clear_files();
+}
+
+// Compile /config.yaml into a temporary file, invoking 'sink' for 'target_index'
+// as a side effect.
+static FILE* compile(int target_index) {
+    FILE* file = tmpfile();
+    ck_assert_ptr_nonnull(file);
+
+    config_cache_writer_t writer;
+    config_cache_write_begin(&writer, file);
+    parse_config_file_compiled("/config.yaml", &sink, target_index, &writer);
+    ck_assert(config_cache_write_end(&writer, &key));
+    return file;
+}
+
+// Return the trace of parsing /config.yaml.
+static char* parse_trace(int target_index) {
+    trace_length = 0;
+    trace[0] = '\0';
+    parse_config_file("/config.yaml", &sink, target_index);
+    return strdup(trace);
+}
+
+// Return the trace of replaying 'file'.
+static char* replay_trace(FILE* file, int target_index) {
+    trace_length = 0;
+    trace[0] = '\0';
+    ck_assert(config_cache_replay(file, &key, &sink, target_index, NULL));
+    return strdup(trace);
+}
+
+// Check that replaying 'file' matches parsing for every config (and the
+// listing) with both keyboard models.
+static void check_replay_matches_parse(FILE* file, int config_count) {
+    const pet_keyboard_model_t models[] = { pet_keyboard_model_graphics, pet_keyboard_model_business };
+
+    for (size_t m = 0; m < sizeof(models) / sizeof(models[0]); m++) {
+        sys_state.pet_keyboard_model = models[m];
+
+        for (int i = -1; i < config_count; i++) {
+            char* expected = parse_trace(i);
+            char* actual = replay_trace(file, i);
+            ck_assert_str_eq(actual, expected);
+            free(expected);
+            free(actual);
+        }
+    }
+}
+
+START_TEST(test_replay_matches_parse) {
+    mock_register_file("/config.yaml", yaml);
+
+    FILE* file = compile(-1);
+    check_replay_matches_parse(file, 2);
+    fclose(file);
+}
+END_TEST
+
+START_TEST(test_compile_while_executing) {
+    mock_register_file("/config.yaml", yaml);
+
+    // Compiling while applying a config invokes the same callbacks as a parse,
+    // including only the branch that applies.
+    sys_state.pet_keyboard_model = pet_keyboard_model_business;
+    char* expected = parse_trace(1);
+
+    trace_length = 0;
+    FILE* file = compile(1);
+    ck_assert_str_eq(trace, expected);
+    ck_assert_ptr_null(strstr(trace, "copy"));
+    ck_assert_ptr_nonnull(strstr(trace, "fix-checksum"));
+    free(expected);
+
+    // Both branches were compiled.
+    sys_state.pet_keyboard_model = pet_keyboard_model_graphics;
+    char* actual = replay_trace(file, 1);
+    ck_assert_ptr_nonnull(strstr(actual, "copy $1000 $2000 256"));
+    ck_assert_ptr_nonnull(strstr(actual, "patch $3000 EA"));
+    ck_assert_ptr_null(strstr(actual, "fix-checksum"));
+    free(actual);
+    fclose(file);
+}
+END_TEST
+
+// Check that running each config from the index matches parsing it, after a
+// single pass over the file to list the configs and index them.
+static void check_run_matches_parse(FILE* file, int config_count) {
+    config_cache_index_t index;
+    trace_length = 0;
+    trace[0] = '\0';
+    ck_assert(config_cache_replay(file, &key, &sink, -1, &index));
+    ck_assert_uint_eq(index.count, (uint32_t) config_count);
+
+    const pet_keyboard_model_t models[] = { pet_keyboard_model_graphics, pet_keyboard_model_business };
+    for (size_t m = 0; m < sizeof(models) / sizeof(models[0]); m++) {
+        sys_state.pet_keyboard_model = models[m];
+
+        for (int i = 0; i < config_count; i++) {
+            // Only the setup actions are run, so compare against a parse
+            // without the listing callbacks.
+            const config_sink_t setup_only = { .setup = &setup_sink };
+            trace_length = 0;
+            trace[0] = '\0';
+            parse_config_file("/config.yaml", &setup_only, i);
+            char* expected = strdup(trace);
+
+            trace_length = 0;
+            trace[0] = '\0';
+            ck_assert(config_cache_run(file, &index, i, &setup_sink));
+            ck_assert_str_eq(trace, expected);
+            free(expected);
+        }
+    }
+
+    ck_assert(!config_cache_run(file, &index, config_count, &setup_sink));
+    ck_assert(!config_cache_run(file, &index, -1, &setup_sink));
+}
+
+START_TEST(test_run_indexed) {
+    mock_register_file("/config.yaml", yaml);
+
+    FILE* file = compile(-1);
+    check_run_matches_parse(file, 2);
+
+    // Indexing alone invokes no callbacks.
+    config_cache_index_t index;
+    trace_length = 0;
+    trace[0] = '\0';
+    ck_assert(config_cache_replay(file, &key, NULL, -1, &index));
+    ck_assert_str_eq(trace, "");
+    ck_assert_uint_eq(index.count, 2);
+    fclose(file);
+}
+END_TEST
+
+// A read error once the selected config's actions have started is fatal,
+// since falling back to the YAML would run them twice.
+START_TEST(test_run_read_error) {
+    mock_register_file("/config.yaml", yaml);
+    FILE* file = compile(-1);
+
+    config_cache_index_t index;
+    ck_assert(config_cache_replay(file, &key, NULL, -1, &index));
+    ck_assert_uint_gt(index.count, 0);
+
+    // The same file, cut short in the middle of the first config's actions.
+    const config_cache_range_t* const range = &index.configs[0];
+    const size_t size = range->offset + range->length - 1;
+    uint8_t* contents = malloc(size);
+    rewind(file);
+    ck_assert_uint_eq(fread(contents, 1, size, file), size);
+    fclose(file);
+    file = tmpfile();
+    fwrite(contents, 1, size, file);
+    free(contents);
+
+    config_cache_run(file, &index, 0, &setup_sink);
+}
+END_TEST
+
+START_TEST(test_replay_stale) {
+    mock_register_file("/config.yaml", yaml);
+    FILE* file = compile(-1);
+
+    trace_length = 0;
+    trace[0] = '\0';
+    const config_cache_key_t changed = { .size = key.size, .mtime = key.mtime + 1 };
+    ck_assert(!config_cache_replay(file, &changed, &sink, 0, NULL));
+    ck_assert_str_eq(trace, "");
+    fclose(file);
+}
+END_TEST
+
+START_TEST(test_replay_incomplete) {
+    mock_register_file("/config.yaml", yaml);
+
+    // A compile that never finished (e.g., power loss) has no valid header.
+    FILE* file = tmpfile();
+    config_cache_writer_t writer;
+    config_cache_write_begin(&writer, file);
+    parse_config_file_compiled("/config.yaml", &sink, -1, &writer);
+
+    trace_length = 0;
+    trace[0] = '\0';
+    ck_assert(!config_cache_replay(file, &key, &sink, 0, NULL));
+    ck_assert_str_eq(trace, "");
+    fclose(file);
+}
+END_TEST
+
+START_TEST(test_replay_damaged) {
+    mock_register_file("/config.yaml", yaml);
+    FILE* file = compile(-1);
+
+    fseek(file, 0, SEEK_END);
+    const long size = ftell(file);
+    uint8_t* contents = malloc(size);
+    rewind(file);
+    ck_assert_int_eq(fread(contents, 1, size, file), size);
+    fclose(file);
+
+    // Truncated.
+    file = tmpfile();
+    fwrite(contents, 1, size - 1, file);
+    ck_assert(!config_cache_replay(file, &key, &sink, 0, NULL));
+    fclose(file);
+
+    // A corrupt first opcode in the last config, found as the length field
+    // that reaches exactly to its id and name.
+    long last = -1;
+    for (long offset = 0; last < 0 && offset + 4 <= size; offset++) {
+        uint32_t length;
+        memcpy(&length, &contents[offset], sizeof(length));
+        if (length > 0 && (long) length == size - 41 - 41 - 4 - offset) {
+            last = offset;
+        }
+    }
+    ck_assert_int_ge(last, 0);
+    contents[last + 4] = 0xFF;
+    file = tmpfile();
+    fwrite(contents, 1, size, file);
+    trace_length = 0;
+    trace[0] = '\0';
+    ck_assert(!config_cache_replay(file, &key, &sink, 0, NULL));
+    ck_assert_str_eq(trace, "");
+    fclose(file);
+
+    free(contents);
+}
+END_TEST
+
+START_TEST(test_compile_rejects_long_default) {
+    mock_register_file("/config.yaml",
+        "default: an-identifier-that-is-longer-than-forty-characters\n"
+        "configs:\n"
+        "  - id: first\n"
+        "    name: First\n"
+        "    setup: []\n");
+
+    FILE* file = tmpfile();
+    config_cache_writer_t writer;
+    config_cache_write_begin(&writer, file);
+    parse_config_file_compiled("/config.yaml", &sink, -1, &writer);
+    ck_assert(!config_cache_write_end(&writer, &key));
+    fclose(file);
+}
+END_TEST
+
+START_TEST(test_sdcard_config_yaml) {
+    const char* sdcard_root = getenv("ECONOPET_TEST_SDCARD_ROOT");
+    ck_assert_msg(sdcard_root != NULL, "ECONOPET_TEST_SDCARD_ROOT environment variable not set");
+
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/config.yaml", sdcard_root);
+    FILE* source = fopen(path, "rb");
+    ck_assert_ptr_nonnull(source);
+    static char contents[32768];
+    const size_t length = fread(contents, 1, sizeof(contents) - 1, source);
+    contents[length] = '\0';
+    fclose(source);
+    mock_register_file("/config.yaml", contents);
+
+    FILE* file = compile(-1);
+    check_replay_matches_parse(file, 7);
+    check_run_matches_parse(file, 7);
+
+    // The compiled copy is smaller than the YAML it replaces.
+    fseek(file, 0, SEEK_END);
+    ck_assert_int_lt(ftell(file), (long) length);
+    fclose(file);
+}
+END_TEST
+
+Suite *config_cache_suite(void) {
+    Suite* s = suite_create("config_cache");
+    TCase* tc = tcase_create("config_cache");
+
+    tcase_add_checked_fixture(tc, setup, teardown);
+    tcase_add_test(tc, test_replay_matches_parse);
+    tcase_add_test(tc, test_compile_while_executing);
+    tcase_add_test(tc, test_run_indexed);
+    tcase_add_test_raise_signal(tc, test_run_read_error, SIGABRT);
+    tcase_add_test(tc, test_replay_stale);
+    tcase_add_test(tc, test_replay_incomplete);
+    tcase_add_test(tc, test_replay_damaged);
+    tcase_add_test(tc, test_compile_rejects_long_default);
+    tcase_add_test(tc, test_sdcard_config_yaml);
+
+    suite_add_tcase(s, tc);
+    return s;
+}
@@ -1,6 +1,7 @@
 // SPDX-License-Identifier: CC0-1.0
 // https://github.com/dlehenbauer/econopet
 
+#include <inttypes.h>
 #include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -25,8 +26,11 @@ typedef struct test_context_s {
     char last_config_id[41];
     char last_config_name[41];
     char last_default_id[41];
+    char last_search_order[41];
     char last_load_file[PATH_MAX];
     uint32_t last_load_address;
+    bool last_load_has_crc;
+    uint32_t last_load_crc;
     uint32_t last_patch_address;
     size_t last_patch_size;
     uint32_t last_copy_source;
@@ -37,6 +41,12 @@ typedef struct test_context_s {
     char last_usb_keymap[261];
     tape_config_t last_tape;
     bool last_tape_enabled;
+    tape_save_config_t last_tape_save;
+    bool last_tape_save_enabled;
+    key_buffer_config_t last_key_buffer;
+    bool last_key_buffer_enabled;
+    ieee_config_t last_ieee;
+    bool last_ieee_enabled;
     uint32_t last_checksum_start;
     uint32_t last_checksum_end;
     uint32_t last_checksum_fix;
@@ -70,12 +80,20 @@ static void test_on_default(void* context, const char* id) {
     ctx->last_default_id[sizeof(ctx->last_default_id) - 1] = '\0';
 }
 
-static void test_on_load(void* context, const char* filename, uint32_t address) {
+static void test_on_search_order(void* context, const char* order) {
+    test_context_t* ctx = (test_context_t*)context;
+    strncpy(ctx->last_search_order, order, sizeof(ctx->last_search_order) - 1);
+    ctx->last_search_order[sizeof(ctx->last_search_order) - 1] = '\0';
+}
+
+static void test_on_load(void* context, const char* filename, uint32_t address, const uint32_t* crc) {
     test_context_t* ctx = (test_context_t*)context;
     ctx->load_count++;
     strncpy(ctx->last_load_file, filename, sizeof(ctx->last_load_file) - 1);
     ctx->last_load_file[sizeof(ctx->last_load_file) - 1] = '\0';
     ctx->last_load_address = address;
+    ctx->last_load_has_crc = crc != NULL;
+    ctx->last_load_crc = crc != NULL ? *crc : 0;
 }
 
 static void test_on_patch(void* context, uint32_t address, const binary_t* binary) {
@@ -102,6 +120,12 @@ static void test_on_set_options(void* context, options_t* options) {
     ctx->last_usb_keymap[sizeof(ctx->last_usb_keymap) - 1] = '\0';
     ctx->last_tape = options->tape;
     ctx->last_tape_enabled = options->tape_enabled;
+    ctx->last_tape_save = options->tape_save;
+    ctx->last_tape_save_enabled = options->tape_save_enabled;
+    ctx->last_key_buffer = options->key_buffer;
+    ctx->last_key_buffer_enabled = options->key_buffer_enabled;
+    ctx->last_ieee = options->ieee;
+    ctx->last_ieee_enabled = options->ieee_enabled;
 }
 
 static void test_on_fix_checksum(void* context, uint32_t start_addr, uint32_t end_addr, 
@@ -130,6 +154,7 @@ static const config_sink_t config_sink = {
     .on_enter_config = test_on_enter_config,
     .on_exit_config = test_on_exit_config,
     .on_default = test_on_default,
+    .on_search_order = test_on_search_order,
     .setup = &setup_sink,
 };
 
@@ -187,6 +212,29 @@ START_TEST(test_parse_load_action) {
     ck_assert_int_eq(test_ctx.load_count, 1);
     ck_assert_str_eq(test_ctx.last_load_file, "basic.bin");
     ck_assert_int_eq(test_ctx.last_load_address, 0xC000);
+    ck_assert(!test_ctx.last_load_has_crc);
+}
+END_TEST
+
+// Test: Parse load action with the expected CRC-32 of the file
+START_TEST(test_parse_load_action_crc) {
+    const char* yaml_content = 
+        "configs:\n"
+        "  - name: Load Test\n"
+        "    setup:\n"
+        "      - action: load\n"
+        "        files:\n"
+        "          - file: basic.bin\n"
+        "            address: 0xC000\n"
+        "            crc: 0xFFC5B6AB\n";
+    
+    mock_register_file("/config.yaml", yaml_content);
+    
+    parse_config_file("/config.yaml", &config_sink, 0);
+    
+    ck_assert_int_eq(test_ctx.load_count, 1);
+    ck_assert(test_ctx.last_load_has_crc);
+    ck_assert_uint_eq(test_ctx.last_load_crc, 0xFFC5B6AB);
 }
 END_TEST
 
@@ -617,6 +665,128 @@ START_TEST(test_parse_set_tape) {
     ck_assert_int_eq(test_ctx.last_tape.fnlen, 0xD1);
     ck_assert_int_eq(test_ctx.last_tape.devnum, 0xD4);
     ck_assert_int_eq(test_ctx.last_tape.fnadr, 0xDA);
+
+    // Omitting 'key-buffer' falls back to matrix typing
+    ck_assert(!test_ctx.last_key_buffer_enabled);
+
+    // Omitting 'tape-save' leaves SAVE to the datasette
+    ck_assert(!test_ctx.last_tape_save_enabled);
+
+    // Omitting 'ieee' leaves the bus to real drives
+    ck_assert(!test_ctx.last_ieee_enabled);
+}
+END_TEST
+
+// Test: Parse config with tape-save hex blob in set action
+START_TEST(test_parse_set_tape_save) {
+    // ROM 4 blob: bp=$F6E3 (SV5); exit=$F6DC (RTS ending SV60); stal=$FB
+    const char* yaml_content = 
+        "configs:\n"
+        "  - name: Tape Save Test\n"
+        "    setup:\n"
+        "      - action: set\n"
+        "        tape: \"2ef415f4c9cad1d4da\"\n"
+        "        tape-save: \"e3f6dcf6fb\"\n";
+    
+    mock_register_file("/config.yaml", yaml_content);
+    
+    parse_config_file("/config.yaml", &config_sink, 0);
+    
+    ck_assert_int_eq(test_ctx.set_options_count, 1);
+    ck_assert(test_ctx.last_tape_enabled);
+    ck_assert(test_ctx.last_tape_save_enabled);
+    ck_assert_int_eq(test_ctx.last_tape_save.bp_addr, 0xF6E3);
+    ck_assert_int_eq(test_ctx.last_tape_save.exit, 0xF6DC);
+    ck_assert_int_eq(test_ctx.last_tape_save.stal, 0xFB);
+}
+END_TEST
+
+// Test: Parse config with key-buffer hex blob in set action
+START_TEST(test_parse_set_key_buffer) {
+    // ROM 1 blob: keyd=$020F; ndx=$020D; size=10
+    const char* yaml_content = 
+        "configs:\n"
+        "  - name: Key Buffer Test\n"
+        "    setup:\n"
+        "      - action: set\n"
+        "        key-buffer: \"0f020d020a\"\n";
+    
+    mock_register_file("/config.yaml", yaml_content);
+    
+    parse_config_file("/config.yaml", &config_sink, 0);
+    
+    ck_assert_int_eq(test_ctx.set_options_count, 1);
+    ck_assert(test_ctx.last_key_buffer_enabled);
+    ck_assert_int_eq(test_ctx.last_key_buffer.keyd, 0x020F);
+    ck_assert_int_eq(test_ctx.last_key_buffer.ndx, 0x020D);
+    ck_assert_int_eq(test_ctx.last_key_buffer.size, 10);
+}
+END_TEST
+
+// Test: Parse config with ieee hex blob in set action
+START_TEST(test_parse_set_ieee) {
+    // BASIC 4 hooks, trap=$03F0, status=$0096, fa=$D4, device 8
+    const char* yaml_content = 
+        "configs:\n"
+        "  - name: IEEE Test\n"
+        "    setup:\n"
+        "      - action: set\n"
+        "        ieee: \"d2f0d5f043f193f19ef1c0f1aef1b9f1f0039600d408\"\n";
+    
+    mock_register_file("/config.yaml", yaml_content);
+    
+    parse_config_file("/config.yaml", &config_sink, 0);
+    
+    ck_assert_int_eq(test_ctx.set_options_count, 1);
+    ck_assert(test_ctx.last_ieee_enabled);
+    ck_assert_int_eq(test_ctx.last_ieee.talk, 0xF0D2);
+    ck_assert_int_eq(test_ctx.last_ieee.listen, 0xF0D5);
+    ck_assert_int_eq(test_ctx.last_ieee.unlsn, 0xF1B9);
+    ck_assert_int_eq(test_ctx.last_ieee.trap, 0x03F0);
+    ck_assert_int_eq(test_ctx.last_ieee.status, 0x96);
+    ck_assert_int_eq(test_ctx.last_ieee.fa, 0xD4);
+    ck_assert_int_eq(test_ctx.last_ieee.device, 8);
+}
+END_TEST
+
+// Test: Every config in the actual /sdcard/config.yaml enables the IEEE-488 drive
+START_TEST(test_validate_sdcard_config_yaml_ieee) {
+    // TALK entry point for each config, in the order of config.yaml.
+    static const uint16_t talk[] = {
+        0xF0D2, 0xF0D2, 0xF0D2, 0xF0D2,     // BASIC 4
+        0xF0B6,                             // BASIC 2
+        0xF0B6,                             // BASIC 1
+        0xF0D2,                             // BASIC 4 (ColourPET)
+    };
+
+    const char* sdcard_root = getenv("ECONOPET_TEST_SDCARD_ROOT");
+    ck_assert_msg(sdcard_root != NULL, "ECONOPET_TEST_SDCARD_ROOT environment variable not set");
+    
+    char config_path[PATH_MAX];
+    snprintf(config_path, sizeof(config_path), "%s/config.yaml", sdcard_root);
+    
+    char* config_contents = read_file_to_string(config_path);
+    ck_assert_msg(config_contents != NULL, "Failed to read config.yaml from %s", config_path);
+    
+    mock_register_file("/config.yaml", config_contents);
+    
+    for (int i = 0; i < (int) (sizeof(talk) / sizeof(talk[0])); i++) {
+        memset(&test_ctx, 0, sizeof(test_ctx));
+        parse_config_file("/config.yaml", &config_sink, i);
+
+        ck_assert_msg(test_ctx.last_ieee_enabled, "config %d does not enable 'ieee'", i);
+        ck_assert_int_eq(test_ctx.last_ieee.talk, talk[i]);
+        ck_assert_int_eq(test_ctx.last_ieee.trap, 0x03F0);
+        ck_assert_int_eq(test_ctx.last_ieee.device, 8);
+
+        // BASIC 1 keeps ST and FA in different places.
+        const bool basic_1 = i == 5;
+        ck_assert_int_eq(test_ctx.last_ieee.status, basic_1 ? 0x020C : 0x96);
+        ck_assert_int_eq(test_ctx.last_ieee.fa, basic_1 ? 0xF1 : 0xD4);
+    }
+    
+    free(config_contents);
+    mock_unregister_file("/config.yaml");
 }
 END_TEST
 
@@ -681,6 +851,24 @@ START_TEST(test_parse_no_default) {
 }
 END_TEST
 
+// Test: Parse the top-level search order for program volumes
+START_TEST(test_parse_search_order) {
+    const char* yaml_content =
+        "search-order: \"sd, usb\"\n"
+        "configs:\n"
+        "  - id: test\n"
+        "    name: Test Config\n"
+        "    setup: []\n";
+
+    mock_register_file("/config.yaml", yaml_content);
+
+    parse_config_file("/config.yaml", &config_sink, -1);
+
+    ck_assert_str_eq(test_ctx.last_search_order, "sd, usb");
+    ck_assert_int_eq(test_ctx.config_exit_count, 1);
+}
+END_TEST
+
 // Test: Validate actual /sdcard/config.yaml has a valid default
 START_TEST(test_validate_sdcard_config_yaml_default) {
     const char* sdcard_root = getenv("ECONOPET_TEST_SDCARD_ROOT");
@@ -707,6 +895,101 @@ START_TEST(test_validate_sdcard_config_yaml_default) {
 }
 END_TEST
 
+// Test: Aliases replay the anchored node, including within the selected config
+START_TEST(test_parse_aliases) {
+    const char* yaml_content =
+        "data:\n"
+        "  kernal: &kernal roms/kernal-4.bin\n"
+        "  common: &common\n"
+        "    - action: load\n"
+        "      files:\n"
+        "        - file: *kernal\n"
+        "          address: 0xF000\n"
+        "    - &wide\n"
+        "      action: set\n"
+        "      columns: 80\n"
+        "configs:\n"
+        "  - name: First\n"
+        "    setup: *common\n"
+        "  - name: Second\n"
+        "    setup:\n"
+        "      - *wide\n"
+        "      - action: copy\n"
+        "        source: 0x1000\n"
+        "        destination: 0x2000\n"
+        "        length: 16\n";
+
+    mock_register_file("/config.yaml", yaml_content);
+
+    parse_config_file("/config.yaml", &config_sink, 0);
+    ck_assert_int_eq(test_ctx.load_count, 1);
+    ck_assert_str_eq(test_ctx.last_load_file, "roms/kernal-4.bin");
+    ck_assert_int_eq(test_ctx.last_load_address, 0xF000);
+    ck_assert_int_eq(test_ctx.set_options_count, 1);
+    ck_assert_int_eq(test_ctx.last_columns, 80);
+    ck_assert_int_eq(test_ctx.copy_count, 0);
+
+    memset(&test_ctx, 0, sizeof(test_ctx));
+    parse_config_file("/config.yaml", &config_sink, 1);
+    ck_assert_int_eq(test_ctx.load_count, 0);
+    ck_assert_int_eq(test_ctx.set_options_count, 1);
+    ck_assert_int_eq(test_ctx.copy_count, 1);
+    ck_assert_int_eq(test_ctx.config_exit_count, 2);
+}
+END_TEST
+
+// Test: Dozens of aliases resolve in a single pass over the file
+START_TEST(test_parse_many_aliases) {
+    enum { blocks = 8, configs = 48 };
+
+    static char yaml[65536];
+    size_t length = 0;
+
+    // Shared blocks of setup actions, each a load followed by a patch.
+    length += snprintf(&yaml[length], sizeof(yaml) - length, "data:\n");
+    for (int i = 0; i < blocks; i++) {
+        length += snprintf(&yaml[length], sizeof(yaml) - length,
+            "  block%d: &block%d\n"
+            "    action: load\n"
+            "    files:\n"
+            "      - file: roms/rom%d.bin\n"
+            "        address: 0x%X\n"
+            "  patch%d: &patch%d\n"
+            "    action: patch\n"
+            "    address: 0x%X\n"
+            "    hex: EAEAEAEA\n",
+            i, i, i, 0x9000 + i * 0x1000, i, i, 0x9000 + i * 0x1000);
+    }
+
+    // Each config uses three aliases.
+    length += snprintf(&yaml[length], sizeof(yaml) - length, "configs:\n");
+    for (int i = 0; i < configs; i++) {
+        length += snprintf(&yaml[length], sizeof(yaml) - length,
+            "  - name: Config %d\n"
+            "    setup:\n"
+            "      - *block%d\n"
+            "      - *patch%d\n"
+            "      - *block%d\n",
+            i, i % blocks, i % blocks, (i + 1) % blocks);
+    }
+    ck_assert_uint_lt(length, sizeof(yaml) - 1);
+    mock_register_file("/config.yaml", yaml);
+
+    for (int i = 0; i < configs; i++) {
+        memset(&test_ctx, 0, sizeof(test_ctx));
+        parse_config_file("/config.yaml", &config_sink, i);
+
+        ck_assert_int_eq(test_ctx.config_exit_count, configs);
+        ck_assert_int_eq(test_ctx.load_count, 2);
+        ck_assert_int_eq(test_ctx.patch_count, 1);
+        ck_assert_int_eq(test_ctx.last_patch_address, 0x9000 + (i % blocks) * 0x1000);
+    }
+
+    // The file is read once per parse, however many aliases it has.
+    ck_assert_uint_eq(mock_open_count(), configs);
+}
+END_TEST
+
 Suite *config_parser_suite(void) {
     Suite *s;
     TCase *tc_core;
@@ -718,6 +1001,7 @@ Suite *config_parser_suite(void) {
     
     tcase_add_test(tc_core, test_parse_minimal_config);
     tcase_add_test(tc_core, test_parse_load_action);
+    tcase_add_test(tc_core, test_parse_load_action_crc);
     tcase_add_test(tc_core, test_parse_patch_action);
     tcase_add_test(tc_core, test_parse_copy_action);
     tcase_add_test(tc_core, test_parse_set_action);
@@ -735,10 +1019,17 @@ Suite *config_parser_suite(void) {
     tcase_add_test(tc_core, test_enumerate_all_configs);
     tcase_add_test(tc_core, test_validate_sdcard_config_yaml);
     tcase_add_test(tc_core, test_parse_set_tape);
+    tcase_add_test(tc_core, test_parse_set_tape_save);
+    tcase_add_test(tc_core, test_parse_set_key_buffer);
+    tcase_add_test(tc_core, test_parse_set_ieee);
+    tcase_add_test(tc_core, test_validate_sdcard_config_yaml_ieee);
     tcase_add_test(tc_core, test_parse_default_config);
     tcase_add_test(tc_core, test_parse_default_after_configs);
     tcase_add_test(tc_core, test_parse_no_default);
+    tcase_add_test(tc_core, test_parse_search_order);
     tcase_add_test(tc_core, test_validate_sdcard_config_yaml_default);
+    tcase_add_test(tc_core, test_parse_aliases);
+    tcase_add_test(tc_core, test_parse_many_aliases);
     
     suite_add_tcase(s, tc_core);
 
@@ -0,0 +1,106 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#include "pch.h"
+#include "esc_parser_test.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "input.h"
+#include "ui/esc_parser.h"
+
+#define ESC 0x1B
+
+static esc_parser_t parser;
+
+static void setup(void) {
+    esc_parser_init(&parser);
+}
+
+// Feed 'text' one byte per call and return the last result.
+static int feed_string(const char* text, uint64_t now_us) {
+    int key = EOF;
+    for (size_t i = 0; text[i] != '\0'; i++) {
+        key = esc_parser_feed(&parser, (uint8_t) text[i], now_us);
+    }
+    return key;
+}
+
+START_TEST(test_plain_characters) {
+    ck_assert_int_eq(esc_parser_feed(&parser, 'a', 0), 'a');
+    ck_assert_int_eq(esc_parser_feed(&parser, '\r', 0), '\r');
+    ck_assert_int_eq(esc_parser_poll(&parser, 0), EOF);
+}
+
+START_TEST(test_cursor_keys) {
+    ck_assert_int_eq(feed_string("\x1b[A", 0), KEY_UP);
+    ck_assert_int_eq(feed_string("\x1b[B", 0), KEY_DOWN);
+    ck_assert_int_eq(feed_string("\x1b[C", 0), KEY_RIGHT);
+    ck_assert_int_eq(feed_string("\x1b[D", 0), KEY_LEFT);
+    ck_assert_int_eq(feed_string("\x1b[H", 0), KEY_HOME);
+    ck_assert_int_eq(feed_string("\x1b[F", 0), KEY_END);
+}
+
+START_TEST(test_sequence_split_across_polls) {
+    // The body of the sequence arrives on a later iteration of the main loop.
+    ck_assert_int_eq(esc_parser_feed(&parser, ESC, 0), EOF);
+    ck_assert_int_eq(esc_parser_poll(&parser, 1000), EOF);
+    ck_assert_int_eq(esc_parser_feed(&parser, '[', 2000), EOF);
+    ck_assert_int_eq(esc_parser_feed(&parser, '5', 4000), EOF);
+    ck_assert_int_eq(esc_parser_poll(&parser, 5000), EOF);
+    ck_assert_int_eq(esc_parser_feed(&parser, '~', 6000), KEY_PGUP);
+
+    ck_assert_int_eq(feed_string("\x1b[6~", 7000), KEY_PGDN);
+}
+
+START_TEST(test_lone_escape) {
+    ck_assert_int_eq(esc_parser_feed(&parser, ESC, 0), EOF);
+    ck_assert_int_eq(esc_parser_poll(&parser, ESC_PARSER_TIMEOUT_US - 1), EOF);
+    ck_assert_int_eq(esc_parser_poll(&parser, ESC_PARSER_TIMEOUT_US), ESC);
+    ck_assert_int_eq(esc_parser_poll(&parser, ESC_PARSER_TIMEOUT_US), EOF);
+}
+
+START_TEST(test_escape_then_character) {
+    ck_assert_int_eq(esc_parser_feed(&parser, ESC, 0), EOF);
+    ck_assert_int_eq(esc_parser_feed(&parser, 'x', 0), 'x');
+    ck_assert_int_eq(esc_parser_feed(&parser, 'y', 0), 'y');
+}
+
+START_TEST(test_unknown_sequence) {
+    ck_assert_int_eq(feed_string("\x1b[Z", 0), EOF);
+    ck_assert_int_eq(feed_string("\x1b[5A", 0), EOF);
+    ck_assert_int_eq(esc_parser_feed(&parser, 'a', 0), 'a');
+}
+
+START_TEST(test_partial_sequence_times_out) {
+    ck_assert_int_eq(feed_string("\x1b[5", 0), EOF);
+    ck_assert_int_eq(esc_parser_poll(&parser, ESC_PARSER_TIMEOUT_US), EOF);
+
+    // The stale sequence was discarded.
+    ck_assert_int_eq(esc_parser_feed(&parser, '~', ESC_PARSER_TIMEOUT_US), '~');
+}
+
+START_TEST(test_overlong_sequence) {
+    ck_assert_int_eq(feed_string("\x1b[0123456789", 0), EOF);
+    ck_assert_int_eq(esc_parser_feed(&parser, 'a', 0), 'a');
+    ck_assert_int_eq(feed_string("\x1b[A", 0), KEY_UP);
+}
+
+Suite *esc_parser_suite(void) {
+    Suite* s = suite_create("esc_parser");
+    TCase* tc = tcase_create("parser");
+
+    tcase_add_checked_fixture(tc, setup, NULL);
+    tcase_add_test(tc, test_plain_characters);
+    tcase_add_test(tc, test_cursor_keys);
+    tcase_add_test(tc, test_sequence_split_across_polls);
+    tcase_add_test(tc, test_lone_escape);
+    tcase_add_test(tc, test_escape_then_character);
+    tcase_add_test(tc, test_unknown_sequence);
+    tcase_add_test(tc, test_partial_sequence_times_out);
+    tcase_add_test(tc, test_overlong_sequence);
+
+    suite_add_tcase(s, tc);
+    return s;
+}
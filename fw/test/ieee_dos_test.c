@@ -0,0 +1,374 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#include "pch.h"
+#include "ieee_dos_test.h"
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ieee/dos.h"
+
+static char root[64];
+static dos_t dos;
+
+static bool scan_dir(const char* path, void (*callback)(const char* name, uint32_t size, void* context),
+                     void* context) {
+    DIR* dir = opendir(path);
+    if (dir == NULL) {
+        return false;
+    }
+
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        char file_path[PATH_MAX];
+        snprintf(file_path, sizeof(file_path), "%s/%s", path, entry->d_name);
+
+        struct stat st;
+        if (stat(file_path, &st) == 0 && S_ISREG(st.st_mode)) {
+            callback(entry->d_name, (uint32_t) st.st_size, context);
+        }
+    }
+
+    closedir(dir);
+    return true;
+}
+
+static uint64_t free_bytes(void) {
+    return 100 * 254;
+}
+
+static const dos_fs_t fs = { scan_dir, free_bytes };
+
+static void write_host_file(const char* name, const char* contents) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", root, name);
+    FILE* file = fopen(path, "wb");
+    ck_assert_ptr_nonnull(file);
+    fputs(contents, file);
+    fclose(file);
+}
+
+// Read a host file into 'out' (NUL-terminated). Returns false if it is missing.
+static bool read_host_file(const char* name, char* out, size_t size) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", root, name);
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        return false;
+    }
+    const size_t length = fread(out, 1, size - 1, file);
+    out[length] = '\0';
+    fclose(file);
+    return true;
+}
+
+static void setup(void) {
+    snprintf(root, sizeof(root), "/tmp/econopet-dos-XXXXXX");
+    ck_assert_ptr_nonnull(mkdtemp(root));
+    dos_init(&dos, root, &fs);
+}
+
+static void teardown(void) {
+    dos_close_all(&dos);
+
+    DIR* dir = opendir(root);
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] != '.') {
+            char path[PATH_MAX];
+            snprintf(path, sizeof(path), "%s/%s", root, entry->d_name);
+            unlink(path);
+        }
+    }
+    closedir(dir);
+    rmdir(root);
+}
+
+// The bus transactions the KERNAL performs (names are PETSCII, which for
+// unshifted letters is the ASCII uppercase range).
+
+static void send(uint8_t secondary, const char* bytes, size_t length) {
+    dos_listen(&dos, secondary);
+    for (size_t i = 0; i < length; i++) {
+        dos_write(&dos, (uint8_t) bytes[i]);
+    }
+    dos_unlisten(&dos);
+}
+
+static void open_channel(uint8_t sa, const char* name) {
+    send(0xF0 | sa, name, strlen(name));
+}
+
+static void close_channel(uint8_t sa) {
+    send(0xE0 | sa, NULL, 0);
+}
+
+// Read up to 'size' bytes from channel 'sa' until EOI. Returns the count, or
+// -1 if the drive had nothing to send.
+static int receive(uint8_t sa, uint8_t* out, size_t size) {
+    dos_talk(&dos, 0x60 | sa);
+    int count = 0;
+    bool eoi = false;
+    while (!eoi && (size_t) count < size) {
+        if (!dos_read(&dos, &out[count], &eoi)) {
+            dos_untalk(&dos);
+            return count == 0 ? -1 : count;
+        }
+        count++;
+    }
+    dos_untalk(&dos);
+    return count;
+}
+
+static bool contains(const uint8_t* haystack, size_t length, const char* needle) {
+    const size_t needle_length = strlen(needle);
+    for (size_t i = 0; i + needle_length <= length; i++) {
+        if (memcmp(&haystack[i], needle, needle_length) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static const char* read_error_channel(void) {
+    static char status[DOS_STATUS_SIZE + 1];
+    const int length = receive(DOS_COMMAND_CHANNEL, (uint8_t*) status, DOS_STATUS_SIZE);
+    ck_assert_int_gt(length, 0);
+    ck_assert_int_eq(status[length - 1], '\r');
+    status[length - 1] = '\0';
+    return status;
+}
+
+START_TEST(test_power_on_status) {
+    ck_assert_str_eq(read_error_channel(), "73,ECONOPET DOS,00,00");
+
+    // Reading the error channel resets it.
+    ck_assert_str_eq(read_error_channel(), "00, OK,00,00");
+}
+END_TEST
+
+START_TEST(test_save_and_load) {
+    // SAVE "GAME",8
+    open_channel(1, "GAME");
+    send(0x61, "\x01\x04" "ABC", 5);
+    close_channel(1);
+    ck_assert_str_eq(dos_status(&dos), "00, OK,00,00");
+
+    char contents[16];
+    ck_assert(read_host_file("game.prg", contents, sizeof(contents)));
+    ck_assert_str_eq(contents, "\x01\x04" "ABC");
+
+    // LOAD "GAME",8
+    open_channel(0, "GAME");
+    uint8_t data[16];
+    ck_assert_int_eq(receive(0, data, sizeof(data)), 5);
+    ck_assert_mem_eq(data, "\x01\x04" "ABC", 5);
+    close_channel(0);
+}
+END_TEST
+
+START_TEST(test_load_wildcard) {
+    write_host_file("galaxy.prg", "XYZ");
+    open_channel(0, "0:GA*");
+
+    uint8_t data[4];
+    ck_assert_int_eq(receive(0, data, sizeof(data)), 3);
+    ck_assert_mem_eq(data, "XYZ", 3);
+}
+END_TEST
+
+START_TEST(test_load_not_found) {
+    open_channel(0, "MISSING");
+    ck_assert_str_eq(dos_status(&dos), "62,FILE NOT FOUND,00,00");
+
+    // The computer sees a timeout on the first byte.
+    uint8_t data[4];
+    ck_assert_int_eq(receive(0, data, sizeof(data)), -1);
+    ck_assert_str_eq(read_error_channel(), "62,FILE NOT FOUND,00,00");
+}
+END_TEST
+
+START_TEST(test_save_existing) {
+    write_host_file("game.prg", "OLD");
+
+    open_channel(1, "GAME");
+    ck_assert_str_eq(dos_status(&dos), "63,FILE EXISTS,00,00");
+
+    // "@0:" replaces the file.
+    open_channel(1, "@0:GAME");
+    send(0x61, "NEW", 3);
+    close_channel(1);
+
+    char contents[16];
+    ck_assert(read_host_file("game.prg", contents, sizeof(contents)));
+    ck_assert_str_eq(contents, "NEW");
+}
+END_TEST
+
+START_TEST(test_sequential_file) {
+    // OPEN 2,8,2,"DATA,S,W" : PRINT#2,"HELLO" : CLOSE 2
+    open_channel(2, "DATA,S,W");
+    send(0x62, "HELLO\r", 6);
+    close_channel(2);
+
+    // OPEN 2,8,2,"DATA,S,A" appends.
+    open_channel(2, "DATA,S,A");
+    send(0x62, "WORLD\r", 6);
+    close_channel(2);
+
+    char contents[16];
+    ck_assert(read_host_file("data.seq", contents, sizeof(contents)));
+    ck_assert_str_eq(contents, "HELLO\rWORLD\r");
+
+    // GET# until EOI.
+    open_channel(3, "DATA,S,R");
+    uint8_t data[16];
+    ck_assert_int_eq(receive(3, data, sizeof(data)), 12);
+    ck_assert_mem_eq(data, "HELLO\rWORLD\r", 12);
+
+    // Further reads time out.
+    ck_assert_int_eq(receive(3, data, sizeof(data)), -1);
+    close_channel(3);
+
+    // A SEQ file is not found as a PRG.
+    open_channel(0, "DATA");
+    ck_assert_str_eq(dos_status(&dos), "62,FILE NOT FOUND,00,00");
+}
+END_TEST
+
+START_TEST(test_append_missing) {
+    open_channel(2, "NOPE,S,A");
+    ck_assert_str_eq(dos_status(&dos), "62,FILE NOT FOUND,00,00");
+}
+END_TEST
+
+START_TEST(test_write_not_open) {
+    send(0x65, "X", 1);
+    ck_assert_str_eq(dos_status(&dos), "61,FILE NOT OPEN,00,00");
+}
+END_TEST
+
+START_TEST(test_bad_names) {
+    open_channel(1, "A*B");
+    ck_assert_str_eq(dos_status(&dos), "33,SYNTAX ERROR,00,00");
+
+    open_channel(2, "NAME,X");
+    ck_assert_str_eq(dos_status(&dos), "33,SYNTAX ERROR,00,00");
+
+    open_channel(2, "");
+    ck_assert_str_eq(dos_status(&dos), "34,SYNTAX ERROR,00,00");
+}
+END_TEST
+
+START_TEST(test_directory) {
+    write_host_file("alpha.prg", "0123456789");
+    write_host_file("notes.seq", "x");
+
+    open_channel(0, "$");
+    uint8_t listing[1024];
+    const int length = receive(0, listing, sizeof(listing));
+    ck_assert_int_gt(length, 4);
+
+    // A BASIC program at $0401 ending in a zero link.
+    ck_assert_uint_eq(listing[0], 0x01);
+    ck_assert_uint_eq(listing[1], 0x04);
+    ck_assert_uint_eq(listing[length - 1], 0);
+    ck_assert_uint_eq(listing[length - 2], 0);
+
+    // Only PRG files are listed.
+    ck_assert(contains(listing, length, "ALPHA"));
+    ck_assert(!contains(listing, length, "NOTES"));
+    close_channel(0);
+}
+END_TEST
+
+START_TEST(test_two_directories) {
+    write_host_file("alpha.prg", "0123456789");
+
+    // Each open listing holds a large pool block, and rendering one borrows
+    // another. A second listing reports an error instead of halting.
+    open_channel(0, "$");
+    open_channel(2, "$");
+    ck_assert_str_eq(read_error_channel(), "70,NO CHANNEL,00,00");
+
+    uint8_t listing[1024];
+    ck_assert_int_eq(receive(2, listing, sizeof(listing)), -1);
+    ck_assert_int_gt(receive(0, listing, sizeof(listing)), 4);
+    close_channel(0);
+    close_channel(2);
+
+    open_channel(2, "$");
+    ck_assert_int_gt(receive(2, listing, sizeof(listing)), 4);
+    close_channel(2);
+}
+END_TEST
+
+START_TEST(test_command_scratch) {
+    write_host_file("one.prg", "1");
+    write_host_file("other.prg", "2");
+    write_host_file("keep.prg", "3");
+
+    // OPEN 15,8,15,"S0:O*"
+    open_channel(15, "S0:O*");
+    ck_assert_str_eq(dos_status(&dos), "01,FILES SCRATCHED,02,00");
+
+    char contents[4];
+    ck_assert(!read_host_file("one.prg", contents, sizeof(contents)));
+    ck_assert(!read_host_file("other.prg", contents, sizeof(contents)));
+    ck_assert(read_host_file("keep.prg", contents, sizeof(contents)));
+}
+END_TEST
+
+START_TEST(test_command_rename) {
+    write_host_file("old.seq", "data");
+
+    // PRINT#15,"R0:NEW=OLD"
+    send(0x6F, "R0:NEW=OLD\r", 11);
+    ck_assert_str_eq(dos_status(&dos), "00, OK,00,00");
+
+    char contents[8];
+    ck_assert(read_host_file("new.seq", contents, sizeof(contents)));
+    ck_assert_str_eq(contents, "data");
+
+    send(0x6F, "R0:NEW=OLD", 10);
+    ck_assert_str_eq(dos_status(&dos), "62,FILE NOT FOUND,00,00");
+}
+END_TEST
+
+START_TEST(test_command_other) {
+    send(0x6F, "I", 1);
+    ck_assert_str_eq(dos_status(&dos), "00, OK,00,00");
+
+    send(0x6F, "Q", 1);
+    ck_assert_str_eq(dos_status(&dos), "31,SYNTAX ERROR,00,00");
+
+    send(0x6F, "UJ", 2);
+    ck_assert_str_eq(dos_status(&dos), "73,ECONOPET DOS,00,00");
+}
+END_TEST
+
+Suite *ieee_dos_suite(void) {
+    Suite* s = suite_create("ieee_dos");
+    TCase* tc = tcase_create("dos");
+
+    tcase_add_checked_fixture(tc, setup, teardown);
+    tcase_add_test(tc, test_power_on_status);
+    tcase_add_test(tc, test_save_and_load);
+    tcase_add_test(tc, test_load_wildcard);
+    tcase_add_test(tc, test_load_not_found);
+    tcase_add_test(tc, test_save_existing);
+    tcase_add_test(tc, test_sequential_file);
+    tcase_add_test(tc, test_append_missing);
+    tcase_add_test(tc, test_write_not_open);
+    tcase_add_test(tc, test_bad_names);
+    tcase_add_test(tc, test_directory);
+    tcase_add_test(tc, test_two_directories);
+    tcase_add_test(tc, test_command_scratch);
+    tcase_add_test(tc, test_command_rename);
+    tcase_add_test(tc, test_command_other);
+
+    suite_add_tcase(s, tc);
+    return s;
+}
@@ -0,0 +1,342 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#include "pch.h"
+#include "lzss_test.h"
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "crc.h"
+#include "lzss.h"
+#include "sd/sd_stream.h"
+
+#define MAX_SIZE (LZSS_WINDOW_SIZE * 3 + 123)
+
+static uint8_t original[MAX_SIZE];
+static uint8_t packed[LZSS_PACK_BOUND(MAX_SIZE)];
+static uint8_t unpacked[MAX_SIZE];
+static lzss_decoder_t decoder;
+
+// Copies decoded spans into 'unpacked', checking that they arrive in order.
+typedef struct {
+    uint8_t* output;
+    size_t capacity;
+    size_t next_offset;
+    unsigned int spans;
+} collector_t;
+
+static void collect(void* context, size_t offset, const uint8_t* data, size_t length) {
+    collector_t* const c = context;
+    ck_assert_uint_eq(offset, c->next_offset);
+    ck_assert_uint_le(offset + length, c->capacity);
+    memcpy(&c->output[offset], data, length);
+    c->next_offset += length;
+    c->spans++;
+}
+
+// Decode 'packed' feeding 'step' bytes at a time. Returns the final status.
+static lzss_status_t unpack(const uint8_t* input, size_t input_length, uint8_t* output, size_t capacity,
+                            size_t step, collector_t* c) {
+    lzss_header_t header;
+    ck_assert(lzss_read_header(input, input_length, &header));
+    ck_assert_uint_le(header.size, capacity);
+
+    *c = (collector_t) { .output = output, .capacity = capacity };
+    lzss_decoder_init(&decoder, &header);
+
+    lzss_status_t status = lzss_more;
+    size_t pos = LZSS_HEADER_SIZE;
+    do {
+        const size_t n = input_length - pos < step ? input_length - pos : step;
+        status = lzss_decode(&decoder, &input[pos], n, collect, c);
+        pos += n;
+    } while (status == lzss_more && pos < input_length);
+
+    return status;
+}
+
+static void round_trip(const uint8_t* data, size_t length, size_t step) {
+    const size_t packed_length = lzss_pack(data, length, packed);
+    ck_assert_uint_le(packed_length, LZSS_PACK_BOUND(length));
+
+    collector_t c;
+    ck_assert_int_eq(unpack(packed, packed_length, unpacked, sizeof(unpacked), step, &c), lzss_done);
+    ck_assert_uint_eq(c.next_offset, length);
+    if (length > 0) {
+        ck_assert_mem_eq(unpacked, data, length);
+    }
+}
+
+static void fill_random(uint8_t* data, size_t length, uint32_t seed) {
+    for (size_t i = 0; i < length; i++) {
+        seed = seed * 1103515245 + 12345;
+        data[i] = (uint8_t) (seed >> 16);
+    }
+}
+
+START_TEST(test_crc32_check_value) {
+    const uint8_t check[] = "123456789";
+    ck_assert_uint_eq(crc32_update(CRC32_INIT, check, 9), 0xCBF43926);
+
+    // Chaining gives the same result as a single call.
+    const uint32_t partial = crc32_update(CRC32_INIT, check, 4);
+    ck_assert_uint_eq(crc32_update(partial, &check[4], 5), 0xCBF43926);
+}
+END_TEST
+
+START_TEST(test_header) {
+    lzss_header_t header;
+    const size_t packed_length = lzss_pack((const uint8_t*) "abc", 3, packed);
+    ck_assert(lzss_read_header(packed, packed_length, &header));
+    ck_assert_uint_eq(header.size, 3);
+    ck_assert_uint_eq(header.crc, crc32_update(CRC32_INIT, (const uint8_t*) "abc", 3));
+
+    // Uncompressed files are rejected.
+    ck_assert(!lzss_read_header((const uint8_t*) "ELZ!xxxxxxxx", 12, &header));
+    ck_assert(!lzss_read_header(packed, LZSS_HEADER_SIZE - 1, &header));
+}
+END_TEST
+
+START_TEST(test_empty) {
+    round_trip(original, 0, SIZE_MAX);
+}
+END_TEST
+
+START_TEST(test_literals) {
+    const char text[] = "The quick brown fox";
+    round_trip((const uint8_t*) text, sizeof(text), SIZE_MAX);
+}
+END_TEST
+
+START_TEST(test_repetitive) {
+    memset(original, 0xAA, MAX_SIZE);
+    const size_t packed_length = lzss_pack(original, MAX_SIZE, packed);
+
+    // Runs compress to ~2 bytes per 18 (plus flags).
+    ck_assert_uint_lt(packed_length, MAX_SIZE / 8);
+    round_trip(original, MAX_SIZE, SIZE_MAX);
+}
+END_TEST
+
+START_TEST(test_random) {
+    fill_random(original, MAX_SIZE, 1);
+    round_trip(original, MAX_SIZE, SIZE_MAX);
+}
+END_TEST
+
+START_TEST(test_window_wrap) {
+    // Repeat a random block so matches reach back across the window boundary.
+    fill_random(original, 1000, 2);
+    for (size_t i = 1000; i < MAX_SIZE; i++) {
+        original[i] = original[i - 1000] ^ (uint8_t) ((i % 97) == 0);
+    }
+
+    collector_t c;
+    const size_t packed_length = lzss_pack(original, MAX_SIZE, packed);
+    ck_assert_int_eq(unpack(packed, packed_length, unpacked, sizeof(unpacked), SIZE_MAX, &c), lzss_done);
+    ck_assert_mem_eq(unpacked, original, MAX_SIZE);
+
+    // Output is delivered at least once per window.
+    ck_assert_uint_ge(c.spans, MAX_SIZE / LZSS_WINDOW_SIZE);
+}
+END_TEST
+
+START_TEST(test_fast) {
+    static uint16_t head[LZSS_PACK_FAST_HASH_SIZE];
+    collector_t c;
+
+    // Runs, random data, and a repeated block (for matches across the window
+    // boundary) each decode to the original.
+    memset(original, 0, MAX_SIZE);
+    size_t packed_length = lzss_pack_fast(original, MAX_SIZE, packed, head);
+    ck_assert_uint_lt(packed_length, MAX_SIZE / 8);
+    ck_assert_int_eq(unpack(packed, packed_length, unpacked, sizeof(unpacked), SIZE_MAX, &c), lzss_done);
+    ck_assert_mem_eq(unpacked, original, MAX_SIZE);
+
+    fill_random(original, MAX_SIZE, 5);
+    packed_length = lzss_pack_fast(original, MAX_SIZE, packed, head);
+    ck_assert_uint_le(packed_length, LZSS_PACK_BOUND(MAX_SIZE));
+    ck_assert_int_eq(unpack(packed, packed_length, unpacked, sizeof(unpacked), SIZE_MAX, &c), lzss_done);
+    ck_assert_mem_eq(unpacked, original, MAX_SIZE);
+
+    for (size_t i = 1000; i < MAX_SIZE; i++) {
+        original[i] = original[i - 1000] ^ (uint8_t) ((i % 97) == 0);
+    }
+    packed_length = lzss_pack_fast(original, MAX_SIZE, packed, head);
+    ck_assert_uint_lt(packed_length, MAX_SIZE / 2);
+    ck_assert_int_eq(unpack(packed, packed_length, unpacked, sizeof(unpacked), 7, &c), lzss_done);
+    ck_assert_mem_eq(unpacked, original, MAX_SIZE);
+}
+END_TEST
+
+START_TEST(test_byte_at_a_time) {
+    fill_random(original, MAX_SIZE, 3);
+    memset(&original[1000], 0, 2000);
+    round_trip(original, MAX_SIZE, 1);
+}
+END_TEST
+
+START_TEST(test_bad_crc) {
+    fill_random(original, 100, 4);
+    const size_t packed_length = lzss_pack(original, 100, packed);
+    packed[8] ^= 1;
+
+    collector_t c;
+    ck_assert_int_eq(unpack(packed, packed_length, unpacked, sizeof(unpacked), SIZE_MAX, &c), lzss_error);
+}
+END_TEST
+
+START_TEST(test_bad_distance) {
+    // A match as the very first item refers to data that doesn't exist.
+    const uint8_t stream[] = { 'E', 'L', 'Z', 0x1A, 3, 0, 0, 0, 0, 0, 0, 0, 0x00, 0x00, 0x00 };
+
+    collector_t c;
+    ck_assert_int_eq(unpack(stream, sizeof(stream), unpacked, sizeof(unpacked), SIZE_MAX, &c), lzss_error);
+}
+END_TEST
+
+START_TEST(test_truncated) {
+    fill_random(original, 500, 5);
+    const size_t packed_length = lzss_pack(original, 500, packed);
+
+    collector_t c;
+    ck_assert_int_eq(unpack(packed, packed_length - 10, unpacked, sizeof(unpacked), SIZE_MAX, &c), lzss_more);
+}
+END_TEST
+
+static uint8_t* read_whole_file(const char* path, size_t* length) {
+    FILE* file = fopen(path, "rb");
+    ck_assert_ptr_nonnull(file);
+    fseek(file, 0, SEEK_END);
+    *length = (size_t) ftell(file);
+    rewind(file);
+
+    uint8_t* data = malloc(*length > 0 ? *length : 1);
+    ck_assert_uint_eq(fread(data, 1, *length, file), *length);
+    fclose(file);
+    return data;
+}
+
+// Round-trip every regular file under 'dir'. Returns the number of files.
+static unsigned int round_trip_tree(const char* dir) {
+    DIR* d = opendir(dir);
+    ck_assert_ptr_nonnull(d);
+
+    unsigned int count = 0;
+    struct dirent* entry;
+    while ((entry = readdir(d)) != NULL) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+
+        struct stat st;
+        ck_assert_int_eq(stat(path, &st), 0);
+        if (S_ISDIR(st.st_mode)) {
+            count += round_trip_tree(path);
+            continue;
+        }
+        if (!S_ISREG(st.st_mode)) {
+            continue;
+        }
+
+        size_t length;
+        uint8_t* const data = read_whole_file(path, &length);
+        uint8_t* const compressed = malloc(LZSS_PACK_BOUND(length));
+        uint8_t* const output = malloc(length > 0 ? length : 1);
+
+        const size_t packed_length = lzss_pack(data, length, compressed);
+        collector_t c;
+        ck_assert_msg(unpack(compressed, packed_length, output, length, 512, &c) == lzss_done,
+            "round trip failed: %s", path);
+        ck_assert_uint_eq(c.next_offset, length);
+        ck_assert_msg(length == 0 || memcmp(output, data, length) == 0, "round trip mismatch: %s", path);
+
+        free(output);
+        free(compressed);
+        free(data);
+        count++;
+    }
+
+    closedir(d);
+    return count;
+}
+
+// Round-trip every file shipped on the SD card (ROMs, keymaps, etc.).
+START_TEST(test_sdcard_files) {
+    const char* sdcard_root = getenv("ECONOPET_TEST_SDCARD_ROOT");
+    ck_assert_msg(sdcard_root != NULL, "ECONOPET_TEST_SDCARD_ROOT environment variable not set");
+
+    ck_assert_uint_gt(round_trip_tree(sdcard_root), 0);
+}
+END_TEST
+
+static void stream_begin(void* context, size_t offset, const uint8_t* buffer, size_t length) {
+    uint8_t* const received = context;
+    memcpy(&received[offset], buffer, length);
+}
+
+// sd_stream_file() decompresses files that start with the LZSS header.
+START_TEST(test_sd_stream_inflates) {
+    fill_random(original, MAX_SIZE, 6);
+    memset(&original[2000], ' ', 3000);
+    const size_t packed_length = lzss_pack(original, MAX_SIZE, packed);
+    ck_assert_uint_gt(packed_length, SD_STREAM_CHUNK_SIZE);
+
+    FILE* file = tmpfile();
+    ck_assert_uint_eq(fwrite(packed, 1, packed_length, file), packed_length);
+    rewind(file);
+
+    const sd_stream_sink_t sink = { .begin = stream_begin, .context = unpacked };
+    sd_stream_stats_t stats;
+    ck_assert(sd_stream_file(file, &sink, SIZE_MAX, &stats));
+    ck_assert_uint_eq(stats.bytes, MAX_SIZE);
+    ck_assert_mem_eq(unpacked, original, MAX_SIZE);
+
+    // 'max_bytes' counts decompressed bytes.
+    memset(unpacked, 0, sizeof(unpacked));
+    rewind(file);
+    ck_assert(sd_stream_file(file, &sink, 5000, &stats));
+    ck_assert_uint_eq(stats.bytes, 5000);
+    ck_assert_mem_eq(unpacked, original, 5000);
+    ck_assert_uint_eq(unpacked[5000], 0);
+
+    // Corruption is reported.
+    packed[packed_length - 1] ^= 0x55;
+    rewind(file);
+    ck_assert_uint_eq(fwrite(packed, 1, packed_length, file), packed_length);
+    rewind(file);
+    ck_assert(!sd_stream_file(file, &sink, SIZE_MAX, NULL));
+
+    fclose(file);
+}
+END_TEST
+
+Suite *lzss_suite(void) {
+    Suite* s = suite_create("lzss");
+    TCase* tc = tcase_create("lzss");
+
+    tcase_add_test(tc, test_crc32_check_value);
+    tcase_add_test(tc, test_header);
+    tcase_add_test(tc, test_empty);
+    tcase_add_test(tc, test_literals);
+    tcase_add_test(tc, test_repetitive);
+    tcase_add_test(tc, test_random);
+    tcase_add_test(tc, test_window_wrap);
+    tcase_add_test(tc, test_fast);
+    tcase_add_test(tc, test_byte_at_a_time);
+    tcase_add_test(tc, test_bad_crc);
+    tcase_add_test(tc, test_bad_distance);
+    tcase_add_test(tc, test_truncated);
+    tcase_add_test(tc, test_sdcard_files);
+    tcase_add_test(tc, test_sd_stream_inflates);
+
+    suite_add_tcase(s, tc);
+    return s;
+}
@@ -2,30 +2,60 @@
 // https://github.com/dlehenbauer/econopet
 
 #include <check.h>
+#include "boot_profile_test.h"
 #include "breakpoint_test.h"
+#include "byte_ring_test.h"
+#include "cbm_image_test.h"
 #include "char_encoding_test.h"
+#include "config_cache_test.h"
 #include "config_parser_test.h"
 #include "crtc_test.h"
+#include "esc_parser_test.h"
+#include "ieee_dos_test.h"
 #include "keyscan_test.h"
 #include "keystate_test.h"
 #include "log_test.h"
+#include "lzss_test.h"
 #include "window_test.h"
 #include "petscii_test.h"
+#include "pool_test.h"
+#include "rom_pages_test.h"
+#include "screen_stream_test.h"
+#include "sd_cache_test.h"
+#include "sd_stream_test.h"
+#include "snapshot_file_test.h"
 #include "tape_dir_test.h"
+#include "tape_index_test.h"
+#include "xfer_test.h"
 
 int run_suite() {
     int number_failed = 0;
 
     // These tests are run in the same process for convenient debugging.
-    SRunner* sr1 = srunner_create(breakpoint_suite());
+    SRunner* sr1 = srunner_create(boot_profile_suite());
+    srunner_add_suite(sr1, breakpoint_suite());
+    srunner_add_suite(sr1, byte_ring_suite());
+    srunner_add_suite(sr1, cbm_image_suite());
     srunner_add_suite(sr1, char_encoding_suite());
+    srunner_add_suite(sr1, config_cache_suite());
     srunner_add_suite(sr1, config_parser_suite());
     srunner_add_suite(sr1, crtc_suite());
+    srunner_add_suite(sr1, esc_parser_suite());
+    srunner_add_suite(sr1, ieee_dos_suite());
     srunner_add_suite(sr1, keyscan_suite());
     srunner_add_suite(sr1, keystate_suite());
     srunner_add_suite(sr1, log_suite());
+    srunner_add_suite(sr1, lzss_suite());
     srunner_add_suite(sr1, petscii_suite());
+    srunner_add_suite(sr1, pool_suite());
+    srunner_add_suite(sr1, rom_pages_suite());
+    srunner_add_suite(sr1, screen_stream_suite());
+    srunner_add_suite(sr1, sd_cache_suite());
+    srunner_add_suite(sr1, sd_stream_suite());
+    srunner_add_suite(sr1, snapshot_file_suite());
     srunner_add_suite(sr1, tape_dir_suite());
+    srunner_add_suite(sr1, tape_index_suite());
+    srunner_add_suite(sr1, xfer_suite());
     srunner_set_fork_status(sr1, CK_NOFORK);
     srunner_run_all(sr1, CK_VERBOSE);
     number_failed += srunner_ntests_failed(sr1);
@@ -71,6 +71,8 @@ void mock_unregister_file(const char* path) {
     }
 }
 
+static unsigned int open_count = 0;
+
 // Clear all registered in-memory files
 void mock_clear_files(void) {
     while (mem_files) {
@@ -79,12 +81,18 @@ void mock_clear_files(void) {
         free(mem_files);
         mem_files = next;
     }
+    open_count = 0;
+}
+
+unsigned int mock_open_count(void) {
+    return open_count;
 }
 
 // Mock implementation of 'sd_open' returns contents of previously registered in-memory files
 // using 'mock_register_file()'.
 FILE* sd_open(const char* path, const char* mode) {
     assert(path[0] == '/');
+    open_count++;
     
     // Check if this is an in-memory file
     mem_file_t* mem_file = find_mem_file(path);
@@ -104,6 +112,21 @@ FILE* sd_open(const char* path, const char* mode) {
     exit(1);
 }
 
+// Mock 'sd_stat' fails, so callers parse config.yaml rather than using a
+// compiled copy.
+bool sd_stat(const char* path, uint32_t* size, uint32_t* mtime) {
+    (void)path;
+    (void)size;
+    (void)mtime;
+    return false;
+}
+
+// Mock 'sd_set_search_order' accepts any order (there are no volumes to search).
+bool sd_set_search_order(const char* order) {
+    (void)order;
+    return true;
+}
+
 // Mock display functions
 void display_window_begin(const void* window) {
     (void)window;
@@ -135,13 +158,17 @@ void roms_refresh_char_rom() { }
 void start_menu_rom() { }
 void pet_nmi() { }
 
-void spi_fill(uint32_t addr, uint8_t byte, size_t byteLength) {
-    (void)addr;
-    (void)byte;
-    (void)byteLength;
+void test_ram() { }
+
+bool snapshot_restore(const char* path) {
+    (void)path;
+    return false;
 }
 
-void test_ram() { }
+bool snapshot_check(const char* path) {
+    (void)path;
+    return false;
+}
 
 // Mock Pico SDK functions for test builds
 
@@ -31,3 +31,6 @@ void mock_unregister_file(const char* path);
 
 // Clear all registered in-memory files
 void mock_clear_files(void);
+
+// Number of files opened with 'sd_open' since the last 'mock_clear_files()'
+unsigned int mock_open_count(void);
@@ -0,0 +1,157 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#include "pch.h"
+#include "pool_test.h"
+
+#include "pool.h"
+
+static void setup(void) {
+    pool_reset_stats();
+}
+
+START_TEST(test_best_fit) {
+    uint8_t* small = pool_alloc(1, "test");
+    uint8_t* medium = pool_alloc(POOL_SMALL_SIZE + 1, "test");
+    uint8_t* large = pool_alloc(POOL_LARGE_SIZE, "test");
+
+    ck_assert_uint_eq(pool_block_size(small), POOL_SMALL_SIZE);
+    ck_assert_uint_eq(pool_block_size(medium), POOL_MEDIUM_SIZE);
+    ck_assert_uint_eq(pool_block_size(large), POOL_LARGE_SIZE);
+
+    // Blocks are usable over their full size without overlapping.
+    memset(small, 1, POOL_SMALL_SIZE);
+    memset(medium, 2, POOL_MEDIUM_SIZE);
+    memset(large, 3, POOL_LARGE_SIZE);
+    ck_assert_uint_eq(small[POOL_SMALL_SIZE - 1], 1);
+    ck_assert_uint_eq(medium[0], 2);
+
+    pool_free(large);
+    pool_free(medium);
+    pool_free(small);
+}
+END_TEST
+
+START_TEST(test_concurrent_blocks) {
+    void* blocks[POOL_MEDIUM_COUNT];
+    for (size_t i = 0; i < POOL_MEDIUM_COUNT; i++) {
+        blocks[i] = pool_alloc(POOL_MEDIUM_SIZE, "test");
+        for (size_t j = 0; j < i; j++) {
+            ck_assert_ptr_ne(blocks[i], blocks[j]);
+        }
+    }
+
+    pool_class_stats_t stats;
+    pool_get_stats(1, &stats);
+    ck_assert_uint_eq(stats.in_use, POOL_MEDIUM_COUNT);
+    ck_assert_uint_eq(stats.high_water, POOL_MEDIUM_COUNT);
+
+    for (size_t i = 0; i < POOL_MEDIUM_COUNT; i++) {
+        pool_free(blocks[i]);
+    }
+
+    pool_get_stats(1, &stats);
+    ck_assert_uint_eq(stats.in_use, 0);
+    ck_assert_uint_eq(stats.high_water, POOL_MEDIUM_COUNT);
+    ck_assert_uint_eq(stats.allocs, POOL_MEDIUM_COUNT);
+}
+END_TEST
+
+START_TEST(test_falls_back_to_larger_class) {
+    void* blocks[POOL_SMALL_COUNT];
+    for (size_t i = 0; i < POOL_SMALL_COUNT; i++) {
+        blocks[i] = pool_alloc(POOL_SMALL_SIZE, "test");
+    }
+
+    void* spill = pool_alloc(POOL_SMALL_SIZE, "test");
+    ck_assert_uint_eq(pool_block_size(spill), POOL_MEDIUM_SIZE);
+
+    pool_free(spill);
+    for (size_t i = 0; i < POOL_SMALL_COUNT; i++) {
+        pool_free(blocks[i]);
+    }
+}
+END_TEST
+
+START_TEST(test_exhausted) {
+    void* blocks[POOL_LARGE_COUNT];
+    for (size_t i = 0; i < POOL_LARGE_COUNT; i++) {
+        blocks[i] = pool_alloc(POOL_LARGE_SIZE, "test");
+    }
+
+    ck_assert_ptr_null(pool_try_alloc(POOL_LARGE_SIZE, "test"));
+    ck_assert_ptr_null(pool_try_alloc(POOL_LARGE_SIZE + 1, "test"));
+
+    pool_class_stats_t stats;
+    pool_get_stats(2, &stats);
+    ck_assert_uint_eq(stats.failures, 2);
+
+    for (size_t i = 0; i < POOL_LARGE_COUNT; i++) {
+        pool_free(blocks[i]);
+    }
+
+    // Freed blocks are reused.
+    void* block = pool_try_alloc(POOL_LARGE_SIZE, "test");
+    ck_assert_ptr_nonnull(block);
+    pool_free(block);
+}
+END_TEST
+
+START_TEST(test_owner_tags) {
+    void* block = pool_alloc(POOL_MEDIUM_SIZE, "tape dir");
+
+    bool found = false;
+    for (size_t i = 0; i < POOL_MEDIUM_COUNT; i++) {
+        const char* owner = pool_block_owner(1, i);
+        if (owner != NULL) {
+            ck_assert_str_eq(owner, "tape dir");
+            found = true;
+        }
+    }
+    ck_assert(found);
+
+    pool_free(block);
+    for (size_t i = 0; i < POOL_MEDIUM_COUNT; i++) {
+        ck_assert_ptr_null(pool_block_owner(1, i));
+    }
+}
+END_TEST
+
+START_TEST(test_reset_stats) {
+    void* a = pool_alloc(1, "test");
+    void* b = pool_alloc(1, "test");
+    pool_free(b);
+
+    pool_reset_stats();
+
+    pool_class_stats_t stats;
+    pool_get_stats(0, &stats);
+    ck_assert_uint_eq(stats.in_use, 1);
+    ck_assert_uint_eq(stats.high_water, 1);
+    ck_assert_uint_eq(stats.allocs, 0);
+
+    pool_free(a);
+}
+END_TEST
+
+START_TEST(test_free_null) {
+    pool_free(NULL);
+}
+END_TEST
+
+Suite *pool_suite(void) {
+    Suite* s = suite_create("pool");
+    TCase* tc = tcase_create("pool");
+
+    tcase_add_checked_fixture(tc, setup, NULL);
+    tcase_add_test(tc, test_best_fit);
+    tcase_add_test(tc, test_concurrent_blocks);
+    tcase_add_test(tc, test_falls_back_to_larger_class);
+    tcase_add_test(tc, test_exhausted);
+    tcase_add_test(tc, test_owner_tags);
+    tcase_add_test(tc, test_reset_stats);
+    tcase_add_test(tc, test_free_null);
+
+    suite_add_tcase(s, tc);
+    return s;
+}
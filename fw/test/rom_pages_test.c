@@ -0,0 +1,321 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#include "pch.h"
+#include "rom_pages_test.h"
+
+#include "driver.h"
+#include "roms/checksum.h"
+#include "roms/rom_pages.h"
+
+// SRAM is the mock in breakpoint_test.c. Unlike the real driver, its
+// spi_write() does not call rom_pages_forget(), so writing with it behind
+// rom_pages' back shows which pages rom_pages did not write.
+
+#define ROM_ADDRESS 0xb000
+#define ROM_LENGTH  0x1000
+#define ROM_CRC     0x1234abcd     // Remembered with the ROM (not its real CRC)
+
+static uint8_t rom[ROM_LENGTH];
+
+static void setup(void) {
+    rom_pages_reset();
+    for (unsigned int i = 0; i < sizeof(rom); i++) {
+        rom[i] = (uint8_t) (i * 7 + (i >> 8));
+    }
+}
+
+static void apply(rom_pages_stats_t* stats) {
+    rom_pages_begin();
+    rom_pages_write(ROM_ADDRESS, rom, sizeof(rom));
+    ck_assert(rom_pages_end(/* verify: */ false, stats));
+}
+
+static bool reuse(const char* path, uint32_t mtime, uint32_t address) {
+    uint32_t length;
+    uint32_t crc;
+    return rom_pages_reuse(path, mtime, address, &length, &crc);
+}
+
+static uint8_t peek(uint32_t address) {
+    uint8_t byte;
+    spi_read(address, 1, &byte);
+    return byte;
+}
+
+static void poke(uint32_t address, uint8_t byte) {
+    spi_write(address, &byte, 1);
+}
+
+static uint8_t sum_of(const uint8_t* data, size_t length) {
+    uint8_t sum = 0;
+    checksum_add(data, length, &sum);
+    return sum;
+}
+
+static void check_rom(void) {
+    uint8_t actual[ROM_LENGTH];
+    spi_read(ROM_ADDRESS, sizeof(actual), actual);
+    ck_assert_mem_eq(actual, rom, sizeof(rom));
+}
+
+START_TEST(test_prefill) {
+    rom_pages_stats_t stats;
+    apply(&stats);
+
+    // Each page is written once: the ROM's pages are not filled first.
+    ck_assert_uint_eq(stats.written, ROM_PAGE_COUNT);
+    ck_assert_uint_eq(stats.unchanged, 0);
+
+    check_rom();
+    ck_assert_uint_eq(peek(0x9000), 0x90);
+    ck_assert_uint_eq(peek(0xafff), 0xaf);
+    ck_assert_uint_eq(peek(0xc000), 0xc0);
+    ck_assert_uint_eq(peek(0xffff), 0xff);
+}
+END_TEST
+
+START_TEST(test_skips_unchanged) {
+    rom_pages_stats_t stats;
+    apply(&stats);
+
+    poke(0x9000, 0x00);
+    poke(ROM_ADDRESS, (uint8_t) ~rom[0]);
+    apply(&stats);
+
+    ck_assert_uint_eq(stats.written, 0);
+    ck_assert_uint_eq(stats.unchanged, ROM_PAGE_COUNT);
+    ck_assert_uint_eq(peek(0x9000), 0x00);
+    ck_assert_uint_eq(peek(ROM_ADDRESS), (uint8_t) ~rom[0]);
+}
+END_TEST
+
+START_TEST(test_rewrites_changed) {
+    rom_pages_stats_t stats;
+    apply(&stats);
+
+    rom[0x180]++;
+    apply(&stats);
+
+    ck_assert_uint_eq(stats.written, 1);
+    check_rom();
+}
+END_TEST
+
+START_TEST(test_forget) {
+    rom_pages_stats_t stats;
+    apply(&stats);
+
+    poke(ROM_ADDRESS + 0x280, 0x00);
+    rom_pages_forget(ROM_ADDRESS + 0x280, 1);
+    apply(&stats);
+
+    ck_assert_uint_eq(stats.written, 1);
+    check_rom();
+}
+END_TEST
+
+START_TEST(test_partial) {
+    static const uint8_t patch[] = { 0xea, 0xea, 0xea };
+
+    rom_pages_stats_t stats;
+    rom_pages_begin();
+    rom_pages_write(ROM_ADDRESS, rom, sizeof(rom));
+    rom_pages_write(ROM_ADDRESS + 0x5fe, patch, sizeof(patch));
+    rom_pages_write(0x9005, patch, 1);
+    ck_assert(rom_pages_end(/* verify: */ true, &stats));
+
+    // The unpatched pages are filled before the patch is written.
+    ck_assert_uint_eq(peek(0x9004), 0x90);
+    ck_assert_uint_eq(peek(0x9005), 0xea);
+    ck_assert_uint_eq(peek(0x9006), 0x90);
+
+    memcpy(&rom[0x5fe], patch, sizeof(patch));
+    check_rom();
+
+    // A ROM that already includes the patch finds every page unchanged. The
+    // patch itself is written again (to each of the two pages it spans), and
+    // the page patched only the first time is filled again.
+    rom_pages_begin();
+    rom_pages_write(ROM_ADDRESS, rom, sizeof(rom));
+    rom_pages_write(ROM_ADDRESS + 0x5fe, patch, sizeof(patch));
+    ck_assert(rom_pages_end(/* verify: */ true, &stats));
+    ck_assert_uint_eq(stats.written, 3);
+    ck_assert_uint_eq(stats.unchanged, ROM_PAGE_COUNT - 1);
+    ck_assert_uint_eq(peek(0x9005), 0x90);
+    check_rom();
+}
+END_TEST
+
+START_TEST(test_stream) {
+    rom_pages_stats_t stats;
+    apply(&stats);
+
+    // Writing the same data in odd spans (as decompression produces it)
+    // finds every page unchanged.
+    rom_pages_stream_t stream;
+    rom_pages_begin();
+    rom_pages_stream_begin(&stream, ROM_ADDRESS);
+    for (size_t offset = 0; offset < sizeof(rom); offset += 37) {
+        const size_t length = sizeof(rom) - offset < 37 ? sizeof(rom) - offset : 37;
+        rom_pages_stream_write(&stream, &rom[offset], length);
+    }
+    rom_pages_stream_end(&stream);
+    ck_assert(rom_pages_end(/* verify: */ false, &stats));
+
+    ck_assert_uint_eq(stats.written, 0);
+    ck_assert_uint_eq(stats.unchanged, ROM_PAGE_COUNT);
+    check_rom();
+}
+END_TEST
+
+START_TEST(test_reuse) {
+    rom_pages_stats_t stats;
+    ck_assert(!reuse("/roms/kernal.bin", 1, ROM_ADDRESS));
+    apply(&stats);
+    rom_pages_remember("/roms/kernal.bin", 1, ROM_ADDRESS, sizeof(rom), ROM_CRC);
+
+    rom_pages_begin();
+    ck_assert(!reuse("/roms/kernal.bin", 2, ROM_ADDRESS));
+    ck_assert(!reuse("/roms/kernal.bin", 1, ROM_ADDRESS + ROM_PAGE_SIZE));
+    ck_assert(!reuse("/roms/basic.bin", 1, ROM_ADDRESS));
+    uint32_t length = 0;
+    uint32_t crc = 0;
+    ck_assert(rom_pages_reuse("/roms/kernal.bin", 1, ROM_ADDRESS, &length, &crc));
+    ck_assert_uint_eq(length, sizeof(rom));
+    ck_assert_uint_eq(crc, ROM_CRC);
+    ck_assert(rom_pages_end(/* verify: */ false, &stats));
+    ck_assert_uint_eq(stats.written, 0);
+    ck_assert_uint_eq(stats.reused, 1);
+
+    // Once any of its pages is written, the file must be read again.
+    rom_pages_forget(ROM_ADDRESS + 0xf00, 1);
+    ck_assert(!reuse("/roms/kernal.bin", 1, ROM_ADDRESS));
+}
+END_TEST
+
+START_TEST(test_saved_page) {
+    rom_pages_stats_t stats;
+    apply(&stats);
+    rom_pages_remember("/roms/kernal.bin", 1, ROM_ADDRESS, sizeof(rom), ROM_CRC);
+
+    // Something else (e.g., the menu ROM) briefly takes over the ROM's last page.
+    const uint32_t last = ROM_ADDRESS + ROM_LENGTH - ROM_PAGE_SIZE;
+    rom_pages_save(last);
+    poke(last, 0xea);
+    rom_pages_forget(last, 1);
+    rom_pages_save(last);           // Already saved, so the overwritten page is not saved again
+    ck_assert(!reuse("/roms/kernal.bin", 1, ROM_ADDRESS));
+
+    rom_pages_begin();
+    ck_assert(reuse("/roms/kernal.bin", 1, ROM_ADDRESS));
+    ck_assert(rom_pages_end(/* verify: */ true, &stats));
+    check_rom();
+}
+END_TEST
+
+START_TEST(test_remember_whole_pages) {
+    rom_pages_stats_t stats;
+    apply(&stats);
+
+    rom_pages_remember("/roms/short.bin", 1, ROM_ADDRESS, 0x7ff, ROM_CRC);
+    ck_assert(!reuse("/roms/short.bin", 1, ROM_ADDRESS));
+    rom_pages_remember("/roms/char.bin", 1, 0x8000, 0x1000, ROM_CRC);
+    ck_assert(!reuse("/roms/char.bin", 1, 0x8000));
+}
+END_TEST
+
+START_TEST(test_sources_replaced) {
+    rom_pages_stats_t stats;
+    apply(&stats);
+
+    char path[ROM_PAGES_PATH_LENGTH];
+    for (unsigned int i = 0; i <= ROM_PAGES_SOURCES; i++) {
+        snprintf(path, sizeof(path), "/roms/%u.bin", i);
+        rom_pages_remember(path, 1, ROM_ADDRESS, sizeof(rom), ROM_CRC);
+    }
+
+    // The oldest entry was replaced, and each page holds only the last file.
+    ck_assert(!reuse("/roms/0.bin", 1, ROM_ADDRESS));
+    ck_assert(!reuse("/roms/1.bin", 1, ROM_ADDRESS));
+    snprintf(path, sizeof(path), "/roms/%u.bin", ROM_PAGES_SOURCES);
+    ck_assert(reuse(path, 1, ROM_ADDRESS));
+}
+END_TEST
+
+START_TEST(test_checksum) {
+    static const uint8_t patch[] = { 0xea, 0xea, 0xea };
+    uint8_t fill[ROM_PAGE_SIZE];
+    memset(fill, 0x90, sizeof(fill));
+
+    rom_pages_stats_t stats;
+    rom_pages_begin();
+    rom_pages_write(ROM_ADDRESS, rom, sizeof(rom));
+    rom_pages_write(ROM_ADDRESS + 0x5fe, patch, sizeof(patch));
+    memcpy(&rom[0x5fe], patch, sizeof(patch));
+
+    // A change behind rom_pages' back is not seen, since whole pages are
+    // summed without reading them. Partial pages at either end are read.
+    const uint8_t poked = (uint8_t) ~rom[0x180];
+    poke(ROM_ADDRESS + 0x180, poked);
+    ck_assert_uint_eq(rom_pages_checksum(ROM_ADDRESS, sizeof(rom)), sum_of(rom, sizeof(rom)));
+    ck_assert_uint_eq(rom_pages_checksum(ROM_ADDRESS + 0x80, 0x301), sum_of(&rom[0x80], 0x301));
+
+    // Deferred prefills are written first.
+    ck_assert_uint_eq(rom_pages_checksum(0x9000, ROM_PAGE_SIZE), sum_of(fill, sizeof(fill)));
+    ck_assert_uint_eq(peek(0x9000), 0x90);
+
+    ck_assert(rom_pages_end(/* verify: */ false, &stats));
+    ck_assert_uint_eq(stats.summed, ROM_LENGTH / ROM_PAGE_SIZE + 2 + 1);
+
+    // A page that is no longer trusted is read.
+    rom_pages_forget(ROM_ADDRESS + 0x180, 1);
+    rom[0x180] = poked;
+    ck_assert_uint_eq(rom_pages_checksum(ROM_ADDRESS, sizeof(rom)), sum_of(rom, sizeof(rom)));
+}
+END_TEST
+
+START_TEST(test_verify) {
+    rom_pages_stats_t stats;
+    apply(&stats);
+
+    rom[0x310]++;
+    rom_pages_begin();
+    rom_pages_write(ROM_ADDRESS, rom, sizeof(rom));
+    poke(ROM_ADDRESS + 0x3ff, 0x00);
+    poke(ROM_ADDRESS + 0x4ff, 0x00);
+    ck_assert(!rom_pages_end(/* verify: */ true, &stats));
+
+    // Only the page that was written is read back.
+    ck_assert_uint_eq(stats.verified, 1);
+    ck_assert_uint_eq(stats.mismatched, 1);
+
+    // The mismatched page is written again next time.
+    apply(&stats);
+    ck_assert_uint_eq(stats.written, 1);
+    ck_assert_uint_eq(peek(ROM_ADDRESS + 0x3ff), rom[0x3ff]);
+    ck_assert_uint_eq(peek(ROM_ADDRESS + 0x4ff), 0x00);
+}
+END_TEST
+
+Suite *rom_pages_suite(void) {
+    Suite* s = suite_create("rom_pages");
+    TCase* tc = tcase_create("pages");
+
+    tcase_add_checked_fixture(tc, setup, NULL);
+    tcase_add_test(tc, test_prefill);
+    tcase_add_test(tc, test_skips_unchanged);
+    tcase_add_test(tc, test_rewrites_changed);
+    tcase_add_test(tc, test_forget);
+    tcase_add_test(tc, test_partial);
+    tcase_add_test(tc, test_stream);
+    tcase_add_test(tc, test_reuse);
+    tcase_add_test(tc, test_saved_page);
+    tcase_add_test(tc, test_remember_whole_pages);
+    tcase_add_test(tc, test_sources_replaced);
+    tcase_add_test(tc, test_checksum);
+    tcase_add_test(tc, test_verify);
+
+    suite_add_tcase(s, tc);
+    return s;
+}
@@ -0,0 +1,227 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#include "pch.h"
+#include "screen_stream_test.h"
+
+#include <string.h>
+
+#include "display/screen_stream.h"
+#include "system_state.h"
+
+#define SCREEN_BYTES 1000   // 40x25
+#define WIRE_CAPACITY (4 * SCREEN_STREAM_MAX_FRAME)
+
+// Encoder and decoder are large, so keep them out of the stack.
+static screen_stream_encoder_t encoder;
+static screen_stream_decoder_t decoder;
+
+static uint8_t wire[WIRE_CAPACITY];
+static size_t wire_length;
+
+static uint8_t screen[SCREEN_STREAM_MAX_SCREEN];
+static uint8_t crtc[SCREEN_STREAM_CRTC_REGS];
+
+static void wire_write(void* context, const uint8_t* data, size_t length) {
+    (void) context;
+    ck_assert_uint_le(wire_length + length, WIRE_CAPACITY);
+    memcpy(&wire[wire_length], data, length);
+    wire_length += length;
+}
+
+// Simple deterministic PRNG so failures are reproducible.
+static uint32_t rng_state;
+static uint32_t rng_next(void) {
+    rng_state = rng_state * 1664525u + 1013904223u;
+    return rng_state >> 8;
+}
+
+static void setup(void) {
+    screen_stream_encoder_init(&encoder);
+    screen_stream_decoder_init(&decoder);
+    wire_length = 0;
+    rng_state = 12345;
+
+    memset(screen, 0x20, sizeof(screen));   // Blank screen (spaces)
+    for (size_t i = 0; i < sizeof(crtc); i++) {
+        crtc[i] = (uint8_t) i;
+    }
+}
+
+static size_t encode(uint16_t length, uint8_t flags) {
+    const screen_stream_frame_t frame = {
+        .screen = screen,
+        .length = length,
+        .crtc = crtc,
+        .flags = flags,
+    };
+    return screen_stream_encode(&encoder, &frame, wire_write, NULL);
+}
+
+// Feed the wire buffer to the decoder and return the number of frames applied.
+static int decode_all(void) {
+    int applied = 0;
+    for (size_t i = 0; i < wire_length; i++) {
+        if (screen_stream_decode_byte(&decoder, wire[i])) {
+            applied++;
+        }
+    }
+    wire_length = 0;
+    return applied;
+}
+
+static void assert_decoded_matches(uint16_t length, uint8_t flags) {
+    ck_assert_uint_eq(decoder.length, length);
+    ck_assert_uint_eq(decoder.flags, flags);
+    ck_assert_mem_eq(decoder.screen, screen, length);
+    ck_assert_mem_eq(decoder.crtc, crtc, sizeof(crtc));
+}
+
+START_TEST(test_keyframe_roundtrip) {
+    memcpy(screen, "HELLO", 5);
+    screen[500] = 0xA0;         // Reverse-video space
+
+    ck_assert_uint_gt(encode(SCREEN_BYTES, SCREEN_STREAM_FLAG_GRAPHICS), 0);
+    ck_assert_uint_eq(wire[2], SCREEN_STREAM_KEYFRAME);
+    ck_assert_int_eq(decode_all(), 1);
+    assert_decoded_matches(SCREEN_BYTES, SCREEN_STREAM_FLAG_GRAPHICS);
+}
+
+START_TEST(test_blank_keyframe_is_compact) {
+    // 1000 identical bytes collapse to 8 repeat records.
+    const size_t bytes = encode(SCREEN_BYTES, 0);
+    ck_assert_uint_eq(bytes, SCREEN_STREAM_HEADER_SIZE + 8 * 2 + SCREEN_STREAM_CRC_SIZE);
+}
+
+START_TEST(test_unchanged_frame_sends_nothing) {
+    encode(SCREEN_BYTES, 0);
+    wire_length = 0;
+
+    ck_assert_uint_eq(encode(SCREEN_BYTES, 0), 0);
+    ck_assert_uint_eq(wire_length, 0);
+}
+
+START_TEST(test_delta_frames_track_changes) {
+    encode(SCREEN_BYTES, 0);
+    ck_assert_int_eq(decode_all(), 1);
+
+    for (int frame = 0; frame < 20; frame++) {
+        // Scatter a few edits, as when the PET prints a line.
+        for (int edit = 0; edit < 8; edit++) {
+            screen[rng_next() % SCREEN_BYTES] = (uint8_t) rng_next();
+        }
+
+        const size_t bytes = encode(SCREEN_BYTES, 0);
+        ck_assert_uint_gt(bytes, 0);
+        ck_assert_uint_eq(wire[2], SCREEN_STREAM_DELTA);
+
+        // A handful of edits must be far smaller than the raw screen.
+        ck_assert_uint_lt(bytes, SCREEN_BYTES / 4);
+
+        ck_assert_int_eq(decode_all(), 1);
+        assert_decoded_matches(SCREEN_BYTES, 0);
+    }
+}
+
+START_TEST(test_random_screen_within_bound) {
+    for (size_t i = 0; i < SCREEN_STREAM_MAX_SCREEN; i++) {
+        screen[i] = (uint8_t) rng_next();
+    }
+
+    const size_t bytes = encode(SCREEN_STREAM_MAX_SCREEN, SCREEN_STREAM_FLAG_COLOUR | SCREEN_STREAM_FLAG_80_COLUMNS);
+    ck_assert_uint_le(bytes, SCREEN_STREAM_MAX_FRAME);
+    ck_assert_int_eq(decode_all(), 1);
+    assert_decoded_matches(SCREEN_STREAM_MAX_SCREEN, SCREEN_STREAM_FLAG_COLOUR | SCREEN_STREAM_FLAG_80_COLUMNS);
+}
+
+START_TEST(test_geometry_change_forces_keyframe) {
+    encode(SCREEN_BYTES, 0);
+    decode_all();
+
+    crtc[CRTC_R1_H_DISPLAYED] = 80;
+    screen[0] ^= 1;
+    encode(SCREEN_BYTES, 0);
+    ck_assert_uint_eq(wire[2], SCREEN_STREAM_KEYFRAME);
+    ck_assert_int_eq(decode_all(), 1);
+    assert_decoded_matches(SCREEN_BYTES, 0);
+
+    encode(2 * SCREEN_BYTES, SCREEN_STREAM_FLAG_80_COLUMNS);
+    ck_assert_uint_eq(wire[2], SCREEN_STREAM_KEYFRAME);
+    ck_assert_int_eq(decode_all(), 1);
+    assert_decoded_matches(2 * SCREEN_BYTES, SCREEN_STREAM_FLAG_80_COLUMNS);
+}
+
+START_TEST(test_periodic_keyframe) {
+    encode(SCREEN_BYTES, 0);
+    decode_all();
+
+    int keyframes = 0;
+    for (int i = 0; i < SCREEN_STREAM_KEYFRAME_INTERVAL; i++) {
+        screen[i] ^= 0x80;
+        encode(SCREEN_BYTES, 0);
+        keyframes += (wire[2] == SCREEN_STREAM_KEYFRAME);
+        ck_assert_int_eq(decode_all(), 1);
+    }
+
+    ck_assert_int_eq(keyframes, 1);
+    assert_decoded_matches(SCREEN_BYTES, 0);
+}
+
+START_TEST(test_corrupt_frame_waits_for_keyframe) {
+    encode(SCREEN_BYTES, 0);
+    decode_all();
+
+    // Corrupt a payload byte of the next delta.
+    screen[10] = 'X';
+    encode(SCREEN_BYTES, 0);
+    wire[SCREEN_STREAM_HEADER_SIZE] ^= 0x55;
+    ck_assert_int_eq(decode_all(), 0);
+    ck_assert_uint_eq(decoder.crc_errors, 1);
+
+    // The following delta cannot be applied without its predecessor.
+    screen[11] = 'Y';
+    encode(SCREEN_BYTES, 0);
+    ck_assert_int_eq(decode_all(), 0);
+    ck_assert_uint_eq(decoder.skipped, 1);
+
+    // A keyframe restores sync.
+    screen_stream_request_keyframe(&encoder);
+    encode(SCREEN_BYTES, 0);
+    ck_assert_int_eq(decode_all(), 1);
+    assert_decoded_matches(SCREEN_BYTES, 0);
+}
+
+START_TEST(test_skips_text_between_frames) {
+    // Console text (or line noise) may be interleaved with frames.
+    static const char noise[] = "\r\nlog: hello \xEC world\xEC\r\n";
+    wire_write(NULL, (const uint8_t*) noise, sizeof(noise) - 1);
+
+    memcpy(screen, "READY.", 6);
+    encode(SCREEN_BYTES, 0);
+    wire_write(NULL, (const uint8_t*) noise, sizeof(noise) - 1);
+
+    screen[40] = '*';
+    encode(SCREEN_BYTES, 0);
+
+    ck_assert_int_eq(decode_all(), 2);
+    assert_decoded_matches(SCREEN_BYTES, 0);
+}
+
+Suite *screen_stream_suite(void) {
+    Suite* s = suite_create("screen_stream");
+    TCase* tc = tcase_create("loopback");
+
+    tcase_add_checked_fixture(tc, setup, NULL);
+    tcase_add_test(tc, test_keyframe_roundtrip);
+    tcase_add_test(tc, test_blank_keyframe_is_compact);
+    tcase_add_test(tc, test_unchanged_frame_sends_nothing);
+    tcase_add_test(tc, test_delta_frames_track_changes);
+    tcase_add_test(tc, test_random_screen_within_bound);
+    tcase_add_test(tc, test_geometry_change_forces_keyframe);
+    tcase_add_test(tc, test_periodic_keyframe);
+    tcase_add_test(tc, test_corrupt_frame_waits_for_keyframe);
+    tcase_add_test(tc, test_skips_text_between_frames);
+
+    suite_add_tcase(s, tc);
+    return s;
+}
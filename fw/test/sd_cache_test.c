@@ -0,0 +1,251 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#include "pch.h"
+#include "sd_cache_test.h"
+
+#include <dirent.h>
+#include <unistd.h>
+
+#include "sd/sd_cache.h"
+
+#define BUDGET 100
+
+static char root[32];
+
+static void setup(void) {
+    snprintf(root, sizeof(root), "/tmp/econopet-cache-XXXXXX");
+    ck_assert_ptr_nonnull(mkdtemp(root));
+    sd_cache_init(root, BUDGET);
+}
+
+static void teardown(void) {
+    DIR* dir = opendir(root);
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] != '.') {
+            char path[PATH_MAX];
+            snprintf(path, sizeof(path), "%s/%s", root, entry->d_name);
+            unlink(path);
+        }
+    }
+    closedir(dir);
+    rmdir(root);
+}
+
+// Store 'size' bytes of 'fill' as the cached copy of 'path'.
+static void store(const char* path, uint32_t size, uint32_t mtime, char fill) {
+    FILE* file = sd_cache_store_begin(path, size, mtime);
+    ck_assert_ptr_nonnull(file);
+    for (uint32_t i = 0; i < size; i++) {
+        fputc(fill, file);
+    }
+    sd_cache_store_end(file, /* complete: */ true);
+}
+
+// True if the cached copy of 'path' matches and holds 'size' bytes of 'fill'.
+static bool hit(const char* path, uint32_t size, uint32_t mtime, char fill) {
+    FILE* file = sd_cache_open(path, size, mtime);
+    if (file == NULL) {
+        return false;
+    }
+
+    uint32_t count = 0;
+    int ch;
+    while ((ch = fgetc(file)) != EOF) {
+        ck_assert_int_eq(ch, fill);
+        count++;
+    }
+    fclose(file);
+
+    ck_assert_uint_eq(count, size);
+    return true;
+}
+
+START_TEST(test_miss_then_hit) {
+    ck_assert(!hit("/roms/kernal.bin", 10, 1, 'k'));
+    store("/roms/kernal.bin", 10, 1, 'k');
+    ck_assert(hit("/roms/kernal.bin", 10, 1, 'k'));
+
+    sd_cache_stats_t stats;
+    sd_cache_get_stats(&stats);
+    ck_assert_uint_eq(stats.hits, 1);
+    ck_assert_uint_eq(stats.misses, 1);
+    ck_assert_uint_eq(stats.stores, 1);
+    ck_assert_uint_eq(stats.entries, 1);
+    ck_assert_uint_eq(stats.bytes, 10);
+}
+END_TEST
+
+START_TEST(test_changed_on_sd) {
+    store("/ukm/us.bin", 10, 1, 'a');
+
+    // A different mtime or size is a miss.
+    ck_assert(!hit("/ukm/us.bin", 10, 2, 'a'));
+    ck_assert(!hit("/ukm/us.bin", 11, 1, 'a'));
+
+    // Storing the new version replaces the old one.
+    store("/ukm/us.bin", 12, 2, 'b');
+    ck_assert(hit("/ukm/us.bin", 12, 2, 'b'));
+
+    sd_cache_stats_t stats;
+    sd_cache_get_stats(&stats);
+    ck_assert_uint_eq(stats.entries, 1);
+    ck_assert_uint_eq(stats.bytes, 12);
+}
+END_TEST
+
+START_TEST(test_open_unchecked) {
+    uint32_t size;
+    uint32_t mtime;
+    ck_assert_ptr_null(sd_cache_open_unchecked("/fpga/EconoPET.hex.bin", &size, &mtime));
+
+    store("/fpga/EconoPET.hex.bin", 10, 7, 'f');
+    FILE* file = sd_cache_open_unchecked("/fpga/EconoPET.hex.bin", &size, &mtime);
+    ck_assert_ptr_nonnull(file);
+    ck_assert_uint_eq(size, 10);
+    ck_assert_uint_eq(mtime, 7);
+    ck_assert_int_eq(fgetc(file), 'f');
+    fclose(file);
+
+    // Not counted until the caller has checked the copy against the card.
+    sd_cache_stats_t stats;
+    sd_cache_get_stats(&stats);
+    ck_assert_uint_eq(stats.hits, 0);
+    ck_assert_uint_eq(stats.misses, 0);
+}
+END_TEST
+
+START_TEST(test_open_unchecked_is_used) {
+    uint32_t size;
+    uint32_t mtime;
+    store("/fpga/EconoPET.hex.bin", 40, 1, 'f');
+    store("/b", 40, 1, 'b');
+    fclose(sd_cache_open_unchecked("/fpga/EconoPET.hex.bin", &size, &mtime));
+
+    // The bitstream was used more recently than 'b', so 'b' makes room for 'c'.
+    store("/c", 40, 1, 'c');
+    ck_assert(hit("/fpga/EconoPET.hex.bin", 40, 1, 'f'));
+    ck_assert(!hit("/b", 40, 1, 'b'));
+}
+END_TEST
+
+START_TEST(test_incomplete_store) {
+    FILE* file = sd_cache_store_begin("/fpga/EconoPET.hex.bin", 10, 1);
+    ck_assert_ptr_nonnull(file);
+    fputs("short", file);
+    sd_cache_store_end(file, /* complete: */ true);
+    ck_assert(!hit("/fpga/EconoPET.hex.bin", 10, 1, 'x'));
+
+    // A read error discards the copy even if it is the right size.
+    file = sd_cache_store_begin("/fpga/EconoPET.hex.bin", 5, 1);
+    fputs("xxxxx", file);
+    sd_cache_store_end(file, /* complete: */ false);
+    ck_assert(!hit("/fpga/EconoPET.hex.bin", 5, 1, 'x'));
+
+    sd_cache_stats_t stats;
+    sd_cache_get_stats(&stats);
+    ck_assert_uint_eq(stats.entries, 0);
+}
+END_TEST
+
+START_TEST(test_too_large) {
+    ck_assert_ptr_null(sd_cache_store_begin("/roms/big.bin", BUDGET + 1, 1));
+}
+END_TEST
+
+START_TEST(test_evicts_least_recently_used) {
+    store("/a", 40, 1, 'a');
+    store("/b", 40, 1, 'b');
+    ck_assert(hit("/a", 40, 1, 'a'));
+
+    // No room for 'c' until the least recently used entry ('b') goes.
+    store("/c", 40, 1, 'c');
+    ck_assert(hit("/a", 40, 1, 'a'));
+    ck_assert(!hit("/b", 40, 1, 'b'));
+    ck_assert(hit("/c", 40, 1, 'c'));
+
+    sd_cache_stats_t stats;
+    sd_cache_get_stats(&stats);
+    ck_assert_uint_eq(stats.evictions, 1);
+    ck_assert_uint_le(stats.bytes, BUDGET);
+}
+END_TEST
+
+START_TEST(test_entry_limit) {
+    char path[16];
+    for (unsigned int i = 0; i <= SD_CACHE_ENTRIES; i++) {
+        snprintf(path, sizeof(path), "/f%u", i);
+        store(path, 1, 1, 'f');
+    }
+
+    // The oldest entry made room for the last.
+    ck_assert(!hit("/f0", 1, 1, 'f'));
+    snprintf(path, sizeof(path), "/f%u", SD_CACHE_ENTRIES);
+    ck_assert(hit(path, 1, 1, 'f'));
+
+    sd_cache_stats_t stats;
+    sd_cache_get_stats(&stats);
+    ck_assert_uint_eq(stats.entries, SD_CACHE_ENTRIES);
+}
+END_TEST
+
+START_TEST(test_persists) {
+    store("/roms/basic.bin", 20, 7, 'r');
+
+    // Power cycle.
+    sd_cache_init(root, BUDGET);
+    ck_assert(hit("/roms/basic.bin", 20, 7, 'r'));
+}
+END_TEST
+
+START_TEST(test_corrupt_index) {
+    store("/roms/basic.bin", 20, 7, 'r');
+
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/index", root);
+    FILE* file = fopen(path, "r+b");
+    ck_assert_ptr_nonnull(file);
+    fseek(file, 10, SEEK_SET);
+    fputc('!', file);
+    fclose(file);
+
+    sd_cache_init(root, BUDGET);
+    ck_assert(!hit("/roms/basic.bin", 20, 7, 'r'));
+
+    sd_cache_stats_t stats;
+    sd_cache_get_stats(&stats);
+    ck_assert_uint_eq(stats.entries, 0);
+}
+END_TEST
+
+START_TEST(test_clear) {
+    store("/a", 10, 1, 'a');
+    sd_cache_clear();
+    ck_assert(!hit("/a", 10, 1, 'a'));
+
+    sd_cache_init(root, BUDGET);
+    ck_assert(!hit("/a", 10, 1, 'a'));
+}
+END_TEST
+
+Suite *sd_cache_suite(void) {
+    Suite* s = suite_create("sd_cache");
+    TCase* tc = tcase_create("cache");
+
+    tcase_add_checked_fixture(tc, setup, teardown);
+    tcase_add_test(tc, test_miss_then_hit);
+    tcase_add_test(tc, test_changed_on_sd);
+    tcase_add_test(tc, test_open_unchecked);
+    tcase_add_test(tc, test_open_unchecked_is_used);
+    tcase_add_test(tc, test_incomplete_store);
+    tcase_add_test(tc, test_too_large);
+    tcase_add_test(tc, test_evicts_least_recently_used);
+    tcase_add_test(tc, test_entry_limit);
+    tcase_add_test(tc, test_persists);
+    tcase_add_test(tc, test_corrupt_index);
+    tcase_add_test(tc, test_clear);
+
+    suite_add_tcase(s, tc);
+    return s;
+}
@@ -0,0 +1,231 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#include "pch.h"
+#include "sd_stream_test.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "mock.h"
+#include "sd/sd.h"
+#include "sd/sd_stream.h"
+
+#define FILE_SIZE (SD_STREAM_CHUNK_SIZE * 3 + 100)
+
+static uint8_t contents[FILE_SIZE];
+
+// Records what the sink observed. Chunks are copied in wait() rather than in
+// begin(), so a buffer that was overwritten while "in flight" is detected.
+typedef struct {
+    FILE* file;
+    uint8_t received[FILE_SIZE];
+    size_t expected_offset;
+    const uint8_t* pending;
+    size_t pending_length;
+    unsigned int begins;
+    unsigned int waits;
+    unsigned int overlapped;    // Chunks during which the next read happened
+    long begin_position;
+} recording_sink_t;
+
+static recording_sink_t recorder;
+
+static void record_begin(void* context, size_t offset, const uint8_t* buffer, size_t length) {
+    recording_sink_t* const r = context;
+    ck_assert_ptr_null(r->pending);
+    ck_assert_uint_eq(offset, r->expected_offset);
+    ck_assert_uint_le(length, SD_STREAM_CHUNK_SIZE);
+
+    r->pending = buffer;
+    r->pending_length = length;
+    r->begin_position = ftell(r->file);
+    r->begins++;
+}
+
+static void record_wait(void* context) {
+    recording_sink_t* const r = context;
+    ck_assert_ptr_nonnull(r->pending);
+
+    memcpy(&r->received[r->expected_offset], r->pending, r->pending_length);
+    if (ftell(r->file) > r->begin_position) {
+        r->overlapped++;
+    }
+
+    r->expected_offset += r->pending_length;
+    r->pending = NULL;
+    r->waits++;
+}
+
+static FILE* open_contents(void) {
+    FILE* file = tmpfile();
+    ck_assert_ptr_nonnull(file);
+    ck_assert_uint_eq(fwrite(contents, 1, sizeof(contents), file), sizeof(contents));
+    rewind(file);
+    return file;
+}
+
+static void setup(void) {
+    for (size_t i = 0; i < sizeof(contents); i++) {
+        contents[i] = (uint8_t) (i * 7 + (i >> 8));
+    }
+    memset(&recorder, 0, sizeof(recorder));
+}
+
+START_TEST(test_streams_whole_file) {
+    recorder.file = open_contents();
+    const sd_stream_sink_t sink = { record_begin, record_wait, &recorder };
+
+    sd_stream_stats_t stats;
+    ck_assert(sd_stream_file(recorder.file, &sink, SIZE_MAX, &stats));
+    fclose(recorder.file);
+
+    ck_assert_uint_eq(stats.bytes, FILE_SIZE);
+    ck_assert_uint_eq(recorder.begins, 4);
+    ck_assert_uint_eq(recorder.waits, 4);
+    ck_assert_mem_eq(recorder.received, contents, FILE_SIZE);
+}
+
+START_TEST(test_reads_ahead_while_sink_is_busy) {
+    recorder.file = open_contents();
+    const sd_stream_sink_t sink = { record_begin, record_wait, &recorder };
+
+    ck_assert(sd_stream_file(recorder.file, &sink, SIZE_MAX, NULL));
+    fclose(recorder.file);
+
+    // Every chunk but the last overlaps with the read of the next one.
+    ck_assert_uint_eq(recorder.overlapped, recorder.begins - 1);
+}
+
+START_TEST(test_max_bytes) {
+    recorder.file = open_contents();
+    const sd_stream_sink_t sink = { record_begin, record_wait, &recorder };
+
+    sd_stream_stats_t stats;
+    ck_assert(sd_stream_file(recorder.file, &sink, SD_STREAM_CHUNK_SIZE + 10, &stats));
+
+    ck_assert_uint_eq(stats.bytes, SD_STREAM_CHUNK_SIZE + 10);
+    ck_assert_uint_eq(ftell(recorder.file), SD_STREAM_CHUNK_SIZE + 10);
+    ck_assert_mem_eq(recorder.received, contents, SD_STREAM_CHUNK_SIZE + 10);
+    fclose(recorder.file);
+}
+
+START_TEST(test_empty_file) {
+    recorder.file = tmpfile();
+    const sd_stream_sink_t sink = { record_begin, record_wait, &recorder };
+
+    sd_stream_stats_t stats;
+    ck_assert(sd_stream_file(recorder.file, &sink, SIZE_MAX, &stats));
+    fclose(recorder.file);
+
+    ck_assert_uint_eq(stats.bytes, 0);
+    ck_assert_uint_eq(recorder.begins, 0);
+}
+
+static size_t sync_length;
+
+static void sync_begin(void* context, size_t offset, const uint8_t* buffer, size_t length) {
+    uint8_t* const received = context;
+    memcpy(&received[offset], buffer, length);
+    sync_length = offset + length;
+}
+
+START_TEST(test_synchronous_sink) {
+    FILE* file = open_contents();
+    const sd_stream_sink_t sink = { .begin = sync_begin, .context = recorder.received };
+
+    ck_assert(sd_stream_file(file, &sink, SIZE_MAX, NULL));
+    fclose(file);
+
+    ck_assert_uint_eq(sync_length, FILE_SIZE);
+    ck_assert_mem_eq(recorder.received, contents, FILE_SIZE);
+}
+
+#define SECTOR_SIZE 512
+#define SECTORS_PER_CHUNK (SD_STREAM_CHUNK_SIZE / SECTOR_SIZE)
+
+// A block device with 512-byte sectors behind a model of FatFs' f_read(): a
+// run of whole sectors at a sector-aligned position is one multi-sector read
+// (CMD18 on the SD card), and anything else goes through a one-sector window.
+// The file is taken to be one contiguous run of clusters.
+typedef struct {
+    FILE* file;
+    size_t position;
+    uint8_t window[SECTOR_SIZE];
+    unsigned int reads;                             // Calls to device_read()
+    unsigned int sectors[FILE_SIZE / SECTOR_SIZE + 2];  // Sectors per call
+} sector_device_t;
+
+static void device_read(sector_device_t* device, uint8_t* buffer, size_t sector, size_t count) {
+    ck_assert_uint_lt(device->reads, sizeof(device->sectors) / sizeof(device->sectors[0]));
+    device->sectors[device->reads++] = (unsigned int) count;
+
+    memset(buffer, 0, count * SECTOR_SIZE);
+    fseek(device->file, (long) (sector * SECTOR_SIZE), SEEK_SET);
+    ck_assert(fread(buffer, 1, count * SECTOR_SIZE, device->file) > 0);
+}
+
+static bool sector_read(void* context, uint8_t* buffer, size_t length, size_t* bytes_read) {
+    sector_device_t* const device = context;
+    size_t total = 0;
+
+    while (total < length && device->position < FILE_SIZE) {
+        const size_t left = FILE_SIZE - device->position;
+        const size_t remaining = length - total < left ? length - total : left;
+        const size_t sectors = remaining / SECTOR_SIZE;
+        size_t n;
+        if (device->position % SECTOR_SIZE == 0 && sectors > 0) {
+            device_read(device, &buffer[total], device->position / SECTOR_SIZE, sectors);
+            n = sectors * SECTOR_SIZE;
+        } else {
+            const size_t offset = device->position % SECTOR_SIZE;
+            device_read(device, device->window, device->position / SECTOR_SIZE, 1);
+            n = remaining < SECTOR_SIZE - offset ? remaining : SECTOR_SIZE - offset;
+            memcpy(&buffer[total], &device->window[offset], n);
+        }
+        device->position += n;
+        total += n;
+    }
+
+    *bytes_read = total;
+    return true;
+}
+
+START_TEST(test_multi_block_reads) {
+    static sector_device_t device;
+    memset(&device, 0, sizeof(device));
+    device.file = open_contents();
+    const sd_stream_source_t source = { .read = sector_read, .context = &device };
+    const sd_stream_sink_t sink = { .begin = sync_begin, .context = recorder.received };
+
+    ck_assert(sd_stream(&source, &sink, SIZE_MAX, NULL));
+    fclose(device.file);
+    ck_assert_mem_eq(recorder.received, contents, FILE_SIZE);
+
+    // Each whole chunk is one read of SECTORS_PER_CHUNK sectors, not one read
+    // per sector. Only the partial sector at the end of the file goes through
+    // the window.
+    const unsigned int chunks = FILE_SIZE / SD_STREAM_CHUNK_SIZE;
+    ck_assert_uint_eq(device.reads, chunks + 1);
+    for (unsigned int i = 0; i < chunks; i++) {
+        ck_assert_uint_eq(device.sectors[i], SECTORS_PER_CHUNK);
+    }
+    ck_assert_uint_eq(device.sectors[chunks], 1);
+}
+END_TEST
+
+Suite *sd_stream_suite(void) {
+    Suite* s = suite_create("sd_stream");
+    TCase* tc = tcase_create("stream");
+
+    tcase_add_checked_fixture(tc, setup, NULL);
+    tcase_add_test(tc, test_streams_whole_file);
+    tcase_add_test(tc, test_reads_ahead_while_sink_is_busy);
+    tcase_add_test(tc, test_max_bytes);
+    tcase_add_test(tc, test_empty_file);
+    tcase_add_test(tc, test_synchronous_sink);
+    tcase_add_test(tc, test_multi_block_reads);
+
+    suite_add_tcase(s, tc);
+    return s;
+}
@@ -0,0 +1,200 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#include "pch.h"
+#include "snapshot_file_test.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "snapshot/snapshot_file.h"
+
+#define CHUNK_COUNT 3
+
+static uint8_t chunks[CHUNK_COUNT][SNAPSHOT_CHUNK_SIZE];
+static uint8_t data[SNAPSHOT_CHUNK_SIZE];
+
+static void setup(void) {
+    srand(48);
+
+    // A compressible chunk, an incompressible one, and a short one.
+    for (size_t i = 0; i < SNAPSHOT_CHUNK_SIZE; i++) {
+        chunks[0][i] = (uint8_t) (i / 64);
+        chunks[1][i] = (uint8_t) rand();
+        chunks[2][i] = (uint8_t) (i & 0x0f);
+    }
+}
+
+static uint32_t chunk_length(unsigned int index) {
+    return index == 2 ? 100 : SNAPSHOT_CHUNK_SIZE;
+}
+
+static FILE* write_snapshot(bool compress, uint32_t* size) {
+    FILE* const file = tmpfile();
+    ck_assert_ptr_nonnull(file);
+
+    snapshot_writer_t writer;
+    snapshot_write_begin(&writer, file, compress);
+    for (unsigned int i = 0; i < CHUNK_COUNT; i++) {
+        snapshot_write_chunk(&writer, i * SNAPSHOT_CHUNK_SIZE, chunks[i], chunk_length(i));
+    }
+    ck_assert(snapshot_write_end(&writer));
+
+    *size = writer.written;
+    ck_assert_int_eq(ftell(file), (long) writer.written);
+    rewind(file);
+    return file;
+}
+
+static void check_snapshot(FILE* file) {
+    snapshot_reader_t reader;
+    ck_assert(snapshot_read_begin(&reader, file));
+
+    for (unsigned int i = 0; i < CHUNK_COUNT; i++) {
+        snapshot_chunk_t chunk;
+        ck_assert_int_eq(snapshot_read_chunk(&reader, &chunk, data), snapshot_chunk_ok);
+        ck_assert_uint_eq(chunk.address, i * SNAPSHOT_CHUNK_SIZE);
+        ck_assert_uint_eq(chunk.length, chunk_length(i));
+        ck_assert_mem_eq(data, chunks[i], chunk.length);
+    }
+
+    snapshot_chunk_t chunk;
+    ck_assert_int_eq(snapshot_read_chunk(&reader, &chunk, data), snapshot_chunk_end);
+    snapshot_read_end(&reader);
+}
+
+START_TEST(test_raw) {
+    uint32_t size;
+    FILE* const file = write_snapshot(/* compress: */ false, &size);
+    ck_assert_uint_eq(size, SNAPSHOT_HEADER_SIZE + (CHUNK_COUNT + 1) * SNAPSHOT_CHUNK_HEADER_SIZE
+        + 2 * SNAPSHOT_CHUNK_SIZE + chunk_length(2));
+
+    check_snapshot(file);
+    fclose(file);
+}
+END_TEST
+
+START_TEST(test_compressed) {
+    uint32_t raw_size;
+    fclose(write_snapshot(/* compress: */ false, &raw_size));
+
+    uint32_t size;
+    FILE* const file = write_snapshot(/* compress: */ true, &size);
+
+    // The compressible chunks shrink and the random one is stored as is.
+    ck_assert_uint_lt(size, raw_size - SNAPSHOT_CHUNK_SIZE / 2);
+
+    check_snapshot(file);
+    fclose(file);
+}
+END_TEST
+
+// Flip a bit of the data in the file at 'offset' and check that reading the
+// first chunk fails.
+static void check_corrupt(bool compress, long offset) {
+    uint32_t size;
+    FILE* const file = write_snapshot(compress, &size);
+
+    ck_assert_int_eq(fseek(file, offset, SEEK_SET), 0);
+    const int byte = fgetc(file);
+    ck_assert_int_eq(fseek(file, offset, SEEK_SET), 0);
+    fputc(byte ^ 0x10, file);
+    rewind(file);
+
+    snapshot_reader_t reader;
+    snapshot_chunk_t chunk;
+    ck_assert(snapshot_read_begin(&reader, file));
+    ck_assert_int_eq(snapshot_read_chunk(&reader, &chunk, data), snapshot_chunk_error);
+    snapshot_read_end(&reader);
+    fclose(file);
+}
+
+START_TEST(test_corrupt) {
+    const long first_data = SNAPSHOT_HEADER_SIZE + SNAPSHOT_CHUNK_HEADER_SIZE;
+
+    check_corrupt(/* compress: */ false, first_data + 1000);
+    check_corrupt(/* compress: */ true, first_data + LZSS_HEADER_SIZE + 5);
+    check_corrupt(/* compress: */ false, first_data - 4);      // Chunk CRC
+    check_corrupt(/* compress: */ false, first_data - 11);     // Chunk length
+}
+END_TEST
+
+START_TEST(test_bad_header) {
+    uint32_t size;
+    FILE* const file = write_snapshot(/* compress: */ false, &size);
+    fputc('X', file);
+    rewind(file);
+
+    snapshot_reader_t reader;
+    ck_assert(!snapshot_read_begin(&reader, file));
+    snapshot_read_end(&reader);
+    fclose(file);
+}
+END_TEST
+
+START_TEST(test_truncated) {
+    uint32_t size;
+    FILE* const file = write_snapshot(/* compress: */ true, &size);
+
+    // Copy all but the end chunk.
+    FILE* const truncated = tmpfile();
+    for (uint32_t i = 0; i < size - SNAPSHOT_CHUNK_HEADER_SIZE; i++) {
+        fputc(fgetc(file), truncated);
+    }
+    fclose(file);
+    rewind(truncated);
+
+    snapshot_reader_t reader;
+    snapshot_chunk_t chunk;
+    ck_assert(snapshot_read_begin(&reader, truncated));
+    for (unsigned int i = 0; i < CHUNK_COUNT; i++) {
+        ck_assert_int_eq(snapshot_read_chunk(&reader, &chunk, data), snapshot_chunk_ok);
+    }
+    ck_assert_int_eq(snapshot_read_chunk(&reader, &chunk, data), snapshot_chunk_error);
+    snapshot_read_end(&reader);
+    fclose(truncated);
+}
+END_TEST
+
+START_TEST(test_machine) {
+    snapshot_machine_t machine = {
+        .a = 1, .x = 2, .y = 3, .sp = 0xf8, .p = 0x24, .pc = 0xe455,
+        .columns = pet_display_columns_80, .video_ram_mask = 1,
+    };
+    for (unsigned int i = 0; i < CRTC_REG_COUNT; i++) {
+        machine.crtc[i] = (uint8_t) (i * 3);
+    }
+
+    uint8_t encoded[SNAPSHOT_MACHINE_SIZE];
+    snapshot_machine_encode(&machine, encoded);
+
+    snapshot_machine_t decoded;
+    ck_assert(!snapshot_machine_decode(encoded, sizeof(encoded) - 1, &decoded));
+    ck_assert(snapshot_machine_decode(encoded, sizeof(encoded), &decoded));
+    ck_assert_uint_eq(decoded.a, 1);
+    ck_assert_uint_eq(decoded.x, 2);
+    ck_assert_uint_eq(decoded.y, 3);
+    ck_assert_uint_eq(decoded.sp, 0xf8);
+    ck_assert_uint_eq(decoded.p, 0x24);
+    ck_assert_uint_eq(decoded.pc, 0xe455);
+    ck_assert_uint_eq(decoded.columns, pet_display_columns_80);
+    ck_assert_uint_eq(decoded.video_ram_mask, 1);
+    ck_assert_mem_eq(decoded.crtc, machine.crtc, CRTC_REG_COUNT);
+}
+END_TEST
+
+Suite *snapshot_file_suite(void) {
+    Suite* s = suite_create("snapshot_file");
+    TCase* tc = tcase_create("file");
+
+    tcase_add_checked_fixture(tc, setup, NULL);
+    tcase_add_test(tc, test_raw);
+    tcase_add_test(tc, test_compressed);
+    tcase_add_test(tc, test_corrupt);
+    tcase_add_test(tc, test_bad_header);
+    tcase_add_test(tc, test_truncated);
+    tcase_add_test(tc, test_machine);
+
+    suite_add_tcase(s, tc);
+    return s;
+}
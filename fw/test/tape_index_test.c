@@ -0,0 +1,183 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#include "pch.h"
+#include "tape_index_test.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "cbm/filename.h"
+#include "cbm/petscii.h"
+#include "tape_index.h"
+
+static tape_index_t index_;
+
+static const char* const names[] = {
+    "Space Invaders.prg",
+    "game.prg",
+    "GAME2.PRG",
+    "gamma.prg",
+    "adventure_v1.prg",
+    "chess.prg",
+    "a.prg",
+    "averyveryverylongname.prg",
+    "averyveryverylongnom.prg",
+};
+
+static void setup(void) {
+    tape_index_clear(&index_);
+    for (size_t i = 0; i < ARRAY_SIZE(names); i++) {
+        ck_assert(tape_index_add(&index_, names[i], (uint32_t) (i * 300)));
+    }
+    tape_index_sort(&index_);
+}
+
+// Encode an ASCII string the way the user would type it on the PET.
+static uint8_t to_pattern(const char* text, bool shifted, uint8_t* out) {
+    uint8_t len = 0;
+    for (; text[len] != '\0'; len++) {
+        uint8_t ch = ascii_to_petscii((uint8_t) text[len], /* fold_case: */ true);
+        if (shifted && ch >= 0x41 && ch <= 0x5A) {
+            ch |= 0x80;
+        }
+        out[len] = ch;
+    }
+    return len;
+}
+
+static const char* find(const char* text) {
+    uint8_t pattern[32];
+    const uint8_t len = to_pattern(text, false, pattern);
+    const tape_index_entry_t* entry = tape_index_find(&index_, pattern, len);
+    return entry != NULL ? tape_index_name(&index_, entry) : NULL;
+}
+
+START_TEST(test_is_prg) {
+    ck_assert(tape_index_is_prg("game.prg"));
+    ck_assert(tape_index_is_prg("GAME.PRG"));
+    ck_assert(tape_index_is_prg("a.Prg"));
+    ck_assert(!tape_index_is_prg(".prg"));
+    ck_assert(!tape_index_is_prg("game.seq"));
+    ck_assert(!tape_index_is_prg("game.prg.bak"));
+    ck_assert(!tape_index_is_prg(".index"));
+}
+
+START_TEST(test_find_exact) {
+    ck_assert_str_eq(find("game"), "game.prg");
+    ck_assert_str_eq(find("GAME2"), "GAME2.PRG");
+    ck_assert_str_eq(find("game.prg"), "game.prg");
+    ck_assert_str_eq(find("space invaders"), "Space Invaders.prg");
+    ck_assert_str_eq(find("adventure_v1"), "adventure_v1.prg");
+    ck_assert_ptr_null(find("gam"));
+    ck_assert_ptr_null(find("games"));
+    ck_assert_ptr_null(find(""));
+    ck_assert_ptr_null(find("*"));
+}
+
+START_TEST(test_find_shifted_letters) {
+    uint8_t pattern[32];
+    const uint8_t len = to_pattern("chess", true, pattern);
+    const tape_index_entry_t* entry = tape_index_find(&index_, pattern, len);
+    ck_assert_ptr_nonnull(entry);
+    ck_assert_str_eq(tape_index_name(&index_, entry), "chess.prg");
+}
+
+START_TEST(test_find_wildcard_returns_first_sorted) {
+    ck_assert_str_eq(find("gam*"), "game.prg");
+    ck_assert_str_eq(find("gamm*"), "gamma.prg");
+    ck_assert_str_eq(find("game2*"), "GAME2.PRG");
+    ck_assert_str_eq(find("a*"), "a.prg");
+    ck_assert_str_eq(find("a.p*"), "a.prg");
+    ck_assert_ptr_null(find("z*"));
+}
+
+START_TEST(test_long_names_match_by_prefix_only) {
+    ck_assert_str_eq(find("averyveryverylo*"), "averyveryverylongname.prg");
+    ck_assert_str_eq(find("averyveryveryl*"), "averyveryverylongname.prg");
+    ck_assert_ptr_null(find("averyveryverylongname"));
+}
+
+// Every lookup must agree with the linear scan it replaces. (Patterns are at
+// most 16 characters, as on the PET.)
+START_TEST(test_agrees_with_filename_match) {
+    static const char* const patterns[] = {
+        "game", "game*", "ga*", "g*", "gamma", "game2", "game2.prg", "GAME2.PRG",
+        "space*", "space invaders", "space invaders*", "adv*", "adventure_v1",
+        "a", "a*", "a.prg", "av*", "chess", "ches", "x*", "averyveryverylo*",
+    };
+
+    for (size_t p = 0; p < ARRAY_SIZE(patterns); p++) {
+        uint8_t pattern[32];
+        const uint8_t len = to_pattern(patterns[p], false, pattern);
+        const tape_index_entry_t* entry = tape_index_find(&index_, pattern, len);
+
+        bool any = false;
+        for (size_t i = 0; i < ARRAY_SIZE(names); i++) {
+            any |= cbm_filename_match(pattern, len, names[i]);
+        }
+
+        ck_assert_msg((entry != NULL) == any, "pattern \"%s\"", patterns[p]);
+        if (entry != NULL) {
+            ck_assert_msg(cbm_filename_match(pattern, len, tape_index_name(&index_, entry)),
+                          "pattern \"%s\" returned \"%s\"", patterns[p], tape_index_name(&index_, entry));
+        }
+    }
+}
+
+START_TEST(test_dir_entries) {
+    tape_dir_entry_t entries[4];
+    ck_assert_uint_eq(tape_index_dir_entries(&index_, entries, ARRAY_SIZE(entries)), 4);
+
+    // Sorted by folded name, with the extension suppressed.
+    ck_assert_str_eq(entries[0].name, "a");
+    ck_assert_str_eq(entries[1].name, "adventure_v1");
+    ck_assert_str_eq(entries[2].name, "averyveryverylon");
+    ck_assert_str_eq(entries[3].name, "averyveryverylon");
+    ck_assert_uint_eq(entries[1].blocks, tape_dir_blocks_from_bytes(4 * 300, true));
+}
+
+START_TEST(test_capacity) {
+    tape_index_clear(&index_);
+
+    char name[16];
+    for (unsigned int i = 0; i < TAPE_INDEX_MAX_ENTRIES; i++) {
+        snprintf(name, sizeof(name), "f%04u.prg", i);
+        ck_assert(tape_index_add(&index_, name, 1));
+    }
+    ck_assert(index_.complete);
+
+    ck_assert(!tape_index_add(&index_, "extra.prg", 1));
+    ck_assert(!index_.complete);
+    ck_assert_uint_eq(index_.count, TAPE_INDEX_MAX_ENTRIES);
+}
+
+START_TEST(test_checksum) {
+    const uint16_t before = tape_index_checksum(&index_);
+
+    // Rescanning an unchanged directory produces the same checksum.
+    setup();
+    ck_assert_uint_eq(tape_index_checksum(&index_), before);
+
+    index_.entries[0].size++;
+    ck_assert_uint_ne(tape_index_checksum(&index_), before);
+}
+
+Suite *tape_index_suite(void) {
+    Suite* s = suite_create("tape_index");
+    TCase* tc = tcase_create("index");
+
+    tcase_add_checked_fixture(tc, setup, NULL);
+    tcase_add_test(tc, test_is_prg);
+    tcase_add_test(tc, test_find_exact);
+    tcase_add_test(tc, test_find_shifted_letters);
+    tcase_add_test(tc, test_find_wildcard_returns_first_sorted);
+    tcase_add_test(tc, test_long_names_match_by_prefix_only);
+    tcase_add_test(tc, test_agrees_with_filename_match);
+    tcase_add_test(tc, test_dir_entries);
+    tcase_add_test(tc, test_capacity);
+    tcase_add_test(tc, test_checksum);
+
+    suite_add_tcase(s, tc);
+    return s;
+}
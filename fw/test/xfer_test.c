@@ -0,0 +1,314 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#include "pch.h"
+#include "xfer_test.h"
+
+#include <string.h>
+
+#include "xfer/xfer_proto.h"
+#include "xfer/xfer_target.h"
+
+#define MEMORY_SIZE 0x10000
+#define MAX_REPLIES 16
+
+// Target and decoder are large, so keep them out of the stack.
+static xfer_target_t target;
+static xfer_decoder_t decoder;
+static uint8_t memory[MEMORY_SIZE];
+
+// Replies captured from the target, decoded.
+typedef struct {
+    uint8_t type;
+    uint8_t seq;
+    uint8_t payload[XFER_MAX_PAYLOAD];
+    uint16_t length;
+} reply_t;
+
+static reply_t replies[MAX_REPLIES];
+static size_t reply_count;
+
+static uint16_t last_jump;
+static int jump_count;
+static int quit_count;
+
+static bool mock_valid_range(void* context, uint32_t addr, size_t length) {
+    (void) context;
+    return addr < MEMORY_SIZE && length <= MEMORY_SIZE - addr;
+}
+
+static void mock_read(void* context, uint32_t addr, uint8_t* dest, size_t length) {
+    (void) context;
+    memcpy(dest, &memory[addr], length);
+}
+
+static void mock_write(void* context, uint32_t addr, const uint8_t* src, size_t length) {
+    (void) context;
+    memcpy(&memory[addr], src, length);
+}
+
+static void mock_send(void* context, const uint8_t* data, size_t length) {
+    (void) context;
+    xfer_decoder_t* const d = &decoder;
+
+    for (size_t i = 0; i < length; i++) {
+        if (xfer_decode_byte(d, data[i]) == xfer_decode_frame) {
+            ck_assert_uint_lt(reply_count, MAX_REPLIES);
+            reply_t* const r = &replies[reply_count++];
+            r->type = d->type;
+            r->seq = d->seq;
+            r->length = d->length;
+            memcpy(r->payload, d->payload, d->length);
+        }
+    }
+}
+
+static void mock_jump(void* context, uint16_t addr) {
+    (void) context;
+    last_jump = addr;
+    jump_count++;
+}
+
+static void mock_quit(void* context) {
+    (void) context;
+    quit_count++;
+}
+
+static const xfer_target_ops_t ops = {
+    .valid_range = mock_valid_range,
+    .read = mock_read,
+    .write = mock_write,
+    .send = mock_send,
+    .jump = mock_jump,
+    .quit = mock_quit,
+};
+
+static void setup(void) {
+    xfer_target_init(&target, &ops, NULL);
+    xfer_decoder_init(&decoder);
+    memset(memory, 0, sizeof(memory));
+    memset(replies, 0, sizeof(replies));
+    reply_count = 0;
+    last_jump = 0;
+    jump_count = 0;
+    quit_count = 0;
+}
+
+// Encode a request into 'out' and return its size.
+static size_t request(uint8_t* out, uint8_t type, uint8_t seq, const uint8_t* payload, size_t length) {
+    return xfer_encode(out, type, seq, payload, length);
+}
+
+static void send_request(uint8_t type, uint8_t seq, const uint8_t* payload, size_t length) {
+    static uint8_t frame[XFER_MAX_FRAME];
+    xfer_target_receive(&target, frame, request(frame, type, seq, payload, length));
+}
+
+static void send_write(uint8_t seq, uint32_t addr, const uint8_t* data, size_t length) {
+    static uint8_t payload[XFER_MAX_PAYLOAD];
+    xfer_put_u32(payload, addr);
+    memcpy(&payload[XFER_ADDR_SIZE], data, length);
+    send_request(XFER_WRITE, seq, payload, XFER_ADDR_SIZE + length);
+}
+
+static void send_read(uint8_t seq, uint32_t addr, uint16_t length) {
+    uint8_t payload[XFER_ADDR_SIZE + 2];
+    xfer_put_u32(payload, addr);
+    xfer_put_u16(&payload[XFER_ADDR_SIZE], length);
+    send_request(XFER_READ, seq, payload, sizeof(payload));
+}
+
+static void assert_reply(size_t index, uint8_t type, uint8_t seq) {
+    ck_assert_uint_lt(index, reply_count);
+    ck_assert_int_eq(replies[index].type, type);
+    ck_assert_int_eq(replies[index].seq, seq);
+}
+
+START_TEST(test_frame_roundtrip) {
+    static const char junk[] = "xfer\r\n[entering transfer mode]\r\n\xEC";
+    const uint8_t payload[] = { 1, 2, 3, XFER_MAGIC_0, XFER_MAGIC_1 };
+
+    uint8_t frame[XFER_MAX_FRAME];
+    const size_t size = xfer_encode(frame, XFER_WRITE, 42, payload, sizeof(payload));
+    ck_assert_uint_eq(size, XFER_HEADER_SIZE + sizeof(payload) + XFER_CRC_SIZE);
+
+    // Stray text (including a lone magic byte) before the frame is skipped.
+    for (size_t i = 0; i < sizeof(junk) - 1; i++) {
+        ck_assert_int_eq(xfer_decode_byte(&decoder, (uint8_t) junk[i]), xfer_decode_pending);
+    }
+    for (size_t i = 0; i < size - 1; i++) {
+        ck_assert_int_eq(xfer_decode_byte(&decoder, frame[i]), xfer_decode_pending);
+    }
+    ck_assert_int_eq(xfer_decode_byte(&decoder, frame[size - 1]), xfer_decode_frame);
+
+    ck_assert_int_eq(decoder.type, XFER_WRITE);
+    ck_assert_int_eq(decoder.seq, 42);
+    ck_assert_uint_eq(decoder.length, sizeof(payload));
+    ck_assert_mem_eq(decoder.payload, payload, sizeof(payload));
+}
+
+START_TEST(test_corrupt_frame_is_reported) {
+    const uint8_t payload[] = { 0x55, 0xAA };
+    uint8_t frame[2][XFER_MAX_FRAME];
+    const size_t size = xfer_encode(frame[0], XFER_WRITE, 1, payload, sizeof(payload));
+    xfer_encode(frame[1], XFER_WRITE, 2, payload, sizeof(payload));
+    frame[0][XFER_HEADER_SIZE] ^= 0x01;
+
+    xfer_decode_result_t result = xfer_decode_pending;
+    for (size_t i = 0; i < size; i++) {
+        result = xfer_decode_byte(&decoder, frame[0][i]);
+    }
+    ck_assert_int_eq(result, xfer_decode_error);
+    ck_assert_uint_eq(decoder.crc_errors, 1);
+
+    // The next frame decodes normally.
+    for (size_t i = 0; i < size; i++) {
+        result = xfer_decode_byte(&decoder, frame[1][i]);
+    }
+    ck_assert_int_eq(result, xfer_decode_frame);
+    ck_assert_int_eq(decoder.seq, 2);
+}
+
+START_TEST(test_hello_reports_limits) {
+    send_request(XFER_HELLO, 200, NULL, 0);
+
+    ck_assert_uint_eq(reply_count, 1);
+    assert_reply(0, XFER_HELLO, 200);
+    ck_assert_int_eq(replies[0].payload[0], XFER_VERSION);
+    ck_assert_int_eq(replies[0].payload[1], XFER_WINDOW);
+    ck_assert_uint_eq(xfer_get_u16(&replies[0].payload[2]), XFER_MAX_DATA);
+
+    // The sequence continues from the host's numbering.
+    ck_assert_int_eq(target.expected_seq, 201);
+}
+
+START_TEST(test_write_then_read) {
+    uint8_t data[XFER_MAX_DATA];
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = (uint8_t) (i * 7);
+    }
+
+    send_write(0, 0x0401, data, sizeof(data));
+    send_read(1, 0x0401, sizeof(data));
+
+    ck_assert_mem_eq(&memory[0x0401], data, sizeof(data));
+    ck_assert_uint_eq(reply_count, 2);
+    assert_reply(0, XFER_ACK, 0);
+    assert_reply(1, XFER_DATA, 1);
+    ck_assert_uint_eq(xfer_get_u32(replies[1].payload), 0x0401);
+    ck_assert_uint_eq(replies[1].length, XFER_ADDR_SIZE + sizeof(data));
+    ck_assert_mem_eq(&replies[1].payload[XFER_ADDR_SIZE], data, sizeof(data));
+    ck_assert_uint_eq(target.stats.bytes_written, sizeof(data));
+    ck_assert_uint_eq(target.stats.bytes_read, sizeof(data));
+}
+
+START_TEST(test_out_of_range_is_rejected) {
+    const uint8_t data[4] = { 1, 2, 3, 4 };
+
+    send_write(0, MEMORY_SIZE - 2, data, sizeof(data));
+    send_read(1, MEMORY_SIZE, 1);
+    send_read(2, 0, XFER_MAX_DATA + 1);
+
+    ck_assert_uint_eq(reply_count, 3);
+    assert_reply(0, XFER_ERROR, 0);
+    ck_assert_int_eq(replies[0].payload[0], XFER_ERROR_BAD_RANGE);
+    assert_reply(1, XFER_ERROR, 1);
+    ck_assert_int_eq(replies[1].payload[0], XFER_ERROR_BAD_RANGE);
+    assert_reply(2, XFER_ERROR, 2);
+    ck_assert_int_eq(replies[2].payload[0], XFER_ERROR_BAD_REQUEST);
+    ck_assert_uint_eq(memory[MEMORY_SIZE - 2], 0);
+}
+
+START_TEST(test_basic_pointers) {
+    // ROM 4 VARTAB is $2A. Program ends at $0C34.
+    const uint8_t payload[] = { 0x2A, 0x34, 0x0C };
+    send_request(XFER_BASIC, 0, payload, sizeof(payload));
+
+    const uint8_t expected[] = { 0x34, 0x0C, 0x34, 0x0C, 0x34, 0x0C };
+    ck_assert_mem_eq(&memory[0x2A], expected, sizeof(expected));
+    assert_reply(0, XFER_ACK, 0);
+}
+
+START_TEST(test_gap_is_naked_once) {
+    const uint8_t data[] = { 0xAA };
+    uint8_t frames[3][XFER_MAX_FRAME];
+    size_t sizes[3];
+
+    for (uint8_t i = 0; i < 3; i++) {
+        uint8_t payload[XFER_ADDR_SIZE + 1];
+        xfer_put_u32(payload, 0x1000 + i);
+        payload[XFER_ADDR_SIZE] = data[0];
+        sizes[i] = request(frames[i], XFER_WRITE, i, payload, sizeof(payload));
+    }
+
+    // Frame 0 is corrupted on the wire. Frames 1 and 2 arrive intact.
+    frames[0][XFER_HEADER_SIZE] ^= 0x80;
+    for (int i = 0; i < 3; i++) {
+        xfer_target_receive(&target, frames[i], sizes[i]);
+    }
+
+    ck_assert_uint_eq(reply_count, 1);
+    assert_reply(0, XFER_NAK, 0);
+    ck_assert_uint_eq(memory[0x1001], 0);   // Out-of-order frames are not executed
+
+    // The host goes back to frame 0 and resends the window.
+    frames[0][XFER_HEADER_SIZE] ^= 0x80;
+    for (int i = 0; i < 3; i++) {
+        xfer_target_receive(&target, frames[i], sizes[i]);
+    }
+
+    ck_assert_uint_eq(reply_count, 4);
+    assert_reply(1, XFER_ACK, 0);
+    assert_reply(2, XFER_ACK, 1);
+    assert_reply(3, XFER_ACK, 2);
+    ck_assert_uint_eq(memory[0x1000], 0xAA);
+    ck_assert_uint_eq(memory[0x1002], 0xAA);
+    ck_assert_uint_eq(target.stats.naks, 1);
+}
+
+START_TEST(test_repeat_is_reacknowledged) {
+    const uint8_t data[] = { 0x42 };
+    const uint8_t jump[] = { 0x00, 0x04 };
+
+    send_write(0, 0x2000, data, sizeof(data));
+    send_request(XFER_JUMP, 1, jump, sizeof(jump));
+
+    // Both acknowledgements were lost, so the host resends both.
+    send_write(0, 0x2000, data, sizeof(data));
+    send_request(XFER_JUMP, 1, jump, sizeof(jump));
+
+    ck_assert_uint_eq(reply_count, 4);
+    assert_reply(2, XFER_ACK, 0);
+    assert_reply(3, XFER_ACK, 1);
+    ck_assert_uint_eq(target.stats.repeats, 2);
+
+    // The program is only started once.
+    ck_assert_int_eq(jump_count, 1);
+    ck_assert_uint_eq(last_jump, 0x0400);
+}
+
+START_TEST(test_quit) {
+    send_request(XFER_QUIT, 0, NULL, 0);
+
+    assert_reply(0, XFER_ACK, 0);
+    ck_assert_int_eq(quit_count, 1);
+}
+
+Suite *xfer_suite(void) {
+    Suite* s = suite_create("xfer");
+    TCase* tc = tcase_create("protocol");
+
+    tcase_add_checked_fixture(tc, setup, NULL);
+    tcase_add_test(tc, test_frame_roundtrip);
+    tcase_add_test(tc, test_corrupt_frame_is_reported);
+    tcase_add_test(tc, test_hello_reports_limits);
+    tcase_add_test(tc, test_write_then_read);
+    tcase_add_test(tc, test_out_of_range_is_rejected);
+    tcase_add_test(tc, test_basic_pointers);
+    tcase_add_test(tc, test_gap_is_naked_once);
+    tcase_add_test(tc, test_repeat_is_reacknowledged);
+    tcase_add_test(tc, test_quit);
+
+    suite_add_tcase(s, tc);
+    return s;
+}
@@ -0,0 +1,190 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+// Compares two boot profiles captured with the 'boot export' serial console
+// command (see fw/src/diag/boot_profile.h), e.g., from two firmware versions.
+//
+// Phases are matched by path (and by occurrence, for a path that appears more
+// than once), so phases added or removed between versions do not shift the
+// comparison. 'ready' compares the time the PET started running rather than a
+// duration. Profile a configuration that boots by default, since time spent
+// in the boot menu waiting for a key is included in 'ready'.
+//
+// Usage: bootdiff [-t <ms>] <old> <new>
+//
+// Exits with status 2 if any phase (or 'ready') takes more than <ms>
+// (default 5) milliseconds longer in <new> than in <old>.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "diag/boot_profile.h"
+
+#define MAX_PHASES 256
+#define MAX_LINE_LENGTH 256
+
+typedef struct {
+    char path[MAX_LINE_LENGTH];
+    unsigned int occurrence;    // 0 for the first phase with this path
+    int64_t us;                 // Duration (start time for 'ready')
+    bool matched;
+} phase_t;
+
+typedef struct {
+    char version[MAX_LINE_LENGTH];
+    phase_t phases[MAX_PHASES];
+    unsigned int count;
+} profile_t;
+
+static profile_t old_profile;
+static profile_t new_profile;
+
+static void usage(const char* argv0) {
+    fprintf(stderr,
+        "Usage: %s [-t <ms>] <old> <new>\n"
+        "Compares two 'boot export' captures. Exits with status 2 if any phase is more\n"
+        "than <ms> (default 5) milliseconds slower in <new>.\n", argv0);
+}
+
+static bool read_profile(const char* path, profile_t* profile) {
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        perror(path);
+        return false;
+    }
+
+    const size_t header_length = strlen(BOOT_PROFILE_EXPORT_HEADER);
+    bool has_header = false;
+    char line[MAX_LINE_LENGTH];
+    while (fgets(line, sizeof(line), file) != NULL) {
+        line[strcspn(line, "\r\n")] = '\0';
+
+        if (strncmp(line, BOOT_PROFILE_EXPORT_HEADER, header_length) == 0) {
+            snprintf(profile->version, sizeof(profile->version), "%s", &line[header_length]);
+            has_header = true;
+            continue;
+        }
+
+        // Ignore anything else captured from the console (e.g., the prompt).
+        unsigned long long start;
+        long long duration;
+        int offset;
+        if (!has_header || sscanf(line, "%llu\t%lld\t%n", &start, &duration, &offset) != 2 || line[offset] == '\0') {
+            continue;
+        }
+        if (duration < 0) {
+            continue;       // Still open when exported
+        }
+
+        if (profile->count == MAX_PHASES) {
+            fprintf(stderr, "%s: more than %d phases\n", path, MAX_PHASES);
+            break;
+        }
+
+        phase_t* const phase = &profile->phases[profile->count];
+        snprintf(phase->path, sizeof(phase->path), "%s", &line[offset]);
+        phase->us = strcmp(phase->path, "ready") == 0 ? (int64_t) start : (int64_t) duration;
+        phase->occurrence = 0;
+        for (unsigned int i = 0; i < profile->count; i++) {
+            if (strcmp(profile->phases[i].path, phase->path) == 0) {
+                phase->occurrence++;
+            }
+        }
+        profile->count++;
+    }
+
+    fclose(file);
+    if (!has_header) {
+        fprintf(stderr, "%s: not a boot profile (no '%s' line)\n", path, BOOT_PROFILE_EXPORT_HEADER);
+        return false;
+    }
+    return true;
+}
+
+static phase_t* find(profile_t* profile, const phase_t* phase) {
+    for (unsigned int i = 0; i < profile->count; i++) {
+        phase_t* const candidate = &profile->phases[i];
+        if (candidate->occurrence == phase->occurrence && strcmp(candidate->path, phase->path) == 0) {
+            return candidate;
+        }
+    }
+    return NULL;
+}
+
+static void print_ms(int64_t us) {
+    printf(" %9.1f", (double) us / 1000);
+}
+
+static void print_path(const phase_t* phase) {
+    if (phase->occurrence > 0) {
+        printf("  %s #%u\n", phase->path, phase->occurrence + 1);
+    } else {
+        printf("  %s\n", phase->path);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    double threshold_ms = 5;
+    int arg = 1;
+    if (argc == 5 && strcmp(argv[1], "-t") == 0) {
+        char* end;
+        threshold_ms = strtod(argv[2], &end);
+        if (*end != '\0' || threshold_ms < 0) {
+            usage(argv[0]);
+            return 1;
+        }
+        arg = 3;
+    } else if (argc != 3) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (!read_profile(argv[arg], &old_profile) || !read_profile(argv[arg + 1], &new_profile)) {
+        return 1;
+    }
+
+    printf("old:%s\nnew:%s\n\n", old_profile.version, new_profile.version);
+    printf("    old ms    new ms  delta ms    phase\n");
+
+    bool regressed = false;
+    for (unsigned int i = 0; i < new_profile.count; i++) {
+        phase_t* const phase = &new_profile.phases[i];
+        phase_t* const old = find(&old_profile, phase);
+        if (old == NULL) {
+            printf("         -");
+            print_ms(phase->us);
+            printf("         +  ");
+            print_path(phase);
+            continue;
+        }
+
+        old->matched = true;
+        const int64_t delta = phase->us - old->us;
+        const bool slower = (double) delta / 1000 > threshold_ms;
+        regressed = regressed || slower;
+
+        print_ms(old->us);
+        print_ms(phase->us);
+        print_ms(delta);
+        printf("%s", slower ? " !" : "  ");
+        print_path(phase);
+    }
+
+    for (unsigned int i = 0; i < old_profile.count; i++) {
+        const phase_t* const phase = &old_profile.phases[i];
+        if (!phase->matched) {
+            print_ms(phase->us);
+            printf("         -         -  ");
+            print_path(phase);
+        }
+    }
+
+    if (regressed) {
+        printf("\nPhases marked '!' are more than %.1f ms slower.\n", threshold_ms);
+        return 2;
+    }
+    return 0;
+}
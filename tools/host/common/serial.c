@@ -0,0 +1,82 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#include "serial.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+
+static struct termios saved_termios;
+static bool have_saved_termios = false;
+
+static speed_t baud_to_speed(int baud) {
+    switch (baud) {
+        case 9600:    return B9600;
+        case 19200:   return B19200;
+        case 38400:   return B38400;
+        case 57600:   return B57600;
+        case 115200:  return B115200;
+        case 230400:  return B230400;
+        case 460800:  return B460800;
+        case 921600:  return B921600;
+        default:      return B0;
+    }
+}
+
+int serial_open(const char* path, int baud) {
+    const int fd = open(path, O_RDWR | O_NOCTTY);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct termios tio;
+    if (tcgetattr(fd, &tio) != 0) {
+        // Not a terminal (e.g., a FIFO used for testing). Use as-is.
+        return fd;
+    }
+
+    cfmakeraw(&tio);
+    tio.c_cflag |= CLOCAL | CREAD;
+    tio.c_cflag &= ~(CSTOPB | CRTSCTS);
+    tio.c_cc[VMIN] = 1;
+    tio.c_cc[VTIME] = 0;
+
+    const speed_t speed = baud_to_speed(baud);
+    if (speed == B0) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+    cfsetispeed(&tio, speed);
+    cfsetospeed(&tio, speed);
+
+    if (tcsetattr(fd, TCSANOW, &tio) != 0) {
+        const int saved_errno = errno;
+        close(fd);
+        errno = saved_errno;
+        return -1;
+    }
+
+    return fd;
+}
+
+bool serial_make_raw(int fd) {
+    struct termios tio;
+    if (tcgetattr(fd, &tio) != 0) {
+        return false;
+    }
+
+    saved_termios = tio;
+    have_saved_termios = true;
+
+    cfmakeraw(&tio);
+    return tcsetattr(fd, TCSANOW, &tio) == 0;
+}
+
+void serial_restore(int fd) {
+    if (have_saved_termios) {
+        tcsetattr(fd, TCSANOW, &saved_termios);
+    }
+}
@@ -0,0 +1,18 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#pragma once
+
+#include <stdbool.h>
+
+// Open 'path' (e.g., /dev/ttyACM0) as a raw 8N1 serial port at 'baud' with
+// no flow control. Returns the file descriptor, or -1 with errno set. Baud
+// is ignored for devices that are not real serial ports (e.g., a pty).
+int serial_open(const char* path, int baud);
+
+// Put the terminal on 'fd' into raw mode so keystrokes can be forwarded
+// unmodified. Returns false if 'fd' is not a terminal.
+bool serial_make_raw(int fd);
+
+// Restore the terminal settings saved by the last serial_make_raw().
+void serial_restore(int fd);
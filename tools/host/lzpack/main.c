@@ -0,0 +1,154 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+// Host-side packer for LZSS-compressed SD card files (see fw/src/lzss.h).
+//
+// The firmware recognizes compressed files by their header, so a packed ROM,
+// PRG, or keymap can replace the original under the same name. The default
+// output name only keeps the packed file from overwriting its input; copy it
+// to the SD card under the original name.
+//
+// Usage: lzpack <in> [<out>]       Compress (default output: <in>.lz)
+//        lzpack -d <in> <out>      Decompress (verifies the CRC)
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lzss.h"
+
+static void usage(const char* argv0) {
+    fprintf(stderr,
+        "Usage: %s <in> [<out>]\n"
+        "       %s -d <in> <out>\n"
+        "Compresses <in> to <out> (default <in>.lz), or decompresses with -d.\n", argv0, argv0);
+}
+
+static uint8_t* read_file(const char* path, size_t* length) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        perror(path);
+        return NULL;
+    }
+
+    fseek(file, 0, SEEK_END);
+    const long size = ftell(file);
+    rewind(file);
+
+    uint8_t* data = malloc(size > 0 ? (size_t) size : 1);
+    if (data == NULL || size < 0 || fread(data, 1, (size_t) size, file) != (size_t) size) {
+        perror(path);
+        free(data);
+        fclose(file);
+        return NULL;
+    }
+
+    fclose(file);
+    *length = (size_t) size;
+    return data;
+}
+
+static bool write_file(const char* path, const uint8_t* data, size_t length) {
+    FILE* file = fopen(path, "wb");
+    if (file == NULL || fwrite(data, 1, length, file) != length || fclose(file) != 0) {
+        perror(path);
+        return false;
+    }
+    return true;
+}
+
+typedef struct {
+    uint8_t* output;
+    size_t capacity;
+} unpack_context_t;
+
+static void unpack_sink(void* context, size_t offset, const uint8_t* data, size_t length) {
+    unpack_context_t* const unpack = context;
+    if (offset + length <= unpack->capacity) {
+        memcpy(&unpack->output[offset], data, length);
+    }
+}
+
+static lzss_decoder_t decoder;
+
+static int decompress(const char* argv0, const char* in_path, const char* out_path) {
+    size_t length;
+    uint8_t* const data = read_file(in_path, &length);
+    if (data == NULL) {
+        return 1;
+    }
+
+    lzss_header_t header;
+    if (!lzss_read_header(data, length, &header)) {
+        fprintf(stderr, "%s: '%s' is not LZSS compressed\n", argv0, in_path);
+        free(data);
+        return 1;
+    }
+
+    unpack_context_t unpack = { malloc(header.size > 0 ? header.size : 1), header.size };
+    lzss_decoder_init(&decoder, &header);
+    const lzss_status_t status = lzss_decode(&decoder, &data[LZSS_HEADER_SIZE], length - LZSS_HEADER_SIZE,
+                                             unpack_sink, &unpack);
+    free(data);
+
+    if (status != lzss_done) {
+        fprintf(stderr, "%s: '%s' is %s\n", argv0, in_path,
+                status == lzss_more ? "truncated" : "corrupt (bad stream or CRC mismatch)");
+        free(unpack.output);
+        return 1;
+    }
+
+    const bool ok = write_file(out_path, unpack.output, header.size);
+    free(unpack.output);
+    return ok ? 0 : 1;
+}
+
+static int compress(const char* in_path, const char* out_path) {
+    size_t length;
+    uint8_t* const data = read_file(in_path, &length);
+    if (data == NULL) {
+        return 1;
+    }
+
+    uint8_t* const packed = malloc(LZSS_PACK_BOUND(length));
+    const size_t packed_length = lzss_pack(data, length, packed);
+    free(data);
+
+    const bool ok = write_file(out_path, packed, packed_length);
+    free(packed);
+    if (ok) {
+        fprintf(stderr, "%s: %zu -> %zu bytes (%.1f%%)\n", out_path, length, packed_length,
+                length > 0 ? 100.0 * packed_length / length : 100.0);
+    }
+    return ok ? 0 : 1;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc == 4 && strcmp(argv[1], "-d") == 0) {
+        return decompress(argv[0], argv[2], argv[3]);
+    }
+
+    if (argc == 2 || argc == 3) {
+        if (argv[1][0] == '-') {
+            usage(argv[0]);
+            return 1;
+        }
+
+        if (argc == 3) {
+            return compress(argv[1], argv[2]);
+        }
+
+        const size_t path_length = strlen(argv[1]);
+        char* const out_path = malloc(path_length + sizeof(".lz"));
+        memcpy(out_path, argv[1], path_length);
+        memcpy(&out_path[path_length], ".lz", sizeof(".lz"));
+        const int result = compress(argv[1], out_path);
+        free(out_path);
+        return result;
+    }
+
+    usage(argv[0]);
+    return 1;
+}
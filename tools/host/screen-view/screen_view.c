@@ -0,0 +1,321 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+// Host-side viewer for the binary screen stream ('remote bin' CLI command).
+//
+// Decodes frames from the EconoPET serial port and renders them with the real
+// PET character ROM, either as a braille-dot preview in the terminal or as a
+// PPM image that is rewritten after every frame. Keystrokes typed into the
+// viewer are forwarded to the PET. Press Ctrl+] to quit.
+//
+// Usage: screen-view -r characters.bin [-b baud] [-o frame.ppm] [-c] <device>
+
+#include <errno.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common/serial.h"
+#include "display/screen_stream.h"
+
+#define CHAR_WIDTH  8
+#define CHAR_HEIGHT 8
+#define MAX_COLS    80
+#define MAX_ROWS    50
+#define MAX_WIDTH   (MAX_COLS * CHAR_WIDTH)
+#define MAX_HEIGHT  (MAX_ROWS * CHAR_HEIGHT)
+
+#define CTRL_C            0x03
+#define CTRL_RIGHT_SQUARE 0x1D  // Ctrl+] quits, like telnet
+
+#define CRTC_R6_V_DISPLAYED    6
+#define CRTC_R12_START_ADDR_HI 12
+
+// Offset of colour RAM within the screen buffer (ColourPET at $8800).
+#define COLOUR_RAM_OFFSET 0x800
+
+// C128 palette (RRRGGGBB), matching the firmware's DVI output.
+static const uint8_t c128_palette[16] = {
+    0x00, 0x49, 0x01, 0x03, 0x10, 0x1C, 0x0D, 0x1F,
+    0x40, 0xE0, 0x81, 0xE3, 0x6C, 0xDC, 0xB6, 0xFF
+};
+
+// Monochrome PET phosphor colours (foreground on background).
+static const uint8_t mono_fg[3] = { 0x33, 0xFF, 0x33 };
+static const uint8_t mono_bg[3] = { 0x00, 0x00, 0x00 };
+
+static uint8_t char_rom[4096];
+static size_t char_rom_size;
+
+static uint8_t pixels[MAX_HEIGHT][MAX_WIDTH][3];
+static unsigned int width;
+static unsigned int height;
+
+static screen_stream_decoder_t decoder;
+
+static void rrrgggbb_to_rgb(uint8_t c, uint8_t rgb[3]) {
+    rgb[0] = (uint8_t) (((c >> 5) & 7) * 255 / 7);
+    rgb[1] = (uint8_t) (((c >> 2) & 7) * 255 / 7);
+    rgb[2] = (uint8_t) ((c & 3) * 255 / 3);
+}
+
+// Select the 1KB charset quadrant the same way the firmware does
+// (see roms_get_char_rom): {crtc_chr_option, video_graphics}.
+static const uint8_t* select_charset(void) {
+    const bool chr_option = (decoder.crtc[CRTC_R12_START_ADDR_HI] & 0x20) != 0;
+    const bool graphics = (decoder.flags & SCREEN_STREAM_FLAG_GRAPHICS) != 0;
+    size_t offset = (size_t) ((chr_option ? 2 : 0) | (graphics ? 1 : 0)) * 0x400;
+
+    // A plain 2KB character ROM only has the two standard charsets.
+    if (offset + 0x400 > char_rom_size) {
+        offset &= 0x400;
+    }
+    return &char_rom[offset];
+}
+
+// Rasterize the decoded screen into 'pixels'.
+static void render_pixels(void) {
+    const unsigned int cols = (decoder.flags & SCREEN_STREAM_FLAG_80_COLUMNS) ? 80 : 40;
+    unsigned int rows = decoder.crtc[CRTC_R6_V_DISPLAYED];
+    if (rows == 0 || rows > MAX_ROWS) {
+        rows = 25;
+    }
+    while (rows > 1 && (size_t) cols * rows > decoder.length) {
+        rows--;
+    }
+
+    width = cols * CHAR_WIDTH;
+    height = rows * CHAR_HEIGHT;
+
+    const uint8_t* const charset = select_charset();
+    const bool colour = (decoder.flags & SCREEN_STREAM_FLAG_COLOUR) != 0
+        && decoder.length >= COLOUR_RAM_OFFSET + (size_t) cols * rows;
+
+    for (unsigned int row = 0; row < rows; row++) {
+        for (unsigned int col = 0; col < cols; col++) {
+            const size_t index = (size_t) row * cols + col;
+            const uint8_t ch = decoder.screen[index];
+            const uint8_t* const glyph = &charset[(ch & 0x7F) * CHAR_HEIGHT];
+            const uint8_t invert = (ch & 0x80) ? 0xFF : 0x00;
+
+            uint8_t fg[3], bg[3];
+            if (colour) {
+                const uint8_t attr = decoder.screen[COLOUR_RAM_OFFSET + index];
+                rrrgggbb_to_rgb(c128_palette[attr & 0x0F], fg);
+                rrrgggbb_to_rgb(c128_palette[attr >> 4], bg);
+            } else {
+                memcpy(fg, mono_fg, 3);
+                memcpy(bg, mono_bg, 3);
+            }
+
+            for (unsigned int y = 0; y < CHAR_HEIGHT; y++) {
+                const uint8_t bits = glyph[y] ^ invert;
+                for (unsigned int x = 0; x < CHAR_WIDTH; x++) {
+                    const bool on = (bits & (0x80 >> x)) != 0;
+                    memcpy(pixels[row * CHAR_HEIGHT + y][col * CHAR_WIDTH + x], on ? fg : bg, 3);
+                }
+            }
+        }
+    }
+}
+
+// Write the frame as a binary PPM. Writes to a temporary file and renames it
+// so image viewers that watch the file never see a partial frame.
+static bool write_ppm(const char* path) {
+    char temp_path[4096];
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+
+    FILE* file = fopen(temp_path, "wb");
+    if (file == NULL) {
+        return false;
+    }
+
+    fprintf(file, "P6\n%u %u\n255\n", width, height);
+    for (unsigned int y = 0; y < height; y++) {
+        fwrite(pixels[y], 3, width, file);
+    }
+
+    const bool ok = fclose(file) == 0;
+    return ok && rename(temp_path, path) == 0;
+}
+
+static bool pixel_on(unsigned int x, unsigned int y) {
+    if (x >= width || y >= height) {
+        return false;
+    }
+    const uint8_t* const p = pixels[y][x];
+    return (p[0] | p[1] | p[2]) != 0
+        && memcmp(p, mono_bg, 3) != 0;
+}
+
+// Draw the frame in the terminal with Unicode braille (2x4 dots per cell).
+// 80 column screens are halved horizontally to keep the preview readable.
+static void render_terminal(void) {
+    const unsigned int x_step = (width > 320) ? 2 : 1;
+    static const uint8_t dot_bits[4][2] = {
+        { 0x01, 0x08 }, { 0x02, 0x10 }, { 0x04, 0x20 }, { 0x40, 0x80 }
+    };
+
+    fputs("\033[H", stdout);
+    for (unsigned int y = 0; y < height; y += 4) {
+        for (unsigned int x = 0; x < width; x += 2 * x_step) {
+            unsigned int bits = 0;
+            for (unsigned int dy = 0; dy < 4; dy++) {
+                for (unsigned int dx = 0; dx < 2; dx++) {
+                    if (pixel_on(x + dx * x_step, y + dy)) {
+                        bits |= dot_bits[dy][dx];
+                    }
+                }
+            }
+
+            // U+2800 + bits, encoded as UTF-8.
+            const unsigned int cp = 0x2800 + bits;
+            putchar(0xE0 | (cp >> 12));
+            putchar(0x80 | ((cp >> 6) & 0x3F));
+            putchar(0x80 | (cp & 0x3F));
+        }
+        fputs("\r\n", stdout);
+    }
+
+    printf("frames: %u  crc errors: %u  skipped: %u\033[K\r\n",
+           decoder.frames, decoder.crc_errors, decoder.skipped);
+    fflush(stdout);
+}
+
+static bool load_char_rom(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        return false;
+    }
+    char_rom_size = fread(char_rom, 1, sizeof(char_rom), file);
+    fclose(file);
+    return char_rom_size >= 0x800;
+}
+
+static void usage(const char* argv0) {
+    fprintf(stderr,
+        "Usage: %s -r <char-rom> [-b <baud>] [-o <frame.ppm>] [-c] <device>\n"
+        "  -r  PET character ROM (e.g., characters-2.901447-10.bin)\n"
+        "  -b  Baud rate (default 115200)\n"
+        "  -o  Write each frame to a PPM image instead of the terminal\n"
+        "  -c  Send 'remote bin' to the EconoPET CLI on startup\n"
+        "Press Ctrl+] to quit.\n", argv0);
+}
+
+int main(int argc, char* argv[]) {
+    const char* rom_path = NULL;
+    const char* ppm_path = NULL;
+    bool send_command = false;
+    int baud = 115200;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "r:b:o:c")) != -1) {
+        switch (opt) {
+            case 'r': rom_path = optarg; break;
+            case 'b': baud = atoi(optarg); break;
+            case 'o': ppm_path = optarg; break;
+            case 'c': send_command = true; break;
+            default: usage(argv[0]); return 2;
+        }
+    }
+
+    if (rom_path == NULL || optind != argc - 1) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    if (!load_char_rom(rom_path)) {
+        fprintf(stderr, "%s: cannot read character ROM '%s'\n", argv[0], rom_path);
+        return 1;
+    }
+
+    const int fd = serial_open(argv[optind], baud);
+    if (fd < 0) {
+        fprintf(stderr, "%s: cannot open '%s': %s\n", argv[0], argv[optind], strerror(errno));
+        return 1;
+    }
+
+    screen_stream_decoder_init(&decoder);
+
+    if (send_command) {
+        static const char command[] = "\rremote bin\r";
+        if (write(fd, command, sizeof(command) - 1) < 0) {
+            perror("write");
+            return 1;
+        }
+    }
+
+    const bool raw_stdin = serial_make_raw(STDIN_FILENO);
+    if (ppm_path == NULL) {
+        fputs("\033[2J", stdout);
+    }
+
+    bool running = true;
+    while (running) {
+        struct pollfd fds[2] = {
+            { .fd = fd, .events = POLLIN },
+            { .fd = STDIN_FILENO, .events = POLLIN },
+        };
+
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("poll");
+            break;
+        }
+
+        if (fds[0].revents & (POLLIN | POLLHUP)) {
+            uint8_t buffer[4096];
+            const ssize_t count = read(fd, buffer, sizeof(buffer));
+            if (count <= 0) {
+                break;
+            }
+
+            bool updated = false;
+            for (ssize_t i = 0; i < count; i++) {
+                updated |= screen_stream_decode_byte(&decoder, buffer[i]);
+            }
+
+            if (updated) {
+                render_pixels();
+                if (ppm_path != NULL) {
+                    if (!write_ppm(ppm_path)) {
+                        perror(ppm_path);
+                        break;
+                    }
+                } else {
+                    render_terminal();
+                }
+            }
+        }
+
+        if (fds[1].revents & POLLIN) {
+            uint8_t key;
+            if (read(STDIN_FILENO, &key, 1) != 1) {
+                break;
+            }
+
+            if (key == CTRL_RIGHT_SQUARE) {
+                // Leave remote mode on the EconoPET before quitting.
+                key = CTRL_C;
+                running = false;
+            }
+
+            if (write(fd, &key, 1) != 1) {
+                perror("write");
+                break;
+            }
+        }
+    }
+
+    if (raw_stdin) {
+        serial_restore(STDIN_FILENO);
+    }
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,218 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+// Host-side client for the binary transfer protocol ('xfer' CLI command).
+//
+// Uploads a program or ROM image into the PET's SRAM/BRAM, or downloads a
+// memory range to a file, over the EconoPET serial port.
+//
+// Usage: xfer [options] <device> put <file>
+//        xfer [options] <device> get <addr> <length> <file>
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "common/serial.h"
+#include "xfer_client.h"
+
+// VARTAB on BASIC 2 and 4. (BASIC 1 uses $7C.)
+#define DEFAULT_VARTAB 0x2A
+
+// Largest range the target accepts (SRAM is 128KB).
+#define MAX_IMAGE_SIZE 0x20000
+
+static void usage(const char* argv0) {
+    fprintf(stderr,
+        "Usage: %s [options] <device> put <file>\n"
+        "       %s [options] <device> get <addr> <length> <file>\n"
+        "  -b <baud>  Baud rate (default 115200)\n"
+        "  -c         Send 'xfer' to the EconoPET CLI first\n"
+        "  -a <addr>  Load address (default: the file's 2-byte PRG header)\n"
+        "  -B         Set BASIC's end-of-program pointers after 'put'\n"
+        "  -z <addr>  Zero page address of VARTAB (default $2A, BASIC 1: $7C)\n"
+        "  -r         Type RUN after 'put'\n"
+        "  -s <addr>  Type SYS <addr> after 'put'\n"
+        "Addresses accept decimal, 0x or $ prefixes.\n", argv0, argv0);
+}
+
+static bool parse_number(const char* text, uint32_t* value) {
+    int base = 0;
+    if (text[0] == '$') {
+        text++;
+        base = 16;
+    }
+
+    char* end;
+    errno = 0;
+    const unsigned long result = strtoul(text, &end, base);
+    if (errno != 0 || end == text || *end != '\0' || result > UINT32_MAX) {
+        return false;
+    }
+    *value = (uint32_t) result;
+    return true;
+}
+
+static double elapsed_seconds(const struct timespec* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) (now.tv_sec - start->tv_sec) + (double) (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void report(const char* verb, size_t length, uint32_t addr, const struct timespec* start,
+                   const xfer_client_t* client) {
+    const double seconds = elapsed_seconds(start);
+    fprintf(stderr, "%s %zu bytes at $%05X in %.2fs (%.0f bytes/s, %u retransmits)\n",
+            verb, length, addr, seconds, seconds > 0 ? length / seconds : 0.0, client->retransmits);
+}
+
+static int fail(const char* argv0, const xfer_client_t* client) {
+    fprintf(stderr, "%s: %s\n", argv0, client->error != NULL ? client->error : "transfer failed");
+    return 1;
+}
+
+static uint8_t image[MAX_IMAGE_SIZE + 2];
+
+int main(int argc, char* argv[]) {
+    int baud = 115200;
+    bool send_command = false;
+    bool have_addr = false;
+    uint32_t load_addr = 0;
+    bool fix_basic = false;
+    uint32_t vartab = DEFAULT_VARTAB;
+    bool run = false;
+    bool sys = false;
+    uint32_t sys_addr = 0;
+    bool valid = true;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "b:ca:Bz:rs:")) != -1) {
+        switch (opt) {
+            case 'b': baud = atoi(optarg); break;
+            case 'c': send_command = true; break;
+            case 'a': have_addr = true; valid &= parse_number(optarg, &load_addr); break;
+            case 'B': fix_basic = true; break;
+            case 'z': valid &= parse_number(optarg, &vartab) && vartab <= 0xFA; break;
+            case 'r': run = true; break;
+            case 's': sys = true; valid &= parse_number(optarg, &sys_addr) && sys_addr > 0 && sys_addr <= 0xFFFF; break;
+            default: valid = false; break;
+        }
+    }
+
+    if (!valid || argc - optind < 3 || (run && sys)) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    const char* const device = argv[optind];
+    const char* const command = argv[optind + 1];
+    const bool put = strcmp(command, "put") == 0 && argc - optind == 3;
+    const bool get = strcmp(command, "get") == 0 && argc - optind == 5;
+    if (!put && !get) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    // Validate arguments before touching the port.
+    size_t length = 0;
+    uint32_t addr = 0;
+    const char* path;
+
+    if (put) {
+        path = argv[optind + 2];
+        FILE* file = fopen(path, "rb");
+        if (file == NULL) {
+            fprintf(stderr, "%s: cannot open '%s': %s\n", argv[0], path, strerror(errno));
+            return 1;
+        }
+        length = fread(image, 1, sizeof(image), file);
+        fclose(file);
+
+        const uint8_t* data = image;
+        if (have_addr) {
+            addr = load_addr;
+        } else if (length >= 2) {
+            // PRG file: the first two bytes are the load address.
+            addr = (uint32_t) (image[0] | (image[1] << 8));
+            data += 2;
+            length -= 2;
+        } else {
+            fprintf(stderr, "%s: '%s' has no load address (use -a)\n", argv[0], path);
+            return 1;
+        }
+        if (length > MAX_IMAGE_SIZE) {
+            fprintf(stderr, "%s: '%s' is too large\n", argv[0], path);
+            return 1;
+        }
+        memmove(image, data, length);
+    } else {
+        uint32_t count;
+        if (!parse_number(argv[optind + 2], &addr) || !parse_number(argv[optind + 3], &count)
+            || count == 0 || count > MAX_IMAGE_SIZE) {
+            usage(argv[0]);
+            return 2;
+        }
+        length = count;
+        path = argv[optind + 4];
+    }
+
+    const int fd = serial_open(device, baud);
+    if (fd < 0) {
+        fprintf(stderr, "%s: cannot open '%s': %s\n", argv[0], device, strerror(errno));
+        return 1;
+    }
+
+    if (send_command) {
+        static const char cli_command[] = "\rxfer\r";
+        if (write(fd, cli_command, sizeof(cli_command) - 1) < 0) {
+            perror("write");
+            return 1;
+        }
+    }
+
+    static xfer_client_t client;
+    xfer_client_init(&client, fd);
+    if (!xfer_client_connect(&client)) {
+        return fail(argv[0], &client);
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if (put) {
+        if (!xfer_client_write(&client, addr, image, length)) {
+            return fail(argv[0], &client);
+        }
+        report("Wrote", length, addr, &start, &client);
+
+        if (fix_basic && !xfer_client_basic(&client, (uint8_t) vartab, (uint16_t) (addr + length))) {
+            return fail(argv[0], &client);
+        }
+        if ((run || sys) && !xfer_client_jump(&client, run ? 0 : (uint16_t) sys_addr)) {
+            return fail(argv[0], &client);
+        }
+    } else {
+        if (!xfer_client_read(&client, addr, image, length)) {
+            return fail(argv[0], &client);
+        }
+        report("Read", length, addr, &start, &client);
+
+        FILE* file = fopen(path, "wb");
+        if (file == NULL || fwrite(image, 1, length, file) != length || fclose(file) != 0) {
+            fprintf(stderr, "%s: cannot write '%s': %s\n", argv[0], path, strerror(errno));
+            return 1;
+        }
+    }
+
+    if (!xfer_client_quit(&client)) {
+        return fail(argv[0], &client);
+    }
+
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,314 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#include "xfer_client.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+
+#define DEFAULT_TIMEOUT_MS  1000
+#define DEFAULT_MAX_RETRIES 10
+
+// Builds request 'index' of a batch into 'frame' and returns its size.
+typedef size_t (*build_fn_t)(void* context, size_t index, uint8_t seq, uint8_t* frame);
+
+// Handles the XFER_ACK or XFER_DATA reply to request 'index'.
+typedef bool (*reply_fn_t)(void* context, size_t index, const xfer_decoder_t* reply);
+
+void xfer_client_init(xfer_client_t* client, int fd) {
+    memset(client, 0, sizeof(*client));
+    client->fd = fd;
+    client->timeout_ms = DEFAULT_TIMEOUT_MS;
+    client->max_retries = DEFAULT_MAX_RETRIES;
+    client->window = 1;
+    client->max_data = XFER_MAX_DATA;
+    xfer_decoder_init(&client->decoder);
+}
+
+static bool write_all(xfer_client_t* client, const uint8_t* data, size_t length) {
+    while (length > 0) {
+        const ssize_t written = write(client->fd, data, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            client->error = strerror(errno);
+            return false;
+        }
+        data += written;
+        length -= (size_t) written;
+    }
+    return true;
+}
+
+// Wait for the next valid frame. Returns 1 when one is in 'client->decoder',
+// 0 on timeout, and -1 on a read error.
+static int wait_frame(xfer_client_t* client) {
+    for (;;) {
+        while (client->rx_offset < client->rx_length) {
+            if (xfer_decode_byte(&client->decoder, client->rx[client->rx_offset++]) == xfer_decode_frame) {
+                return 1;
+            }
+        }
+
+        struct pollfd pfd = { .fd = client->fd, .events = POLLIN };
+        const int ready = poll(&pfd, 1, client->timeout_ms);
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            client->error = strerror(errno);
+            return -1;
+        }
+        if (ready == 0) {
+            return 0;
+        }
+
+        const ssize_t count = read(client->fd, client->rx, sizeof(client->rx));
+        if (count <= 0) {
+            client->error = count == 0 ? "connection closed" : strerror(errno);
+            return -1;
+        }
+        client->rx_length = (size_t) count;
+        client->rx_offset = 0;
+    }
+}
+
+static const char* error_message(uint8_t code) {
+    switch (code) {
+        case XFER_ERROR_BAD_REQUEST: return "target rejected the request";
+        case XFER_ERROR_BAD_RANGE:   return "address range is outside SRAM/BRAM";
+        default:                     return "target reported an unknown error";
+    }
+}
+
+// Send 'count' requests with up to 'client->window' in flight, resending
+// from the oldest unacknowledged request on a NAK or timeout (Go-Back-N).
+static bool run_batch_synced(xfer_client_t* client, size_t count, build_fn_t build, reply_fn_t on_reply, void* context) {
+    static uint8_t frames[XFER_WINDOW][XFER_MAX_FRAME];
+    size_t sizes[XFER_WINDOW];
+
+    const uint8_t first_seq = client->seq;
+    size_t base = 0;        // Oldest unacknowledged request
+    size_t next = 0;        // Next request to send
+    size_t built = 0;       // Requests encoded so far
+    int retries = 0;
+
+    while (base < count) {
+        while (next < count && next - base < client->window) {
+            const size_t slot = next % XFER_WINDOW;
+            if (next == built) {
+                sizes[slot] = build(context, next, (uint8_t) (first_seq + next), frames[slot]);
+                built++;
+            } else {
+                client->retransmits++;
+            }
+
+            if (!write_all(client, frames[slot], sizes[slot])) {
+                return false;
+            }
+            next++;
+        }
+
+        const int result = wait_frame(client);
+        if (result < 0) {
+            return false;
+        }
+        if (result == 0) {
+            if (++retries > client->max_retries) {
+                client->error = "no response from target";
+                return false;
+            }
+            next = base;
+            continue;
+        }
+
+        const xfer_decoder_t* const reply = &client->decoder;
+        const uint8_t base_seq = (uint8_t) (first_seq + base);
+
+        switch (reply->type) {
+            case XFER_ACK:
+            case XFER_DATA:
+                // Replies arrive in order. Anything else is a stale repeat.
+                if (reply->seq == base_seq) {
+                    if (on_reply != NULL && !on_reply(context, base, reply)) {
+                        return false;
+                    }
+                    base++;
+                    retries = 0;
+                }
+                break;
+
+            case XFER_NAK:
+                next = base;
+                break;
+
+            case XFER_ERROR:
+                if (reply->seq == base_seq) {
+                    client->error = error_message(reply->length > 0 ? reply->payload[0] : 0);
+                    return false;
+                }
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    client->seq = (uint8_t) (first_seq + count);
+    return true;
+}
+
+static bool run_batch(xfer_client_t* client, size_t count, build_fn_t build, reply_fn_t on_reply, void* context) {
+    // After a failure, requests later in the window may or may not have been
+    // executed, so restart the sequence before sending anything else.
+    if (!client->synced && !xfer_client_connect(client)) {
+        return false;
+    }
+
+    client->synced = run_batch_synced(client, count, build, on_reply, context);
+    return client->synced;
+}
+
+bool xfer_client_connect(xfer_client_t* client) {
+    uint8_t frame[XFER_HEADER_SIZE + XFER_CRC_SIZE];
+    const size_t size = xfer_encode(frame, XFER_HELLO, client->seq, NULL, 0);
+
+    for (int attempt = 0; attempt <= client->max_retries; attempt++) {
+        if (!write_all(client, frame, size)) {
+            return false;
+        }
+
+        int result;
+        while ((result = wait_frame(client)) > 0) {
+            const xfer_decoder_t* const reply = &client->decoder;
+            if (reply->type == XFER_HELLO && reply->seq == client->seq && reply->length >= 4) {
+                if (reply->payload[0] != XFER_VERSION) {
+                    client->error = "unsupported protocol version";
+                    return false;
+                }
+
+                const uint8_t window = reply->payload[1];
+                const uint16_t max_data = xfer_get_u16(&reply->payload[2]);
+                client->window = window < XFER_WINDOW ? window : XFER_WINDOW;
+                client->max_data = max_data < XFER_MAX_DATA ? max_data : XFER_MAX_DATA;
+                if (client->window == 0 || client->max_data == 0) {
+                    client->error = "invalid limits from target";
+                    return false;
+                }
+
+                client->seq++;
+                client->synced = true;
+                return true;
+            }
+        }
+        if (result < 0) {
+            return false;
+        }
+    }
+
+    client->error = "no response from target (is it in 'xfer' mode?)";
+    return false;
+}
+
+typedef struct {
+    xfer_client_t* client;
+    uint32_t addr;
+    uint8_t* data;
+    size_t length;
+} block_batch_t;
+
+static size_t block_offset(const block_batch_t* batch, size_t index) {
+    return index * batch->client->max_data;
+}
+
+static size_t block_length(const block_batch_t* batch, size_t index) {
+    const size_t remaining = batch->length - block_offset(batch, index);
+    return remaining < batch->client->max_data ? remaining : batch->client->max_data;
+}
+
+static size_t block_count(const xfer_client_t* client, size_t length) {
+    return (length + client->max_data - 1) / client->max_data;
+}
+
+static size_t build_write(void* context, size_t index, uint8_t seq, uint8_t* frame) {
+    const block_batch_t* const batch = context;
+    const size_t offset = block_offset(batch, index);
+    const size_t length = block_length(batch, index);
+
+    // Assemble the payload in place to avoid a second copy.
+    uint8_t* const payload = &frame[XFER_HEADER_SIZE];
+    xfer_put_u32(payload, batch->addr + (uint32_t) offset);
+    memcpy(&payload[XFER_ADDR_SIZE], &batch->data[offset], length);
+    return xfer_encode(frame, XFER_WRITE, seq, payload, XFER_ADDR_SIZE + length);
+}
+
+bool xfer_client_write(xfer_client_t* client, uint32_t addr, const uint8_t* data, size_t length) {
+    block_batch_t batch = { client, addr, (uint8_t*) data, length };
+    return run_batch(client, block_count(client, length), build_write, NULL, &batch);
+}
+
+static size_t build_read(void* context, size_t index, uint8_t seq, uint8_t* frame) {
+    const block_batch_t* const batch = context;
+
+    uint8_t payload[XFER_ADDR_SIZE + 2];
+    xfer_put_u32(payload, batch->addr + (uint32_t) block_offset(batch, index));
+    xfer_put_u16(&payload[XFER_ADDR_SIZE], (uint16_t) block_length(batch, index));
+    return xfer_encode(frame, XFER_READ, seq, payload, sizeof(payload));
+}
+
+static bool on_read_reply(void* context, size_t index, const xfer_decoder_t* reply) {
+    const block_batch_t* const batch = context;
+    const size_t offset = block_offset(batch, index);
+    const size_t length = block_length(batch, index);
+
+    if (reply->type != XFER_DATA
+        || reply->length != XFER_ADDR_SIZE + length
+        || xfer_get_u32(reply->payload) != batch->addr + (uint32_t) offset) {
+        batch->client->error = "unexpected reply to read request";
+        return false;
+    }
+
+    memcpy(&batch->data[offset], &reply->payload[XFER_ADDR_SIZE], length);
+    return true;
+}
+
+bool xfer_client_read(xfer_client_t* client, uint32_t addr, uint8_t* data, size_t length) {
+    block_batch_t batch = { client, addr, data, length };
+    return run_batch(client, block_count(client, length), build_read, on_read_reply, &batch);
+}
+
+typedef struct {
+    uint8_t type;
+    const uint8_t* payload;
+    size_t length;
+} single_request_t;
+
+static size_t build_single(void* context, size_t index, uint8_t seq, uint8_t* frame) {
+    (void) index;
+    const single_request_t* const request = context;
+    return xfer_encode(frame, request->type, seq, request->payload, request->length);
+}
+
+static bool run_single(xfer_client_t* client, uint8_t type, const uint8_t* payload, size_t length) {
+    single_request_t request = { type, payload, length };
+    return run_batch(client, 1, build_single, NULL, &request);
+}
+
+bool xfer_client_basic(xfer_client_t* client, uint8_t vartab, uint16_t end) {
+    uint8_t payload[3] = { vartab };
+    xfer_put_u16(&payload[1], end);
+    return run_single(client, XFER_BASIC, payload, sizeof(payload));
+}
+
+bool xfer_client_jump(xfer_client_t* client, uint16_t addr) {
+    uint8_t payload[2];
+    xfer_put_u16(payload, addr);
+    return run_single(client, XFER_JUMP, payload, sizeof(payload));
+}
+
+bool xfer_client_quit(xfer_client_t* client) {
+    return run_single(client, XFER_QUIT, NULL, 0);
+}
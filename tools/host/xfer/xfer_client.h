@@ -0,0 +1,48 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "xfer/xfer_proto.h"
+
+// Host side of the transfer protocol (see fw/src/xfer/xfer_proto.h).
+typedef struct {
+    int fd;
+    int timeout_ms;             // Wait this long for a reply before resending
+    int max_retries;            // Consecutive timeouts before giving up
+
+    uint8_t seq;                // Sequence number of the next request
+    uint8_t window;             // Negotiated by xfer_client_connect()
+    uint16_t max_data;
+    bool synced;                // False until connected, and after a failed request
+
+    xfer_decoder_t decoder;
+    uint8_t rx[256];            // Bytes read from 'fd' but not yet decoded
+    size_t rx_length;
+    size_t rx_offset;
+
+    uint32_t retransmits;       // Requests sent more than once
+    const char* error;          // Reason for the last failure
+} xfer_client_t;
+
+void xfer_client_init(xfer_client_t* client, int fd);
+
+// Resynchronize with the target and negotiate the window and block size.
+// Requests after a failure resynchronize automatically.
+bool xfer_client_connect(xfer_client_t* client);
+
+bool xfer_client_write(xfer_client_t* client, uint32_t addr, const uint8_t* data, size_t length);
+bool xfer_client_read(xfer_client_t* client, uint32_t addr, uint8_t* data, size_t length);
+
+// Point VARTAB/ARYTAB/STREND (starting at zero page 'vartab') at 'end'.
+bool xfer_client_basic(xfer_client_t* client, uint8_t vartab, uint16_t end);
+
+// Type "SYS addr" at the READY prompt (or "RUN" if 'addr' is 0).
+bool xfer_client_jump(xfer_client_t* client, uint16_t addr);
+
+// Return the target to its CLI prompt.
+bool xfer_client_quit(xfer_client_t* client);
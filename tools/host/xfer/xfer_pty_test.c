@@ -0,0 +1,207 @@
+// SPDX-License-Identifier: CC0-1.0
+// https://github.com/dlehenbauer/econopet
+
+// Loopback test for the transfer protocol. A child process runs the
+// firmware's target state machine against an in-memory SRAM on the master
+// side of a pty, while the parent drives the host client through the slave
+// side as if it were the EconoPET serial port. The child corrupts and drops
+// a few bytes on the way in to exercise NAK and timeout recovery.
+
+#define _XOPEN_SOURCE 600
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "common/serial.h"
+#include "xfer/xfer_target.h"
+#include "xfer_client.h"
+
+#define SRAM_SIZE   0x20000
+#define UPLOAD_ADDR 0x0401
+#define UPLOAD_SIZE 20000
+#define VARTAB      0x2A
+
+// Faults injected by the target side, as offsets into the received stream.
+#define DROP_FIRST   8          // Lose the first HELLO entirely (forces a timeout)
+#define CORRUPT_AT   3000       // Flip a bit inside an early WRITE frame
+#define DROP_AT      9000       // Lose one byte of a later WRITE frame
+
+// Child exit codes.
+#define CHILD_OK         0
+#define CHILD_NO_QUIT    3
+#define CHILD_BAD_JUMP   4
+
+typedef struct {
+    int fd;
+    uint8_t sram[SRAM_SIZE];
+    bool quit;
+    int jumps;
+    uint16_t jump_addr;
+} pty_target_t;
+
+static bool target_valid_range(void* context, uint32_t addr, size_t length) {
+    (void) context;
+    return addr < SRAM_SIZE && length <= SRAM_SIZE - addr;
+}
+
+static void target_read(void* context, uint32_t addr, uint8_t* dest, size_t length) {
+    pty_target_t* const t = context;
+    memcpy(dest, &t->sram[addr], length);
+}
+
+static void target_write(void* context, uint32_t addr, const uint8_t* src, size_t length) {
+    pty_target_t* const t = context;
+    memcpy(&t->sram[addr], src, length);
+}
+
+static void target_send(void* context, const uint8_t* data, size_t length) {
+    pty_target_t* const t = context;
+    while (length > 0) {
+        const ssize_t written = write(t->fd, data, length);
+        if (written <= 0) {
+            _exit(2);
+        }
+        data += written;
+        length -= (size_t) written;
+    }
+}
+
+static void target_jump(void* context, uint16_t addr) {
+    pty_target_t* const t = context;
+    t->jumps++;
+    t->jump_addr = addr;
+}
+
+static void target_quit(void* context) {
+    pty_target_t* const t = context;
+    t->quit = true;
+}
+
+static const xfer_target_ops_t target_ops = {
+    .valid_range = target_valid_range,
+    .read = target_read,
+    .write = target_write,
+    .send = target_send,
+    .jump = target_jump,
+    .quit = target_quit,
+};
+
+static int run_target(int fd) {
+    static pty_target_t state;
+    static xfer_target_t target;
+
+    state.fd = fd;
+    xfer_target_init(&target, &target_ops, &state);
+
+    size_t offset = 0;
+    while (!state.quit) {
+        uint8_t buffer[512];
+        const ssize_t count = read(fd, buffer, sizeof(buffer));
+        if (count <= 0) {
+            break;
+        }
+
+        for (ssize_t i = 0; i < count && !state.quit; i++, offset++) {
+            uint8_t byte = buffer[i];
+            if (offset < DROP_FIRST || offset == DROP_AT) {
+                continue;
+            }
+            if (offset == CORRUPT_AT) {
+                byte ^= 0x10;
+            }
+            xfer_target_receive(&target, &byte, 1);
+        }
+    }
+
+    if (!state.quit) {
+        return CHILD_NO_QUIT;
+    }
+    if (state.jumps != 1 || state.jump_addr != 0) {
+        return CHILD_BAD_JUMP;
+    }
+    return CHILD_OK;
+}
+
+static int check(bool condition, const char* what, const xfer_client_t* client) {
+    if (!condition) {
+        fprintf(stderr, "FAIL: %s (%s)\n", what, client->error != NULL ? client->error : "mismatch");
+        return 1;
+    }
+    return 0;
+}
+
+int main(void) {
+    const int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+        perror("posix_openpt");
+        return 1;
+    }
+
+    // Open the slave (and make it raw) before the target starts replying.
+    const int fd = serial_open(ptsname(master), 115200);
+    if (fd < 0) {
+        perror("serial_open");
+        return 1;
+    }
+
+    const pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return 1;
+    }
+    if (pid == 0) {
+        close(fd);
+        _exit(run_target(master));
+    }
+
+    static xfer_client_t client;
+    xfer_client_init(&client, fd);
+    client.timeout_ms = 200;
+
+    static uint8_t upload[UPLOAD_SIZE];
+    static uint8_t download[UPLOAD_SIZE];
+    uint32_t seed = 12345;
+    for (size_t i = 0; i < sizeof(upload); i++) {
+        seed = seed * 1664525u + 1013904223u;
+        upload[i] = (uint8_t) (seed >> 24);
+    }
+
+    int failures = 0;
+    failures += check(xfer_client_connect(&client), "connect", &client);
+    failures += check(client.window == XFER_WINDOW && client.max_data == XFER_MAX_DATA, "negotiated limits", &client);
+    failures += check(xfer_client_write(&client, UPLOAD_ADDR, upload, sizeof(upload)), "write", &client);
+    failures += check(client.retransmits > 0, "faults were recovered by retransmitting", &client);
+    failures += check(xfer_client_read(&client, UPLOAD_ADDR, download, sizeof(download)), "read", &client);
+    failures += check(memcmp(upload, download, sizeof(upload)) == 0, "read back matches", &client);
+
+    const uint16_t end = UPLOAD_ADDR + UPLOAD_SIZE;
+    uint8_t pointers[6];
+    failures += check(xfer_client_basic(&client, VARTAB, end), "basic", &client);
+    failures += check(xfer_client_read(&client, VARTAB, pointers, sizeof(pointers)), "read pointers", &client);
+    for (size_t i = 0; i < sizeof(pointers); i += 2) {
+        failures += check(pointers[i] == (uint8_t) end && pointers[i + 1] == (uint8_t) (end >> 8),
+                          "BASIC pointers", &client);
+    }
+
+    failures += check(!xfer_client_write(&client, SRAM_SIZE - 1, upload, 2), "out of range write is rejected", &client);
+
+    failures += check(xfer_client_jump(&client, 0), "jump", &client);
+    failures += check(xfer_client_quit(&client), "quit", &client);
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+    failures += check(WIFEXITED(status) && WEXITSTATUS(status) == CHILD_OK, "target exited cleanly", &client);
+
+    close(fd);
+    close(master);
+
+    printf("%s (%u retransmits)\n", failures == 0 ? "PASS" : "FAIL", client.retransmits);
+    return failures == 0 ? 0 : 1;
+}